@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <malloc.h>
+#include "stats.h"
+
+// the allocator wrappers behind --stats' memory numbers, linked into the
+// compiler only: its malloc, calloc, realloc and free (the C library's own
+// calls to them included) land here and go on to glibc's. with stats off
+// that's all they do.
+//
+// a block allocated with stats on starts with a header that says how much
+// of the heap it holds, and only blocks with one are counted when they're
+// freed. the ones from before stats_enable(), and from the allocators not
+// wrapped here (aligned_alloc, posix_memalign), go back to glibc as they
+// came. the magic is the word right before the pointer, which in a block
+// of glibc's own is its chunk size, and that never has the top bit set
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+#define MAGIC 0xa110c8ed5747a75dULL
+
+typedef struct {
+    size_t usable;      // what the block holds of the heap, less the header
+    uint64_t magic;
+} Header;               // 16 bytes, so the pointer after it is aligned as glibc's
+
+static void *Counted(void *block, size_t size) {
+    Header *header = block;
+    header->usable = malloc_usable_size(block) - sizeof(Header);
+    header->magic = MAGIC;
+    stats_allocated((long)size, (long)header->usable);
+    return header + 1;
+}
+
+// the header of a block allocated with stats on, NULL for any other
+static Header *HeaderOf(void *pointer) {
+    Header *header = (Header*)pointer - 1;
+    return header->magic == MAGIC ? header : NULL;
+}
+
+static int TooBig(size_t size) {
+    if(size <= SIZE_MAX - sizeof(Header))
+        return 0;
+    errno = ENOMEM;
+    return 1;
+}
+
+void *malloc(size_t size) {
+    if(!stats_enabled)
+        return __libc_malloc(size);
+    if(TooBig(size))
+        return NULL;
+    void *block = __libc_malloc(size + sizeof(Header));
+    return block ? Counted(block, size) : NULL;
+}
+
+void *calloc(size_t count, size_t size) {
+    if(!stats_enabled)
+        return __libc_calloc(count, size);
+    size_t total;
+    if(__builtin_mul_overflow(count, size, &total) || TooBig(total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *block = __libc_calloc(1, total + sizeof(Header));
+    return block ? Counted(block, total) : NULL;
+}
+
+void free(void *pointer) {
+    // stats are never turned off again, so before they're on nothing has a header
+    Header *header = stats_enabled && pointer ? HeaderOf(pointer) : NULL;
+    if(!header) {
+        __libc_free(pointer);
+        return;
+    }
+    stats_freed((long)header->usable);
+    __libc_free(header);
+}
+
+void *realloc(void *pointer, size_t size) {
+    if(!stats_enabled)
+        return __libc_realloc(pointer, size);
+    if(!pointer)
+        return malloc(size);
+    Header *header = HeaderOf(pointer);
+    if(!header)
+        return __libc_realloc(pointer, size);   // uncounted, and it stays that way
+    if(size == 0) {
+        free(pointer);
+        return NULL;
+    }
+    if(TooBig(size))
+        return NULL;
+    long usable = (long)header->usable;
+    void *block = __libc_realloc(header, size + sizeof(Header));
+    if(!block)
+        return NULL;    // the old block is still there, and still counted
+    stats_freed(usable);
+    return Counted(block, size);
+}
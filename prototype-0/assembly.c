@@ -4,103 +4,94 @@
 #include <ctype.h>
 #include "assembly.h"
 #include "symbol_table.h"
+#include "string_pool.h"
 #include "ast.h"
+#include "error.h"
+#include "stats.h"
+#include "trace.h"
+#include "hash.h"
+#include "dead_store.h"
+#include "value_number.h"
+#include "ir.h"
 
-/////
-// string table structure
-typedef struct {
-    char *label;
-    char *value;
-} StringEntry;
-
-// string table variables
-static StringEntry string_table[100];
-static int string_count = 0;
-static int string_label_counter = 0;
-/////
-
-// rack w/c variables have been explicitly initialized
-static char *initialized_vars[100];
-static int init_var_count = 0;
-
-// temporary registers for expression evaluation (r20–r30)
-static int temp_start = 20;
-static int temp_next = 20;
-static int temp_max = 30;
-
-static char* GetStringLabel(const char *str) {
-    // process escape sequences in the input string
-    char *processed_str = malloc(strlen(str) * 2 + 1);
-    char *dst = processed_str;
-    
-    for(const char *src = str; *src; src++) {
-        if(*src == '\\' && *(src+1)) {
-            // hndle escape sequence
-            src++;
-            switch(*src) {
-                case 'n': *dst++ = '\n'; break;
-                case 't': *dst++ = '\t'; break;
-                case '"': *dst++ = '"'; break;
-                case '\\': *dst++ = '\\'; break;
-                default:
-                    // invalid, keep both chars
-                    *dst++ = '\\';
-                    *dst++ = *src;
-                    break;
-            }
-        } else {
-            *dst++ = *src;
-        }
-    }
-    *dst = '\0';
-    
-    // now check if this processed string already exists
-    for(int i = 0; i < string_count; i++) {
-        if(strcmp(string_table[i].value, processed_str) == 0) {
-            free(processed_str);
-            return string_table[i].label;
-        }
-    }
-    
-    // store the processed string (with actual newlines, not \n)
-    if(string_count >= 100) {
-        free(processed_str);
-        return NULL;
-    }
-    
-    string_table[string_count].value = processed_str;  // store as-is
-    
-    // generate label
-    char *label = malloc(20);
-    sprintf(label, "str%d", string_label_counter++);
-    string_table[string_count].label = label;
-    
-    string_count++;
-    return label;
-}
+// "; line N" comments before the code of each source line (see
+// AssemblyLineMarkers)
+static _Thread_local int line_markers = 0;
 
-static void mark_initialized(const char *name) {
-    for(int i = 0; i < init_var_count; i++) {
-        if(strcmp(initialized_vars[i], name) == 0)
-            return;
-    }
-    if(init_var_count < 100) {
-        initialized_vars[init_var_count++] = strdup(name);
-    }
-}
+// with -O, the stores that go and the variables with no place in .data
+// (see AssemblyDeadStores)
+static _Thread_local const DeadStores *dead_stores = NULL;
+
+// temporary registers for expression evaluation (r2-r27), taken like a
+// stack: the temps of an operand are free again once it's been used. an
+// operation whose right side needs every temp left puts its left side in
+// a spill slot ("spill.N", a name no variable can have) until the right
+// side is done, so an expression of any depth fits in them
+#define TEMP_COUNT 26
+static int temp_start = 2;
+static _Thread_local int temp_next = 2;
+static int temp_max = 27;
+static _Thread_local int spill_depth = 0;  // the spill slots in use
+static _Thread_local int may_spill = 0;    // the expression needs more than TEMP_COUNT
+
+// with -O, values the program computes again later are held in temps the
+// stack passes over, from one statement to the next: held_value is the
+// number a register holds (-1 = none) and reuses_left how many of a
+// number's reuses are still to come (see AssemblyValueNumbers). when the
+// stack grows into a held value it goes, and its reuses compute it again.
+// r14 holds nothing: a printf takes its arguments' address there
+#define PRINTF_REGISTER 14
+static _Thread_local const ValueNumbering *value_numbers = NULL;
+static _Thread_local int held_value[32];
+static _Thread_local int *reuses_left = NULL;
+
+// .data past the reach of a 16-bit offset is addressed from the base
+// register, loaded with lui; base_high is the %hi it holds (-1 = none)
+#define BASE_REGISTER 28
+#define MAX_DIRECT_OFFSET 32767
+static _Thread_local long long base_high = -1;
 
 // reset temp register usage
 void AssemblyInit() {
     temp_next = temp_start;
-    init_var_count = 0;
+    spill_depth = 0;
+    base_high = -1;
+    for(int reg = 0; reg < 32; reg++)
+        held_value[reg] = -1;
 }
 
-// allocate a temp register for intermediate computation
+// allocate a temp register for intermediate computation. the spills keep
+// an expression within TEMP_COUNT temps, so there always is one
 static int NewTempRegister() {
-    int r = temp_next++;
-    if(temp_next > temp_max)
-        temp_next = temp_start;
-    return r;
+    if(temp_next > temp_max) {
+        fprintf(get_diagnostics_stream(), "Internal error: out of temporary registers\n");
+        abort();
+    }
+    // a value held there goes: the temps come first
+    held_value[temp_next] = -1;
+    return temp_next++;
+}
+
+// the register holding a number's value, 0 if none does
+static int HeldRegister(int number) {
+    if(number < 0)
+        return 0;
+    for(int reg = temp_start; reg <= temp_max; reg++)
+        if(held_value[reg] == number)
+            return reg;
+    return 0;
+}
+
+// hold the value of number, just computed into reg, for its reuses: in the
+// highest register above the temps in use, if there's one
+static void HoldValue(FILE *out, int number, int reg) {
+    for(int held = temp_max; held >= temp_next; held--) {
+        if(held_value[held] < 0 && held != PRINTF_REGISTER && held != reg) {
+            fprintf(out, "dadd r%d, r%d, r0\n", held, reg);
+            held_value[held] = number;
+            return;
+        }
+    }
 }
 
 // reset the temp reg pointer after each statement
@@ -108,19 +99,60 @@ static void ResetTempRegister() {
     temp_next = temp_start;
 }
 
+// "ld"/"sd" of a variable: name(r0) if it's in reach, %lo(name)(r28)
+// otherwise, after a lui of its %hi unless the base register has it already
+static void AccessVariable(FILE *out, const char *mnemonic, int reg, const char *name) {
+    uint64_t offset = DeclareSymbol(name);
+    if(offset <= MAX_DIRECT_OFFSET) {
+        fprintf(out, "%s r%d, %s(r0)\n", mnemonic, reg, name);
+        return;
+    }
+    long long high = (long long)((offset + 0x8000) >> 16);
+    if(high != base_high) {
+        fprintf(out, "lui r%d, %%hi(%s)\n", BASE_REGISTER, name);
+        base_high = high;
+    }
+    fprintf(out, "%s r%d, %%lo(%s)(r%d)\n", mnemonic, reg, name, BASE_REGISTER);
+}
+
 // load variable: generates MIPS64 instruction to load a var's value
 static void LoadVariable(FILE *out, int reg, const char *name) {
-    fprintf(out, "ld r%d, %s(r0)\n", reg, name);
+    AccessVariable(out, "ld", reg, name);
 }
 
 // store: generate instruction to store a reg's value into memory
 static void StoreVariable(FILE *out, int reg, const char *name) {
-    fprintf(out, "sd r%d, %s(r0)\n", reg, name);
+    AccessVariable(out, "sd", reg, name);
+}
+
+// load the address of .data at offset, labelled label
+static void LoadAddress(FILE *out, int reg, const char *label, uint64_t offset) {
+    if(offset <= MAX_DIRECT_OFFSET) {
+        fprintf(out, "daddi r%d, r0, %s\n", reg, label);
+    } else {
+        fprintf(out, "lui r%d, %%hi(%s)\n", reg, label);
+        fprintf(out, "daddiu r%d, r%d, %%lo(%s)\n", reg, reg, label);
+    }
+}
+
+// load the address of a string
+static void LoadString(FILE *out, int reg, const char *str) {
+    int string = StringPoolAdd(str);
+    LoadAddress(out, reg, StringPoolLabel(string), StringPoolOffset(string));
 }
 
-// load immediate constant into a register
+// load immediate constant into a register; past 16 bits the upper half
+// goes in with lui first (rounded up when the lower half is negative)
 static void GenerateLoadImmediate(FILE *out, int reg, long long imm) {
-    fprintf(out, "daddiu r%d, r0, #%lld\n", reg, imm);
+    if(imm >= -32768 && imm <= 32767) {
+        fprintf(out, "daddiu r%d, r0, #%lld\n", reg, imm);
+        return;
+    }
+    long long high = ((imm + 0x8000) >> 16) & 0xFFFF;
+    long long low = (long long)(int16_t)(imm & 0xFFFF);
+    fprintf(out, "lui r%d, #%lld\n", reg, high);
+    if(low != 0)
+        fprintf(out, "daddiu r%d, r%d, #%lld\n", reg, reg, low);
 }
 
 // generate binary arithmetic instructions
@@ -136,97 +168,327 @@ static void GenerateBinOp(FILE *out, const char *op_mnemonic, int dst, int r1, i
     }
 }
 
-// helper function to collect symbols from AST
-static void CollectSymbolsFromAST(Node *node) {
-    if(!node)
-        return;
+// the value of an expression of numbers only, as the code would compute
+// it (64-bit, wrapping); 0 if it isn't one or it divides by zero, which is
+// left to happen at run time
+static int ConstantValue(Node *node, int64_t *value) {
+    if(node->node_type == 0) {
+        *value = node->int_val;
+        return 1;
+    }
+    int64_t left, right;
+    if(node->node_type != 3 || !ConstantValue(node->binop.left, &left) || !ConstantValue(node->binop.right, &right))
+        return 0;
+    switch(node->binop.op) {
+        case '+': *value = (int64_t)((uint64_t)left + (uint64_t)right); return 1;
+        case '-': *value = (int64_t)((uint64_t)left - (uint64_t)right); return 1;
+        case '*': *value = (int64_t)((uint64_t)left * (uint64_t)right); return 1;
+        case '/':
+            if(right == 0 || (left == INT64_MIN && right == -1))
+                return 0;
+            *value = left / right;
+            return 1;
+    }
+    return 0;
+}
+
+static void SpillSlot(char *name, size_t size, int slot) {
+    snprintf(name, size, "spill.%d", slot);
+}
+
+// the temps an expression takes without spilling: the left side's, or one
+// for the left side's value and the right side's (Sethi-Ullman)
+static int TempsNeeded(Node *node) {
+    if(node->node_type == 7)  // NODE_PRINT_PART
+        return TempsNeeded(node->list.items);
+    if(node->node_type != 3 || node->binop.op == '=')
+        return 1;
+    int left = TempsNeeded(node->binop.left);
+    int right = TempsNeeded(node->binop.right) + 1;
+    return left > right ? left : right;
+}
+
+// the spill slots an expression takes with temps free, the way
+// GenerateOperation spills: the right side of an operation has all the
+// temps if it needs them and the left side's value is spilled. an
+// expression that fits takes none, which is the one walk most of them get
+static int SpillsNeeded(Node *node, int temps) {
+    if(node->node_type == 7)
+        return SpillsNeeded(node->list.items, temps);
+    if(node->node_type != 3 || node->binop.op == '=' || TempsNeeded(node) <= temps)
+        return 0;
+    int left = SpillsNeeded(node->binop.left, temps);
+    int right = 0;
+    if(TempsNeeded(node->binop.right) >= temps)
+        right = 1 + SpillsNeeded(node->binop.right, temps);
+    return left > right ? left : right;
+}
+
+// a print statement lowered to one syscall. the strings are text and the
+// integers are computed at run time, the constant ones too: folded into
+// the text they'd make a pooled string of nearly every print, and .data
+// would grow with the program (with --stream too). with only strings the
+// line is one pooled string, printed by syscall 4; otherwise it's a format
+// with a %d for every integer, printed by syscall 5 (eduMIPS64's printf)
+// from an argument block: the format's address, then the integers
+typedef struct {
+    char *text;         // the line, or its format, with the newline at the end
+    Node **arguments;   // the integers computed at run time
+    int argument_count;
+} LoweredPrint;
+
+static void LowerPrint(Node *node, LoweredPrint *print) {
+    print->arguments = NULL;
+    print->argument_count = 0;
+    // the line as it is and as a format ('%' doubled), one of them kept
+    char *line = NULL, *format = NULL;
+    size_t line_length = 0, format_length = 0;
+    FILE *plain = open_memstream(&line, &line_length);
+    FILE *formatted = open_memstream(&format, &format_length);
+    Node *last = NULL;
+    for(Node *current = node->print_stmt.parts; current; current = current->list.next) {
+        Node *content = current->node_type == 7 ? current->list.items : current;  // NODE_PRINT_PART
+        if(content->node_type == 1) {  // NODE_STR
+            fputs(content->str_val, plain);
+            for(const char *c = content->str_val; *c; c++) {
+                if(*c == '%')
+                    fputc('%', formatted);
+                fputc(*c, formatted);
+            }
+        } else {
+            // a print has a handful of parts, a power of two at a time will do
+            int count = print->argument_count;
+            if((count & (count - 1)) == 0)
+                print->arguments = realloc(print->arguments, sizeof(Node*) * (count ? count * 2 : 1));
+            print->arguments[print->argument_count++] = content;
+            fputs("%d", formatted);
+        }
+        last = content;
+    }
     
-    // traverse linked list of statements
-    Node *current = node;
-    while(current) {
-        switch(current->node_type) {
-            ////
-            case 1: // NODE_STR - string literal
-                GetStringLabel(current->str_val);
-                break;
-            /////
-
-            case 4: { // NODE_DECL - declaration
-                Node *item = current->list.items;
-                while(item) {
-                    if(item->node_type == 2) {
-                        // simple declaration: int x
-                        AllocateRegisterForTheSymbol(item->str_val);
-                    } else if(item->node_type == 3 && item->binop.op == '=') {
-                        // initialized declaration: int x = expr
-                        if(item->binop.left && item->binop.left->node_type == 2) {
-                            AllocateRegisterForTheSymbol(item->binop.left->str_val);
-                        }
-                        // also collect from expression
-                        CollectSymbolsFromAST(item->binop.right);
+    // a newline after print statement, unless it ends with a string that
+    // ends in one (the same output as the interpreter)
+    size_t last_length = last && last->node_type == 1 ? strlen(last->str_val) : 0;
+    if(last_length == 0 || last->str_val[last_length - 1] != '\n') {
+        fputc('\n', plain);
+        fputc('\n', formatted);
+    }
+    fclose(plain);
+    fclose(formatted);
+    if(print->argument_count > 0) {
+        print->text = format;
+        free(line);
+    } else {
+        print->text = line;
+        free(format);
+    }
+}
+
+static void FreeLoweredPrint(LoweredPrint *print) {
+    free(print->text);
+    free(print->arguments);
+}
+
+// the argument block of the prints with count integers, and its slots: the
+// blocks are .data, one for every count, shared by the prints with it.
+// "args2.0" to "args2.2" are names no variable can have
+static void ArgumentSlot(char *name, size_t size, int count, int slot) {
+    snprintf(name, size, "args%d.%d", count, slot);
+}
+
+static void DeclareArgumentBlock(int count) {
+    char name[32];
+    for(int slot = 0; slot <= count; slot++) {
+        ArgumentSlot(name, sizeof(name), count, slot);
+        DeclareSymbol(name);
+    }
+}
+
+// what becomes of the store of item, "x = expr" (STORE_*)
+static int StoreStatus(const Node *item) {
+    return dead_stores ? dead_stores_store(dead_stores, item) : STORE_LIVE;
+}
+
+// 1 if a variable has its place in .data
+static int VariableKept(const char *name) {
+    return !dead_stores || !dead_stores_variable_dead(dead_stores, name);
+}
+
+static void CollectSymbolsFromAST(Node *node);
+static void CollectSymbolsFromNode(Node *current);
+
+// collect the symbols of an expression. its nodes aren't a list: the
+// list.next of a binop is its right side, so following it would walk
+// every right side again
+static void CollectSymbolsFromExpression(Node *expression) {
+    if(expression)
+        CollectSymbolsFromNode(expression);
+}
+
+// the spill slots an expression evaluated at a statement's level (all the
+// temps free) takes, in .data with the variables
+static void CollectSpillSlots(Node *expression) {
+    int slots = SpillsNeeded(expression, TEMP_COUNT);
+    char name[32];
+    for(int slot = 0; slot < slots; slot++) {
+        SpillSlot(name, sizeof(name), slot);
+        DeclareSymbol(name);
+    }
+}
+
+// collect the symbols of one node (without following list.next)
+static void CollectSymbolsFromNode(Node *current) {
+    switch(current->node_type) {
+        ////
+        case 1: // NODE_STR - string literal, pooled with the print it's in
+            break;
+        /////
+
+        case 4: { // NODE_DECL - declaration
+            Node *item = current->list.items;
+            while(item) {
+                if(item->node_type == 2) {
+                    // simple declaration: int x
+                    if(VariableKept(item->str_val))
+                        DeclareSymbol(item->str_val);
+                } else if(item->node_type == 3 && item->binop.op == '=') {
+                    // initialized declaration: int x = expr, which is data
+                    // if expr is a constant (nothing can read x before)
+                    int64_t value;
+                    int status = StoreStatus(item);
+                    if(item->binop.left && item->binop.left->node_type == 2) {
+                        if(VariableKept(item->binop.left->str_val))
+                            DeclareSymbol(item->binop.left->str_val);
+                        if(status == STORE_LIVE && ConstantValue(item->binop.right, &value))
+                            SetSymbolInitialValue(item->binop.left->str_val, value);
                     }
-                    item = item->list.next;
-                }
-                break;
-            }
-                
-            case 5: { // NODE_ASSIGN - assignment
-                Node *assign = current->list.items;
-                while(assign) {
-                    if(assign->node_type == 3 && assign->binop.op == '=') {
-                        if(assign->binop.left && assign->binop.left->node_type == 2) {
-                            AllocateRegisterForTheSymbol(assign->binop.left->str_val);
-                        }
-                        // collect from expression
-                        CollectSymbolsFromAST(assign->binop.right);
+                    // also collect from expression, if it's evaluated
+                    if(status != STORE_DEAD) {
+                        CollectSymbolsFromExpression(item->binop.right);
+                        CollectSpillSlots(item->binop.right);
                     }
-                    assign = assign->list.next;
                 }
-                break;
+                item = item->list.next;
             }
-                
-            case 6: { // NODE_PRINT - print statement
-                Node *part = current->print_stmt.parts;
-                while(part) {
-                    if(part->node_type == 7) {  // NODE_PRINT_PART
-                        Node *content = part->list.items;
-                        if(content && content->node_type == 1) {  // NODE_STR
-                            GetStringLabel(content->str_val);
-                        } else {
-                            CollectSymbolsFromAST(content);
-                        }
-                    } else if(part->node_type == 1) {  // NODE_STR
-                        GetStringLabel(part->str_val);
-                    } else {
-                        CollectSymbolsFromAST(part);
+            break;
+        }
+            
+        case 5: { // NODE_ASSIGN - assignment
+            Node *assign = current->list.items;
+            while(assign) {
+                if(assign->node_type == 3 && assign->binop.op == '=') {
+                    if(assign->binop.left && assign->binop.left->node_type == 2) {
+                        if(VariableKept(assign->binop.left->str_val))
+                            DeclareSymbol(assign->binop.left->str_val);
+                    }
+                    // collect from expression, if it's evaluated
+                    if(StoreStatus(assign) != STORE_DEAD) {
+                        CollectSymbolsFromExpression(assign->binop.right);
+                        CollectSpillSlots(assign->binop.right);
                     }
-                    part = part->list.next;
                 }
-                break;
+                assign = assign->list.next;
             }
-            /////
-                
-            case 3: // NODE_BINOP - expression
-                CollectSymbolsFromAST(current->binop.left);
-                CollectSymbolsFromAST(current->binop.right);
-                break;
-                
-            case 2: // NODE_ID - variable reference
-                AllocateRegisterForTheSymbol(current->str_val);
-                break;
+            break;
+        }
             
-            /////
-            case 7: // NODE_PRINT_PART
-                CollectSymbolsFromAST(current->list.items);
-                break;
-            ////
+        case 6: { // NODE_PRINT - print statement
+            LoweredPrint print;
+            LowerPrint(current, &print);
+            StringPoolAdd(print.text);
+            if(print.argument_count > 0)
+                DeclareArgumentBlock(print.argument_count);
+            for(int i = 0; i < print.argument_count; i++) {
+                CollectSymbolsFromExpression(print.arguments[i]);
+                CollectSpillSlots(print.arguments[i]);
+            }
+            FreeLoweredPrint(&print);
+            break;
         }
+        /////
+            
+        case 3: // NODE_BINOP - expression
+            CollectSymbolsFromExpression(current->binop.left);
+            CollectSymbolsFromExpression(current->binop.right);
+            break;
+            
+        case 2: // NODE_ID - variable reference
+            DeclareSymbol(current->str_val);
+            break;
+        
+        /////
+        case 7: // NODE_PRINT_PART
+            CollectSymbolsFromExpression(current->list.items);
+            break;
+        ////
+    }
+}
+
+// helper function to collect symbols from AST
+static void CollectSymbolsFromAST(Node *node) {
+    // traverse linked list of statements
+    Node *current = node;
+    while(current) {
+        CollectSymbolsFromNode(current);
         
         // move to next statement
         current = current->list.next;
     }
 }
 
+static int GenerateExpression(Node *node, FILE *out, int target_reg);
+
+// the code of a binop other than '=': both sides, then the operation
+static int GenerateOperation(Node *node, FILE *out, int target_reg) {
+    // evaluate both sides; their temps are free again once the
+    // operation has read them. the left side's value is the temp at mark,
+    // spilled while the right side is evaluated if that needs all the rest
+    int mark = temp_next;
+    int left_reg = GenerateExpression(node->binop.left, out, 0);
+    int right_reg;
+    if(may_spill && TempsNeeded(node->binop.right) > temp_max - temp_next + 1) {
+        char slot[32];
+        SpillSlot(slot, sizeof(slot), spill_depth++);
+        StoreVariable(out, left_reg, slot);
+        temp_next = mark;
+        right_reg = GenerateExpression(node->binop.right, out, 0);
+        left_reg = NewTempRegister();
+        LoadVariable(out, left_reg, slot);
+        spill_depth--;
+    } else {
+        right_reg = GenerateExpression(node->binop.right, out, 0);
+    }
+    temp_next = mark;
+    
+    // for multiplication, need to handle mflo
+    if(node->binop.op == '*') {
+        // generate multiplication
+        fprintf(out, "dmult r%d, r%d\n", left_reg, right_reg);
+        
+        // get result register
+        int result_reg = target_reg ? target_reg : NewTempRegister();
+        fprintf(out, "mflo r%d\n", result_reg);
+        return result_reg;
+    }
+    
+    // for other operations, use target reg if there is
+    int result_reg = target_reg ? target_reg : NewTempRegister();
+    
+    switch(node->binop.op) {
+        case '+':
+            GenerateBinOp(out, "daddu", result_reg, left_reg, right_reg);
+            break;
+        case '-':
+            GenerateBinOp(out, "dsubu", result_reg, left_reg, right_reg);
+            break;
+        case '/':
+            GenerateBinOp(out, "ddiv", result_reg, left_reg, right_reg);
+            break;
+    }
+    
+    return result_reg;
+}
+
 static int GenerateExpression(Node *node, FILE *out, int target_reg) {
     if(!node)
         return 0;
@@ -243,20 +505,10 @@ static int GenerateExpression(Node *node, FILE *out, int target_reg) {
             return reg;
         }
         case 2: { // NODE_ID (variable)
-            int var_reg = GetRegisterOfTheSymbol(node->str_val);
-            if(var_reg == -1)
-                var_reg = AllocateRegisterForTheSymbol(node->str_val);
-            
-            // always load from memory
-            if(target_reg) {
-                // load directly into target register
-                fprintf(out, "ld r%d, %s(r0)\n", target_reg, node->str_val);
-                return target_reg;
-            } else {
-                // load into variable's own register
-                fprintf(out, "ld r%d, %s(r0)\n", var_reg, node->str_val);
-                return var_reg;
-            }
+            // always load from memory, into the target register if there is one
+            int reg = target_reg ? target_reg : NewTempRegister();
+            LoadVariable(out, reg, node->str_val);
+            return reg;
         }
 
         
@@ -264,37 +516,22 @@ static int GenerateExpression(Node *node, FILE *out, int target_reg) {
             // for assignment, handle separately
             if(node->binop.op == '=')
                 return GenerateExpression(node->binop.left, out, target_reg);
-            
-            // evaluate both sides
-            int left_reg = GenerateExpression(node->binop.left, out, 0);
-            int right_reg = GenerateExpression(node->binop.right, out, 0);
-            
-            // for multiplication, need to handle mflo
-            if(node->binop.op == '*') {
-                // generate multiplication
-                fprintf(out, "dmult r%d, r%d\n", left_reg, right_reg);
-                
-                // get result register
-                int result_reg = target_reg ? target_reg : NewTempRegister();
-                fprintf(out, "mflo r%d\n", result_reg);
-                return result_reg;
-            }
-            
-            // for other operations, use target reg if there is
-            int result_reg = target_reg ? target_reg : NewTempRegister();
-            
-            switch(node->binop.op) {
-                case '+':
-                    GenerateBinOp(out, "daddu", result_reg, left_reg, right_reg);
-                    break;
-                case '-':
-                    GenerateBinOp(out, "dsubu", result_reg, left_reg, right_reg);
-                    break;
-                case '/':
-                    GenerateBinOp(out, "ddiv", result_reg, left_reg, right_reg);
-                    break;
+
+            // a value held from before is copied, not computed again (the
+            // register that has it could be a temp's in a moment)
+            int number = value_numbers ? value_number(value_numbers, node) : -1;
+            int held = HeldRegister(number);
+            if(held) {
+                int reg = target_reg ? target_reg : NewTempRegister();
+                if(reg != held)
+                    fprintf(out, "dadd r%d, r%d, r0\n", reg, held);
+                if(--reuses_left[number] == 0 || reg == held)
+                    held_value[held] = -1;
+                return reg;
             }
-            
+            int result_reg = GenerateOperation(node, out, target_reg);
+            if(number >= 0 && reuses_left[number] > 0)
+                HoldValue(out, number, result_reg);
             return result_reg;
         }
         
@@ -303,6 +540,13 @@ static int GenerateExpression(Node *node, FILE *out, int target_reg) {
     }
 }
 
+// the code of an expression at a statement's level, all the temps free;
+// the one walk of TempsNeeded says if anything in it has to be spilled
+static int GenerateValue(Node *node, FILE *out) {
+    may_spill = TempsNeeded(node) > TEMP_COUNT;
+    return GenerateExpression(node, out, 0);
+}
+
 // generate assembly for declaration
 static void GenerateDeclaration(Node *node, FILE *out) {
     if(!node || node->node_type != 4)
@@ -315,30 +559,28 @@ static void GenerateDeclaration(Node *node, FILE *out) {
             Node *left = current->binop.left;
             Node *right = current->binop.right;
             
-            // allocate register for variable
-            int reg = AllocateRegisterForTheSymbol(left->str_val);
-            if(reg == -1)
-                return;
-            
-            mark_initialized(left->str_val);
-            
-            // generate code for expression
-            // int expr_reg = GenerateExpression(right, out);
-            int expr_reg = GenerateExpression(right, out, reg);  // pass target register
-            
-            // store result to variable
-            if(expr_reg != reg) {
-                fprintf(out, "daddu r%d, r%d, r0\n", reg, expr_reg);
+            // generate code for expression, then store it to the variable
+            // (unless it's a constant, which .data starts out with)
+            int64_t value;
+            int status = StoreStatus(current);
+            if(status == STORE_LIVE) {
+                DeclareSymbol(left->str_val);
+                if(!ConstantValue(right, &value)) {
+                    int expr_reg = GenerateValue(right, out);
+                    StoreVariable(out, expr_reg, left->str_val);
+                    ResetTempRegister();
+                }
+            } else if(status == STORE_EVALUATE) {
+                // nothing reads it, but the division can trap
+                GenerateValue(right, out);
+                ResetTempRegister();
             }
-            StoreVariable(out, reg, left->str_val);
             
         } else if(current->node_type == 2) {
             // declaration without initialization: int x
-            int reg = AllocateRegisterForTheSymbol(current->str_val);
-            if(reg == -1)
-                return;
-            
             // don't initialize to 0 - just allocate
+            if(VariableKept(current->str_val))
+                DeclareSymbol(current->str_val);
         }
         current = current->list.next;
     }
@@ -355,23 +597,15 @@ static void GenerateAssignment(Node *node, FILE *out) {
             Node *left = current->binop.left;
             Node *right = current->binop.right;
             
-            // get or allocate register for left variable
-            int left_reg = GetRegisterOfTheSymbol(left->str_val);
-            if(left_reg == -1) {
-                left_reg = AllocateRegisterForTheSymbol(left->str_val);
+            // evaluate into a temp and store result to memory (only
+            // evaluated for its division's trap if nothing reads it)
+            int status = StoreStatus(current);
+            if(status != STORE_DEAD) {
+                int expr_reg = GenerateValue(right, out);
+                if(status == STORE_LIVE)
+                    StoreVariable(out, expr_reg, left->str_val);
+                ResetTempRegister();
             }
-            
-            mark_initialized(left->str_val);
-            
-            // ALWAYS use GenerateExpression to get target register optimization
-            int expr_reg = GenerateExpression(right, out, left_reg);
-            
-            // store result to memory
-            // expr_reg should be left_reg if target register was used
-            StoreVariable(out, expr_reg, left->str_val);
-            
-            // no need for daddu - GenerateExpression should have loaded directly
-            // into left_reg if it was a simple variable
         }
         current = current->list.next;
     }
@@ -382,43 +616,36 @@ static void GeneratePrint(Node *node, FILE *out) {
     if(!node || node->node_type != 6)
         return;
     
-    Node *current = node->print_stmt.parts;
-    while(current) {
-        Node *content = current;
-        
-        // handle NODE_PRINT_PART wrapper
-        if(current->node_type == 7) {  // NODE_PRINT_PART
-            content = current->list.items;
-        }
-        
-        if(content->node_type == 1) {  // NODE_STR (string)
-            // get the label for this string
-            char *label = GetStringLabel(content->str_val);
-            if(label) {
-                // eduMIPS64: load string address into r1, syscall 4 for string print
-                fprintf(out, "daddi r1, r0, %s\n", label);  // load string address
-                fprintf(out, "syscall 4\n");               // print string
-            }
-        } else {
-            // integer expression
-            int reg = GenerateExpression(content, out, 0);
-            
-            // eduMIPS64 print integer: value in r1, syscall 1
-            if(reg != 1) {  // if value not already in r1
-                fprintf(out, "dadd r1, r%d, r0\n", reg);  // move to r1
-            }
-            fprintf(out, "syscall 1\n");  // print integer
-            
-            // optional: print space between items (remove if not needed)
-            fprintf(out, "daddi r1, r0, #32\n");  // ASCII space
-            fprintf(out, "syscall 11\n");         // print character
-        }
-        current = current->list.next;
+    LoweredPrint print;
+    LowerPrint(node, &print);
+    if(print.argument_count == 0) {
+        // eduMIPS64: load string address into r1, syscall 4 for string print
+        LoadString(out, 1, print.text);
+        fprintf(out, "syscall 4\n");
+        FreeLoweredPrint(&print);
+        return;
     }
-    
-    // print newline after print statement
-    fprintf(out, "daddi r1, r0, #10\n");  // ASCII newline
-    fprintf(out, "syscall 11\n");         // print character
+
+    // the argument block: the format's address, then every integer,
+    // evaluated into a temp and stored to its slot
+    char slot[32];
+    int reg = NewTempRegister();
+    LoadString(out, reg, print.text);
+    ArgumentSlot(slot, sizeof(slot), print.argument_count, 0);
+    StoreVariable(out, reg, slot);
+    ResetTempRegister();
+    for(int i = 0; i < print.argument_count; i++) {
+        reg = GenerateValue(print.arguments[i], out);
+        ArgumentSlot(slot, sizeof(slot), print.argument_count, i + 1);
+        StoreVariable(out, reg, slot);
+        ResetTempRegister();
+    }
+
+    // eduMIPS64: the block's address in r14, syscall 5 for printf
+    ArgumentSlot(slot, sizeof(slot), print.argument_count, 0);
+    LoadAddress(out, 14, slot, GetOffsetOfTheSymbol(slot));
+    fprintf(out, "syscall 5\n");
+    FreeLoweredPrint(&print);
 }
 ///////////////
 
@@ -429,6 +656,8 @@ void GenerateAssemblyNode(Node *node, FILE *out) {
         return;
     
     ResetTempRegister();
+    // the base register isn't carried over from another statement
+    base_high = -1;
     
     switch(node->node_type) {
         case 4: // NODE_DECL
@@ -452,57 +681,422 @@ void GenerateAssemblyNode(Node *node, FILE *out) {
     }
 }
 
+// start a new program: reset the symbol and string tables
+void AssemblyBegin() {
+    SymbolInit();
+    StringPoolInit();
+    AssemblyInit();
+}
+
+// register the variables and strings of one statement, in program order
+void AssemblyCollectStatement(Node *statement) {
+    if(statement)
+        CollectSymbolsFromNode(statement);
+}
+
+// the spill slots of a statement's expressions, the ones CollectSpillSlots
+// declared for it
+static int StatementSpills(Node *statement, const LoweredPrint *print) {
+    int slots = 0;
+    if(statement->node_type == 4 || statement->node_type == 5) {
+        for(Node *item = statement->list.items; item; item = item->list.next) {
+            if(item->node_type == 3 && item->binop.op == '=' && StoreStatus(item) != STORE_DEAD) {
+                int spills = SpillsNeeded(item->binop.right, TEMP_COUNT);
+                if(spills > slots)
+                    slots = spills;
+            }
+        }
+    }
+    for(int i = 0; print && i < print->argument_count; i++) {
+        int spills = SpillsNeeded(print->arguments[i], TEMP_COUNT);
+        if(spills > slots)
+            slots = spills;
+    }
+    return slots;
+}
+
+// the .data a statement collected by AssemblyCollectStatement refers to
+// other than its variables, hashed: the label and offset of the string a
+// print prints and of its argument block, and the offsets of the spill
+// slots it takes
+uint64_t AssemblyStatementBindings(Node *statement) {
+    uint64_t hash = 0;
+    if(!statement)
+        return hash;
+    LoweredPrint print;
+    int printing = statement->node_type == 6;
+    if(printing) {
+        LowerPrint(statement, &print);
+        int string = StringPoolAdd(print.text);
+        const char *label = StringPoolLabel(string);
+        uint64_t block = 0;
+        if(print.argument_count > 0) {
+            char slot[32];
+            ArgumentSlot(slot, sizeof(slot), print.argument_count, 0);
+            block = GetOffsetOfTheSymbol(slot);
+        }
+        uint64_t parts[3] = { hash64(label, strlen(label), 0), StringPoolOffset(string), block };
+        hash = hash64(parts, sizeof(parts), 0);
+    }
+    int slots = StatementSpills(statement, printing ? &print : NULL);
+    for(int slot = 0; slot < slots; slot++) {
+        char name[32];
+        SpillSlot(name, sizeof(name), slot);
+        uint64_t parts[2] = { hash, GetOffsetOfTheSymbol(name) };
+        hash = hash64(parts, sizeof(parts), 0);
+    }
+    if(printing)
+        FreeLoweredPrint(&print);
+    return hash;
+}
+
+// .data section for everything collected so far, up to and including ".code"
+void AssemblyWriteData(FILE *out) {
+    // the variables and strings at the offsets they got when they were
+    // collected, with .space for the alignment of a variable after a string
+    fprintf(out, ".data\n");
+    uint64_t at = 0;
+    int next_block = 0;
+    int block_count = StringPoolBlockCount();
+    int symbol_count = SymbolCount();
+    for(int i = 0; i <= symbol_count; i++) {
+        uint64_t offset = i < symbol_count ? SymbolOffset(i) : DataSize();
+        while(next_block < block_count && StringPoolBlockOffset(next_block) < offset)
+            at = StringPoolWriteBlock(out, next_block++);
+        if(i == symbol_count)
+            break;
+        if(offset > at)
+            fprintf(out, ".space %llu\n", (unsigned long long)(offset - at));
+        int64_t value;
+        if(SymbolInitialValue(i, &value))
+            fprintf(out, "%s: .word64 %lld\n", SymbolName(i), (long long)value);
+        else
+            fprintf(out, "%s: .space 8\n", SymbolName(i));
+        at = offset + 8;
+    }
+    fprintf(out, "\n.code\n");
+}
+
+// clean up string table
+void AssemblyEnd() {
+    StringPoolFree();
+    SymbolFree();
+}
+
+void AssemblyDeadStores(const DeadStores *dead) {
+    dead_stores = dead;
+}
+
+void AssemblyValueNumbers(const ValueNumbering *numbering) {
+    value_numbers = numbering;
+    free(reuses_left);
+    reuses_left = NULL;
+    if(!numbering)
+        return;
+    int count = value_number_count(numbering);
+    reuses_left = malloc(sizeof(int) * (count + 1));
+    for(int number = 0; number < count; number++)
+        reuses_left[number] = value_number_reuses(numbering, number);
+}
+
+void AssemblyLineMarkers(int on) {
+    line_markers = on;
+}
+
+void AssemblyWriteLineMarker(Node *statement, FILE *out) {
+    fprintf(out, "; line %d\n", statement->line_number);
+}
+
 // full program generation
 void GenerateAssemblyProgram(Node *program, FILE *out) {
     if(!program || !out)
         return;
     
     // initialize
-    SymbolInit();
-    AssemblyInit();
-    string_count = 0;           // reset string table
-    string_label_counter = 0;   // reset label counter
+    AssemblyBegin();
     
     // first, process the AST to collect all symbols AND strings
     CollectSymbolsFromAST(program);
     
-    // generate .data section with all variables AND strings
-    fprintf(out, ".data\n");
-    PrintDataSection(out);  // this prints .space for each variable
- 
-    // Generate string data
-    for(int i = 0; i < string_count; i++) {
-        fprintf(out, "%s: .asciiz \"", string_table[i].label);
-        
-        // Write string character by character, escaping as needed
-        for(char *p = string_table[i].value; *p; p++) {
-            if(*p == '\n') {
-                fprintf(out, "\\n");
-            } else if(*p == '"') {
-                fprintf(out, "\\\"");
-            } else if(*p == '\\') {
-                fprintf(out, "\\\\");
-            } else {
-                fputc(*p, out);
-            }
-        }
-        
-        fprintf(out, "\"\n");
-    }
-    fprintf(out, "\n.code\n");
+    AssemblyWriteData(out);
 
     // generate code - traverse the linked list of statements
     Node *current = program;
+    int line = 0;
     while(current) {
+        if(line_markers && current->line_number != line) {
+            AssemblyWriteLineMarker(current, out);
+            line = current->line_number;
+        }
+        trace_begin_line("codegen statement", current->line_number);
         GenerateAssemblyNode(current, out);
+        trace_end_line("codegen statement", current->line_number);
         current = current->list.next;
     }
     
-    // clean up string table
-    for(int i = 0; i < string_count; i++) {
-        free(string_table[i].value);
-        free(string_table[i].label);
+    stats_count(STATS_STRINGS, StringPoolCount());
+    AssemblyEnd();
+}
+
+////////////
+// the lowering of the SSA IR (GenerateAssemblyIR). a value is put in a temp
+// where it's first read and stays there until its last read; a constant or
+// a string is loaded again wherever it's read once it's lost its temp. when
+// the temps run out, the value read furthest ahead loses its temp: it's
+// loaded again from a variable that has it in memory, or from the spill
+// slot it's stored to first ("spill.N", a name no variable can have)
+typedef struct {
+    const IrProgram *ir;
+    FILE *out;
+    int at;                 // the instruction being lowered
+    int *last_use;          // by value: the last instruction that reads it, -1 = none
+    int *value_register;    // by value: 0 = in none
+    int *home;              // by value: a variable whose memory has had it, -1 = none
+    int *spill_slot;        // by value: -1 = none
+    int *memory;            // by variable: the value in it, -1 = not known
+    int register_value[32]; // -1 = free
+    int *free_slots;        // the slots of the values read for the last time
+    int free_slot_count;
+    int slot_count;
+} Lowering;
+
+static int InMemory(const Lowering *l, int value) {
+    return l->home[value] >= 0 && l->memory[l->home[value]] == value;
+}
+
+static int Rematerialized(const Lowering *l, int value) {
+    int op = l->ir->instructions[value].op;
+    return op == IR_CONST || op == IR_STRING;
+}
+
+static void Hold(Lowering *l, int value, int reg) {
+    l->register_value[reg] = value;
+    l->value_register[value] = reg;
+}
+
+// the value in reg loses it, stored first if nothing else has it (and it's
+// still to be read, by this instruction too: a print can read it twice)
+static void Evict(Lowering *l, int reg) {
+    int value = l->register_value[reg];
+    if(!Rematerialized(l, value) && !InMemory(l, value) && l->spill_slot[value] < 0 && l->last_use[value] >= l->at) {
+        int slot = l->free_slot_count > 0 ? l->free_slots[--l->free_slot_count] : l->slot_count++;
+        char name[32];
+        SpillSlot(name, sizeof(name), slot);
+        StoreVariable(l->out, reg, name);
+        l->spill_slot[value] = slot;
+        stats_count(STATS_SPILLED_VALUES, 1);
     }
+    l->value_register[value] = 0;
+    l->register_value[reg] = -1;
 }
 
-////////////
\ No newline at end of file
+// a free temp, or the one of the value read furthest ahead (not one in protect)
+static int TakeRegister(Lowering *l, unsigned protect) {
+    int victim = 0;
+    for(int reg = temp_start; reg <= temp_max; reg++) {
+        if(reg == PRINTF_REGISTER || (protect >> reg & 1))
+            continue;
+        if(l->register_value[reg] < 0)
+            return reg;
+        if(!victim || l->last_use[l->register_value[reg]] > l->last_use[l->register_value[victim]])
+            victim = reg;
+    }
+    Evict(l, victim);
+    return victim;
+}
+
+// the register with a value in it, loaded if it's in none
+static int Fetch(Lowering *l, int value, unsigned protect) {
+    if(l->value_register[value])
+        return l->value_register[value];
+    const IrInstruction *instruction = &l->ir->instructions[value];
+    int reg = TakeRegister(l, protect);
+    if(instruction->op == IR_CONST) {
+        GenerateLoadImmediate(l->out, reg, instruction->constant);
+    } else if(instruction->op == IR_STRING) {
+        LoadString(l->out, reg, l->ir->strings[instruction->string]);
+    } else if(InMemory(l, value)) {
+        LoadVariable(l->out, reg, l->ir->variables[l->home[value]]);
+    } else {
+        char name[32];
+        SpillSlot(name, sizeof(name), l->spill_slot[value]);
+        LoadVariable(l->out, reg, name);
+    }
+    Hold(l, value, reg);
+    return reg;
+}
+
+// a value read for the last time gives its temp and its slot back
+static void Release(Lowering *l, int value) {
+    if(value < 0 || l->last_use[value] > l->at)
+        return;
+    if(l->value_register[value]) {
+        l->register_value[l->value_register[value]] = -1;
+        l->value_register[value] = 0;
+    }
+    if(l->spill_slot[value] >= 0) {
+        l->free_slots[l->free_slot_count++] = l->spill_slot[value];
+        l->spill_slot[value] = -1;
+    }
+}
+
+static void LowerIrStore(Lowering *l, const IrInstruction *instruction) {
+    int value = instruction->operands[0];
+    int variable = instruction->variable;
+    // a declaration's constant is in .data from the start
+    if(!(instruction->initial && l->ir->instructions[value].op == IR_CONST)) {
+        int reg = Fetch(l, value, 0);
+        // the value the variable had may have been in memory only
+        int old = l->memory[variable];
+        if(old >= 0 && old != value && l->home[old] == variable && !l->value_register[old] &&
+           l->spill_slot[old] < 0 && l->last_use[old] > l->at && !Rematerialized(l, old))
+            Fetch(l, old, 1u << reg);
+        StoreVariable(l->out, reg, l->ir->variables[variable]);
+    }
+    if(!InMemory(l, value))
+        l->home[value] = variable;
+    l->memory[variable] = value;
+}
+
+static void LowerIrPrint(Lowering *l, const IrInstruction *instruction) {
+    const IrProgram *ir = l->ir;
+    int count = instruction->print.count;
+    if(count == 0) {
+        LoadString(l->out, 1, ir->strings[ir->instructions[instruction->operands[0]].string]);
+        fprintf(l->out, "syscall 4\n");
+        return;
+    }
+    char slot[32];
+    ArgumentSlot(slot, sizeof(slot), count, 0);
+    StoreVariable(l->out, Fetch(l, instruction->operands[0], 0), slot);
+    for(int i = 0; i < count; i++) {
+        ArgumentSlot(slot, sizeof(slot), count, i + 1);
+        StoreVariable(l->out, Fetch(l, ir->arguments[instruction->print.first + i], 0), slot);
+    }
+    ArgumentSlot(slot, sizeof(slot), count, 0);
+    LoadAddress(l->out, PRINTF_REGISTER, slot, GetOffsetOfTheSymbol(slot));
+    fprintf(l->out, "syscall 5\n");
+}
+
+static void LowerIrInstruction(Lowering *l, int i) {
+    const IrInstruction *instruction = &l->ir->instructions[i];
+    static const char *mnemonics[IR_OP_COUNT] = {
+        [IR_ADD] = "daddu", [IR_SUB] = "dsubu", [IR_MUL] = "dmul", [IR_DIV] = "ddiv"
+    };
+    switch(instruction->op) {
+        case IR_CONST:
+        case IR_STRING:
+            // loaded where they're read
+            break;
+        case IR_LOAD:
+            if(l->last_use[i] >= 0) {
+                int reg = TakeRegister(l, 0);
+                LoadVariable(l->out, reg, l->ir->variables[instruction->variable]);
+                Hold(l, i, reg);
+                l->home[i] = instruction->variable;
+                l->memory[instruction->variable] = i;
+            }
+            break;
+        case IR_STORE:
+            LowerIrStore(l, instruction);
+            break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV: {
+            int left = Fetch(l, instruction->operands[0], 0);
+            int right = Fetch(l, instruction->operands[1], 1u << left);
+            Release(l, instruction->operands[0]);
+            Release(l, instruction->operands[1]);
+            int reg = TakeRegister(l, 0);
+            GenerateBinOp(l->out, mnemonics[instruction->op], reg, left, right);
+            Hold(l, i, reg);
+            break;
+        }
+        case IR_DIV_CHECK:
+            // the ddiv after it stops the run itself
+            break;
+        case IR_PRINT:
+            LowerIrPrint(l, instruction);
+            for(int a = 0; a < instruction->print.count; a++)
+                Release(l, l->ir->arguments[instruction->print.first + a]);
+            break;
+    }
+    Release(l, instruction->operands[0]);
+    Release(l, instruction->operands[1]);
+    if(l->value_register[i] && l->last_use[i] < 0)
+        Release(l, i);
+}
+
+void GenerateAssemblyIR(const IrProgram *ir, FILE *out) {
+    if(!ir || !out)
+        return;
+    AssemblyBegin();
+
+    // .data: the variables, the prints' texts and argument blocks, and the
+    // constants the declarations start the variables out with
+    for(int v = 0; v < ir->variable_count; v++)
+        DeclareSymbol(ir->variables[v]);
+    for(int i = 0; i < ir->count; i++) {
+        const IrInstruction *instruction = &ir->instructions[i];
+        if(instruction->op == IR_STRING)
+            StringPoolAdd(ir->strings[instruction->string]);
+        else if(instruction->op == IR_PRINT && instruction->print.count > 0)
+            DeclareArgumentBlock(instruction->print.count);
+        else if(instruction->op == IR_STORE && instruction->initial &&
+                ir->instructions[instruction->operands[0]].op == IR_CONST)
+            SetSymbolInitialValue(ir->variables[instruction->variable], ir->instructions[instruction->operands[0]].constant);
+    }
+
+    Lowering l;
+    memset(&l, 0, sizeof(l));
+    l.ir = ir;
+    size_t values = ir->count + 1;
+    l.last_use = malloc(sizeof(int) * values);
+    l.value_register = calloc(values, sizeof(int));
+    l.home = malloc(sizeof(int) * values);
+    l.spill_slot = malloc(sizeof(int) * values);
+    l.free_slots = malloc(sizeof(int) * values);
+    l.memory = malloc(sizeof(int) * (ir->variable_count + 1));
+    for(int i = 0; i < ir->count; i++)
+        l.last_use[i] = l.home[i] = l.spill_slot[i] = -1;
+    for(int v = 0; v < ir->variable_count; v++)
+        l.memory[v] = -1;
+    for(int reg = 0; reg < 32; reg++)
+        l.register_value[reg] = -1;
+    for(int i = 0; i < ir->count; i++) {
+        const IrInstruction *instruction = &ir->instructions[i];
+        for(int o = 0; o < 2; o++)
+            if(instruction->operands[o] >= 0)
+                l.last_use[instruction->operands[o]] = i;
+        if(instruction->op == IR_PRINT)
+            for(int a = 0; a < instruction->print.count; a++)
+                l.last_use[ir->arguments[instruction->print.first + a]] = i;
+    }
+
+    // the code goes after .data, which has the spill slots once it's done
+    char *code = NULL;
+    size_t code_length = 0;
+    l.out = open_memstream(&code, &code_length);
+    int line = 0;
+    for(l.at = 0; l.at < ir->count; l.at++) {
+        if(line_markers && ir->instructions[l.at].line != line) {
+            line = ir->instructions[l.at].line;
+            fprintf(l.out, "; line %d\n", line);
+        }
+        LowerIrInstruction(&l, l.at);
+    }
+    fclose(l.out);
+    AssemblyWriteData(out);
+    fwrite(code, 1, code_length, out);
+    free(code);
+
+    free(l.last_use);
+    free(l.value_register);
+    free(l.home);
+    free(l.spill_slot);
+    free(l.free_slots);
+    free(l.memory);
+    stats_count(STATS_STRINGS, StringPoolCount());
+    AssemblyEnd();
+}
@@ -2,10 +2,42 @@
 #define ASSEMBLY_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "ast.h"
+#include "dead_store.h"
+#include "value_number.h"
+#include "ir.h"
 
 void AssemblyInit();
 void GenerateAssemblyProgram(Node *program, FILE *out);
 void GenerateAssemblyNode(Node *node, FILE *out);
 
+// the same generation one statement at a time (GenerateAssemblyProgram is
+// Begin, Collect for every statement, WriteData, GenerateAssemblyNode for
+// every statement, End)
+void AssemblyBegin();
+void AssemblyCollectStatement(Node *statement);
+void AssemblyWriteData(FILE *out);
+void AssemblyEnd();
+uint64_t AssemblyStatementBindings(Node *statement);
+
+// with dead stores (dead_store.h), the code leaves out the stores they
+// found and .data the variables nothing reads, until AssemblyDeadStores(NULL)
+void AssemblyDeadStores(const DeadStores *dead);
+// with a program's value numbers (value_number.h, numbered with the same
+// dead stores), a value computed again is kept in a register from where
+// it's first computed, until AssemblyValueNumbers(NULL)
+void AssemblyValueNumbers(const ValueNumbering *numbering);
+
+// the same code from the SSA IR (ir.h) instead of the AST: the values are
+// kept in registers from where they're computed to their last use (and put
+// in .data if they run out), the way the AST's are for one statement
+void GenerateAssemblyIR(const IrProgram *ir, FILE *out);
+
+// with markers on, GenerateAssemblyProgram (and GenerateAssemblyIR) writes a "; line N" comment
+// (AssemblyWriteLineMarker) before the code of every source line, for the
+// annotated machine code listing to show where the code came from
+void AssemblyLineMarkers(int on);
+void AssemblyWriteLineMarker(Node *statement, FILE *out);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "driver.h"
+#include "trace.h"
+
+typedef struct {
+    char **names;
+    int count;
+    int capacity;
+} InputList;
+
+// a worker's share of the inputs: [next, end) packed into one word so the
+// owner taking from the front and thieves taking from the back only need a CAS
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t range;
+} WorkQueue;
+
+#define RANGE(next, end) (((uint64_t)(next) << 32) | (uint32_t)(end))
+#define RANGE_NEXT(range) ((uint32_t)((range) >> 32))
+#define RANGE_END(range) ((uint32_t)(range))
+
+static struct {
+    const CompilerOptions *opts;
+    InputList inputs;
+    WorkQueue *queues;
+    int jobs;
+    char **bases;                // per input, its --out-dir files without the extension
+    double *latencies;           // per input, in ms
+    atomic_int failed;           // didn't compile (or run)
+    atomic_int errors;           // couldn't be read or written
+    pthread_mutex_t output_lock; // one JSON line at a time
+} batch;
+
+static double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void AddInput(InputList *list, const char *name) {
+    if(list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->names = realloc(list->names, sizeof(char*) * list->capacity);
+    }
+    list->names[list->count++] = strdup(name);
+}
+
+// @file: one input per line
+static int AddListFile(InputList *list, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if(!f) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return 0;
+    }
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t n;
+    while((n = getline(&line, &size, f)) > 0) {
+        while(n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+            line[--n] = '\0';
+        if(n > 0)
+            AddInput(list, line);
+    }
+    free(line);
+    fclose(f);
+    return 1;
+}
+
+static int ExpandInputs(const CompilerOptions *opts, InputList *list) {
+    for(int i = 0; i < opts->input_count; i++) {
+        const char *arg = opts->inputs[i];
+        if(arg[0] == '@') {
+            if(!AddListFile(list, arg + 1))
+                return 0;
+        } else if(strpbrk(arg, "*?[")) {
+            glob_t matches;
+            if(glob(arg, 0, NULL, &matches) != 0) {
+                fprintf(stderr, "Error: No files match %s\n", arg);
+                return 0;
+            }
+            for(size_t j = 0; j < matches.gl_pathc; j++)
+                AddInput(list, matches.gl_pathv[j]);
+            globfree(&matches);
+        } else {
+            AddInput(list, arg);
+        }
+    }
+    return 1;
+}
+
+// next input for worker self: its own share first, then half of someone else's
+static int TakeInput(int self) {
+    WorkQueue *own = &batch.queues[self];
+    uint64_t range = atomic_load(&own->range);
+    while(RANGE_NEXT(range) < RANGE_END(range)) {
+        if(atomic_compare_exchange_weak(&own->range, &range, RANGE(RANGE_NEXT(range) + 1, RANGE_END(range))))
+            return RANGE_NEXT(range);
+    }
+
+    for(int i = 1; i < batch.jobs; i++) {
+        WorkQueue *victim = &batch.queues[(self + i) % batch.jobs];
+        range = atomic_load(&victim->range);
+        while(RANGE_NEXT(range) < RANGE_END(range)) {
+            uint32_t next = RANGE_NEXT(range), end = RANGE_END(range);
+            uint32_t split = end - (end - next + 1) / 2;
+            if(atomic_compare_exchange_weak(&victim->range, &range, RANGE(next, split))) {
+                // [split, end) is ours now: run the first, queue the rest
+                atomic_store(&own->range, RANGE(split + 1, end));
+                return split;
+            }
+        }
+    }
+    // nobody has anything left, and running jobs don't make new ones
+    return -1;
+}
+
+static void JsonString(FILE *out, const char *s, size_t length) {
+    fputc('"', out);
+    for(size_t i = 0; i < length; i++) {
+        unsigned char c = s[i];
+        switch(c) {
+            case '"':  fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if(c < 0x20)
+                    fprintf(out, "\\u%04x", c);
+                else
+                    fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// bytes that aren't text (an executable, a raw or ELF image) as a JSON string
+static void JsonBase64(FILE *out, const unsigned char *s, size_t length) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    fputc('"', out);
+    for(size_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)s[i] << 16;
+        if(i + 1 < length)
+            group |= (uint32_t)s[i+1] << 8;
+        if(i + 2 < length)
+            group |= s[i+2];
+        fputc(digits[group >> 18], out);
+        fputc(digits[(group >> 12) & 63], out);
+        fputc(i + 1 < length ? digits[(group >> 6) & 63] : '=', out);
+        fputc(i + 2 < length ? digits[group & 63] : '=', out);
+    }
+    fputc('"', out);
+}
+
+// name of the input's output files without the extension:
+// "subs/alice/a1.p0" -> "DIR/subs_alice_a1"
+static char *OutputBase(const char *dir, const char *input) {
+    while(strncmp(input, "./", 2) == 0)
+        input += 2;
+    size_t length = strlen(input);
+    if(length > 3 && strcmp(input + length - 3, ".p0") == 0)
+        length -= 3;
+
+    char *base = malloc(strlen(dir) + length + 2);
+    char *p = base + sprintf(base, "%s/", dir);
+    for(size_t i = 0; i < length; i++)
+        *p++ = input[i] == '/' ? '_' : input[i];
+    *p = '\0';
+    return base;
+}
+
+static int CompareBases(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    int order = strcmp(batch.bases[x], batch.bases[y]);
+    return order ? order : (x > y) - (x < y);
+}
+
+// the first of a run of inputs sorted by base with the same one as the next,
+// -1 if no two have the same
+static int SameBase(int *order, int count) {
+    for(int i = 0; i < count; i++)
+        order[i] = i;
+    qsort(order, count, sizeof(int), CompareBases);
+    for(int i = 0; i + 1 < count; i++) {
+        if(strcmp(batch.bases[order[i]], batch.bases[order[i+1]]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// every input's base. the inputs whose names flatten to the same one ("a/b.p0"
+// and "a_b.p0", or a file given twice) get their index as well: "DIR/a_b~3".
+// 0 if that still leaves two the same
+static int OutputBases(void) {
+    int count = batch.inputs.count;
+    batch.bases = malloc(sizeof(char*) * (count ? count : 1));
+    for(int i = 0; i < count; i++)
+        batch.bases[i] = OutputBase(batch.opts->out_dir, batch.inputs.names[i]);
+
+    int *order = malloc(sizeof(int) * (count ? count : 1));
+    int first = SameBase(order, count);
+    if(first >= 0) {
+        // everyone in a run of the same base gets renamed, the first one too
+        int *renamed = calloc(count, sizeof(int));
+        for(int i = 0; i + 1 < count; i++) {
+            if(strcmp(batch.bases[order[i]], batch.bases[order[i+1]]) == 0)
+                renamed[order[i]] = renamed[order[i+1]] = 1;
+        }
+        for(int i = 0; i < count; i++) {
+            if(!renamed[i])
+                continue;
+            char *base = malloc(strlen(batch.bases[i]) + 16);
+            sprintf(base, "%s~%d", batch.bases[i], i);
+            free(batch.bases[i]);
+            batch.bases[i] = base;
+        }
+        free(renamed);
+        first = SameBase(order, count);
+    }
+    if(first >= 0)
+        fprintf(stderr, "Error: %s and %s would both write %s.*\n", batch.inputs.names[order[first]],
+                batch.inputs.names[order[first+1]], batch.bases[order[first]]);
+    free(order);
+    return first < 0;
+}
+
+static const char *section_keys[RESULT_SECTION_COUNT] = { "output", "diagnostics", "assembly", "machine" };
+static const char *section_suffixes[RESULT_SECTION_COUNT] = { ".out", ".err", ".s", NULL };
+
+static int WantSection(int section) {
+    // an x86_64 compile makes one executable instead of both
+    if(section == RESULT_ASSEMBLY)
+        return (batch.opts->stages & STAGE_ASM) && batch.opts->target != TARGET_X86_64;
+    if(section == RESULT_MACHINE)
+        return batch.opts->stages & (batch.opts->target == TARGET_X86_64 ? STAGE_ASM | STAGE_MC : STAGE_MC);
+    return 1;
+}
+
+// the JSON fields for the result's sections, or for the files they went to
+static int WriteSections(FILE *record, int index, const CompileResult *result) {
+    int ok = 1;
+    const char *base = batch.bases ? batch.bases[index] : NULL;
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++) {
+        if(!WantSection(i))
+            continue;
+        int binary = i == RESULT_MACHINE && machine_is_binary(batch.opts);
+        if(!base) {
+            // bytes >= 0x80 aren't UTF-8, so a binary section is base64
+            if(binary) {
+                fprintf(record, ",\"%s_base64\":", section_keys[i]);
+                JsonBase64(record, (const unsigned char*)(result->sections[i] ? result->sections[i] : ""), result->lengths[i]);
+            } else {
+                fprintf(record, ",\"%s\":", section_keys[i]);
+                JsonString(record, result->sections[i] ? result->sections[i] : "", result->lengths[i]);
+            }
+            continue;
+        }
+
+        const char *suffix = i == RESULT_MACHINE ? machine_extension(batch.opts) : section_suffixes[i];
+        char *filename = malloc(strlen(base) + strlen(suffix) + 1);
+        sprintf(filename, "%s%s", base, suffix);
+        FILE *f = fopen(filename, binary ? "wb" : "w");
+        if(f) {
+            if(result->lengths[i] > 0)
+                fwrite(result->sections[i], 1, result->lengths[i], f);
+            fclose(f);
+            if(batch.opts->target == TARGET_X86_64 && i == RESULT_MACHINE)
+                chmod(filename, 0755);
+            fprintf(record, ",\"%s_file\":", section_keys[i]);
+            JsonString(record, filename, strlen(filename));
+        } else {
+            fprintf(stderr, "Error: Cannot open output file %s\n", filename);
+            ok = 0;
+        }
+        free(filename);
+    }
+    return ok;
+}
+
+static void RunJob(int index) {
+    const char *input = batch.inputs.names[index];
+    char *text;
+    size_t text_length;
+    FILE *record = open_memstream(&text, &text_length);
+
+    // input i is request i + 1 in the trace
+    trace_request(index + 1);
+    trace_begin("request");
+    double start = Now();
+    size_t length;
+    char *source = read_source_file(input, &length);
+    fprintf(record, "{\"file\":");
+    JsonString(record, input, strlen(input));
+    fprintf(record, ",\"index\":%d", index);
+
+    if(!source) {
+        batch.latencies[index] = (Now() - start) * 1000;
+        fprintf(record, ",\"status\":1,\"ms\":%.3f,\"error\":\"cannot open file\"}\n", batch.latencies[index]);
+        atomic_fetch_add(&batch.errors, 1);
+    } else {
+        CompileResult result;
+        compile_source(source, length, batch.opts, &result);
+        free(source);
+        batch.latencies[index] = (Now() - start) * 1000;
+
+        fprintf(record, ",\"status\":%d,\"ms\":%.3f", result.status, batch.latencies[index]);
+        if(!WriteSections(record, index, &result))
+            atomic_fetch_add(&batch.errors, 1);
+        fprintf(record, "}\n");
+        if(result.status != 0)
+            atomic_fetch_add(&batch.failed, 1);
+        free_result(&result);
+    }
+    fclose(record);
+    trace_end("request");
+    trace_request(0);
+
+    pthread_mutex_lock(&batch.output_lock);
+    fwrite(text, 1, text_length, stdout);
+    pthread_mutex_unlock(&batch.output_lock);
+    free(text);
+}
+
+static void *Worker(void *arg) {
+    int self = (int)(intptr_t)arg;
+    int index;
+    while((index = TakeInput(self)) >= 0)
+        RunJob(index);
+    return NULL;
+}
+
+static int CompareLatency(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void PrintReport(double seconds) {
+    int count = batch.inputs.count;
+    fprintf(stderr, "batch: %d files, %d failed, %d errors, %d jobs, %.3f s, %.1f files/s\n",
+            count, atomic_load(&batch.failed), atomic_load(&batch.errors), batch.jobs,
+            seconds, seconds > 0 ? count / seconds : 0.0);
+    if(count == 0)
+        return;
+
+    int slowest = 0;
+    double total = 0;
+    for(int i = 0; i < count; i++) {
+        total += batch.latencies[i];
+        if(batch.latencies[i] > batch.latencies[slowest])
+            slowest = i;
+    }
+    double *sorted = malloc(sizeof(double) * count);
+    memcpy(sorted, batch.latencies, sizeof(double) * count);
+    qsort(sorted, count, sizeof(double), CompareLatency);
+    fprintf(stderr, "latency (ms): avg %.3f, p50 %.3f, p95 %.3f, max %.3f (%s)\n",
+            total / count, sorted[(count - 1) / 2], sorted[(int)((count - 1) * 0.95)],
+            sorted[count - 1], batch.inputs.names[slowest]);
+    free(sorted);
+}
+
+int run_batch(const CompilerOptions *opts) {
+    memset(&batch, 0, sizeof(batch));
+    batch.opts = opts;
+    if(!ExpandInputs(opts, &batch.inputs)) {
+        for(int i = 0; i < batch.inputs.count; i++)
+            free(batch.inputs.names[i]);
+        free(batch.inputs.names);
+        return 1;
+    }
+
+    int count = batch.inputs.count;
+    if(opts->out_dir && !OutputBases()) {
+        for(int i = 0; i < count; i++) {
+            free(batch.bases[i]);
+            free(batch.inputs.names[i]);
+        }
+        free(batch.bases);
+        free(batch.inputs.names);
+        return 1;
+    }
+    batch.jobs = opts->jobs > 0 ? opts->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(batch.jobs > count)
+        batch.jobs = count;
+    if(batch.jobs < 1)
+        batch.jobs = 1;
+
+    // everyone starts with an even share
+    batch.queues = aligned_alloc(_Alignof(WorkQueue), sizeof(WorkQueue) * batch.jobs);
+    for(int i = 0; i < batch.jobs; i++)
+        atomic_init(&batch.queues[i].range, RANGE((uint64_t)count * i / batch.jobs, (uint64_t)count * (i + 1) / batch.jobs));
+    batch.latencies = calloc(count ? count : 1, sizeof(double));
+    pthread_mutex_init(&batch.output_lock, NULL);
+
+    double start = Now();
+    pthread_t *workers = malloc(sizeof(pthread_t) * batch.jobs);
+    for(int i = 0; i < batch.jobs; i++)
+        pthread_create(&workers[i], NULL, Worker, (void*)(intptr_t)i);
+    for(int i = 0; i < batch.jobs; i++)
+        pthread_join(workers[i], NULL);
+    fflush(stdout);
+    PrintReport(Now() - start);
+
+    int status = atomic_load(&batch.errors) > 0;
+    pthread_mutex_destroy(&batch.output_lock);
+    free(workers);
+    free(batch.latencies);
+    free(batch.queues);
+    for(int i = 0; i < count; i++) {
+        if(batch.bases)
+            free(batch.bases[i]);
+        free(batch.inputs.names[i]);
+    }
+    free(batch.bases);
+    free(batch.inputs.names);
+    return status;
+}
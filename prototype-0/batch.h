@@ -0,0 +1,24 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "options.h"
+
+// compile many programs in one process, e.g. every submission of an assignment
+//
+// the inputs are files, glob patterns (quoted, so the shell doesn't expand
+// thousands of names) or @list files with one name per line. they are
+// spread over --jobs worker threads that steal from each other once their
+// own share is done. every input gets one JSON line on stdout, in the
+// order they finish:
+//
+//   {"file":"a.p0","index":0,"status":0,"ms":0.41,"output":"...","diagnostics":"...",...}
+//
+// with "assembly"/"machine" for -S/--mc. with --out-dir the sections go to
+// DIR/<name>.out/.err/.s/.mc instead (<name> is the input path with '/' as
+// '_' and without .p0) and the line has their paths ("output_file", ...).
+// throughput and latency go to stderr at the end.
+// returns 1 if an input couldn't be read or an output file written, programs
+// that don't compile are just reported
+int run_batch(const CompilerOptions *opts);
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "hash.h"
+
+// bump when CompileResult or the file layout changes
+#define CACHE_FORMAT 1
+#define CACHE_MAGIC "P0CACHE1"
+#define INITIAL_BUCKETS 1024
+
+// on-disk entry: this header followed by the sections back to back
+typedef struct {
+    char magic[8];
+    uint64_t key_lo;
+    uint64_t key_hi;
+    int32_t status;
+    int32_t reserved;
+    uint64_t lengths[RESULT_SECTION_COUNT];
+} CacheFileHeader;
+
+// in-memory entry; all sections live in one block
+typedef struct CacheEntry {
+    CacheKey key;
+    CompileResult result;
+    char *data;
+    size_t size;
+    struct CacheEntry *newer;  // LRU list, newest first
+    struct CacheEntry *older;
+    struct CacheEntry *chain;  // hash bucket
+} CacheEntry;
+
+struct Cache {
+    char *dir;
+    size_t memory_limit;
+    size_t memory_used;
+    CacheEntry **buckets;
+    size_t bucket_count;
+    size_t entry_count;
+    CacheEntry *newest;
+    CacheEntry *oldest;
+    unsigned long temp_counter;
+    CacheStats stats;
+};
+
+// identity of the running compiler binary, so a rebuilt compiler never
+// serves results of an older one
+static uint64_t CompilerIdentity() {
+    static uint64_t identity = 0;
+    if(identity == 0) {
+        struct stat st;
+        uint64_t parts[4] = { CACHE_FORMAT, 0, 0, 0 };
+        if(stat("/proc/self/exe", &st) == 0) {
+            parts[1] = (uint64_t)st.st_size;
+            parts[2] = (uint64_t)st.st_mtime;
+            parts[3] = (uint64_t)st.st_ino;
+        }
+        identity = hash64(parts, sizeof(parts), 0) | 1;
+    }
+    return identity;
+}
+
+// drop trailing blanks (and \r) at the end of every line; they never change
+// what p0 compiles to since a string literal can't run into a newline
+static char *NormaliseSource(const char *source, size_t length, size_t *out_length) {
+    char *normal = malloc(length + 1);
+    size_t n = 0;
+    size_t line_start = 0;
+
+    for(size_t i = 0; i <= length; i++) {
+        if(i == length || source[i] == '\n') {
+            size_t end = i;
+            while(end > line_start && (source[end-1] == ' ' || source[end-1] == '\t' || source[end-1] == '\r'))
+                end--;
+            memcpy(normal + n, source + line_start, end - line_start);
+            n += end - line_start;
+            if(i < length)
+                normal[n++] = '\n';
+            line_start = i + 1;
+        }
+    }
+
+    *out_length = n;
+    return normal;
+}
+
+CacheKey cache_key(const char *source, size_t length, const CompilerOptions *opts) {
+    // only the stage selection, the target, the machine code format, the
+    // passes and the IR (and their dumps) change the result; file names don't
+    const char *passes = opts->passes ? opts->passes : "";
+    const char *print_after = opts->print_after ? opts->print_after : "";
+    uint64_t salt_parts[10] = { CompilerIdentity(), (uint64_t)opts->stages, (uint64_t)opts->target,
+                                (uint64_t)opts->mc_format, (uint64_t)opts->little_endian,
+                                (uint64_t)opts->opt_level, (uint64_t)opts->ir, (uint64_t)opts->print_ir,
+                                hash64(passes, strlen(passes), opts->passes != NULL),
+                                hash64(print_after, strlen(print_after), 0) };
+    uint64_t salt = hash64(salt_parts, sizeof(salt_parts), 0);
+
+    size_t normal_length;
+    char *normal = NormaliseSource(source, length, &normal_length);
+
+    CacheKey key;
+    key.lo = hash64(normal, normal_length, salt);
+    key.hi = hash64(normal, normal_length, ~salt);
+    free(normal);
+    return key;
+}
+
+Cache *cache_create(const char *dir, size_t memory_limit) {
+    Cache *cache = calloc(1, sizeof(Cache));
+    cache->memory_limit = memory_limit;
+    if(dir) {
+        cache->dir = strdup(dir);
+        mkdir(dir, 0755);  // fine if it already exists
+    }
+    if(memory_limit > 0) {
+        cache->bucket_count = INITIAL_BUCKETS;
+        cache->buckets = calloc(cache->bucket_count, sizeof(CacheEntry*));
+    }
+    return cache;
+}
+
+static void FreeEntry(CacheEntry *entry) {
+    free(entry->data);
+    free(entry);
+}
+
+void cache_destroy(Cache *cache) {
+    if(!cache)
+        return;
+    CacheEntry *entry = cache->newest;
+    while(entry) {
+        CacheEntry *older = entry->older;
+        FreeEntry(entry);
+        entry = older;
+    }
+    free(cache->buckets);
+    free(cache->dir);
+    free(cache);
+}
+
+static int SameKey(const CacheKey *a, const CacheKey *b) {
+    return a->lo == b->lo && a->hi == b->hi;
+}
+
+static size_t BucketOf(Cache *cache, const CacheKey *key) {
+    return key->lo & (cache->bucket_count - 1);
+}
+
+///// in-memory tier
+
+static void Unlink(Cache *cache, CacheEntry *entry) {
+    if(entry->newer)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+    if(entry->older)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+    entry->newer = entry->older = NULL;
+}
+
+static void PushNewest(Cache *cache, CacheEntry *entry) {
+    entry->older = cache->newest;
+    entry->newer = NULL;
+    if(cache->newest)
+        cache->newest->newer = entry;
+    cache->newest = entry;
+    if(!cache->oldest)
+        cache->oldest = entry;
+}
+
+static void RemoveFromBucket(Cache *cache, CacheEntry *entry) {
+    CacheEntry **link = &cache->buckets[BucketOf(cache, &entry->key)];
+    while(*link && *link != entry)
+        link = &(*link)->chain;
+    if(*link)
+        *link = entry->chain;
+}
+
+static void Grow(Cache *cache) {
+    size_t old_count = cache->bucket_count;
+    CacheEntry **old = cache->buckets;
+    cache->bucket_count = old_count * 2;
+    cache->buckets = calloc(cache->bucket_count, sizeof(CacheEntry*));
+    for(size_t i = 0; i < old_count; i++) {
+        CacheEntry *entry = old[i];
+        while(entry) {
+            CacheEntry *next = entry->chain;
+            size_t b = BucketOf(cache, &entry->key);
+            entry->chain = cache->buckets[b];
+            cache->buckets[b] = entry;
+            entry = next;
+        }
+    }
+    free(old);
+}
+
+static CacheEntry *MemoryFind(Cache *cache, const CacheKey *key) {
+    CacheEntry *entry = cache->buckets[BucketOf(cache, key)];
+    while(entry && !SameKey(&entry->key, key))
+        entry = entry->chain;
+    return entry;
+}
+
+static void MemoryInsert(Cache *cache, const CacheKey *key, const CompileResult *result) {
+    size_t size = sizeof(CacheEntry);
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++)
+        size += result->lengths[i];
+    if(size > cache->memory_limit)
+        return;
+
+    CacheEntry *entry = MemoryFind(cache, key);
+    if(entry) {
+        // same key -> same content, just refresh it
+        Unlink(cache, entry);
+        PushNewest(cache, entry);
+        return;
+    }
+
+    // evict least recently used entries until the new one fits
+    while(cache->oldest && cache->memory_used + size > cache->memory_limit) {
+        CacheEntry *victim = cache->oldest;
+        Unlink(cache, victim);
+        RemoveFromBucket(cache, victim);
+        cache->memory_used -= victim->size;
+        cache->entry_count--;
+        cache->stats.evictions++;
+        FreeEntry(victim);
+    }
+
+    entry = calloc(1, sizeof(CacheEntry));
+    entry->key = *key;
+    entry->size = size;
+    entry->data = malloc(size - sizeof(CacheEntry) + 1);
+    entry->result.status = result->status;
+    entry->result.storage = RESULT_BORROWED;
+
+    char *p = entry->data;
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++) {
+        if(result->lengths[i] > 0)
+            memcpy(p, result->sections[i], result->lengths[i]);
+        entry->result.sections[i] = p;
+        entry->result.lengths[i] = result->lengths[i];
+        p += result->lengths[i];
+    }
+
+    if(cache->entry_count >= cache->bucket_count)
+        Grow(cache);
+    size_t b = BucketOf(cache, key);
+    entry->chain = cache->buckets[b];
+    cache->buckets[b] = entry;
+    PushNewest(cache, entry);
+    cache->memory_used += size;
+    cache->entry_count++;
+}
+
+///// on-disk tier
+
+static char *EntryPath(Cache *cache, const CacheKey *key) {
+    size_t len = strlen(cache->dir) + 40;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/%016llx%016llx.p0c", cache->dir,
+             (unsigned long long)key->hi, (unsigned long long)key->lo);
+    return path;
+}
+
+static int DiskLookup(Cache *cache, const CacheKey *key, CompileResult *result) {
+    char *path = EntryPath(cache, key);
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if(fd < 0)
+        return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CacheFileHeader)) {
+        close(fd);
+        return 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return 0;
+
+    // reject anything that doesn't look like a complete entry for this key
+    const CacheFileHeader *header = mapping;
+    size_t total = sizeof(CacheFileHeader);
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++)
+        total += header->lengths[i];
+    if(memcmp(header->magic, CACHE_MAGIC, 8) != 0 || header->key_lo != key->lo ||
+       header->key_hi != key->hi || total != size) {
+        munmap(mapping, size);
+        return 0;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->status = header->status;
+    result->storage = RESULT_MAPPED;
+    result->mapping = mapping;
+    result->mapping_size = size;
+
+    char *p = (char*)mapping + sizeof(CacheFileHeader);
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++) {
+        result->sections[i] = p;
+        result->lengths[i] = header->lengths[i];
+        p += header->lengths[i];
+    }
+    return 1;
+}
+
+static void DiskStore(Cache *cache, const CacheKey *key, const CompileResult *result) {
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, 8);
+    header.key_lo = key->lo;
+    header.key_hi = key->hi;
+    header.status = result->status;
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++)
+        header.lengths[i] = result->lengths[i];
+
+    // write to a temp file and rename, so readers never see half an entry
+    size_t len = strlen(cache->dir) + 64;
+    char *temp = malloc(len);
+    snprintf(temp, len, "%s/.tmp-%ld-%lu", cache->dir, (long)getpid(), cache->temp_counter++);
+
+    FILE *f = fopen(temp, "wb");
+    if(!f) {
+        free(temp);
+        return;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for(int i = 0; i < RESULT_SECTION_COUNT && ok; i++) {
+        if(result->lengths[i] > 0)
+            ok = fwrite(result->sections[i], 1, result->lengths[i], f) == result->lengths[i];
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    char *path = EntryPath(cache, key);
+    if(!ok || rename(temp, path) != 0)
+        unlink(temp);
+    free(path);
+    free(temp);
+}
+
+///// public
+
+int cache_lookup(Cache *cache, const CacheKey *key, CompileResult *result) {
+    if(cache->memory_limit > 0) {
+        CacheEntry *entry = MemoryFind(cache, key);
+        if(entry) {
+            Unlink(cache, entry);
+            PushNewest(cache, entry);
+            *result = entry->result;
+            cache->stats.memory_hits++;
+            return 1;
+        }
+    }
+
+    if(cache->dir && DiskLookup(cache, key, result)) {
+        cache->stats.disk_hits++;
+        // promote into memory so the next hit doesn't touch the file
+        if(cache->memory_limit > 0) {
+            MemoryInsert(cache, key, result);
+            CacheEntry *entry = MemoryFind(cache, key);
+            if(entry) {
+                free_result(result);
+                *result = entry->result;
+            }
+        }
+        return 1;
+    }
+
+    cache->stats.misses++;
+    return 0;
+}
+
+void cache_store(Cache *cache, const CacheKey *key, const CompileResult *result) {
+    if(cache->memory_limit > 0)
+        MemoryInsert(cache, key, result);
+    if(cache->dir)
+        DiskStore(cache, key, result);
+    cache->stats.stores++;
+}
+
+const CacheStats *cache_get_stats(Cache *cache) {
+    return &cache->stats;
+}
+
+void cache_print_stats(Cache *cache, FILE *out) {
+    const CacheStats *s = &cache->stats;
+    fprintf(out, "cache: memory_hits=%lu disk_hits=%lu misses=%lu stores=%lu evictions=%lu entries=%zu bytes=%zu\n",
+            s->memory_hits, s->disk_hits, s->misses, s->stores, s->evictions,
+            cache->entry_count, cache->memory_used);
+}
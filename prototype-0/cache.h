@@ -0,0 +1,42 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "driver.h"
+#include "options.h"
+
+// content-addressed compile cache
+// key = hash of the normalised source + the options that change the result
+// (+ the compiler binary itself), value = a whole CompileResult.
+// two tiers: an LRU in memory (useful in --daemon) and one file per entry
+// under a cache directory, mmap'd on lookup
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} CacheKey;
+
+typedef struct {
+    unsigned long memory_hits;
+    unsigned long disk_hits;
+    unsigned long misses;
+    unsigned long stores;
+    unsigned long evictions;
+} CacheStats;
+
+typedef struct Cache Cache;
+
+// dir may be NULL (no disk tier), memory_limit may be 0 (no memory tier)
+Cache *cache_create(const char *dir, size_t memory_limit);
+void cache_destroy(Cache *cache);
+
+CacheKey cache_key(const char *source, size_t length, const CompilerOptions *opts);
+
+// on a hit fills result (BORROWED or MAPPED storage, free with free_result)
+int cache_lookup(Cache *cache, const CacheKey *key, CompileResult *result);
+void cache_store(Cache *cache, const CacheKey *key, const CompileResult *result);
+
+const CacheStats *cache_get_stats(Cache *cache);
+void cache_print_stats(Cache *cache, FILE *out);
+
+#endif
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daemon.h"
+#include "driver.h"
+#include "cache.h"
+#include "incremental.h"
+#include "trace.h"
+
+#define MAX_REQUEST_LINE 1024
+
+// parse "COMPILE <length> flags..." into length + per-request options
+static int ParseCompileLine(char *line, const CompilerOptions *defaults, size_t *length, CompilerOptions *opts) {
+    char *save = NULL;
+    char *word = strtok_r(line, " \t\r\n", &save);  // COMPILE
+    word = strtok_r(NULL, " \t\r\n", &save);
+    if(!word)
+        return 0;
+
+    char *end;
+    unsigned long long n = strtoull(word, &end, 10);
+    if(*end != '\0')
+        return 0;
+    *length = (size_t)n;
+
+    *opts = *defaults;
+    opts->stages = 0;
+    opts->check_only = 0;
+    while((word = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        int optimization = apply_optimization_option(opts, word);
+        if(optimization < 0 || (optimization == 0 && !apply_stage_option(opts, word)))
+            return 0;
+    }
+    finish_stage_options(opts);
+    return 1;
+}
+
+static void WriteResponse(const CompileResult *result, int cached) {
+    printf("RESULT %d %d %zu %zu %zu %zu\n", result->status, cached,
+           result->lengths[RESULT_OUTPUT], result->lengths[RESULT_DIAGNOSTICS],
+           result->lengths[RESULT_ASSEMBLY], result->lengths[RESULT_MACHINE]);
+    int order[] = { RESULT_OUTPUT, RESULT_DIAGNOSTICS, RESULT_ASSEMBLY, RESULT_MACHINE };
+    for(int i = 0; i < RESULT_SECTION_COUNT; i++) {
+        int s = order[i];
+        if(result->lengths[s] > 0)
+            fwrite(result->sections[s], 1, result->lengths[s], stdout);
+    }
+    fflush(stdout);
+}
+
+int run_daemon(const CompilerOptions *opts) {
+    Cache *cache = cache_create(opts->cache_dir, opts->cache_memory_limit);
+    IncrementalState *incremental = opts->incremental ? incremental_create() : NULL;
+    char line[MAX_REQUEST_LINE];
+    int64_t requests = 0;
+
+    while(fgets(line, sizeof(line), stdin)) {
+        if(strncmp(line, "QUIT", 4) == 0)
+            break;
+
+        if(strncmp(line, "STATS", 5) == 0) {
+            cache_print_stats(cache, stdout);
+            if(incremental)
+                incremental_print_stats(incremental, stdout);
+            fflush(stdout);
+            continue;
+        }
+
+        if(strncmp(line, "COMPILE ", 8) != 0) {
+            printf("ERROR unknown request\n");
+            fflush(stdout);
+            continue;
+        }
+
+        size_t length;
+        CompilerOptions request;
+        if(!ParseCompileLine(line, opts, &length, &request)) {
+            printf("ERROR bad COMPILE line\n");
+            fflush(stdout);
+            continue;
+        }
+
+        char *source = malloc(length + 1);
+        if(fread(source, 1, length, stdin) != length) {
+            free(source);
+            break;  // client went away mid-request
+        }
+
+        // the COMPILEs are numbered from 1 in the trace
+        trace_request(++requests);
+        trace_begin("request");
+        CacheKey key = cache_key(source, length, &request);
+        CompileResult result;
+        int cached = cache_lookup(cache, &key, &result);
+        if(!cached) {
+            // the passes need the whole program: an optimised request is
+            // compiled from scratch, next to the incremental state
+            if(incremental && !optimizing(&request))
+                incremental_compile(incremental, source, length, &request, &result);
+            else
+                compile_source(source, length, &request, &result);
+            cache_store(cache, &key, &result);
+        }
+        WriteResponse(&result, cached);
+        trace_end("request");
+        trace_request(0);
+        trace_flush();
+        free_result(&result);
+        free(source);
+    }
+
+    if(opts->cache_stats) {
+        cache_print_stats(cache, stderr);
+        if(incremental)
+            incremental_print_stats(incremental, stderr);
+    }
+    incremental_destroy(incremental);
+    cache_destroy(cache);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "options.h"
+
+// long-running compiler: reads requests on stdin, answers on stdout
+//
+//   COMPILE <length> [--run] [-S] [--mc] [--check-only] [-O0|-O1|-O2]
+//           [--passes=A,B] [--print-after=PASS]\n<length bytes of source>
+//     -> RESULT <status> <cached> <output_len> <diag_len> <asm_len> <mc_len>\n
+//        followed by the four sections back to back
+//
+// the optimisation flags are per request (an editor can ask for -O0 on
+// every keystroke and -O2 for the assembly it shows); the daemon's own are
+// the default. with --incremental an optimised request is compiled whole
+//   STATS\n -> cache: ... (one line, see cache_print_stats), plus an
+//             incremental: ... line with --incremental
+//   QUIT\n  -> exits
+//
+// anything malformed is answered with "ERROR <message>\n"
+int run_daemon(const CompilerOptions *opts);
+
+#endif
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "dead_store.h"
+#include "hash.h"
+
+#define INITIAL_BUCKETS 64
+
+// one thing the program does, in the order it runs: the store of an item,
+// or the reads of a printed expression
+typedef struct {
+    const Node *item;   // "x = expr", NULL for a print's expression
+    int variable;       // x
+    Node *expression;
+} Step;
+
+// a store that goes, by its item
+typedef struct {
+    const Node *item;
+    int status;
+} Removed;
+
+struct DeadStores {
+    // the variables, numbered: open addressing over names, -1 = empty
+    const char **names;
+    int variable_count;
+    int variable_capacity;
+    int *variable_buckets;
+    size_t variable_bucket_count;
+    char *read;                 // by variable: some evaluated expression reads it
+
+    // the stores that go, open addressing, item NULL = empty
+    Removed *removed;
+    size_t removed_bucket_count;
+    long removed_count;
+
+    long dead_variables;
+};
+
+static size_t NameBucket(const char *name, size_t mask) {
+    return hash64(name, strlen(name), 0) & mask;
+}
+
+static size_t ItemBucket(const Node *item, size_t mask) {
+    return hash64(&item, sizeof(item), 0) & mask;
+}
+
+static int FindVariable(const DeadStores *d, const char *name) {
+    if(d->variable_bucket_count == 0)
+        return -1;
+    size_t mask = d->variable_bucket_count - 1;
+    for(size_t i = NameBucket(name, mask); d->variable_buckets[i] >= 0; i = (i + 1) & mask)
+        if(strcmp(d->names[d->variable_buckets[i]], name) == 0)
+            return d->variable_buckets[i];
+    return -1;
+}
+
+static void IndexVariable(DeadStores *d, int variable) {
+    size_t mask = d->variable_bucket_count - 1;
+    size_t i = NameBucket(d->names[variable], mask);
+    while(d->variable_buckets[i] >= 0)
+        i = (i + 1) & mask;
+    d->variable_buckets[i] = variable;
+}
+
+// the number of a variable, a new one the first time; the names are the AST's
+static int Variable(DeadStores *d, const char *name) {
+    int variable = FindVariable(d, name);
+    if(variable >= 0)
+        return variable;
+    if(d->variable_count == d->variable_capacity) {
+        d->variable_capacity = d->variable_capacity ? d->variable_capacity * 2 : 64;
+        d->names = realloc(d->names, sizeof(char*) * d->variable_capacity);
+    }
+    variable = d->variable_count++;
+    d->names[variable] = name;
+
+    // at most half full
+    if((size_t)d->variable_count * 2 > d->variable_bucket_count) {
+        free(d->variable_buckets);
+        d->variable_bucket_count = d->variable_bucket_count ? d->variable_bucket_count * 2 : INITIAL_BUCKETS;
+        d->variable_buckets = malloc(sizeof(int) * d->variable_bucket_count);
+        memset(d->variable_buckets, 0xff, sizeof(int) * d->variable_bucket_count);
+        for(int i = 0; i < d->variable_count; i++)
+            IndexVariable(d, i);
+    } else {
+        IndexVariable(d, variable);
+    }
+    return variable;
+}
+
+static void InsertRemoved(Removed *table, size_t bucket_count, const Node *item, int status) {
+    size_t mask = bucket_count - 1;
+    size_t i = ItemBucket(item, mask);
+    while(table[i].item)
+        i = (i + 1) & mask;
+    table[i] = (Removed){ item, status };
+}
+
+static void Remove(DeadStores *d, const Node *item, int status) {
+    if((size_t)(d->removed_count + 1) * 2 > d->removed_bucket_count) {
+        size_t count = d->removed_bucket_count ? d->removed_bucket_count * 2 : INITIAL_BUCKETS;
+        Removed *table = calloc(count, sizeof(Removed));
+        for(size_t i = 0; i < d->removed_bucket_count; i++)
+            if(d->removed[i].item)
+                InsertRemoved(table, count, d->removed[i].item, d->removed[i].status);
+        free(d->removed);
+        d->removed = table;
+        d->removed_bucket_count = count;
+    }
+    InsertRemoved(d->removed, d->removed_bucket_count, item, status);
+    d->removed_count++;
+}
+
+// the items of a declaration/assignment are chained through the rightmost
+// leaf of each one (see the interpreter's next_item)
+static Node *NextItem(Node *item) {
+    while(item->node_type == 3)
+        item = item->binop.right;
+    return item->list.next;
+}
+
+static void AddStep(Step **steps, size_t *count, size_t *capacity, Step step) {
+    if(*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        *steps = realloc(*steps, sizeof(Step) * *capacity);
+    }
+    (*steps)[(*count)++] = step;
+}
+
+// 1 if evaluating node can divide by zero: a division by anything but a
+// number other than 0
+static int CanTrap(const Node *node) {
+    if(!node || node->node_type != 3)
+        return 0;
+    if(node->binop.op == '/' && (node->binop.right->node_type != 0 || node->binop.right->int_val == 0))
+        return 1;
+    return CanTrap(node->binop.left) || CanTrap(node->binop.right);
+}
+
+// every variable node reads gets its number
+static void NumberReads(DeadStores *d, const Node *node) {
+    if(!node)
+        return;
+    if(node->node_type == 2) {
+        Variable(d, node->str_val);
+    } else if(node->node_type == 3) {
+        NumberReads(d, node->binop.left);
+        NumberReads(d, node->binop.right);
+    }
+}
+
+// the variables node reads are live, and read
+static void Read(DeadStores *d, const Node *node, char *live) {
+    if(!node)
+        return;
+    if(node->node_type == 2) {
+        int variable = FindVariable(d, node->str_val);
+        live[variable] = 1;
+        d->read[variable] = 1;
+    } else if(node->node_type == 3) {
+        Read(d, node->binop.left, live);
+        Read(d, node->binop.right, live);
+    }
+}
+
+DeadStores *dead_stores_find(Node *program) {
+    DeadStores *d = calloc(1, sizeof(DeadStores));
+
+    // the program's steps, numbering every variable on the way
+    Step *steps = NULL;
+    size_t step_count = 0, step_capacity = 0;
+    for(Node *statement = program; statement; statement = statement->list.next) {
+        if(statement->node_type == 4 || statement->node_type == 5) {  // NODE_DECL, NODE_ASSIGN
+            for(Node *item = statement->list.items; item; item = NextItem(item)) {
+                if(item->node_type == 2)
+                    Variable(d, item->str_val);
+                else if(item->node_type == 3 && item->binop.op == '=' && item->binop.left->node_type == 2) {
+                    AddStep(&steps, &step_count, &step_capacity,
+                            (Step){ item, Variable(d, item->binop.left->str_val), item->binop.right });
+                    NumberReads(d, item->binop.right);
+                }
+            }
+        } else if(statement->node_type == 6) {  // NODE_PRINT
+            for(Node *part = statement->print_stmt.parts; part; part = part->list.next) {
+                Node *content = part->node_type == NODE_PRINT_PART ? part->list.items : part;
+                if(content->node_type != 1) {  // NODE_STR
+                    AddStep(&steps, &step_count, &step_capacity, (Step){ NULL, -1, content });
+                    NumberReads(d, content);
+                }
+            }
+        }
+    }
+
+    // back from the end, where nothing is live
+    char *live = calloc(d->variable_count + 1, 1);
+    d->read = calloc(d->variable_count + 1, 1);
+    for(size_t i = step_count; i-- > 0;) {
+        Step *step = &steps[i];
+        if(step->item) {
+            if(!live[step->variable]) {
+                int status = CanTrap(step->expression) ? STORE_EVALUATE : STORE_DEAD;
+                Remove(d, step->item, status);
+                if(status == STORE_DEAD)
+                    continue;
+            }
+            live[step->variable] = 0;
+        }
+        Read(d, step->expression, live);
+    }
+    for(int i = 0; i < d->variable_count; i++)
+        if(!d->read[i])
+            d->dead_variables++;
+    free(live);
+    free(steps);
+    return d;
+}
+
+void dead_stores_free(DeadStores *d) {
+    if(!d)
+        return;
+    free(d->names);
+    free(d->variable_buckets);
+    free(d->read);
+    free(d->removed);
+    free(d);
+}
+
+int dead_stores_store(const DeadStores *d, const Node *item) {
+    if(d->removed_bucket_count == 0)
+        return STORE_LIVE;
+    size_t mask = d->removed_bucket_count - 1;
+    for(size_t i = ItemBucket(item, mask); d->removed[i].item; i = (i + 1) & mask)
+        if(d->removed[i].item == item)
+            return d->removed[i].status;
+    return STORE_LIVE;
+}
+
+int dead_stores_variable_dead(const DeadStores *d, const char *name) {
+    int variable = FindVariable(d, name);
+    return variable < 0 || !d->read[variable];
+}
+
+long dead_stores_store_count(const DeadStores *d) {
+    return d->removed_count;
+}
+
+long dead_stores_variable_count(const DeadStores *d) {
+    return d->dead_variables;
+}
@@ -0,0 +1,39 @@
+#ifndef DEAD_STORE_H
+#define DEAD_STORE_H
+
+#include "ast.h"
+
+// dead store elimination (-O): the stores of a checked program that no
+// later statement reads, and the variables nothing reads at all.
+//
+// a program is straight-line code, so this is one walk back over it with
+// the set of variables still to be read. a store to a variable outside that
+// set is dead, and nothing is read after the last statement. a dead store
+// whose expression can divide by zero is still evaluated, for its trap, and
+// the variables that expression reads stay live. a variable no evaluated
+// expression reads has no place in .data at all
+//
+// the AST isn't changed: the code generator asks about every store
+// (AssemblyDeadStores), and the interpreter runs the program as it is
+
+// what becomes of the store of "x = expr", a declaration's or an assignment's
+#define STORE_LIVE 0
+#define STORE_DEAD 1        // neither evaluated nor stored
+#define STORE_EVALUATE 2    // evaluated for a division's trap, not stored
+
+typedef struct DeadStores DeadStores;
+
+DeadStores *dead_stores_find(Node *program);
+void dead_stores_free(DeadStores *dead);
+
+// item is the '=' binop of "x = expr"
+int dead_stores_store(const DeadStores *dead, const Node *item);
+// 1 if nothing reads the variable
+int dead_stores_variable_dead(const DeadStores *dead, const char *name);
+
+// what was found: stores that go (STORE_DEAD and STORE_EVALUATE), and
+// variables with no place in .data
+long dead_stores_store_count(const DeadStores *dead);
+long dead_stores_variable_count(const DeadStores *dead);
+
+#endif
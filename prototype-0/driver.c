@@ -0,0 +1,491 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "driver.h"
+#include "semantics.h"
+#include "ast.h"
+#include "assembly.h"
+#include "passes.h"
+#include "ir.h"
+#include "machine_code.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "native.h"
+#include "error.h"
+#include "stats.h"
+#include "trace.h"
+#include "parser.tab.h"
+
+// parser state (parser.y)
+extern int yyparse();
+void free_node(Node *node);
+extern _Thread_local int (*token_source)(YYSTYPE *lval);
+
+// lexer state (lexer.l)
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern int yylex(YYSTYPE *lval);
+extern YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len);
+extern void yyrestart(FILE *input_file);
+extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+extern int yylex_destroy(void);
+extern int line_num;
+extern int column_num;
+
+char *read_source_file(const char *filename, size_t *length) {
+    FILE *in = fopen(filename, "rb");
+    if(!in)
+        return NULL;
+
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *buffer = malloc(capacity);
+    size_t n;
+    while((n = fread(buffer + size, 1, capacity - size, in)) > 0) {
+        size += n;
+        if(size == capacity) {
+            capacity *= 2;
+            buffer = realloc(buffer, capacity);
+        }
+    }
+    fclose(in);
+
+    *length = size;
+    return buffer;
+}
+
+// the flex scanner is not reentrant, so threads take turns with it. the
+// parser and everything behind it are per thread, so parse_text scans the
+// whole text up front and only holds the lock for that
+static pthread_mutex_t scanner_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    int type;
+    YYSTYPE value;
+    char *diagnostic;   // lexical error, printed when the parser gets to it
+} ScannedToken;
+
+static _Thread_local struct {
+    ScannedToken *tokens;
+    size_t count;
+    size_t next;
+} scanned;
+
+static void ScanText(const char *text, size_t length, int first_line) {
+    // lexical errors travel with their token so they come out in parse order
+    char *messages = NULL;
+    size_t messages_length = 0, reported = 0;
+    FILE *diag = open_memstream(&messages, &messages_length);
+    FILE *saved = get_diagnostics_stream();
+    set_diagnostics_stream(diag);
+
+    size_t capacity = 256;
+    scanned.tokens = malloc(sizeof(ScannedToken) * capacity);
+    scanned.count = scanned.next = 0;
+
+    pthread_mutex_lock(&scanner_lock);
+    line_num = first_line;
+    column_num = 1;
+    YY_BUFFER_STATE buffer = yy_scan_bytes(text, (int)length);
+    int type;
+    do {
+        if(scanned.count == capacity) {
+            capacity *= 2;
+            scanned.tokens = realloc(scanned.tokens, sizeof(ScannedToken) * capacity);
+        }
+        ScannedToken *token = &scanned.tokens[scanned.count++];
+        token->type = type = yylex(&token->value);
+        token->diagnostic = NULL;
+        fflush(diag);
+        if(messages_length > reported) {
+            token->diagnostic = strndup(messages + reported, messages_length - reported);
+            reported = messages_length;
+        }
+    } while(type != 0);
+    yy_delete_buffer(buffer);
+    yylex_destroy();
+    pthread_mutex_unlock(&scanner_lock);
+
+    set_diagnostics_stream(saved);
+    fclose(diag);
+    free(messages);
+}
+
+// token_source for the parser
+static int NextScannedToken(YYSTYPE *lval) {
+    ScannedToken *token = &scanned.tokens[scanned.next];
+    if(token->type != 0)
+        scanned.next++;
+    if(token->diagnostic) {
+        fputs(token->diagnostic, get_diagnostics_stream());
+        free(token->diagnostic);
+        token->diagnostic = NULL;
+    }
+    *lval = token->value;
+    return token->type;
+}
+
+// whatever the parser didn't get to (syntax error)
+static void FreeScannedTokens() {
+    for(size_t i = scanned.next; i < scanned.count; i++) {
+        ScannedToken *token = &scanned.tokens[i];
+        free(token->diagnostic);
+        if(token->type == ID || token->type == STR)
+            free(token->value.str_val);
+    }
+    free(scanned.tokens);
+    scanned.tokens = NULL;
+    scanned.count = scanned.next = 0;
+}
+
+size_t scan_text(const char *text, size_t length, int first_line) {
+    ScanText(text, length, first_line);
+    return scanned.count;
+}
+
+int parse_scanned(void) {
+    token_source = NextScannedToken;
+    int parse_result = yyparse();
+    token_source = NULL;
+    FreeScannedTokens();
+    return parse_result;
+}
+
+int parse_text(const char *text, size_t length, int first_line) {
+    scan_text(text, length, first_line);
+    return parse_scanned();
+}
+
+int parse_file(FILE *in, int first_line) {
+    // this one streams, so it keeps the scanner for the whole parse
+    pthread_mutex_lock(&scanner_lock);
+    line_num = first_line;
+    column_num = 1;
+
+    yyrestart(in);
+    int parse_result = yyparse();
+    yylex_destroy();
+    pthread_mutex_unlock(&scanner_lock);
+    return parse_result;
+}
+
+void encode_assembly(const char *text, size_t length, FILE *out) {
+    if(length == 0)
+        return;
+    FILE *in = fmemopen((void*)text, length, "r");
+    MachineFromAssemblyStream(in, out);
+    fclose(in);
+}
+
+char *encode_machine(const char *text, size_t length, const char *source, size_t source_length,
+                     const CompilerOptions *opts, size_t *result_length) {
+    char *machine = NULL;
+    if(opts->mc_format == MC_FORMAT_LISTING) {
+        FILE *out = open_memstream(&machine, result_length);
+        encode_assembly(text, length, out);
+        fclose(out);
+        return machine;
+    }
+    if(opts->mc_format == MC_FORMAT_ANNOTATED) {
+        FILE *out = open_memstream(&machine, result_length);
+        if(length > 0) {
+            FILE *in = fmemopen((void*)text, length, "r");
+            MachineAnnotatedListing(in, out, source, source_length);
+            fclose(in);
+        }
+        fclose(out);
+        return machine;
+    }
+
+    // an empty program is still an (empty) image
+    MachineImage image;
+    MachineImageInit(&image, !opts->little_endian);
+    if(length > 0) {
+        FILE *in = fmemopen((void*)text, length, "r");
+        MachineImageFromAssemblyStream(in, &image, !opts->little_endian);
+        fclose(in);
+    }
+    if(opts->mc_format == MC_FORMAT_RAW)
+        machine = MachineRawImage(&image, result_length);
+    else
+        machine = MachineElfObject(&image, result_length);
+    FreeMachineImage(&image);
+    return machine;
+}
+
+// reuse_values: after value-numbering, the interpreter keeps what it computed
+static void RunProgram(Node *program, const CompilerOptions *opts, int reuse_values, FILE *out) {
+    ErrorState error_state;
+    error_state_init(&error_state);
+
+    // interpret with error state (the JIT gives the same result, faster)
+    char *output = opts->jit ? jit_program(program, &error_state) : NULL;
+    if(!output)
+        output = reuse_values ? interpret_program_reusing_values(program, &error_state)
+                              : interpret_program(program, &error_state);
+
+    print_run_result(out, &error_state, output);
+    free(output);
+    error_state_free(&error_state);
+}
+
+void run_program(Node *program, const CompilerOptions *opts, FILE *out) {
+    RunProgram(program, opts, 0, out);
+}
+
+void print_run_result(FILE *out, ErrorState *errors, const char *output) {
+    // print runtime errors if any
+    if(get_error_count(errors) > 0) {
+        fprintf(out, "\n=== Runtime Error ===\n");
+        fprint_messages(out, errors);
+        fprintf(out, "====================\n");
+    } else if(output) {
+        // onnly print output if NO runtime errors
+        fputs(output, out);
+    }
+}
+
+// the back end: codegen + encoding + interpretation of a checked program
+static void RunStages(Node *program, const char *source, size_t length, const CompilerOptions *opts,
+                      FILE *out, CompileResult *result) {
+    // the passes of -O1/-O2/--passes= (passes.h): every stage after them sees
+    // what they rewrote, and codegen and the interpreter what they found
+    Optimization optimization = { NULL, NULL };
+    Pipeline pipeline;
+    if(pipeline_from_options(opts, &pipeline) && pipeline.count > 0) {
+        stats_begin(STATS_OPTIMIZE);
+        trace_begin("optimize");
+        int verified = run_pipeline(&pipeline, program, opts->print_after, &optimization);
+        trace_end("optimize");
+        stats_end(STATS_OPTIMIZE);
+        if(!verified) {
+            free_optimization(&optimization);
+            fprintf(out, "Compilation failed\n");
+            result->status = 1;
+            return;
+        }
+    }
+
+    // codegen only runs when the assembly or the machine code was asked for
+    if(opts->target == TARGET_X86_64 && (opts->stages & (STAGE_ASM | STAGE_MC))) {
+        // one executable instead of both
+        stats_begin(STATS_CODEGEN);
+        trace_begin("codegen");
+        result->sections[RESULT_MACHINE] = native_executable(program, &result->lengths[RESULT_MACHINE]);
+        trace_end("codegen");
+        stats_end(STATS_CODEGEN);
+    } else if(opts->stages & (STAGE_ASM | STAGE_MC)) {
+        char *asm_text = NULL;
+        size_t asm_length = 0;
+        FILE *asm_file = open_memstream(&asm_text, &asm_length);
+
+        // generate MIPS64 assembly (marking the source lines for the annotated listing)
+        stats_begin(STATS_CODEGEN);
+        trace_begin("codegen");
+        AssemblyLineMarkers(opts->mc_format == MC_FORMAT_ANNOTATED);
+        int verified = 1;
+        if(opts->ir) {
+            // through the SSA IR (ir.h), which takes the dead stores but not
+            // the value numbers: in SSA a value is computed once anyway
+            trace_begin("ir");
+            IrProgram *ir = ir_build(program, optimization.dead, optimizing(opts));
+            verified = ir_verify(ir);
+            trace_end("ir");
+            stats_count(STATS_IR_INSTRUCTIONS, ir->count);
+            if(verified && opts->print_ir) {
+                fprintf(get_diagnostics_stream(), "=== IR ===\n");
+                ir_print(get_diagnostics_stream(), ir);
+            }
+            if(verified)
+                GenerateAssemblyIR(ir, asm_file);
+            ir_free(ir);
+        } else {
+            AssemblyDeadStores(optimization.dead);
+            AssemblyValueNumbers(optimization.numbering);
+            GenerateAssemblyProgram(program, asm_file);
+            AssemblyValueNumbers(NULL);
+            AssemblyDeadStores(NULL);
+        }
+        fclose(asm_file);
+        trace_end("codegen");
+        stats_end(STATS_CODEGEN);
+        if(!verified) {
+            free(asm_text);
+            free_optimization(&optimization);
+            fprintf(out, "Compilation failed\n");
+            result->status = 1;
+            return;
+        }
+
+        // now convert assembly to machine code
+        if(opts->stages & STAGE_MC) {
+            stats_begin(STATS_ENCODE);
+            trace_begin("encode");
+            result->sections[RESULT_MACHINE] = encode_machine(asm_text, asm_length, source, length, opts,
+                                                               &result->lengths[RESULT_MACHINE]);
+            trace_end("encode");
+            stats_end(STATS_ENCODE);
+        }
+
+        if(opts->stages & STAGE_ASM) {
+            result->sections[RESULT_ASSEMBLY] = asm_text;
+            result->lengths[RESULT_ASSEMBLY] = asm_length;
+        } else {
+            free(asm_text);
+        }
+    }
+
+    // now interpret the program and display output
+    if(opts->stages & STAGE_RUN) {
+        stats_begin(STATS_RUN);
+        trace_begin("run");
+        RunProgram(program, opts, optimization.numbering != NULL, out);
+        trace_end("run");
+        stats_end(STATS_RUN);
+    }
+    free_optimization(&optimization);
+}
+
+// the AST nodes free_node would free
+static long CountNodes(Node *node) {
+    long count = 0;
+    while(node) {
+        Node *next = NULL;
+        switch(node->node_type) {
+            case 0: // NUM
+            case 2: // ID
+                next = node->list.next;
+                break;
+            case 3: // BINOP
+                count += CountNodes(node->binop.left) + CountNodes(node->binop.right);
+                break;
+            case 4: // DECL
+            case 5: // ASSIGN
+            case 6: // PRINT
+            case NODE_PRINT_PART:
+                count += CountNodes(node->list.items);
+                next = node->list.next;
+                break;
+        }
+        count++;
+        node = next;
+    }
+    return count;
+}
+
+static void CountProgram(Node *program) {
+    stats_add(STATS_NODES, CountNodes(program));
+    long symbols = 0;
+    for(Symbol *s = sem_analyzer.symbol_table; s; s = s->next)
+        symbols++;
+    stats_add(STATS_SYMBOLS, symbols);
+}
+
+void compile_source(const char *source, size_t length, const CompilerOptions *opts, CompileResult *result) {
+    memset(result, 0, sizeof(*result));
+    result->storage = RESULT_OWNED;
+
+    // stdout and stderr of the compilation are captured separately
+    FILE *out = open_memstream(&result->sections[RESULT_OUTPUT], &result->lengths[RESULT_OUTPUT]);
+    FILE *diag = open_memstream(&result->sections[RESULT_DIAGNOSTICS], &result->lengths[RESULT_DIAGNOSTICS]);
+    set_diagnostics_stream(diag);
+
+    // initialize semantic analyzer
+    sem_init(&sem_analyzer);
+    sem_set_line(&sem_analyzer, 1);
+    ast_root = NULL;
+
+    stats_begin(STATS_LEX);
+    trace_begin("lex");
+    size_t tokens = scan_text(source, length, 1);
+    trace_end("lex");
+    stats_end(STATS_LEX);
+    stats_begin(STATS_PARSE);
+    trace_begin("parse");
+    int parse_result = parse_scanned();
+    trace_end("parse");
+    stats_end(STATS_PARSE);
+    int error_count = sem_get_error_count(&sem_analyzer);
+    if(stats_enabled) {
+        stats_add(STATS_TOKENS, tokens);
+        CountProgram(ast_root);
+    }
+
+    if(parse_result == 0 && error_count == 0) {
+        RunStages(ast_root, source, length, opts, out, result);
+    } else {
+        // semantic/parsing error - don't execute at all
+        // NVM the count; we should stop at the first error
+        fprintf(out, "Compilation failed\n");
+        result->status = 1;
+    }
+
+    sem_cleanup(&sem_analyzer);
+    free_node(ast_root);
+    ast_root = NULL;
+
+    set_diagnostics_stream(NULL);
+    fclose(diag);
+    fclose(out);
+}
+
+static int WriteFile(const char *filename, const char *data, size_t length) {
+    FILE *f = fopen(filename, "w");
+    if(!f)
+        return 0;
+    if(length > 0)
+        fwrite(data, 1, length, f);
+    fclose(f);
+    return 1;
+}
+
+static int WriteExecutable(const char *filename, const char *data, size_t length) {
+    if(!WriteFile(filename, data, length))
+        return 0;
+    chmod(filename, 0755);
+    return 1;
+}
+
+int emit_result(const CompileResult *result, const CompilerOptions *opts) {
+    int ok = 1;
+
+    // output files only exist for a program that compiled
+    if(result->status == 0 && opts->target == TARGET_X86_64) {
+        if((opts->stages & (STAGE_ASM | STAGE_MC)) &&
+           !WriteExecutable(opts->machine_filename, result->sections[RESULT_MACHINE], result->lengths[RESULT_MACHINE])) {
+            fprintf(stderr, "Error: Cannot open executable file %s\n", opts->machine_filename);
+            ok = 0;
+        }
+    } else if(result->status == 0) {
+        if((opts->stages & STAGE_ASM) &&
+           !WriteFile(opts->asm_filename, result->sections[RESULT_ASSEMBLY], result->lengths[RESULT_ASSEMBLY])) {
+            fprintf(stderr, "Error: Cannot open assembly file %s\n", opts->asm_filename);
+            ok = 0;
+        }
+        if((opts->stages & STAGE_MC) &&
+           !WriteFile(opts->machine_filename, result->sections[RESULT_MACHINE], result->lengths[RESULT_MACHINE])) {
+            fprintf(stderr, "Error: Cannot open machine code file %s\n", opts->machine_filename);
+            ok = 0;
+        }
+    }
+
+    if(result->lengths[RESULT_DIAGNOSTICS] > 0)
+        fwrite(result->sections[RESULT_DIAGNOSTICS], 1, result->lengths[RESULT_DIAGNOSTICS], stderr);
+    if(result->lengths[RESULT_OUTPUT] > 0)
+        fwrite(result->sections[RESULT_OUTPUT], 1, result->lengths[RESULT_OUTPUT], stdout);
+    fflush(stdout);
+
+    return ok;
+}
+
+void free_result(CompileResult *result) {
+    if(result->storage == RESULT_OWNED) {
+        for(int i = 0; i < RESULT_SECTION_COUNT; i++)
+            free(result->sections[i]);
+    } else if(result->storage == RESULT_MAPPED) {
+        munmap(result->mapping, result->mapping_size);
+    }
+    memset(result, 0, sizeof(*result));
+}
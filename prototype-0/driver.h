@@ -0,0 +1,81 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "options.h"
+#include "ast.h"
+#include "semantics.h"
+#include "error.h"
+
+// parser state (parser.y)
+extern _Thread_local Node *ast_root;
+extern _Thread_local Semantics sem_analyzer;
+extern _Thread_local void (*statement_handler)(Node *statement);
+
+// everything one compilation produces, kept in memory so it can be
+// cached or sent back over the daemon protocol before being written out
+enum {
+    RESULT_OUTPUT,       // what goes to stdout (program output, runtime errors)
+    RESULT_DIAGNOSTICS,  // what goes to stderr (lexer/parser/semantic messages)
+    RESULT_ASSEMBLY,     // MIPS64 assembly text
+    RESULT_MACHINE,      // machine code listing
+    RESULT_SECTION_COUNT
+};
+
+// who owns the section buffers
+typedef enum {
+    RESULT_OWNED,     // malloc'd, freed by free_result
+    RESULT_MAPPED,    // point into an mmap'd cache file, unmapped by free_result
+    RESULT_BORROWED   // point into the in-memory cache, valid until the next cache call
+} ResultStorage;
+
+typedef struct {
+    int status;  // process exit status (0 = ok)
+    char *sections[RESULT_SECTION_COUNT];
+    size_t lengths[RESULT_SECTION_COUNT];
+    ResultStorage storage;
+    void *mapping;
+    size_t mapping_size;
+} CompileResult;
+
+// run the stages selected in opts over an in-memory source
+void compile_source(const char *source, size_t length, const CompilerOptions *opts, CompileResult *result);
+
+// write a result the way the one-shot compiler does: .s/.mc files for the
+// selected stages, output to stdout and diagnostics to stderr.
+// returns 0 if an output file could not be written
+int emit_result(const CompileResult *result, const CompilerOptions *opts);
+
+void free_result(CompileResult *result);
+
+// lex + parse text whose first line is line first_line; the statements end up
+// in ast_root and the checks run against sem_analyzer, both set up by the caller.
+// returns the yyparse result. threads can parse at the same time, they only
+// take turns scanning
+int parse_text(const char *text, size_t length, int first_line);
+// same, reading the source from a file as the lexer needs it (one thread at a time)
+int parse_file(FILE *in, int first_line);
+// parse_text in its two halves, for timing them apart (p0bench): scan_text
+// lexes the whole text up front (returning the token count) and
+// parse_scanned parses those tokens. one thread's scan at a time
+size_t scan_text(const char *text, size_t length, int first_line);
+int parse_scanned(void);
+
+// interpret a checked program and write its output (or runtime errors) to out.
+// with opts->jit it runs as native code, where that's possible
+void run_program(Node *program, const CompilerOptions *opts, FILE *out);
+// what run_program writes for the output and errors of a run
+void print_run_result(FILE *out, ErrorState *errors, const char *output);
+
+// machine code for a piece of assembly text, appended to out
+void encode_assembly(const char *text, size_t length, FILE *out);
+// the machine code for a whole program's assembly in opts->mc_format
+// (malloc'd, *result_length bytes); the source is for the annotated listing
+char *encode_machine(const char *text, size_t length, const char *source, size_t source_length,
+                     const CompilerOptions *opts, size_t *result_length);
+
+// read a whole file into a malloc'd buffer; NULL if it can't be opened
+char *read_source_file(const char *filename, size_t *length);
+
+#endif
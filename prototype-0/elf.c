@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "elf.h"
+
+typedef struct {
+    FILE *out;
+    int big_endian;
+} ElfWriter;
+
+static void Put(ElfWriter *w, uint64_t value, int bytes) {
+    unsigned char buffer[8];
+    for(int i = 0; i < bytes; i++) {
+        int shift = w->big_endian ? (bytes - 1 - i) * 8 : i * 8;
+        buffer[i] = (unsigned char)(value >> shift);
+    }
+    fwrite(buffer, 1, bytes, w->out);
+}
+
+static void Pad(ElfWriter *w, size_t to) {
+    long at = ftell(w->out);
+    while((size_t)at++ < to)
+        fputc(0, w->out);
+}
+
+// first offset >= from that the segment can be mapped from
+static size_t SegmentOffset(size_t from, uint64_t address) {
+    size_t offset = (from & ~(size_t)(ELF_PAGE_SIZE - 1)) | (address & (ELF_PAGE_SIZE - 1));
+    return offset < from ? offset + ELF_PAGE_SIZE : offset;
+}
+
+char *elf_executable(const ElfHeader *header, const ElfSegment *segments, int count, size_t *length) {
+    char *file = NULL;
+    ElfWriter w = { open_memstream(&file, length), header->big_endian };
+
+    size_t *offsets = malloc(sizeof(size_t) * (count + 1));
+    size_t end = ELF_HEADERS_SIZE(count);
+    for(int i = 0; i < count; i++) {
+        offsets[i] = SegmentOffset(end, segments[i].address);
+        end = offsets[i] + segments[i].size;
+    }
+
+    // e_ident: ELFCLASS64, data encoding, EV_CURRENT, System V ABI
+    fwrite("\x7f" "ELF\x02", 1, 5, w.out);
+    fputc(header->big_endian ? 2 : 1, w.out);
+    fputc(1, w.out);
+    Pad(&w, 16);
+    Put(&w, 2, 2);                      // e_type: ET_EXEC
+    Put(&w, header->machine, 2);
+    Put(&w, 1, 4);                      // e_version
+    Put(&w, header->entry, 8);
+    Put(&w, 64, 8);                     // e_phoff
+    Put(&w, 0, 8);                      // e_shoff: no sections
+    Put(&w, header->flags, 4);
+    Put(&w, 64, 2);                     // e_ehsize
+    Put(&w, 56, 2);                     // e_phentsize
+    Put(&w, count, 2);
+    Put(&w, 64, 2);                     // e_shentsize
+    Put(&w, 0, 2);                      // e_shnum
+    Put(&w, 0, 2);                      // e_shstrndx
+
+    for(int i = 0; i < count; i++) {
+        const ElfSegment *s = &segments[i];
+        Put(&w, 1, 4);                  // PT_LOAD
+        Put(&w, s->flags, 4);
+        Put(&w, offsets[i], 8);
+        Put(&w, s->address, 8);         // p_vaddr
+        Put(&w, s->address, 8);         // p_paddr
+        Put(&w, s->size, 8);
+        Put(&w, s->memory_size, 8);
+        Put(&w, ELF_PAGE_SIZE, 8);
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(segments[i].size == 0)
+            continue;
+        Pad(&w, offsets[i]);
+        fwrite(segments[i].data, 1, segments[i].size, w.out);
+    }
+
+    free(offsets);
+    fclose(w.out);
+    return file;
+}
+
+// the names in a string table, each at its offset
+static size_t AddString(FILE *table, size_t *size, const char *s) {
+    size_t offset = *size;
+    size_t length = strlen(s) + 1;
+    fwrite(s, 1, length, table);
+    *size += length;
+    return offset;
+}
+
+static void SectionHeader(ElfWriter *w, size_t name, int type, uint64_t flags, size_t offset,
+                          size_t size, int link, int info, size_t alignment, size_t entry_size) {
+    Put(w, name, 4);
+    Put(w, type, 4);
+    Put(w, flags, 8);
+    Put(w, 0, 8);                       // sh_addr: not loaded yet
+    Put(w, offset, 8);
+    Put(w, size, 8);
+    Put(w, link, 4);
+    Put(w, info, 4);
+    Put(w, alignment, 8);
+    Put(w, entry_size, 8);
+}
+
+#define ALIGN_TO(n, a) (((n) + (a) - 1) / (a) * (a))
+
+// r_info: the symbol and the type. MIPS64 splits the type into three and
+// keeps the fields in this order in either byte order
+static void PutRelocationInfo(ElfWriter *w, int machine, uint32_t symbol, uint32_t type) {
+    if(machine == ELF_MACHINE_MIPS) {
+        Put(w, symbol, 4);
+        Put(w, 0, 1);                   // r_ssym
+        Put(w, 0, 1);                   // r_type3
+        Put(w, 0, 1);                   // r_type2
+        Put(w, type, 1);
+    } else {
+        Put(w, (uint64_t)symbol << 32 | type, 8);
+    }
+}
+
+char *elf_object(const ElfHeader *header, const ElfSection *sections, int count,
+                 const ElfSymbol *symbols, int symbol_count,
+                 const ElfRelocation *relocations, int relocation_count, size_t *length) {
+    // section indices: 0 is null, then the given ones, their .rela sections,
+    // then these three
+    int *relocated = calloc(count + 1, sizeof(int));   // its .rela section's index
+    int rela_count = 0;
+    for(int i = 0; i < relocation_count; i++) {
+        int target = relocations[i].section;
+        if(target >= 1 && target <= count && !relocated[target])
+            relocated[target] = -1;
+    }
+    for(int i = 1; i <= count; i++)
+        if(relocated[i])
+            relocated[i] = count + 1 + rela_count++;
+    int symtab = count + rela_count + 1, strtab = symtab + 1, shstrtab = symtab + 2;
+    int section_count = shstrtab + 1;
+
+    char *names = NULL, *section_names = NULL;
+    size_t names_size = 0, section_names_size = 0, names_length, section_names_length;
+    FILE *names_out = open_memstream(&names, &names_length);
+    FILE *section_names_out = open_memstream(&section_names, &section_names_length);
+    AddString(names_out, &names_size, "");
+    AddString(section_names_out, &section_names_size, "");
+    size_t *name_offsets = malloc(sizeof(size_t) * section_count);
+    for(int i = 0; i < count; i++)
+        name_offsets[i + 1] = AddString(section_names_out, &section_names_size, sections[i].name);
+    for(int i = 1; i <= count; i++) {
+        if(!relocated[i])
+            continue;
+        char *name = malloc(strlen(sections[i - 1].name) + 6);
+        sprintf(name, ".rela%s", sections[i - 1].name);
+        name_offsets[relocated[i]] = AddString(section_names_out, &section_names_size, name);
+        free(name);
+    }
+    name_offsets[symtab] = AddString(section_names_out, &section_names_size, ".symtab");
+    name_offsets[strtab] = AddString(section_names_out, &section_names_size, ".strtab");
+    name_offsets[shstrtab] = AddString(section_names_out, &section_names_size, ".shstrtab");
+    size_t *symbol_names = malloc(sizeof(size_t) * (symbol_count + 1));
+    int first_global = symbol_count + 1;
+    for(int i = 0; i < symbol_count; i++) {
+        symbol_names[i] = AddString(names_out, &names_size, symbols[i].name);
+        if(symbols[i].global && first_global > symbol_count)
+            first_global = i + 1;
+    }
+    fclose(names_out);
+    fclose(section_names_out);
+
+    // where everything goes
+    size_t *offsets = malloc(sizeof(size_t) * section_count);
+    size_t *sizes = calloc(section_count, sizeof(size_t));
+    size_t end = 64;
+    for(int i = 0; i < count; i++) {
+        size_t alignment = sections[i].alignment ? sections[i].alignment : 1;
+        offsets[i + 1] = ALIGN_TO(end, alignment);
+        if(sections[i].type != ELF_SECTION_NOBITS)
+            end = offsets[i + 1] + sections[i].size;
+    }
+    for(int i = 0; i < relocation_count; i++)
+        if(relocations[i].section >= 1 && relocations[i].section <= count)
+            sizes[relocated[relocations[i].section]] += 24;
+    for(int i = 1; i <= count; i++) {
+        if(!relocated[i])
+            continue;
+        offsets[relocated[i]] = ALIGN_TO(end, 8);
+        end = offsets[relocated[i]] + sizes[relocated[i]];
+    }
+    size_t symtab_size = 24 * (symbol_count + 1);
+    offsets[symtab] = ALIGN_TO(end, 8);
+    offsets[strtab] = offsets[symtab] + symtab_size;
+    offsets[shstrtab] = offsets[strtab] + names_size;
+    size_t section_headers = ALIGN_TO(offsets[shstrtab] + section_names_size, 8);
+
+    char *file = NULL;
+    ElfWriter w = { open_memstream(&file, length), header->big_endian };
+
+    fwrite("\x7f" "ELF\x02", 1, 5, w.out);
+    fputc(header->big_endian ? 2 : 1, w.out);
+    fputc(1, w.out);
+    Pad(&w, 16);
+    Put(&w, 1, 2);                      // e_type: ET_REL
+    Put(&w, header->machine, 2);
+    Put(&w, 1, 4);                      // e_version
+    Put(&w, 0, 8);                      // e_entry
+    Put(&w, 0, 8);                      // e_phoff: no segments
+    Put(&w, section_headers, 8);
+    Put(&w, header->flags, 4);
+    Put(&w, 64, 2);                     // e_ehsize
+    Put(&w, 0, 2);                      // e_phentsize
+    Put(&w, 0, 2);                      // e_phnum
+    Put(&w, 64, 2);                     // e_shentsize
+    Put(&w, section_count, 2);
+    Put(&w, shstrtab, 2);
+
+    for(int i = 0; i < count; i++) {
+        if(sections[i].type == ELF_SECTION_NOBITS || sections[i].size == 0)
+            continue;
+        Pad(&w, offsets[i + 1]);
+        fwrite(sections[i].data, 1, sections[i].size, w.out);
+    }
+
+    // Elf64_Rela, grouped by the section they patch
+    for(int i = 1; i <= count; i++) {
+        if(!relocated[i])
+            continue;
+        Pad(&w, offsets[relocated[i]]);
+        for(int j = 0; j < relocation_count; j++) {
+            const ElfRelocation *r = &relocations[j];
+            if(r->section != i)
+                continue;
+            Put(&w, r->offset, 8);
+            PutRelocationInfo(&w, header->machine, r->symbol + 1, r->type);
+            Put(&w, (uint64_t)r->addend, 8);
+        }
+    }
+
+    // the symbol table starts with the null symbol
+    Pad(&w, offsets[symtab]);
+    Pad(&w, offsets[symtab] + 24);
+    for(int i = 0; i < symbol_count; i++) {
+        const ElfSymbol *s = &symbols[i];
+        Put(&w, symbol_names[i], 4);
+        Put(&w, (s->global ? 1 : 0) << 4 | s->type, 1);    // st_info: binding, type
+        Put(&w, 0, 1);                  // st_other: default visibility
+        Put(&w, s->section, 2);
+        Put(&w, s->value, 8);
+        Put(&w, s->size, 8);
+    }
+    fwrite(names, 1, names_size, w.out);
+    fwrite(section_names, 1, section_names_size, w.out);
+
+    Pad(&w, section_headers);
+    Pad(&w, section_headers + 64);      // the null section
+    for(int i = 0; i < count; i++) {
+        const ElfSection *s = &sections[i];
+        SectionHeader(&w, name_offsets[i + 1], s->type, s->flags, offsets[i + 1], s->size,
+                      0, 0, s->alignment, 0);
+    }
+    // SHT_RELA, SHF_INFO_LINK: the symbols are in symtab, sh_info is the section patched
+    for(int i = 1; i <= count; i++)
+        if(relocated[i])
+            SectionHeader(&w, name_offsets[relocated[i]], 4, 0x40, offsets[relocated[i]], sizes[relocated[i]],
+                          symtab, i, 8, 24);
+    SectionHeader(&w, name_offsets[symtab], 2, 0, offsets[symtab], symtab_size, strtab, first_global, 8, 24);
+    SectionHeader(&w, name_offsets[strtab], 3, 0, offsets[strtab], names_size, 0, 0, 1, 0);
+    SectionHeader(&w, name_offsets[shstrtab], 3, 0, offsets[shstrtab], section_names_size, 0, 0, 1, 0);
+
+    free(names);
+    free(section_names);
+    free(name_offsets);
+    free(symbol_names);
+    free(offsets);
+    free(sizes);
+    free(relocated);
+    fclose(w.out);
+    return file;
+}
@@ -0,0 +1,94 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// static ELF64 executables and relocatable objects, built in memory
+
+// e_machine
+#define ELF_MACHINE_MIPS 8
+#define ELF_MACHINE_X86_64 62
+
+// e_flags: MIPS64 (EF_MIPS_ARCH_64)
+#define ELF_FLAGS_MIPS64 0x60000000
+
+// segment permissions (p_flags)
+#define ELF_X 1
+#define ELF_W 2
+#define ELF_R 4
+
+#define ELF_PAGE_SIZE 0x1000
+// file header + program headers: where the first segment can start
+#define ELF_HEADERS_SIZE(segment_count) (64 + 56 * (segment_count))
+
+typedef struct {
+    const void *data;       // file contents, NULL for none
+    size_t size;
+    size_t memory_size;     // >= size, the rest is zero filled (bss)
+    uint64_t address;
+    int flags;              // ELF_R | ELF_W | ELF_X
+} ElfSegment;
+
+typedef struct {
+    int machine;            // ELF_MACHINE_*
+    uint32_t flags;         // e_flags
+    int big_endian;
+    uint64_t entry;
+} ElfHeader;
+
+// the file (malloc'd): the headers, then every segment at the first file
+// offset that's congruent to its address modulo the page size
+char *elf_executable(const ElfHeader *header, const ElfSegment *segments, int count, size_t *length);
+
+// an object's sections (sh_type, sh_flags)
+#define ELF_SECTION_PROGBITS 1
+#define ELF_SECTION_NOBITS 8
+#define ELF_SECTION_WRITE 1
+#define ELF_SECTION_ALLOC 2
+#define ELF_SECTION_EXEC 4
+
+// symbol types (STT_*)
+#define ELF_SYMBOL_NOTYPE 0
+#define ELF_SYMBOL_OBJECT 1
+#define ELF_SYMBOL_FUNC 2
+
+typedef struct {
+    const char *name;
+    int type;               // ELF_SECTION_PROGBITS/NOBITS
+    int flags;              // ELF_SECTION_*
+    const void *data;
+    size_t size;
+    size_t alignment;
+} ElfSection;
+
+typedef struct {
+    const char *name;
+    int section;            // 1 + the index into the sections, 0 = undefined
+    uint64_t value;         // offset into the section
+    uint64_t size;
+    int type;               // ELF_SYMBOL_*
+    int global;             // the locals have to come first
+} ElfSymbol;
+
+// relocation types
+#define ELF_RELOCATION_MIPS_16 1   // R_MIPS_16: the low 16 bits of the word
+#define ELF_RELOCATION_MIPS_HI16 5 // R_MIPS_HI16: %hi of the address
+#define ELF_RELOCATION_MIPS_LO16 6 // R_MIPS_LO16: %lo of the address
+
+typedef struct {
+    int section;            // 1 + the index of the section it patches
+    uint64_t offset;        // into that section
+    int symbol;             // index into the symbols
+    uint32_t type;          // ELF_RELOCATION_*
+    int64_t addend;
+} ElfRelocation;
+
+// a relocatable object (malloc'd) with the sections, a .rela section for
+// each one that has relocations, then .symtab, .strtab and .shstrtab made
+// from the symbols; header->entry is ignored
+char *elf_object(const ElfHeader *header, const ElfSection *sections, int count,
+                 const ElfSymbol *symbols, int symbol_count,
+                 const ElfRelocation *relocations, int relocation_count, size_t *length);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "emulator.h"
+
+static int Aligned(const Emulator *emu, uint64_t address) {
+    return address % 8 == 0 && address + 8 <= emu->memory_size;
+}
+
+int64_t emulator_load(const Emulator *emu, uint64_t address) {
+    if(!Aligned(emu, address))
+        return 0;
+    uint64_t value = 0;
+    for(int i = 0; i < 8; i++) {
+        int shift = emu->big_endian ? 56 - i * 8 : i * 8;
+        value |= (uint64_t)emu->memory[address + i] << shift;
+    }
+    return (int64_t)value;
+}
+
+static void Store(Emulator *emu, uint64_t address, int64_t value) {
+    for(int i = 0; i < 8; i++) {
+        int shift = emu->big_endian ? 56 - i * 8 : i * 8;
+        emu->memory[address + i] = (unsigned char)((uint64_t)value >> shift);
+    }
+}
+
+// the string at address, "" outside the data
+static const char *String(const Emulator *emu, int64_t address) {
+    if(address < 0 || (uint64_t)address >= emu->memory_size)
+        return "";
+    return (const char*)emu->memory + address;
+}
+
+// eduMIPS64's printf: block holds the format's address, then a doubleword
+// for every %d (or %i) and %s (a string's address) in it. returns the
+// number of characters printed
+static int64_t Printf(const Emulator *emu, uint64_t block, FILE *out) {
+    const char *format = String(emu, emulator_load(emu, block));
+    int64_t printed = 0;
+    for(const char *c = format; *c; c++) {
+        if(c[0] != '%' || c[1] == '\0') {
+            fputc(*c, out);
+            printed++;
+            continue;
+        }
+        c++;
+        if(*c == 'd' || *c == 'i') {
+            block += 8;
+            printed += fprintf(out, "%lld", (long long)emulator_load(emu, block));
+        } else if(*c == 's') {
+            block += 8;
+            const char *string = String(emu, emulator_load(emu, block));
+            fputs(string, out);
+            printed += (int64_t)strlen(string);
+        } else {
+            // "%%", or a conversion it doesn't know, as it is
+            if(*c != '%') {
+                fputc('%', out);
+                printed++;
+            }
+            fputc(*c, out);
+            printed++;
+        }
+    }
+    return printed;
+}
+
+static void Syscall(Emulator *emu, int code, FILE *out) {
+    int64_t r1 = emu->registers[1];
+    switch(code) {
+    case 1:
+        fprintf(out, "%lld", (long long)r1);
+        break;
+    case 4:
+        // an address outside the data prints nothing
+        fputs(String(emu, r1), out);
+        break;
+    case 5:
+        r1 = Printf(emu, (uint64_t)emu->registers[14], out);
+        emu->registers[1] = r1;
+        break;
+    case 11:
+        fputc((int)(r1 & 0xFF), out);
+        break;
+    }
+}
+
+int emulator_run(Emulator *emu, const MachineImage *image, FILE *out, long step_limit) {
+    memset(emu, 0, sizeof(*emu));
+    // with a '\0' after the data, so a string syscall can't run off the end
+    emu->memory_size = image->data_size;
+    emu->memory = calloc(image->data_size + 1, 1);
+    if(image->data_size > 0)
+        memcpy(emu->memory, image->data, image->data_size);
+    emu->big_endian = image->big_endian;
+
+    int64_t *r = emu->registers;
+    while(emu->pc < image->code_count) {
+        if(step_limit > 0 && emu->steps >= step_limit)
+            return emu->status = EMULATOR_STEP_LIMIT;
+
+        uint32_t code = image->code[emu->pc];
+        int opcode = code >> 26;
+        int rs = (code >> 21) & 0x1F;
+        int rt = (code >> 16) & 0x1F;
+        int rd = (code >> 11) & 0x1F;
+        int shamt = (code >> 6) & 0x1F;
+        int64_t imm = (int16_t)(code & 0xFFFF);
+        uint64_t address = (uint64_t)(r[rs] + imm);
+
+        // the arithmetic wraps, like the 64-bit registers do
+        switch(opcode) {
+        case OP_DADDIU:
+        case OP_DADDI:
+            r[rt] = (int64_t)((uint64_t)r[rs] + (uint64_t)imm);
+            break;
+        case OP_LUI:
+            r[rt] = (int64_t)(int32_t)((code & 0xFFFF) << 16);
+            break;
+        case OP_LD:
+            if(!Aligned(emu, address))
+                return emu->status = EMULATOR_BAD_ADDRESS;
+            r[rt] = emulator_load(emu, address);
+            break;
+        case OP_SD:
+            if(!Aligned(emu, address))
+                return emu->status = EMULATOR_BAD_ADDRESS;
+            Store(emu, address, r[rt]);
+            break;
+        case 0:
+            switch(code & 0x3F) {
+            case FUNCT_DADDU:
+            case FUNCT_DADD:
+                r[rd] = (int64_t)((uint64_t)r[rs] + (uint64_t)r[rt]);
+                break;
+            case FUNCT_DSUBU:
+                r[rd] = (int64_t)((uint64_t)r[rs] - (uint64_t)r[rt]);
+                break;
+            case FUNCT_DMULT: {
+                __int128 product = (__int128)r[rs] * r[rt];
+                emu->lo = (int64_t)(uint64_t)product;
+                emu->hi = (int64_t)(uint64_t)(product >> 64);
+                break;
+            }
+            case FUNCT_DDIV:
+                if(r[rt] == 0)
+                    return emu->status = EMULATOR_DIVISION_BY_ZERO;
+                if(r[rs] == INT64_MIN && r[rt] == -1) {
+                    emu->lo = INT64_MIN;
+                    emu->hi = 0;
+                } else {
+                    emu->lo = r[rs] / r[rt];
+                    emu->hi = r[rs] % r[rt];
+                }
+                break;
+            case FUNCT_MFLO:
+                r[rd] = emu->lo;
+                break;
+            case FUNCT_MFHI:
+                r[rd] = emu->hi;
+                break;
+            case FUNCT_SYSCALL:
+                Syscall(emu, shamt, out);
+                break;
+            default:
+                return emu->status = EMULATOR_BAD_INSTRUCTION;
+            }
+            break;
+        default:
+            return emu->status = EMULATOR_BAD_INSTRUCTION;
+        }
+        r[0] = 0;
+        emu->pc++;
+        emu->steps++;
+    }
+    return emu->status = EMULATOR_OK;
+}
+
+void emulator_free(Emulator *emu) {
+    free(emu->memory);
+    emu->memory = NULL;
+}
+
+const char *emulator_status_name(int status) {
+    static const char *names[] = { "ok", "bad instruction", "bad address", "division by zero", "step limit" };
+    return status >= 0 && status <= EMULATOR_STEP_LIMIT ? names[status] : "?";
+}
@@ -0,0 +1,45 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "machine_code.h"
+
+// runs assembled MIPS64 code (a MachineImage with collect_code) so the
+// generated code can be checked against the interpreter
+//
+// the code starts at its first instruction and stops after the last one.
+// memory is a copy of the data section at address 0, in the image's byte
+// order. the syscalls are the ones the code generator uses: 1 prints r1 as
+// an integer, 4 the string at address r1, 5 is printf (r14 is the address
+// of the format's address, followed by its arguments; the count printed
+// goes in r1), 11 the character in r1
+
+#define EMULATOR_OK 0
+#define EMULATOR_BAD_INSTRUCTION 1  // a word the disassembler doesn't know
+#define EMULATOR_BAD_ADDRESS 2      // a load/store outside the data or unaligned
+#define EMULATOR_DIVISION_BY_ZERO 3
+#define EMULATOR_STEP_LIMIT 4
+
+typedef struct {
+    int64_t registers[32];
+    int64_t hi, lo;
+    unsigned char *memory;      // the data section
+    size_t memory_size;
+    int big_endian;
+    size_t pc;                  // index of the next instruction (the failing one after an error)
+    long steps;
+    int status;                 // EMULATOR_*
+} Emulator;
+
+// run image with the program's output going to out; returns the status.
+// step_limit <= 0 means no limit
+int emulator_run(Emulator *emu, const MachineImage *image, FILE *out, long step_limit);
+// the doubleword at address (a variable's value); 0 outside the data
+int64_t emulator_load(const Emulator *emu, uint64_t address);
+void emulator_free(Emulator *emu);
+
+// "ok", "bad instruction", ...
+const char *emulator_status_name(int status);
+
+#endif
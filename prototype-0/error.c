@@ -3,6 +3,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+// NULL means stderr; per thread so pipeline stages can hold theirs back
+static _Thread_local FILE *diagnostics_stream = NULL;
+
 void error_state_init(ErrorState *state) {
     state->messages = NULL;
     state->message_count = 0;
@@ -94,6 +97,10 @@ const char* get_error_string(ErrorCode code) {
 }
 
 void print_messages(ErrorState *state) {
+    fprint_messages(stdout, state);
+}
+
+void fprint_messages(FILE *out, ErrorState *state) {
     for(int i = 0; i < state->message_count; i++) {
         CompilerMessage *msg = &state->messages[i];
         
@@ -118,20 +125,20 @@ void print_messages(ErrorState *state) {
         
         if(msg->line > 0) {
             if(msg->column > 0) {
-                printf("%s%s:%s %s at line %d, column %d", 
+                fprintf(out, "%s%s:%s %s at line %d, column %d", 
                        color_code, type_str, reset_code, msg->message, msg->line, msg->column);
             } else {
-                printf("%s%s:%s %s at line %d", 
+                fprintf(out, "%s%s:%s %s at line %d", 
                        color_code, type_str, reset_code, msg->message, msg->line);
             }
         } else {
-            printf("%s%s:%s %s", color_code, type_str, reset_code, msg->message);
+            fprintf(out, "%s%s:%s %s", color_code, type_str, reset_code, msg->message);
         }
         
         if(msg->details) {
-            printf(" (%s)", msg->details);
+            fprintf(out, " (%s)", msg->details);
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
 }
 
@@ -179,4 +186,12 @@ void report_redeclared_variable(ErrorState *state, int line, int column, const c
 
 void report_uninitialized_variable(ErrorState *state, int line, int column, const char *var_name) {
     add_warning(state, ERR_UNINITIALIZED_VARIABLE, line, column, var_name);
+}
+
+FILE* get_diagnostics_stream(void) {
+    return diagnostics_stream ? diagnostics_stream : stderr;
+}
+
+void set_diagnostics_stream(FILE *out) {
+    diagnostics_stream = out;
 }
\ No newline at end of file
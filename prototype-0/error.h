@@ -2,6 +2,7 @@
 #define ERROR_H
 
 #include <stdbool.h>
+#include <stdio.h>
 
 typedef enum {
     ERR_NONE = 0,
@@ -55,6 +56,7 @@ void add_info(ErrorState *state, ErrorCode code, int line, int column, const cha
 // utility functions
 const char* get_error_string(ErrorCode code);
 void print_messages(ErrorState *state);
+void fprint_messages(FILE *out, ErrorState *state);
 void clear_messages(ErrorState *state);
 bool has_errors(ErrorState *state);
 int get_error_count(ErrorState *state);
@@ -66,4 +68,9 @@ void report_undeclared_variable(ErrorState *state, int line, int column, const c
 void report_redeclared_variable(ErrorState *state, int line, int column, const char *var_name);
 void report_uninitialized_variable(ErrorState *state, int line, int column, const char *var_name);
 
+// where lexer/parser/semantic diagnostics are written (stderr unless redirected,
+// e.g. by the driver when it captures a compilation into memory); set per thread
+FILE* get_diagnostics_stream(void);
+void set_diagnostics_stream(FILE *out);
+
 #endif
\ No newline at end of file
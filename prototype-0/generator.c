@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "generator.h"
+
+// an expression that fails its checks is made again, up to this many times,
+// before a plain number is used instead
+#define EXPRESSION_TRIES 16
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Text;
+
+typedef struct {
+    const GeneratorOptions *options;
+    uint64_t random;
+    int64_t *values;
+    int *assigned;      // the variables with a value, in no order
+    int assigned_count;
+    char *has_value;
+    int declared;       // v0 .. v(declared - 1)
+    int variables;      // at least 1
+} Generator;
+
+void generator_defaults(GeneratorOptions *options) {
+    options->lines = 20;
+    options->variables = 6;
+    options->depth = 3;
+    options->strings = 6;
+    options->print_percent = 30;
+    options->overflow = 0;
+    options->seed = 1;
+}
+
+static uint64_t Next(Generator *g) {
+    // xorshift64*
+    g->random ^= g->random >> 12;
+    g->random ^= g->random << 25;
+    g->random ^= g->random >> 27;
+    return g->random * 0x2545F4914F6CDD1DULL;
+}
+
+static void Append(Text *t, const char *text) {
+    size_t length = strlen(text);
+    if(t->length + length + 1 > t->capacity) {
+        t->capacity = (t->length + length + 1) * 2;
+        t->data = realloc(t->data, t->capacity);
+    }
+    memcpy(t->data + t->length, text, length + 1);
+    t->length += length;
+}
+
+static int Fits(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// what a value is after 32-bit arithmetic: the low 32 bits, signed
+static int64_t Wrap(int64_t value) {
+    return (int32_t)(uint32_t)value;
+}
+
+// a value as the program has it; 0 if it doesn't have one (left 32 bits)
+static int Result(Generator *g, int64_t *value) {
+    if(g->options->overflow) {
+        *value = Wrap(*value);
+        return 1;
+    }
+    return Fits(*value);
+}
+
+// a number or a variable with a value
+static int Leaf(Generator *g, Text *t, int64_t *value) {
+    char text[32];
+    if(g->assigned_count > 0 && Next(g) % 2 == 0) {
+        int v = g->assigned[Next(g) % g->assigned_count];
+        snprintf(text, sizeof(text), "v%d", v);
+        *value = g->values[v];
+    } else if(g->options->overflow && Next(g) % 8 == 0) {
+        // around the edges of 32 bits, and numbers whose products leave them
+        static const int64_t big[] = { 2147483647, 2147483646, 1073741824, 65536, 46341, 1000003 };
+        *value = big[Next(g) % (sizeof(big) / sizeof(big[0]))];
+        snprintf(text, sizeof(text), "%lld", (long long)*value);
+    } else {
+        *value = Next(g) % 100;
+        snprintf(text, sizeof(text), "%lld", (long long)*value);
+    }
+    Append(t, text);
+    return 1;
+}
+
+static int Compound(Generator *g, int depth, Text *t, int64_t *value);
+
+// an operand of an operator, in parentheses unless it's a leaf
+static int Operand(Generator *g, int depth, Text *t, int64_t *value) {
+    if(depth == 0 || Next(g) % 100 < 30)
+        return Leaf(g, t, value);
+    Append(t, "(");
+    int ok = Compound(g, depth, t, value);
+    Append(t, ")");
+    return ok;
+}
+
+// a negation or a binary operation; 0 if it divides by zero or (without
+// overflow) leaves 32 bits
+static int Compound(Generator *g, int depth, Text *t, int64_t *value) {
+    int64_t left, right;
+    if(Next(g) % 10 == 0) {
+        Append(t, "-");
+        int ok = Operand(g, depth - 1, t, &right);
+        *value = -right;
+        return ok && Result(g, value);
+    }
+
+    static const char *operators[] = { " + ", " - ", " * ", " / " };
+    int op = Next(g) % 4;
+    int ok = Operand(g, depth - 1, t, &left);
+    Append(t, operators[op]);
+    ok = Operand(g, depth - 1, t, &right) && ok;
+    if(!ok)
+        return 0;
+    switch(op) {
+    case 0: *value = left + right; break;
+    case 1: *value = left - right; break;
+    case 2: *value = left * right; break;
+    case 3:
+        if(right == 0)
+            return 0;
+        // INT32_MIN / -1 leaves 32 bits, and wraps back to INT32_MIN
+        *value = left / right;
+        break;
+    }
+    return Result(g, value);
+}
+
+static void Expression(Generator *g, Text *t, int64_t *value) {
+    size_t start = t->length;
+    for(int i = 0; i < EXPRESSION_TRIES; i++) {
+        t->length = start;
+        int depth = g->options->depth;
+        if(depth == 0 || Next(g) % 100 < 20 ? Leaf(g, t, value) : Compound(g, depth, t, value))
+            return;
+    }
+    t->length = start;
+    Leaf(g, t, value);
+}
+
+static void Assign(Generator *g, int v, int64_t value) {
+    if(!g->has_value[v]) {
+        g->has_value[v] = 1;
+        g->assigned[g->assigned_count++] = v;
+    }
+    g->values[v] = value;
+}
+
+// the text of string literal i: some end in a newline, some don't, and
+// some are the tail of another one (which the string pool shares)
+static void StringLiteral(int i, Text *t) {
+    char text[32];
+    switch(i % 3) {
+    case 0: snprintf(text, sizeof(text), "\"line %d\\n\"", i); break;
+    case 1: snprintf(text, sizeof(text), "\"s%d = \"", i); break;
+    default:
+        if(i % 6 == 5)
+            snprintf(text, sizeof(text), "\"e %d\\n\"", i - 5);
+        else
+            snprintf(text, sizeof(text), "\" and %d \"", i);
+        break;
+    }
+    Append(t, text);
+}
+
+static void Statement(Generator *g, Text *t) {
+    const GeneratorOptions *options = g->options;
+    int64_t value;
+    char text[64];
+    t->length = 0;
+    Append(t, "    ");
+
+    if((int)(Next(g) % 100) < options->print_percent) {
+        Append(t, "p: ");
+        int parts = 1 + Next(g) % 3;
+        for(int i = 0; i < parts; i++) {
+            if(i > 0)
+                Append(t, ", ");
+            if(options->strings > 0 && Next(g) % 100 < 40)
+                StringLiteral(Next(g) % options->strings, t);
+            else
+                Expression(g, t, &value);
+        }
+    } else if(g->declared < g->variables && (g->declared == 0 || g->assigned_count == 0 || Next(g) % 4 == 0)) {
+        int v = g->declared++;
+        snprintf(text, sizeof(text), "int v%d", v);
+        Append(t, text);
+        if(Next(g) % 100 < 70) {
+            Append(t, " = ");
+            Expression(g, t, &value);
+            Assign(g, v, value);
+        }
+    } else {
+        int v = Next(g) % g->declared;
+        snprintf(text, sizeof(text), "v%d = ", v);
+        Append(t, text);
+        Expression(g, t, &value);
+        Assign(g, v, value);
+    }
+    Append(t, "\n");
+}
+
+void generate_program(const GeneratorOptions *options, FILE *out) {
+    Generator g;
+    memset(&g, 0, sizeof(g));
+    g.options = options;
+    // spread out neighbouring seeds (and never 0, which xorshift can't leave)
+    g.random = ((options->seed + 1) * 0x9E3779B97F4A7C15ULL) | 1;
+    g.variables = options->variables > 0 ? options->variables : 1;
+    g.values = calloc(g.variables, sizeof(int64_t));
+    g.assigned = calloc(g.variables, sizeof(int));
+    g.has_value = calloc(g.variables, 1);
+
+    Text line = { NULL, 0, 0 };
+    fputs(">>>\n", out);
+    for(long i = 0; i < options->lines; i++) {
+        Statement(&g, &line);
+        fwrite(line.data, 1, line.length, out);
+    }
+    fputs("<<<", out);
+
+    free(line.data);
+    free(g.values);
+    free(g.assigned);
+    free(g.has_value);
+}
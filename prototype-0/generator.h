@@ -0,0 +1,30 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// random p0 programs that are well defined: every variable (v0, v1, ...) is
+// declared once and only read after it has a value, nothing divides by zero
+// and every value, the intermediate ones too, fits in 32 bits. so the
+// interpreter and any back end have to agree on what one does. with
+// overflow the values wrap at 32 bits instead, and some of the numbers are
+// big ones, which only the back ends with 32-bit arithmetic (the x86-64
+// ones) compute the way the interpreter does
+typedef struct {
+    long lines;           // statements
+    int variables;        // how many distinct variables
+    int depth;            // of the expressions (0 = a number or a variable)
+    int strings;          // distinct string literals in the prints
+    int print_percent;    // of the statements that are prints
+    int overflow;         // wrap at 32 bits rather than stay in them
+    uint64_t seed;
+} GeneratorOptions;
+
+void generator_defaults(GeneratorOptions *options);
+
+// the whole program, ">>>" to "<<<" (with no newline after it, which the
+// grammar doesn't take), written to out
+void generate_program(const GeneratorOptions *options, FILE *out);
+
+#endif
@@ -0,0 +1,94 @@
+#include <string.h>
+#include "hash.h"
+
+// XXH64 by Yann Collet, written out for our use (only the one-shot form)
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t RotateLeft(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// unaligned little-endian reads (x86-64 and the usual ARM hosts)
+static inline uint64_t Read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t Read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t Round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = RotateLeft(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+    acc ^= Round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash64(const void *data, size_t length, uint64_t seed) {
+    const uint8_t *p = data;
+    const uint8_t *end = p + length;
+    uint64_t h;
+
+    if(length >= 32) {
+        // 4 independent lanes of 8 bytes each
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while(p <= limit);
+
+        h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        h = MergeRound(h, v1);
+        h = MergeRound(h, v2);
+        h = MergeRound(h, v3);
+        h = MergeRound(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+
+    h += (uint64_t)length;
+
+    // tail: 8 bytes, then 4, then single bytes
+    while(p + 8 <= end) {
+        h ^= Round(0, Read64(p));
+        h = RotateLeft(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if(p + 4 <= end) {
+        h ^= (uint64_t)Read32(p) * PRIME64_1;
+        h = RotateLeft(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while(p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = RotateLeft(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
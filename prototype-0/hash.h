@@ -0,0 +1,10 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit xxHash (XXH64) of a byte buffer
+uint64_t hash64(const void *data, size_t length, uint64_t seed);
+
+#endif
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "incremental.h"
+#include "assembly.h"
+#include "symbol_table.h"
+#include "error.h"
+#include "hash.h"
+#include "machine_code.h"
+
+#define INITIAL_BUCKETS 256
+
+void free_node(Node *node);
+
+// one source line of a previous compilation
+typedef struct Fragment {
+    char *text;
+    size_t length;
+    uint64_t hash;
+    int line;                 // line number stored in the AST nodes
+    Node *statement;          // NULL for blank and comment-only lines
+    SemFact *facts;           // declares/uses checked while parsing, in order
+    int fact_count;
+    int reusable;             // parsed cleanly with no diagnostics
+
+    // generated code, valid for one binding signature
+    uint64_t signature;
+    int has_code;
+    char *code;
+    size_t code_length;
+    int has_machine;
+    uint64_t machine_labels;  // hash of the .data section it was encoded against
+    char *machine;
+    size_t machine_length;
+
+    int used;                 // claimed by the compilation in progress
+    struct Fragment *chain;   // same hash bucket
+} Fragment;
+
+struct IncrementalState {
+    Fragment **buckets;
+    size_t bucket_count;
+    IncrementalStats stats;
+};
+
+// a line of the incoming source
+typedef struct {
+    const char *text;
+    size_t length;
+} SourceLine;
+
+IncrementalState *incremental_create(void) {
+    IncrementalState *state = calloc(1, sizeof(IncrementalState));
+    state->bucket_count = INITIAL_BUCKETS;
+    state->buckets = calloc(state->bucket_count, sizeof(Fragment*));
+    return state;
+}
+
+static void FreeFragment(Fragment *frag) {
+    if(frag->statement) {
+        frag->statement->list.next = NULL;  // don't free the rest of the program
+        free_node(frag->statement);
+    }
+    sem_free_facts(frag->facts, frag->fact_count);
+    free(frag->text);
+    free(frag->code);
+    free(frag->machine);
+    free(frag);
+}
+
+static void FreeTable(Fragment **buckets, size_t bucket_count) {
+    for(size_t i = 0; i < bucket_count; i++) {
+        Fragment *frag = buckets[i];
+        while(frag) {
+            Fragment *next = frag->chain;
+            FreeFragment(frag);
+            frag = next;
+        }
+    }
+    free(buckets);
+}
+
+void incremental_destroy(IncrementalState *state) {
+    if(!state)
+        return;
+    FreeTable(state->buckets, state->bucket_count);
+    free(state);
+}
+
+const IncrementalStats *incremental_get_stats(IncrementalState *state) {
+    return &state->stats;
+}
+
+void incremental_print_stats(IncrementalState *state, FILE *out) {
+    const IncrementalStats *s = &state->stats;
+    fprintf(out, "incremental: full_compiles=%lu lines_parsed=%lu lines_reused=%lu statements_emitted=%lu statements_kept=%lu\n",
+            s->full_compiles, s->lines_parsed, s->lines_reused, s->statements_emitted, s->statements_kept);
+}
+
+///// source shape
+
+static int TrimmedEquals(const char *text, size_t length, const char *word) {
+    while(length > 0 && (*text == ' ' || *text == '\t' || *text == '\r' || *text == '\f')) {
+        text++;
+        length--;
+    }
+    while(length > 0 && (text[length-1] == ' ' || text[length-1] == '\t' ||
+                         text[length-1] == '\r' || text[length-1] == '\f'))
+        length--;
+    return length == strlen(word) && memcmp(text, word, length) == 0;
+}
+
+static int Contains(const char *text, size_t length, const char *word) {
+    size_t n = strlen(word);
+    for(size_t i = 0; i + n <= length; i++) {
+        if(memcmp(text + i, word, n) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// split into lines; only ">>>" alone on the first line, "<<<" alone on the last
+// line and neither anywhere in between is handled line by line
+static SourceLine *SplitProgram(const char *source, size_t length, int *count) {
+    int capacity = 64;
+    int n = 0;
+    SourceLine *lines = malloc(sizeof(SourceLine) * capacity);
+
+    size_t start = 0;
+    for(size_t i = 0; i <= length; i++) {
+        if(i == length || source[i] == '\n') {
+            if(n == capacity) {
+                capacity *= 2;
+                lines = realloc(lines, sizeof(SourceLine) * capacity);
+            }
+            lines[n].text = source + start;
+            lines[n].length = i - start;
+            n++;
+            start = i + 1;
+        }
+    }
+
+    int ok = n >= 2 &&
+             TrimmedEquals(lines[0].text, lines[0].length, ">>>") &&
+             TrimmedEquals(lines[n-1].text, lines[n-1].length, "<<<");
+    for(int i = 1; ok && i < n - 1; i++) {
+        if(Contains(lines[i].text, lines[i].length, ">>>") || Contains(lines[i].text, lines[i].length, "<<<"))
+            ok = 0;
+    }
+
+    if(!ok) {
+        free(lines);
+        return NULL;
+    }
+    *count = n;
+    return lines;
+}
+
+///// walking a statement
+
+typedef void (*NodeVisitor)(Node *node, void *data);
+
+static void VisitExpression(Node *node, NodeVisitor visit, void *data) {
+    if(!node)
+        return;
+    visit(node, data);
+    if(node->node_type == 3) {
+        VisitExpression(node->binop.left, visit, data);
+        VisitExpression(node->binop.right, visit, data);
+    } else if(node->node_type == NODE_PRINT_PART) {
+        VisitExpression(node->list.items, visit, data);
+    }
+}
+
+// every node of one statement, in the order codegen looks at them
+static void VisitStatement(Node *statement, NodeVisitor visit, void *data) {
+    visit(statement, data);
+    switch(statement->node_type) {
+        case 4: // NODE_DECL
+        case 5: // NODE_ASSIGN
+            for(Node *item = statement->list.items; item; item = item->list.next)
+                VisitExpression(item, visit, data);
+            break;
+        case 6: // NODE_PRINT
+            for(Node *part = statement->print_stmt.parts; part; part = part->list.next)
+                VisitExpression(part, visit, data);
+            break;
+    }
+}
+
+static void SetLine(Node *node, void *data) {
+    // print parts never carried a line number, leave them at 0
+    if(node->line_number != 0)
+        node->line_number = *(int*)data;
+}
+
+static void MixBinding(Node *node, void *data) {
+    uint64_t *sig = data;
+    uint64_t parts[3] = { *sig, 0, 0 };
+    if(node->node_type == 2) {
+        parts[1] = hash64(node->str_val, strlen(node->str_val), 0);
+        parts[2] = GetOffsetOfTheSymbol(node->str_val);
+    } else {
+        return;
+    }
+    *sig = hash64(parts, sizeof(parts), 0);
+}
+
+// variables, memory offsets and string labels a statement's code refers to;
+// the same text with the same signature generates the same code
+static uint64_t BindingSignature(Node *statement) {
+    uint64_t sig = AssemblyStatementBindings(statement);
+    VisitStatement(statement, MixBinding, &sig);
+    return sig;
+}
+
+///// fragments
+
+static Fragment *FindReusable(IncrementalState *state, const SourceLine *line, uint64_t hash) {
+    Fragment *frag = state->buckets[hash & (state->bucket_count - 1)];
+    for(; frag; frag = frag->chain) {
+        if(!frag->used && frag->reusable && frag->hash == hash && frag->length == line->length &&
+           memcmp(frag->text, line->text, line->length) == 0)
+            return frag;
+    }
+    return NULL;
+}
+
+// replay the declares/uses of a fragment against the current symbols;
+// a use that is no longer declared means the line has to be parsed again
+// (which also produces the error message)
+static int ReplayFacts(Fragment *frag) {
+    for(int i = 0; i < frag->fact_count; i++) {
+        if(frag->facts[i].kind == FACT_USE) {
+            if(!sem_is_duplicate(&sem_analyzer, frag->facts[i].name))
+                return 0;
+        } else {
+            sem_add_symbol(&sem_analyzer, frag->facts[i].name);
+        }
+    }
+    return 1;
+}
+
+// parse a single line as if it were at line number `line` of the program
+static Fragment *ParseLine(const SourceLine *src, uint64_t hash, int line, FILE *diag, int *parse_result) {
+    // ">>>\n" first so the line's tokens start on a fresh line (column 1)
+    size_t length = src->length + 8;
+    char *text = malloc(length + 1);
+    memcpy(text, ">>>\n", 4);
+    memcpy(text + 4, src->text, src->length);
+    memcpy(text + 4 + src->length, "\n<<<", 4);
+
+    fflush(diag);
+    long diag_before = ftell(diag);
+    int errors_before = sem_get_error_count(&sem_analyzer);
+
+    ast_root = NULL;
+    sem_set_line(&sem_analyzer, line - 1);
+    sem_record_facts(&sem_analyzer, true);
+    *parse_result = parse_text(text, length, line - 1);
+    sem_record_facts(&sem_analyzer, false);
+    free(text);
+
+    fflush(diag);
+    Fragment *frag = calloc(1, sizeof(Fragment));
+    frag->text = malloc(src->length + 1);
+    memcpy(frag->text, src->text, src->length);
+    frag->length = src->length;
+    frag->hash = hash;
+    frag->line = line;
+    frag->statement = (*parse_result == 0) ? ast_root : NULL;
+    frag->facts = sem_take_facts(&sem_analyzer, &frag->fact_count);
+    frag->reusable = *parse_result == 0 && errors_before == 0 &&
+                     sem_get_error_count(&sem_analyzer) == 0 && ftell(diag) == diag_before;
+    frag->used = 1;
+    ast_root = NULL;
+    return frag;
+}
+
+static void SetCode(Fragment *frag, uint64_t signature) {
+    free(frag->code);
+    free(frag->machine);
+    frag->code = NULL;
+    frag->machine = NULL;
+    frag->has_machine = 0;
+
+    FILE *out = open_memstream(&frag->code, &frag->code_length);
+    GenerateAssemblyNode(frag->statement, out);
+    fclose(out);
+    frag->signature = signature;
+    frag->has_code = 1;
+}
+
+// the addresses of the labels are the data section's, so the encoding
+// holds for as long as that doesn't change
+static void SetMachine(Fragment *frag, MachineImage *labels, uint64_t labels_hash) {
+    free(frag->machine);
+    FILE *out = open_memstream(&frag->machine, &frag->machine_length);
+    if(frag->code_length > 0) {
+        FILE *in = fmemopen(frag->code, frag->code_length, "r");
+        MachineEncode(labels, in, out);
+        MachineResolveFixups(labels, NULL, 0);
+        fclose(in);
+    }
+    fclose(out);
+    frag->has_machine = 1;
+    frag->machine_labels = labels_hash;
+}
+
+// codegen for the spliced program, reusing every statement whose bindings didn't change
+static void GenerateCode(IncrementalState *state, Fragment **frags, int count, const char *source,
+                         size_t length, const CompilerOptions *opts, CompileResult *result) {
+    int statements = 0;
+    for(int i = 0; i < count; i++)
+        if(frags[i]->statement)
+            statements++;
+    // an empty program has no .data/.code at all
+    if(statements == 0) {
+        if(opts->stages & STAGE_MC)
+            result->sections[RESULT_MACHINE] = encode_machine("", 0, source, length, opts, &result->lengths[RESULT_MACHINE]);
+        if(opts->stages & STAGE_ASM)
+            result->sections[RESULT_ASSEMBLY] = calloc(1, 1);
+        return;
+    }
+
+    AssemblyBegin();
+    for(int i = 0; i < count; i++)
+        AssemblyCollectStatement(frags[i]->statement);
+
+    FILE *asm_out = open_memstream(&result->sections[RESULT_ASSEMBLY], &result->lengths[RESULT_ASSEMBLY]);
+    FILE *mc_out = NULL;
+    AssemblyWriteData(asm_out);
+    fflush(asm_out);
+    // the binary and annotated formats are built from the whole assembly at the end
+    MachineImage labels;
+    uint64_t labels_hash = 0;
+    if((opts->stages & STAGE_MC) && opts->mc_format == MC_FORMAT_LISTING) {
+        // pass 1 of the assembler over the data section
+        MachineImageInit(&labels, 1);
+        FILE *in = fmemopen(result->sections[RESULT_ASSEMBLY], result->lengths[RESULT_ASSEMBLY], "r");
+        MachineDefineLabels(&labels, in);
+        fclose(in);
+        labels_hash = hash64(result->sections[RESULT_ASSEMBLY], result->lengths[RESULT_ASSEMBLY], 0);
+        mc_out = open_memstream(&result->sections[RESULT_MACHINE], &result->lengths[RESULT_MACHINE]);
+    }
+
+    for(int i = 0; i < count; i++) {
+        Fragment *frag = frags[i];
+        if(!frag->statement)
+            continue;
+
+        uint64_t signature = BindingSignature(frag->statement);
+        if(frag->has_code && frag->signature == signature) {
+            state->stats.statements_kept++;
+        } else {
+            SetCode(frag, signature);
+            state->stats.statements_emitted++;
+        }
+        // a line is one statement, so every fragment gets a marker
+        if(opts->mc_format == MC_FORMAT_ANNOTATED)
+            AssemblyWriteLineMarker(frag->statement, asm_out);
+        fwrite(frag->code, 1, frag->code_length, asm_out);
+
+        if(mc_out) {
+            if(!frag->has_machine || frag->machine_labels != labels_hash)
+                SetMachine(frag, &labels, labels_hash);
+            fwrite(frag->machine, 1, frag->machine_length, mc_out);
+        }
+    }
+
+    AssemblyEnd();
+    if(mc_out) {
+        fclose(mc_out);
+        FreeMachineImage(&labels);
+    }
+    fclose(asm_out);
+    if((opts->stages & STAGE_MC) && opts->mc_format != MC_FORMAT_LISTING)
+        result->sections[RESULT_MACHINE] = encode_machine(result->sections[RESULT_ASSEMBLY], result->lengths[RESULT_ASSEMBLY],
+                                                          source, length, opts, &result->lengths[RESULT_MACHINE]);
+
+    if(!(opts->stages & STAGE_ASM)) {
+        free(result->sections[RESULT_ASSEMBLY]);
+        result->sections[RESULT_ASSEMBLY] = NULL;
+        result->lengths[RESULT_ASSEMBLY] = 0;
+    }
+}
+
+// keep this compilation's fragments (and, if it stopped early, the old
+// ones it never got to) for the next request
+static void ReplaceTable(IncrementalState *state, Fragment **frags, int count, int keep_unused) {
+    Fragment **old = state->buckets;
+    size_t old_count = state->bucket_count;
+
+    size_t buckets = INITIAL_BUCKETS;
+    while(buckets < (size_t)count)
+        buckets *= 2;
+    state->bucket_count = buckets;
+    state->buckets = calloc(buckets, sizeof(Fragment*));
+
+    for(size_t i = 0; i < old_count; i++) {
+        Fragment *frag = old[i];
+        while(frag) {
+            Fragment *next = frag->chain;
+            if(frag->used) {
+                // moved over below
+            } else if(keep_unused) {
+                size_t b = frag->hash & (buckets - 1);
+                frag->chain = state->buckets[b];
+                state->buckets[b] = frag;
+            } else {
+                FreeFragment(frag);
+            }
+            frag = next;
+        }
+    }
+    free(old);
+
+    for(int i = 0; i < count; i++) {
+        Fragment *frag = frags[i];
+        frag->used = 0;
+        if(frag->statement)
+            frag->statement->list.next = NULL;
+        size_t b = frag->hash & (buckets - 1);
+        frag->chain = state->buckets[b];
+        state->buckets[b] = frag;
+    }
+}
+
+void incremental_compile(IncrementalState *state, const char *source, size_t length,
+                         const CompilerOptions *opts, CompileResult *result) {
+    int line_count;
+    SourceLine *lines = SplitProgram(source, length, &line_count);
+    if(!lines) {
+        state->stats.full_compiles++;
+        compile_source(source, length, opts, result);
+        return;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->storage = RESULT_OWNED;
+
+    FILE *out = open_memstream(&result->sections[RESULT_OUTPUT], &result->lengths[RESULT_OUTPUT]);
+    FILE *diag = open_memstream(&result->sections[RESULT_DIAGNOSTICS], &result->lengths[RESULT_DIAGNOSTICS]);
+    set_diagnostics_stream(diag);
+
+    sem_init(&sem_analyzer);
+    ast_root = NULL;
+
+    // front end, line by line (line 1 is ">>>")
+    int count = 0;
+    Fragment **frags = malloc(sizeof(Fragment*) * line_count);
+    int parse_result = 0;
+
+    for(int i = 1; i < line_count - 1 && parse_result == 0; i++) {
+        int line = i + 1;
+        uint64_t hash = hash64(lines[i].text, lines[i].length, 0);
+        Fragment *frag = NULL;
+
+        if(sem_get_error_count(&sem_analyzer) == 0) {
+            frag = FindReusable(state, &lines[i], hash);
+            if(frag && !ReplayFacts(frag))
+                frag = NULL;
+        }
+
+        if(frag) {
+            frag->used = 1;
+            if(frag->line != line) {
+                if(frag->statement)
+                    VisitStatement(frag->statement, SetLine, &line);
+                frag->line = line;
+            }
+            state->stats.lines_reused++;
+        } else {
+            frag = ParseLine(&lines[i], hash, line, diag, &parse_result);
+            state->stats.lines_parsed++;
+        }
+        frags[count++] = frag;
+    }
+
+    if(parse_result == 0 && sem_get_error_count(&sem_analyzer) == 0) {
+        // link the statements into one program again
+        Node *head = NULL;
+        Node *tail = NULL;
+        for(int i = 0; i < count; i++) {
+            Node *statement = frags[i]->statement;
+            if(!statement)
+                continue;
+            statement->list.next = NULL;
+            if(tail)
+                tail->list.next = statement;
+            else
+                head = statement;
+            tail = statement;
+        }
+
+        if(opts->stages & (STAGE_ASM | STAGE_MC))
+            GenerateCode(state, frags, count, source, length, opts, result);
+        if(opts->stages & STAGE_RUN)
+            run_program(head, opts, out);
+    } else {
+        // semantic/parsing error - don't execute at all
+        fprintf(out, "Compilation failed\n");
+        result->status = 1;
+    }
+
+    ReplaceTable(state, frags, count, result->status != 0);
+    free(frags);
+    free(lines);
+
+    sem_cleanup(&sem_analyzer);
+    set_diagnostics_stream(NULL);
+    fclose(diag);
+    fclose(out);
+}
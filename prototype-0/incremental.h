@@ -0,0 +1,48 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdio.h>
+#include "driver.h"
+#include "options.h"
+
+// statement-level incremental compilation for the daemon
+//
+// p0 is one statement per line, so every line between ">>>" and "<<<" is
+// kept as a fragment of the previous compilation: its text, AST, the
+// semantic facts it checked (declares/uses, in order) and the assembly +
+// machine code it produced. on the next request a line whose text is
+// unchanged and whose facts still hold against the incoming symbols is
+// not lexed, parsed or checked again, and its code is reused as long as
+// the registers/offsets/labels it refers to are the same.
+// programs of any other shape just get a full compile.
+//
+// what's skipped is the lexing, parsing and checking of the unchanged
+// lines and their codegen and encoding. a request still costs time in
+// the size of the whole program, not of the lines that changed: every
+// line is hashed and every reused line's facts are replayed, the .data
+// section is collected from all the statements again, --run interprets
+// the whole program from the start, and the answer is the whole
+// program's assembly and machine code. nothing tracks which lines depend
+// on a changed one; a line is checked again only if its text changed or
+// a fact of its no longer holds
+typedef struct {
+    unsigned long full_compiles;
+    unsigned long lines_parsed;
+    unsigned long lines_reused;
+    unsigned long statements_emitted;   // code generated again
+    unsigned long statements_kept;      // code reused
+} IncrementalStats;
+
+typedef struct IncrementalState IncrementalState;
+
+IncrementalState *incremental_create(void);
+void incremental_destroy(IncrementalState *state);
+
+// same result as compile_source, using (and replacing) the fragments kept in state
+void incremental_compile(IncrementalState *state, const char *source, size_t length,
+                         const CompilerOptions *opts, CompileResult *result);
+
+const IncrementalStats *incremental_get_stats(IncrementalState *state);
+void incremental_print_stats(IncrementalState *state, FILE *out);
+
+#endif
@@ -3,12 +3,12 @@
 #include <string.h>
 #include <stdbool.h>
 #include "interpreter.h"
+#include "trace.h"
+#include "hash.h"
+#include "value_number.h"
 
 #define NODE_PRINT_PART 7
 
-// global flag to stop execution
-static bool execution_stopped = false;
-
 //static void debug_print_ast(Node *node, int depth);
 
 typedef struct Variable {
@@ -21,19 +21,43 @@ struct InterpreterState {
     Variable *vars;
     int var_count;
     int var_capacity;
+    // indices into vars hashed by name, -1 = empty; at most half full
+    int *buckets;
+    size_t bucket_count;
     OutputCapture *output;
+    ErrorState *err;
+    bool stopped;   // set at the first error, nothing runs after it
+
+    // with interpreter_reuse_values: the value of every number computed so
+    // far, for the operations that compute it again
+    ValueNumbering *numbering;
+    int *values;
+    char *known;
+    int value_capacity;
 };
 
 // helper functions
 static Variable* find_variable(InterpreterState *state, const char *name) {
-    for(int i = 0; i < state->var_count; i++) {
-        if(strcmp(state->vars[i].name, name) == 0) {
-            return &state->vars[i];
-        }
+    if(state->bucket_count == 0)
+        return NULL;
+    size_t mask = state->bucket_count - 1;
+    size_t i = hash64(name, strlen(name), 0) & mask;
+    while(state->buckets[i] >= 0) {
+        if(strcmp(state->vars[state->buckets[i]].name, name) == 0)
+            return &state->vars[state->buckets[i]];
+        i = (i + 1) & mask;
     }
     return NULL;
 }
 
+static void index_variable(InterpreterState *state, int index) {
+    size_t mask = state->bucket_count - 1;
+    size_t i = hash64(state->vars[index].name, strlen(state->vars[index].name), 0) & mask;
+    while(state->buckets[i] >= 0)
+        i = (i + 1) & mask;
+    state->buckets[i] = index;
+}
+
 static Variable* add_variable(InterpreterState *state, const char *name) {
     if(state->var_count >= state->var_capacity) {
         state->var_capacity = state->var_capacity ? state->var_capacity * 2 : 10;
@@ -44,6 +68,17 @@ static Variable* add_variable(InterpreterState *state, const char *name) {
     var->name = strdup(name);
     var->value = 0;
     var->initialized = 0;
+
+    if((size_t)state->var_count * 2 > state->bucket_count) {
+        free(state->buckets);
+        state->bucket_count = state->bucket_count ? state->bucket_count * 2 : 64;
+        state->buckets = malloc(sizeof(int) * state->bucket_count);
+        memset(state->buckets, 0xff, sizeof(int) * state->bucket_count);
+        for(int i = 0; i < state->var_count; i++)
+            index_variable(state, i);
+    } else {
+        index_variable(state, state->var_count - 1);
+    }
     return var;
 }
 
@@ -51,6 +86,13 @@ static InterpreterState* create_state() {
     InterpreterState *state = malloc(sizeof(InterpreterState));
     state->var_capacity = 10;
     state->var_count = 0;
+    state->stopped = false;
+    state->buckets = NULL;
+    state->bucket_count = 0;
+    state->numbering = NULL;
+    state->values = NULL;
+    state->known = NULL;
+    state->value_capacity = 0;
     state->vars = malloc(sizeof(Variable) * state->var_capacity);
     state->output = malloc(sizeof(OutputCapture));
     capture_init(state->output);
@@ -61,6 +103,10 @@ static void free_state(InterpreterState *state) {
     for(int i = 0; i < state->var_count; i++)
         free(state->vars[i].name);
     free(state->vars);
+    free(state->buckets);
+    value_numbering_free(state->numbering);
+    free(state->values);
+    free(state->known);
     if(state->output) {
         capture_free(state->output);
         free(state->output);
@@ -68,10 +114,34 @@ static void free_state(InterpreterState *state) {
     free(state);
 }
 
+// the items of a declaration/assignment are chained through the rightmost
+// leaf of each one (append_to_list follows binop.right), so the item after
+// "x = expr" hangs off the end of expr, not off the '=' itself
+static Node* next_item(Node *item) {
+    while(item->node_type == 3)
+        item = item->binop.right;
+    return item->list.next;
+}
+
+static int evaluate_operation(Node *node, InterpreterState *state, ErrorState *err);
+
+// keep the value of a number (interpreter_reuse_values)
+static void remember_value(InterpreterState *state, int number, int value) {
+    if(number >= state->value_capacity) {
+        int capacity = state->value_capacity;
+        state->value_capacity = value_number_count(state->numbering);
+        state->values = realloc(state->values, sizeof(int) * state->value_capacity);
+        state->known = realloc(state->known, state->value_capacity);
+        memset(state->known + capacity, 0, state->value_capacity - capacity);
+    }
+    state->values[number] = value;
+    state->known[number] = 1;
+}
+
 // stop exec at first error
 // updated: evaluate_expression to check if execution should stop
 static int evaluate_expression(Node *node, InterpreterState *state, ErrorState *err) {
-    if(!node || execution_stopped)
+    if(!node || state->stopped)
         return 0;
     
     switch(node->node_type) {
@@ -85,7 +155,7 @@ static int evaluate_expression(Node *node, InterpreterState *state, ErrorState *
                 var = add_variable(state, node->str_val);
             if(!var->initialized) {
                 report_uninitialized_variable(err, node->line_number, 0, node->str_val);
-                execution_stopped = true;  // stop execution
+                state->stopped = true;  // stop execution
                 return 0;
             }
             return var->value;
@@ -93,29 +163,15 @@ static int evaluate_expression(Node *node, InterpreterState *state, ErrorState *
             
         case 3: // NODE_BINOP
         {
-            int left = evaluate_expression(node->binop.left, state, err);
-            if(execution_stopped)
-                return 0;
-            
-            int right = evaluate_expression(node->binop.right, state, err);
-            if(execution_stopped)
-                return 0;
-            
-            switch(node->binop.op) {
-                case '+': return left + right;
-                case '-': return left - right;
-                case '*': return left * right;
-                case '/': 
-                    if(right == 0) {
-                        report_division_by_zero(err, node->line_number, 0);
-                        execution_stopped = true;  // stop execution
-                        return 0;
-                    }
-                    return left / right;
-                case '=': // should be handled in execute_statement
-                    return left;
-            }
-            return 0;
+            // an operation that computes a value once more has it already
+            // (it ran without an error the first time)
+            int number = state->numbering ? value_number(state->numbering, node) : -1;
+            if(number >= 0 && number < state->value_capacity && state->known[number])
+                return state->values[number];
+            int value = evaluate_operation(node, state, err);
+            if(number >= 0 && !state->stopped)
+                remember_value(state, number, value);
+            return value;
         }
             
         default:
@@ -123,17 +179,50 @@ static int evaluate_expression(Node *node, InterpreterState *state, ErrorState *
     }
 }
 
+// a binop's operands, and what it makes of them
+static int evaluate_operation(Node *node, InterpreterState *state, ErrorState *err) {
+    int left = evaluate_expression(node->binop.left, state, err);
+    if(state->stopped)
+        return 0;
+    
+    int right = evaluate_expression(node->binop.right, state, err);
+    if(state->stopped)
+        return 0;
+    
+    // the operations wrap at 32 bits, the way the jit's and the native
+    // code's do; done in unsigned, where the wrapping is defined
+    switch(node->binop.op) {
+        case '+': return (int)((unsigned)left + (unsigned)right);
+        case '-': return (int)((unsigned)left - (unsigned)right);
+        case '*': return (int)((unsigned)left * (unsigned)right);
+        case '/': 
+            if(right == 0) {
+                report_division_by_zero(err, node->line_number, 0);
+                state->stopped = true;  // stop execution
+                return 0;
+            }
+            // INT_MIN / -1 wraps to INT_MIN, the way the other operations
+            // overflow, where the division itself would trap
+            if(right == -1)
+                return (int)(0u - (unsigned)left);
+            return left / right;
+        case '=': // should be handled in execute_statement
+            return left;
+    }
+    return 0;
+}
+
 
 // updated execute_statement to check if execution should stop
 static void execute_statement(Node *node, InterpreterState *state, ErrorState *err) {
-    if(!node || execution_stopped)
+    if(!node || state->stopped)
         return;
     
     switch(node->node_type) {
         case 4: // NODE_DECL
         {
             Node *current = node->list.items;
-            while(current && !execution_stopped) {
+            while(current && !state->stopped) {
                 if(current->node_type == 3 && current->binop.op == '=') {
                     Node *left = current->binop.left;
                     Node *right = current->binop.right;
@@ -151,7 +240,7 @@ static void execute_statement(Node *node, InterpreterState *state, ErrorState *e
                     var->initialized = 0;
                     var->value = 0;
                 }
-                current = current->list.next;
+                current = next_item(current);
             }
             break;
         }
@@ -159,7 +248,7 @@ static void execute_statement(Node *node, InterpreterState *state, ErrorState *e
         case 5: // NODE_ASSIGN
         {
             Node *current = node->list.items;
-            while(current && !execution_stopped) {
+            while(current && !state->stopped) {
                 if(current->node_type == 3 && current->binop.op == '=') {
                     Node *left = current->binop.left;
                     Node *right = current->binop.right;
@@ -172,21 +261,21 @@ static void execute_statement(Node *node, InterpreterState *state, ErrorState *e
                     var->value = evaluate_expression(right, state, err);
                     var->initialized = 1;
                 }
-                current = current->list.next;
+                current = next_item(current);
             }
             break;
         }
 
         case 6: // NODE_PRINT
         {
-            if(execution_stopped)
+            if(state->stopped)
                 return;
             
             Node *current = node->print_stmt.parts;
             
             // FIRST PASS: evaluate all expressions to check for errors B4 printing
             Node *temp = current;
-            while(temp && !execution_stopped) {
+            while(temp && !state->stopped) {
                 if(temp->node_type == NODE_PRINT_PART) {
                     Node *content = temp->list.items;
                     if(content->node_type != 1) { // not a string - evaluate to check for errors
@@ -199,7 +288,7 @@ static void execute_statement(Node *node, InterpreterState *state, ErrorState *e
             }
             
             // if error occurred during evaluation, nothing is printed
-            if(execution_stopped)
+            if(state->stopped)
                 return;
             
             // SECOND PASS: now actually print (no errors will occur)
@@ -252,28 +341,73 @@ static void execute_statement(Node *node, InterpreterState *state, ErrorState *e
     }
 }
 
-char* interpret_program(Node *program, ErrorState *error_state) {
+InterpreterState* interpreter_begin(ErrorState *error_state, FILE *sink) {
     InterpreterState *state = create_state();
-    execution_stopped = false;
+    state->output->sink = sink;
+    state->err = error_state;
+    return state;
+}
+
+void interpreter_execute(InterpreterState *state, Node *statement) {
+    if(state->numbering && !state->stopped)
+        value_numbering_statement(state->numbering, statement, NULL);
+    execute_statement(statement, state, state->err);
+}
+
+void interpreter_reuse_values(InterpreterState *state) {
+    if(!state->numbering)
+        state->numbering = value_numbering_create();
+}
+
+int interpreter_stopped(InterpreterState *state) {
+    return state->stopped;
+}
+
+void interpreter_end(InterpreterState *state) {
+    free_state(state);
+}
+
+int interpreter_variable(InterpreterState *state, const char *name, int *value) {
+    Variable *var = find_variable(state, name);
+    if(!var || !var->initialized)
+        return 0;
+    *value = var->value;
+    return 1;
+}
+
+static char* interpret(Node *program, ErrorState *error_state, int reuse_values) {
+    InterpreterState *state = interpreter_begin(error_state, NULL);
+    if(reuse_values)
+        interpreter_reuse_values(state);
     
     Node *current = program;
-    while(current && !execution_stopped) {
-        execute_statement(current, state, error_state);
+    while(current && !state->stopped) {
+        trace_begin_line("interpret statement", current->line_number);
+        interpreter_execute(state, current);
+        trace_end_line("interpret statement", current->line_number);
         current = current->list.next;
     }
     
     // if execution was stopped due to error, return empty string
-    if(execution_stopped) {
+    if(state->stopped) {
         char *result = strdup("");
-        free_state(state);
+        interpreter_end(state);
         return result;
     }
     
     char *result = strdup(capture_get(state->output));
-    free_state(state);
+    interpreter_end(state);
     return result;
 }
 
+char* interpret_program(Node *program, ErrorState *error_state) {
+    return interpret(program, error_state, 0);
+}
+
+char* interpret_program_reusing_values(Node *program, ErrorState *error_state) {
+    return interpret(program, error_state, 1);
+}
+
 // // 4 debugging....
 // static void debug_print_ast(Node *node, int depth) {
 //     for(int i = 0; i < depth; i++)
@@ -10,5 +10,21 @@ typedef struct InterpreterState InterpreterState;
 //char* interpret_program(Node *program);
 // update function prototype to accept ErrorState
 char* interpret_program(Node *program, ErrorState *error_state);
+// the same with interpreter_reuse_values (-O)
+char* interpret_program_reusing_values(Node *program, ErrorState *error_state);
+
+// the same thing one statement at a time, with the output written to sink
+// as it's produced (interpret_program is begin, execute for every
+// statement, end). after a runtime error or an uninitialized read
+// interpreter_stopped() is set and whatever was written must be dropped
+InterpreterState* interpreter_begin(ErrorState *error_state, FILE *sink);
+void interpreter_execute(InterpreterState *state, Node *statement);
+int interpreter_stopped(InterpreterState *state);
+void interpreter_end(InterpreterState *state);
+// from now on, an operation that computes a value the program computed
+// before (value_number.h) takes that value instead of evaluating again
+void interpreter_reuse_values(InterpreterState *state);
+// a variable's value after what ran so far; 0 if it has none (yet)
+int interpreter_variable(InterpreterState *state, const char *name, int *value);
 
 #endif
\ No newline at end of file
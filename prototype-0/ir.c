@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+#include "error.h"
+#include "hash.h"
+
+#define INITIAL_BUCKETS 64
+
+static const char *op_names[IR_OP_COUNT] = {
+    "const", "literal", "load", "store", "add", "sub", "mul", "div", "div.check", "print"
+};
+
+static const char *type_names[] = { "void", "int", "string" };
+
+typedef struct {
+    IrProgram *ir;
+    const DeadStores *dead;
+    int fold;
+
+    // the variables by name (open addressing, at most half full): the
+    // index of each one, and the value it has now (-1 = none yet)
+    int *buckets;       // variable index, -1 = empty
+    size_t bucket_count;
+    int *values;        // by variable
+} Builder;
+
+static int Emit(IrProgram *ir, int op, int type, int line, int left, int right) {
+    if(ir->count == ir->capacity) {
+        ir->capacity = ir->capacity ? ir->capacity * 2 : 256;
+        ir->instructions = realloc(ir->instructions, sizeof(IrInstruction) * ir->capacity);
+    }
+    IrInstruction *instruction = &ir->instructions[ir->count];
+    memset(instruction, 0, sizeof(*instruction));
+    instruction->op = op;
+    instruction->type = type;
+    instruction->line = line;
+    instruction->operands[0] = left;
+    instruction->operands[1] = right;
+    return ir->count++;
+}
+
+static int Constant(IrProgram *ir, int64_t value, int line) {
+    int constant = Emit(ir, IR_CONST, IR_TYPE_INT, line, -1, -1);
+    ir->instructions[constant].constant = value;
+    return constant;
+}
+
+static void InsertVariable(Builder *b, int *buckets, size_t bucket_count, int variable) {
+    size_t mask = bucket_count - 1;
+    const char *name = b->ir->variables[variable];
+    size_t i = hash64(name, strlen(name), 0) & mask;
+    while(buckets[i] >= 0)
+        i = (i + 1) & mask;
+    buckets[i] = variable;
+}
+
+// the index of a variable, a new one the first time
+static int Variable(Builder *b, const char *name) {
+    IrProgram *ir = b->ir;
+    if(b->bucket_count > 0) {
+        size_t mask = b->bucket_count - 1;
+        for(size_t i = hash64(name, strlen(name), 0) & mask; b->buckets[i] >= 0; i = (i + 1) & mask)
+            if(strcmp(ir->variables[b->buckets[i]], name) == 0)
+                return b->buckets[i];
+    }
+    if((size_t)(ir->variable_count + 1) * 2 > b->bucket_count) {
+        size_t count = b->bucket_count ? b->bucket_count * 2 : INITIAL_BUCKETS;
+        int *buckets = malloc(sizeof(int) * count);
+        for(size_t i = 0; i < count; i++)
+            buckets[i] = -1;
+        for(size_t i = 0; i < b->bucket_count; i++)
+            if(b->buckets[i] >= 0)
+                InsertVariable(b, buckets, count, b->buckets[i]);
+        free(b->buckets);
+        b->buckets = buckets;
+        b->bucket_count = count;
+    }
+    if(ir->variable_count == ir->variable_capacity) {
+        ir->variable_capacity = ir->variable_capacity ? ir->variable_capacity * 2 : 64;
+        ir->variables = realloc(ir->variables, sizeof(char*) * ir->variable_capacity);
+        b->values = realloc(b->values, sizeof(int) * ir->variable_capacity);
+    }
+    int variable = ir->variable_count++;
+    ir->variables[variable] = strdup(name);
+    b->values[variable] = -1;
+    InsertVariable(b, b->buckets, b->bucket_count, variable);
+    return variable;
+}
+
+// an operation on two constants, as the code computes it; 0 if it divides
+// by zero (or overflows doing it), which is left to happen at run time
+static int Fold(int op, int64_t left, int64_t right, int64_t *value) {
+    switch(op) {
+        case IR_ADD: *value = (int64_t)((uint64_t)left + (uint64_t)right); return 1;
+        case IR_SUB: *value = (int64_t)((uint64_t)left - (uint64_t)right); return 1;
+        case IR_MUL: *value = (int64_t)((uint64_t)left * (uint64_t)right); return 1;
+        case IR_DIV:
+            if(right == 0 || (left == INT64_MIN && right == -1))
+                return 0;
+            *value = left / right;
+            return 1;
+    }
+    return 0;
+}
+
+static int IsConstant(const IrProgram *ir, int value) {
+    return ir->instructions[value].op == IR_CONST;
+}
+
+// a constant just built and folded into something else is taken back (a
+// variable's constant is never the last instruction: its store comes after)
+static void DropConstant(IrProgram *ir, int value) {
+    if(value == ir->count - 1 && IsConstant(ir, value))
+        ir->count--;
+}
+
+static int BuildExpression(Builder *b, Node *node) {
+    IrProgram *ir = b->ir;
+    if(node->node_type == 0)    // NUM
+        return Constant(ir, node->int_val, node->line_number);
+    if(node->node_type == 2) {  // ID
+        int variable = Variable(b, node->str_val);
+        if(b->values[variable] < 0) {
+            b->values[variable] = Emit(ir, IR_LOAD, IR_TYPE_INT, node->line_number, -1, -1);
+            ir->instructions[b->values[variable]].variable = variable;
+        }
+        return b->values[variable];
+    }
+
+    // BINOP, the operands in the order they're evaluated
+    int left = BuildExpression(b, node->binop.left);
+    int right = BuildExpression(b, node->binop.right);
+    int op = node->binop.op == '+' ? IR_ADD : node->binop.op == '-' ? IR_SUB : node->binop.op == '*' ? IR_MUL : IR_DIV;
+    int64_t value;
+    if(b->fold && IsConstant(ir, left) && IsConstant(ir, right) &&
+       Fold(op, ir->instructions[left].constant, ir->instructions[right].constant, &value)) {
+        DropConstant(ir, right);
+        DropConstant(ir, left);
+        return Constant(ir, value, node->line_number);
+    }
+    if(op == IR_DIV && !(IsConstant(ir, right) && ir->instructions[right].constant != 0))
+        Emit(ir, IR_DIV_CHECK, IR_TYPE_VOID, node->line_number, right, -1);
+    return Emit(ir, op, IR_TYPE_INT, node->line_number, left, right);
+}
+
+// the items of a declaration/assignment are chained through the rightmost
+// leaf of each one (see the interpreter's next_item)
+static Node *NextItem(Node *item) {
+    while(item->node_type == 3)
+        item = item->binop.right;
+    return item->list.next;
+}
+
+static int VariableKept(const Builder *b, const char *name) {
+    return !b->dead || !dead_stores_variable_dead(b->dead, name);
+}
+
+static void BuildStores(Builder *b, Node *statement) {
+    IrProgram *ir = b->ir;
+    for(Node *item = statement->list.items; item; item = NextItem(item)) {
+        if(item->node_type == 2) {
+            // int x: memory, without a value
+            if(VariableKept(b, item->str_val))
+                Variable(b, item->str_val);
+            continue;
+        }
+        const char *name = item->binop.left->str_val;
+        if(VariableKept(b, name))
+            Variable(b, name);
+        int status = b->dead ? dead_stores_store(b->dead, item) : STORE_LIVE;
+        if(status == STORE_DEAD)
+            continue;
+        int value = BuildExpression(b, item->binop.right);
+        if(status == STORE_EVALUATE)
+            continue;
+        int variable = Variable(b, name);
+        int store = Emit(ir, IR_STORE, IR_TYPE_VOID, item->line_number, value, -1);
+        ir->instructions[store].variable = variable;
+        ir->instructions[store].initial = statement->node_type == 4;   // DECL
+        b->values[variable] = value;
+    }
+}
+
+static int AddString(IrProgram *ir, char *text) {
+    if(ir->string_count == ir->string_capacity) {
+        ir->string_capacity = ir->string_capacity ? ir->string_capacity * 2 : 64;
+        ir->strings = realloc(ir->strings, sizeof(char*) * ir->string_capacity);
+    }
+    ir->strings[ir->string_count] = text;
+    return ir->string_count++;
+}
+
+static void AddArgument(IrProgram *ir, int value) {
+    if(ir->argument_count == ir->argument_capacity) {
+        ir->argument_capacity = ir->argument_capacity ? ir->argument_capacity * 2 : 64;
+        ir->arguments = realloc(ir->arguments, sizeof(int) * ir->argument_capacity);
+    }
+    ir->arguments[ir->argument_count++] = value;
+}
+
+// a print is its text and the integers only known at run time: the text is
+// a format with a %d for each of them ('%' doubled), or the line as it is
+// if there are none. the constants are part of the text
+static void BuildPrint(Builder *b, Node *statement) {
+    IrProgram *ir = b->ir;
+    char *line = NULL, *format = NULL;
+    size_t line_length = 0, format_length = 0;
+    FILE *plain = open_memstream(&line, &line_length);
+    FILE *formatted = open_memstream(&format, &format_length);
+    int first = ir->argument_count;
+    Node *last = NULL;
+    for(Node *part = statement->print_stmt.parts; part; part = part->list.next) {
+        Node *content = part->list.items;
+        if(content->node_type == 1) {   // STR
+            fputs(content->str_val, plain);
+            for(const char *c = content->str_val; *c; c++) {
+                if(*c == '%')
+                    fputc('%', formatted);
+                fputc(*c, formatted);
+            }
+        } else {
+            int value = BuildExpression(b, content);
+            if(IsConstant(ir, value)) {
+                fprintf(plain, "%lld", (long long)ir->instructions[value].constant);
+                fprintf(formatted, "%lld", (long long)ir->instructions[value].constant);
+                DropConstant(ir, value);
+            } else {
+                AddArgument(ir, value);
+                fputs("%d", formatted);
+            }
+        }
+        last = content;
+    }
+
+    // a newline after it, unless it ends with a string that ends in one
+    size_t last_length = last && last->node_type == 1 ? strlen(last->str_val) : 0;
+    if(last_length == 0 || last->str_val[last_length - 1] != '\n') {
+        fputc('\n', plain);
+        fputc('\n', formatted);
+    }
+    fclose(plain);
+    fclose(formatted);
+    int count = ir->argument_count - first;
+    if(count > 0) {
+        free(line);
+    } else {
+        free(format);
+        format = line;
+    }
+
+    int text = Emit(ir, IR_STRING, IR_TYPE_STRING, statement->line_number, -1, -1);
+    ir->instructions[text].string = AddString(ir, format);
+    int print = Emit(ir, IR_PRINT, IR_TYPE_VOID, statement->line_number, text, -1);
+    ir->instructions[print].print.first = first;
+    ir->instructions[print].print.count = count;
+}
+
+IrProgram *ir_build(Node *program, const DeadStores *dead, int fold) {
+    Builder b = { calloc(1, sizeof(IrProgram)), dead, fold, NULL, 0, NULL };
+    for(Node *statement = program; statement; statement = statement->list.next) {
+        if(statement->node_type == 4 || statement->node_type == 5)     // DECL, ASSIGN
+            BuildStores(&b, statement);
+        else if(statement->node_type == 6)                              // PRINT
+            BuildPrint(&b, statement);
+    }
+    free(b.buckets);
+    free(b.values);
+    return b.ir;
+}
+
+void ir_free(IrProgram *ir) {
+    if(!ir)
+        return;
+    for(int i = 0; i < ir->variable_count; i++)
+        free(ir->variables[i]);
+    for(int i = 0; i < ir->string_count; i++)
+        free(ir->strings[i]);
+    free(ir->variables);
+    free(ir->strings);
+    free(ir->arguments);
+    free(ir->instructions);
+    free(ir);
+}
+
+const char *ir_op_name(int op) {
+    return op >= 0 && op < IR_OP_COUNT ? op_names[op] : "?";
+}
+
+static void PrintString(FILE *out, const char *text) {
+    fputc('"', out);
+    for(const char *c = text; *c; c++) {
+        switch(*c) {
+            case '\n': fputs("\\n", out); break;
+            case '\t': fputs("\\t", out); break;
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            default: fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// one instruction a line, "%3 = add int %1, %2", with a "; line N" before
+// the instructions of every source line
+void ir_print(FILE *out, const IrProgram *ir) {
+    fprintf(out, "; %d instructions, %d variables\n", ir->count, ir->variable_count);
+    int line = 0;
+    for(int i = 0; i < ir->count; i++) {
+        const IrInstruction *instruction = &ir->instructions[i];
+        if(instruction->line != line) {
+            fprintf(out, "; line %d\n", instruction->line);
+            line = instruction->line;
+        }
+        if(instruction->type != IR_TYPE_VOID)
+            fprintf(out, "%%%d = %s %s", i, ir_op_name(instruction->op), type_names[instruction->type]);
+        else
+            fprintf(out, "%s", ir_op_name(instruction->op));
+        switch(instruction->op) {
+            case IR_CONST:
+                fprintf(out, " %lld", (long long)instruction->constant);
+                break;
+            case IR_STRING:
+                fputc(' ', out);
+                PrintString(out, ir->strings[instruction->string]);
+                break;
+            case IR_LOAD:
+                fprintf(out, " %s", ir->variables[instruction->variable]);
+                break;
+            case IR_STORE:
+                fprintf(out, " %s, %%%d%s", ir->variables[instruction->variable], instruction->operands[0],
+                        instruction->initial ? " initial" : "");
+                break;
+            case IR_PRINT:
+                fprintf(out, " %%%d", instruction->operands[0]);
+                for(int a = 0; a < instruction->print.count; a++)
+                    fprintf(out, ", %%%d", ir->arguments[instruction->print.first + a]);
+                break;
+            default:
+                for(int o = 0; o < 2 && instruction->operands[o] >= 0; o++)
+                    fprintf(out, "%s%%%d", o > 0 ? ", " : " ", instruction->operands[o]);
+        }
+        fputc('\n', out);
+    }
+}
+
+// the operands and the type of the value of every op
+static const struct {
+    int operands;
+    int operand_type;
+    int type;
+} shapes[IR_OP_COUNT] = {
+    [IR_CONST]     = { 0, IR_TYPE_VOID, IR_TYPE_INT },
+    [IR_STRING]    = { 0, IR_TYPE_VOID, IR_TYPE_STRING },
+    [IR_LOAD]      = { 0, IR_TYPE_VOID, IR_TYPE_INT },
+    [IR_STORE]     = { 1, IR_TYPE_INT, IR_TYPE_VOID },
+    [IR_ADD]       = { 2, IR_TYPE_INT, IR_TYPE_INT },
+    [IR_SUB]       = { 2, IR_TYPE_INT, IR_TYPE_INT },
+    [IR_MUL]       = { 2, IR_TYPE_INT, IR_TYPE_INT },
+    [IR_DIV]       = { 2, IR_TYPE_INT, IR_TYPE_INT },
+    [IR_DIV_CHECK] = { 1, IR_TYPE_INT, IR_TYPE_VOID },
+    [IR_PRINT]     = { 1, IR_TYPE_STRING, IR_TYPE_VOID },
+};
+
+// the %d in a format, -1 if it has a '%' that's neither "%d" nor "%%"
+static int FormatArguments(const char *format) {
+    int count = 0;
+    for(const char *c = format; *c; c++) {
+        if(*c != '%')
+            continue;
+        if(c[1] == 'd')
+            count++;
+        else if(c[1] != '%')
+            return -1;
+        c++;
+    }
+    return count;
+}
+
+static const char *VerifyInstruction(const IrProgram *ir, int i, const char *checked) {
+    const IrInstruction *instruction = &ir->instructions[i];
+    if(instruction->op < 0 || instruction->op >= IR_OP_COUNT)
+        return "an op there isn't";
+    if(instruction->type != shapes[instruction->op].type)
+        return "a value of the wrong type";
+    for(int o = 0; o < 2; o++) {
+        int operand = instruction->operands[o];
+        if(o >= shapes[instruction->op].operands) {
+            if(operand != -1)
+                return "an operand too many";
+            continue;
+        }
+        if(operand < 0 || operand >= i)
+            return "an operand that isn't defined before it";
+        if(ir->instructions[operand].type != shapes[instruction->op].operand_type)
+            return "an operand of the wrong type";
+    }
+    switch(instruction->op) {
+        case IR_STRING:
+            if(instruction->string < 0 || instruction->string >= ir->string_count)
+                return "a string there isn't";
+            break;
+        case IR_LOAD:
+        case IR_STORE:
+            if(instruction->variable < 0 || instruction->variable >= ir->variable_count)
+                return "a variable there isn't";
+            break;
+        case IR_DIV: {
+            const IrInstruction *divisor = &ir->instructions[instruction->operands[1]];
+            if(!(divisor->op == IR_CONST && divisor->constant != 0) && !checked[instruction->operands[1]])
+                return "a division without a div.check of its divisor";
+            break;
+        }
+        case IR_PRINT: {
+            int first = instruction->print.first, count = instruction->print.count;
+            if(first < 0 || count < 0 || first + count > ir->argument_count)
+                return "arguments there aren't";
+            for(int a = first; a < first + count; a++)
+                if(ir->arguments[a] < 0 || ir->arguments[a] >= i || ir->instructions[ir->arguments[a]].type != IR_TYPE_INT)
+                    return "an argument that isn't an int defined before it";
+            const char *text = ir->strings[ir->instructions[instruction->operands[0]].string];
+            if(count > 0 && FormatArguments(text) != count)
+                return "a format without a %d for every argument";
+            break;
+        }
+    }
+    return NULL;
+}
+
+int ir_verify(const IrProgram *ir) {
+    // the values a div.check is done for, so far
+    char *checked = calloc(ir->count + 1, 1);
+    const char *problem = NULL;
+    int i;
+    for(i = 0; i < ir->count && !problem; i++) {
+        problem = VerifyInstruction(ir, i, checked);
+        if(!problem && ir->instructions[i].op == IR_DIV_CHECK)
+            checked[ir->instructions[i].operands[0]] = 1;
+    }
+    free(checked);
+    if(!problem)
+        return 1;
+    fprintf(get_diagnostics_stream(), "Internal error: IR instruction %%%d (line %d): %s\n", i - 1,
+            ir->instructions[i - 1].line, problem);
+    return 0;
+}
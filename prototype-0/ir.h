@@ -0,0 +1,91 @@
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "ast.h"
+#include "dead_store.h"
+
+// the SSA IR (--ir): a checked program as one array of instructions, built
+// from the AST after the passes and lowered to MIPS64 (GenerateAssemblyIR).
+//
+// a program is straight-line code, so an instruction's value is its index
+// and is defined before everything that uses it. a variable isn't a value:
+// a store writes one to its memory, and from then on the builder reads the
+// variable as that value, so every assignment is one value and a variable
+// is only loaded if it's read before anything was stored to it. a division
+// comes after a div.check of its divisor (unless that's a constant other
+// than 0), the one place a run can stop. under -O operations on constants
+// are folded the way the code would compute them (64-bit, wrapping), and
+// since a variable's value is what was stored to it, that goes through
+// them: a program without loads is then constants and prints.
+//
+// each instruction has the source line it came from. an analysis is a walk
+// over the array, and a value's facts go in arrays indexed by it
+
+// the types of the values
+enum {
+    IR_TYPE_VOID,       // no value (store, div.check, print)
+    IR_TYPE_INT,        // 64-bit integer
+    IR_TYPE_STRING,     // the address of a pooled string
+};
+
+enum {
+    IR_CONST,       // int: constant
+    IR_STRING,      // string: strings[string] ("literal")
+    IR_LOAD,        // int: the memory of variables[variable]
+    IR_STORE,       // variables[variable] = operands[0]
+    IR_ADD,         // int: operands[0] op operands[1]
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_DIV_CHECK,   // stops the run if operands[0] is 0
+    IR_PRINT,       // the format operands[0], its %d from arguments[first..]
+    IR_OP_COUNT
+};
+
+typedef struct {
+    int op;             // IR_*
+    int type;           // IR_TYPE_* of its value
+    int line;           // in the source
+    int operands[2];    // values, -1 = none
+    union {
+        int64_t constant;   // CONST
+        int string;         // STRING
+        int variable;       // LOAD, STORE
+        struct {
+            int first;
+            int count;
+        } print;            // PRINT: its arguments
+    };
+    int initial;        // STORE of a declaration: nothing read the variable before
+} IrInstruction;
+
+typedef struct {
+    IrInstruction *instructions;
+    int count;
+    int capacity;
+    int *arguments;     // of the prints, values
+    int argument_count;
+    int argument_capacity;
+    char **variables;   // in the order they're first seen
+    int variable_count;
+    int variable_capacity;
+    char **strings;     // the prints' texts: a format if the print has arguments
+    int string_count;
+    int string_capacity;
+} IrProgram;
+
+// the IR of a checked program, folded if fold is set. with dead stores
+// (NULL = none) the stores they found aren't in it, and neither are the
+// variables nothing reads
+IrProgram *ir_build(Node *program, const DeadStores *dead, int fold);
+void ir_free(IrProgram *ir);
+
+const char *ir_op_name(int op);
+void ir_print(FILE *out, const IrProgram *ir);
+// 1 if the IR is well formed; what's wrong with it goes to the diagnostics
+// stream if it isn't
+int ir_verify(const IrProgram *ir);
+
+#endif
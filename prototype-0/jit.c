@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "x86_64.h"
+
+#if defined(__x86_64__)
+
+// int program(char **cursor, int32_t *frame): 0, or 1 + the exit taken.
+// *cursor is where the output goes, and where it ended afterwards
+typedef int (*JitFunction)(char **cursor, int32_t *frame);
+
+char* jit_program(Node *program, ErrorState *error_state) {
+    X86Code x;
+    x86_init(&x);
+
+    // push rbp; mov rbp, rsp; push rbx; push r12; push r13;
+    // mov r13, rdi (cursor); mov r12, [rdi]; mov rbx, rsi (frame)
+    x86_emit(&x, "\x55\x48\x89\xe5\x53\x41\x54\x41\x55\x49\x89\xfd\x4c\x8b\x27\x48\x89\xf3", 18);
+    x86_program(&x, program);
+    x86_emit(&x, "\x31\xc0", 2);             // xor eax, eax
+
+    // mov [r13], r12; lea rsp, [rbp-24]; pop r13; pop r12; pop rbx; pop rbp; ret
+    size_t epilogue = x.size;
+    x86_emit(&x, "\x4d\x89\x65\x00\x48\x8d\x65\xe8\x41\x5d\x41\x5c\x5b\x5d\xc3", 15);
+
+    // one stub per exit: mov eax, 1 + exit; jmp epilogue
+    for(int i = 0; i < x.exit_count; i++) {
+        x86_jump_here(&x, x.exits[i].position);
+        x86_emit(&x, "\xb8", 1);
+        x86_emit32(&x, i + 1);
+        x86_emit(&x, "\xe9", 1);
+        x86_emit32(&x, (int32_t)(epilogue - (x.size + 4)));
+    }
+    x86_finish(&x);
+    x86_relocate(&x, (uint64_t)(uintptr_t)x.data);
+
+    void *memory = mmap(NULL, x.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        x86_free(&x);
+        return NULL;
+    }
+    memcpy(memory, x.code, x.size);
+    if(mprotect(memory, x.size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, x.size);
+        x86_free(&x);
+        return NULL;
+    }
+
+    int32_t *frame = calloc(x.variable_count + 1, sizeof(int32_t));
+    char *output = malloc(x.output_bound + 1);
+    char *cursor = output;
+    int exit = ((JitFunction)memory)(&cursor, frame);
+
+    char *result;
+    if(exit) {
+        X86Exit *e = &x.exits[exit - 1];
+        if(e->uninitialized)
+            report_uninitialized_variable(error_state, e->line, 0, e->name);
+        else
+            report_division_by_zero(error_state, e->line, 0);
+        free(output);
+        result = strdup("");
+    } else {
+        *cursor = '\0';
+        result = output;
+    }
+
+    free(frame);
+    munmap(memory, x.size);
+    x86_free(&x);
+    return result;
+}
+
+#else
+
+char* jit_program(Node *program, ErrorState *error_state) {
+    return NULL;
+}
+
+#endif
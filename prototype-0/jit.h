@@ -0,0 +1,19 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "ast.h"
+#include "error.h"
+
+// run a checked program as native x86-64 code instead of interpreting it
+//
+// the statements are compiled (x86_64.h) into one function in an executable
+// buffer: variables live in a frame array, print appends to an output
+// buffer sized up front, and a division by zero or an uninitialized read
+// leaves through an exit that reports it with the line of the node, like
+// the interpreter. the result is the same as interpret_program's: the
+// output, or "" with the error in error_state.
+// returns NULL if it can't run here (not x86-64, no executable memory);
+// the caller falls back to the interpreter then
+char* jit_program(Node *program, ErrorState *error_state);
+
+#endif
@@ -468,13 +468,19 @@ char *yytext;
 #include <stdlib.h>
 #include <string.h>
 #include "parser.tab.h"
+#include "error.h"
 
 int line_num = 1;
 int column_num = 1;
 
 void update_column(int length);
-#line 476 "lex.yy.c"
-#line 477 "lex.yy.c"
+
+// the parser is pure (see parser.y): tokens go back through a pointer so the
+// scanner can run on its own thread without sharing a global yylval
+#define YY_DECL int yylex(YYSTYPE *yylval_param)
+#define yylval (*yylval_param)
+#line 482 "lex.yy.c"
+#line 483 "lex.yy.c"
 
 #define INITIAL 0
 
@@ -691,10 +697,10 @@ YY_DECL
 		}
 
 	{
-#line 22 "lexer.l"
+#line 28 "lexer.l"
 
 
-#line 697 "lex.yy.c"
+#line 703 "lex.yy.c"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -753,77 +759,77 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 24 "lexer.l"
+#line 30 "lexer.l"
 { update_column(yyleng); /* ignore comments */ }
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 26 "lexer.l"
+#line 32 "lexer.l"
 { update_column(3); return PROG_START; }
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 27 "lexer.l"
+#line 33 "lexer.l"
 { update_column(3); return PROG_END; }
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 29 "lexer.l"
+#line 35 "lexer.l"
 { update_column(3); return KW_INT; }
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 30 "lexer.l"
+#line 36 "lexer.l"
 { update_column(1); return KW_PRINT; }
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 32 "lexer.l"
+#line 38 "lexer.l"
 { update_column(1); return '='; }
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 33 "lexer.l"
+#line 39 "lexer.l"
 { update_column(1); return '+'; }
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 34 "lexer.l"
+#line 40 "lexer.l"
 { update_column(1); return '-'; }
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 35 "lexer.l"
+#line 41 "lexer.l"
 { update_column(1); return '*'; }
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 36 "lexer.l"
+#line 42 "lexer.l"
 { update_column(1); return '/'; }
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 37 "lexer.l"
+#line 43 "lexer.l"
 { update_column(1); return '('; }
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 38 "lexer.l"
+#line 44 "lexer.l"
 { update_column(1); return ')'; }
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 39 "lexer.l"
+#line 45 "lexer.l"
 { update_column(1); return ','; }
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 40 "lexer.l"
+#line 46 "lexer.l"
 { update_column(1); return ':'; }
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 42 "lexer.l"
+#line 48 "lexer.l"
 { 
               yylval.str_val = strdup(yytext);
               update_column(yyleng);
@@ -832,7 +838,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 48 "lexer.l"
+#line 54 "lexer.l"
 {
               yylval.int_val = atoi(yytext);
               update_column(yyleng);
@@ -841,7 +847,7 @@ YY_RULE_SETUP
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 54 "lexer.l"
+#line 60 "lexer.l"
 {
               // string literal with escape sequences
               char *text = yytext;
@@ -880,20 +886,20 @@ YY_RULE_SETUP
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 90 "lexer.l"
+#line 96 "lexer.l"
 { update_column(yyleng); }
 	YY_BREAK
 case 19:
 /* rule 19 can match eol */
 YY_RULE_SETUP
-#line 92 "lexer.l"
+#line 98 "lexer.l"
 { line_num++; column_num = 1; return NEWLINE_TOKEN; }
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 94 "lexer.l"
+#line 100 "lexer.l"
 { 
-              fprintf(stderr, "Lexical error at line %d, column %d: Unexpected character '%c'\n", 
+              fprintf(get_diagnostics_stream(), "Lexical error at line %d, column %d: Unexpected character '%c'\n", 
                       line_num, column_num, yytext[0]);
               update_column(1);
               return ILLEGAL;
@@ -901,10 +907,10 @@ YY_RULE_SETUP
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 101 "lexer.l"
+#line 107 "lexer.l"
 ECHO;
 	YY_BREAK
-#line 907 "lex.yy.c"
+#line 913 "lex.yy.c"
 case YY_STATE_EOF(INITIAL):
 	yyterminate();
 
@@ -1909,7 +1915,7 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 101 "lexer.l"
+#line 107 "lexer.l"
 
 
 void update_column(int length) {
@@ -5,28 +5,45 @@
 #include <stdint.h>
 #include "machine_code.h"
 #include "symbol_table.h"
+#include "hash.h"
+#include "error.h"
+#include "elf.h"
+#include "stats.h"
 
-// I-type opcodes
-#define OP_DADDIU 0x19 // daddiu rt, rs, immediate
-#define OP_LD 0x37 // 64-bit load doubleword
-#define OP_SD 0x3F // 64-bit store doubleword
-#define OP_DADDI 0x18  
+// every instruction we know, for the assembler and the disassembler both
+const MachineOpcode machine_opcodes[] = {
+    { "daddiu",  OP_DADDIU, 0,             MACHINE_FORMAT_RT_RS_IMM },
+    { "daddi",   OP_DADDI,  0,             MACHINE_FORMAT_RT_RS_IMM },
+    { "daddu",   0,         FUNCT_DADDU,   MACHINE_FORMAT_RD_RS_RT },
+    { "dsubu",   0,         FUNCT_DSUBU,   MACHINE_FORMAT_RD_RS_RT },
+    { "dadd",    0,         FUNCT_DADD,    MACHINE_FORMAT_RD_RS_RT },
+    { "dmult",   0,         FUNCT_DMULT,   MACHINE_FORMAT_RS_RT },
+    { "ddiv",    0,         FUNCT_DDIV,    MACHINE_FORMAT_RS_RT },
+    { "mflo",    0,         FUNCT_MFLO,    MACHINE_FORMAT_RD },
+    { "mfhi",    0,         FUNCT_MFHI,    MACHINE_FORMAT_RD },
+    { "ld",      OP_LD,     0,             MACHINE_FORMAT_RT_MEMORY },
+    { "sd",      OP_SD,     0,             MACHINE_FORMAT_RT_MEMORY },
+    { "syscall", 0,         FUNCT_SYSCALL, MACHINE_FORMAT_CODE },
+    { "lui",     OP_LUI,    0,             MACHINE_FORMAT_RT_IMM },
+};
+const int machine_opcode_count = sizeof(machine_opcodes) / sizeof(machine_opcodes[0]);
 
-// R-type function codes (funct field)
-#define FUNCT_DADDU 0x2D
-#define FUNCT_DSUBU 0x23
-#define FUNCT_DMULT 0x18
-#define FUNCT_DDIV 0x1A
-#define FUNCT_MFHI 0x10
-#define FUNCT_MFLO 0x12
-#define FUNCT_SYSCALL 0x0C
-#define FUNCT_DADD 0x2C 
+static const MachineOpcode *FindOpcode(const char *mnemonic) {
+    for(int i = 0; i < machine_opcode_count; i++)
+        if(strcmp(machine_opcodes[i].mnemonic, mnemonic) == 0)
+            return &machine_opcodes[i];
+    return NULL;
+}
 
 
 // map reister name "r0".."r31" to number
-// convert reg name string into number
+// convert reg name string into number, -1 if it isn't one
 static int RegisterNumber(const char *r) {
-    return atoi(r + 1); // skip first character (w/c is 'r', and directly go to the first digit)
+    if(r[0] != 'r' || !isdigit((unsigned char)r[1]))
+        return -1;
+    char *end;
+    long n = strtol(r + 1, &end, 10); // skip first character (w/c is 'r', and directly go to the first digit)
+    return *end == '\0' && n <= 31 ? (int)n : -1;
 }
 
 // R-type instruction: opcode rs rt rd shamt funct
@@ -39,205 +56,899 @@ static uint32_t Encode_I_Type(uint8_t opcode, uint8_t rs, uint8_t rt, int16_t im
     return (opcode << 26) | (rs << 21) | (rt << 16) | ((uint16_t)imm & 0xFFFF);
 }
 
-// print 32-bit instruction in binary
-static void PrintBinary(uint32_t code, FILE *out) {
-    for(int i = 31; i >= 0; i--) {
-        fprintf(out, "%c", (code & (1U << i)) ? '1' : '0');
-        if(i % 4 == 0)
-            fprintf(out, " "); // spacing every 4 bits
+// the listing is rendered from these into a buffer, rather than printed
+// a bit at a time
+static const char nibble_bits[] = "0000000100100011010001010110011110001001101010111100110111101111";
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// 32-bit instruction in binary, a space after every 4 bits, then the hex:
+// a MACHINE_LISTING_LINE line
+static char *RenderInstruction(char *p, uint32_t code) {
+    for(int i = 7; i >= 0; i--) {
+        memcpy(p, nibble_bits + ((code >> (i * 4)) & 0xF) * 4, 4);
+        p[4] = ' '; // spacing every 4 bits
+        p += 5;
     }
+    memcpy(p, " : ", 3);
+    p += 3;
+    for(int i = 7; i >= 0; i--)
+        *p++ = hex_digits[(code >> (i * 4)) & 0xF]; // hex representation
+    *p++ = '\n';
+    return p;
 }
 
+static char *RenderHex(char *p, uint64_t value, int digits) {
+    for(int i = digits - 1; i >= 0; i--)
+        *p++ = hex_digits[(value >> (i * 4)) & 0xF];
+    return p;
+}
 
-// MAIN TRANSLATION SECTION
-// convert assembly to machine code, one line per assembly
-// each instrcution line is converted into a bits of integer code
-// and teh resulting binary and hex are written to out_file
-int MachineFromAssembly(const char *asm_file, const char *out_file) {
-    FILE *in = fopen(asm_file, "r");
-    if(!in)
+// the low bits of value, most significant first
+static char *RenderBits(char *p, uint32_t value, int bits) {
+    for(int i = bits - 1; i >= 0; i--)
+        *p++ = '0' + ((value >> i) & 1);
+    return p;
+}
+
+// the instruction's fields: opcode rs rt rd shamt funct (R-type, opcode 0)
+// or opcode rs rt immediate, padded to the width of the R-type
+#define FIELDS_WIDTH 37
+static char *RenderFields(char *p, uint32_t code) {
+    char *start = p;
+    static const int r_type[] = { 6, 5, 5, 5, 5, 6 };
+    static const int i_type[] = { 6, 5, 5, 16 };
+    const int *widths = (code >> 26) == 0 ? r_type : i_type;
+    int count = (code >> 26) == 0 ? 6 : 4;
+    int shift = 32;
+    for(int i = 0; i < count; i++) {
+        shift -= widths[i];
+        p = RenderBits(p, code >> shift, widths[i]);
+        *p++ = ' ';
+    }
+    while(p < start + FIELDS_WIDTH + 1)
+        *p++ = ' ';
+    return p;
+}
+
+// the listing goes through one large buffer
+#define LISTING_BUFFER (64 * 1024)
+#define LISTING_RESERVE 128     // enough for any rendered part of a line
+
+typedef struct {
+    FILE *out;
+    char *buffer;
+    size_t used;
+} ListingWriter;
+
+static void ListingFlush(ListingWriter *w) {
+    if(w->used > 0)
+        fwrite(w->buffer, 1, w->used, w->out);
+    w->used = 0;
+}
+
+// room for LISTING_RESERVE bytes at the end; set w->used past what's written
+static char *ListingReserve(ListingWriter *w) {
+    if(w->used + LISTING_RESERVE > LISTING_BUFFER)
+        ListingFlush(w);
+    return w->buffer + w->used;
+}
+
+static void ListingWrite(ListingWriter *w, const char *text, size_t length) {
+    if(w->used + length > LISTING_BUFFER)
+        ListingFlush(w);
+    if(length > LISTING_BUFFER) {
+        fwrite(text, 1, length, w->out);
+        return;
+    }
+    memcpy(w->buffer + w->used, text, length);
+    w->used += length;
+}
+
+
+// ASSEMBLER
+// two passes: MachineDefineLabels gives every label its address (and lays
+// out the data), MachineEncode then encodes the instructions with them.
+// a label nothing defined yet is left as a fixup for MachineResolveFixups,
+// which is how code can be encoded before its data section exists
+
+#define INITIAL_BUCKETS 64
+#define MAX_LABEL_LEN 256
+
+// getline() into line, and a copy of it for the messages
+static ssize_t ReadLine(FILE *in, char **line, size_t *size, char **copy, size_t *copy_size) {
+    ssize_t n = getline(line, size, in);
+    if(n <= 0)
+        return n;
+    if((size_t)n + 1 > *copy_size) {
+        *copy_size = n + 1;
+        *copy = realloc(*copy, *copy_size);
+    }
+    memcpy(*copy, *line, n + 1);
+    (*copy)[strcspn(*copy, "\r\n")] = '\0';
+    return n;
+}
+
+// one source line split up: "label: mnemonic operands ; comment"
+typedef struct {
+    char label[MAX_LABEL_LEN];   // "" if none
+    char mnemonic[16];          // the instruction or directive, "" if none
+    char *operands;             // the rest, trimmed (points into the line)
+} SourceLine;
+
+static int IsLabelChar(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+static char *Trim(char *s) {
+    while(*s && isspace((unsigned char)*s))
+        s++;
+    char *end = s + strlen(s);
+    while(end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+// splits line (which it changes); returns 0 for a blank or comment line
+static int SplitLine(char *line, SourceLine *source) {
+    line[strcspn(line, "\r\n")] = '\0'; // remove newline
+    source->label[0] = '\0';
+    source->mnemonic[0] = '\0';
+
+    // ';' starts a comment outside a string, so does a '#' at the start
+    // (elsewhere it's an immediate)
+    int quoted = 0;
+    for(char *p = line; *p; p++) {
+        if(*p == '"' && (p == line || p[-1] != '\\'))
+            quoted = !quoted;
+        else if(*p == ';' && !quoted) {
+            *p = '\0';
+            break;
+        }
+    }
+    char *p = Trim(line);
+    if(*p == '#' || *p == '\0')
         return 0;
-    FILE *out = fopen(out_file, "w");
-    if(!out) { 
-        fclose(in); 
-        return 0; 
+
+    char *name = p;
+    while(IsLabelChar(*name))
+        name++;
+    if(name > p && *name == ':' && name - p < MAX_LABEL_LEN) {
+        memcpy(source->label, p, name - p);
+        source->label[name - p] = '\0';
+        p = Trim(name + 1);
     }
 
-    char line[MAX_SYMBOLS];
-    while(fgets(line, sizeof(line), in)) {
-        line[strcspn(line, "\r\n")] = '\0'; // remove newline
-        char *p = line;
-        while(*p && isspace(*p)) 
-            p++;
-        if(*p == '#' || *p == '\0') 
-            continue; // skip comments/empty
+    size_t length = strcspn(p, " \t");
+    if(length >= sizeof(source->mnemonic))
+        length = sizeof(source->mnemonic) - 1;
+    memcpy(source->mnemonic, p, length);
+    source->mnemonic[length] = '\0';
+    source->operands = Trim(p + strcspn(p, " \t"));
+    return 1;
+}
 
-        ////
-        // skip assembler directives and labels
-        if(strncmp(p, ".data", 5) == 0 || strncmp(p, ".code",5) == 0)
-            continue;
-        if(strchr(p, ':'))   // labels like a: .space 8
-            continue;
-        if(strstr(line, ".asciiz"))
-            continue;
-        ////
-
-        // parsed fields
-        char regA[8], regB[MAX_NAME_LEN], regC[8]; // tempoeary string buffers to use when parsing assembly instructions
-        // 3 regs since most MIPS64 instruction formats have at most 3 registers
-        // regB is MAX_NAME_LEN (64) bc it may hold memory operands like "result(r0)" or variable names, w/c can be long
-        // regA and regC are size 8 since the longest reg name is of length 3 (r10 - r31) + \0, and extra padding for safety
-        int imm;
-        uint32_t code = 0;
-        int matched = 0; // flag for valid instruction
-
-        // daddiu
-        // %7[^,] means read up to 7 characters and stop at the comma
-        // #%i reads an int following a #
-        // sscanf(...) == 3 means all 3 fields were parsed successfully
-        if(sscanf(line, "daddiu %7[^,], %7[^,], #%i", regA, regB, &imm) == 3) {
-            int rt = RegisterNumber(regA);
-            int rs = RegisterNumber(regB); // convert rt and rs strings to reg numbers
-            if(rt >= 0 && rs >= 0) { 
-                code = Encode_I_Type(OP_DADDIU, rs, rt, imm); 
-                matched = 1; 
-            }
+// splits the operands at the commas; returns how many there are, -1 if too many
+static int SplitOperands(char *operands, char *parts[3]) {
+    if(*operands == '\0')
+        return 0;
+    int count = 0;
+    char *p = operands;
+    while(1) {
+        if(count == 3)
+            return -1;
+        char *comma = strchr(p, ',');
+        if(comma)
+            *comma = '\0';
+        parts[count++] = Trim(p);
+        if(!comma)
+            return count;
+        p = comma + 1;
+    }
+}
+
+static int IsLabel(const char *s) {
+    if(!isalpha((unsigned char)*s) && *s != '_')
+        return 0;
+    while(*s && IsLabelChar(*s))
+        s++;
+    return *s == '\0';
+}
+
+// an immediate: "#n", "n" or a label (copied to label)
+static int ParseImmediate(const char *operand, long long *value, char *label) {
+    const char *p = operand[0] == '#' ? operand + 1 : operand;
+    label[0] = '\0';
+    *value = 0;
+    if(IsLabel(p) && strlen(p) < MAX_LABEL_LEN) {
+        strcpy(label, p);
+        return 1;
+    }
+    if(*p == '\0')
+        return 0;
+    char *end;
+    *value = strtoll(p, &end, 0);
+    return *end == '\0';
+}
+
+// an immediate that can also be "%hi(label)" or "%lo(label)"
+static int ParseRelocatable(const char *operand, long long *value, char *label, int *relocation) {
+    const char *p = operand[0] == '#' ? operand + 1 : operand;
+    *relocation = MACHINE_RELOCATION_16;
+    if(p[0] != '%')
+        return ParseImmediate(operand, value, label);
+    if(strncmp(p, "%hi(", 4) == 0)
+        *relocation = MACHINE_RELOCATION_HI16;
+    else if(strncmp(p, "%lo(", 4) == 0)
+        *relocation = MACHINE_RELOCATION_LO16;
+    else
+        return 0;
+    const char *close = strchr(p, ')');
+    size_t length = close ? (size_t)(close - (p + 4)) : 0;
+    if(!close || close[1] != '\0' || length == 0 || length >= MAX_LABEL_LEN)
+        return 0;
+    memcpy(label, p + 4, length);
+    label[length] = '\0';
+    *value = 0;
+    return IsLabel(label);
+}
+
+// a memory operand "offset(rN)"; the offset is a number, a label, %lo(label)
+// or nothing
+static int ParseMemory(char *operand, long long *offset, char *label, int *relocation, int *base) {
+    char *open = strrchr(operand, '(');
+    char *close = open ? strchr(open, ')') : NULL;
+    if(!close || Trim(close + 1)[0] != '\0')
+        return 0;
+    *open = '\0';
+    *close = '\0';
+    *base = RegisterNumber(Trim(open + 1));
+    char *displacement = Trim(operand);
+    if(*displacement == '\0') {
+        *offset = 0;
+        label[0] = '\0';
+        *relocation = MACHINE_RELOCATION_16;
+        return *base >= 0;
+    }
+    return *base >= 0 && ParseRelocatable(displacement, offset, label, relocation);
+}
+
+static int FitsImmediate(long long value) {
+    return value >= -32768 && value <= 32767;
+}
+
+// encode one instruction, with 0 in place of a label operand whose name
+// goes to label ("" if there is none) and what it's used for to relocation;
+// returns 0 if it isn't an instruction we know, -1 if its immediate doesn't
+// fit in 16 bits
+static int EncodeInstruction(SourceLine *source, uint32_t *encoded, char *label, int *relocation) {
+    const MachineOpcode *op = FindOpcode(source->mnemonic);
+    if(!op)
+        return 0;
+    char *ops[3];
+    int count = SplitOperands(source->operands, ops);
+    long long imm = 0;
+    int rs = 0, rt = 0, rd = 0, shamt = 0;
+    label[0] = '\0';
+    *relocation = MACHINE_RELOCATION_16;
+
+    switch(op->format) {
+    // daddiu rt, rs, imm
+    case MACHINE_FORMAT_RT_RS_IMM:
+        if(count != 3 || (rt = RegisterNumber(ops[0])) < 0 || (rs = RegisterNumber(ops[1])) < 0 ||
+           !ParseRelocatable(ops[2], &imm, label, relocation))
+            return 0;
+        break;
+    // lui rt, imm (the 16 bits as they are, 0 to 65535 too)
+    case MACHINE_FORMAT_RT_IMM:
+        if(count != 2 || (rt = RegisterNumber(ops[0])) < 0 || !ParseRelocatable(ops[1], &imm, label, relocation))
+            return 0;
+        if(imm > 32767 && imm <= 65535)
+            imm -= 65536;
+        break;
+    // daddu rd, rs, rt
+    case MACHINE_FORMAT_RD_RS_RT:
+        if(count != 3 || (rd = RegisterNumber(ops[0])) < 0 || (rs = RegisterNumber(ops[1])) < 0 ||
+           (rt = RegisterNumber(ops[2])) < 0)
+            return 0;
+        break;
+    // dmult rs, rt
+    case MACHINE_FORMAT_RS_RT:
+        if(count != 2 || (rs = RegisterNumber(ops[0])) < 0 || (rt = RegisterNumber(ops[1])) < 0)
+            return 0;
+        break;
+    // mflo rd
+    case MACHINE_FORMAT_RD:
+        if(count != 1 || (rd = RegisterNumber(ops[0])) < 0)
+            return 0;
+        break;
+    // ld rt, offset(base)
+    case MACHINE_FORMAT_RT_MEMORY:
+        if(count != 2 || (rt = RegisterNumber(ops[0])) < 0 || !ParseMemory(ops[1], &imm, label, relocation, &rs))
+            return 0;
+        break;
+    // syscall [n]
+    case MACHINE_FORMAT_CODE:
+        if(count > 1 || (count == 1 && (!ParseImmediate(ops[0], &imm, label) || label[0] || imm < 0 || imm > 31)))
+            return 0;
+        shamt = imm;
+        break;
+    }
+
+    if(op->opcode == 0)
+        *encoded = Encode_R_Type(rs, rt, rd, shamt, op->funct);
+    else
+        *encoded = Encode_I_Type(op->opcode, rs, rt, (int16_t)imm);
+    return FitsImmediate(imm) ? 1 : -1;
+}
+
+int MachineAssembleLine(const char *text, uint32_t *code) {
+    char line[MAX_LABEL_LEN];
+    size_t length = strlen(text);
+    if(length >= sizeof(line))
+        return 0;
+    memcpy(line, text, length + 1);
+
+    SourceLine source;
+    char label[MAX_LABEL_LEN];
+    int relocation;
+    if(!SplitLine(line, &source) || source.label[0])
+        return 0;
+    int encoded = EncodeInstruction(&source, code, label, &relocation);
+    return label[0] ? 0 : encoded;
+}
+
+int MachineDisassemble(uint32_t code, char *text, size_t size) {
+    int opcode = code >> 26;
+    int rs = (code >> 21) & 0x1F;
+    int rt = (code >> 16) & 0x1F;
+    int rd = (code >> 11) & 0x1F;
+    int shamt = (code >> 6) & 0x1F;
+    int funct = code & 0x3F;
+    int imm = (int16_t)(code & 0xFFFF);
+
+    const MachineOpcode *op = NULL;
+    for(int i = 0; i < machine_opcode_count && !op; i++)
+        if(machine_opcodes[i].opcode == opcode && (opcode != 0 || machine_opcodes[i].funct == funct))
+            op = &machine_opcodes[i];
+
+    // the fields an instruction doesn't use are 0 in anything we assemble
+    int known = op != NULL;
+    if(op) {
+        switch(op->format) {
+        case MACHINE_FORMAT_RT_RS_IMM:
+            snprintf(text, size, "%s r%d, r%d, #%d", op->mnemonic, rt, rs, imm);
+            break;
+        case MACHINE_FORMAT_RD_RS_RT:
+            known = shamt == 0;
+            snprintf(text, size, "%s r%d, r%d, r%d", op->mnemonic, rd, rs, rt);
+            break;
+        case MACHINE_FORMAT_RS_RT:
+            known = rd == 0 && shamt == 0;
+            snprintf(text, size, "%s r%d, r%d", op->mnemonic, rs, rt);
+            break;
+        case MACHINE_FORMAT_RD:
+            known = rs == 0 && rt == 0 && shamt == 0;
+            snprintf(text, size, "%s r%d", op->mnemonic, rd);
+            break;
+        case MACHINE_FORMAT_RT_MEMORY:
+            snprintf(text, size, "%s r%d, %d(r%d)", op->mnemonic, rt, imm, rs);
+            break;
+        case MACHINE_FORMAT_RT_IMM:
+            known = rs == 0;
+            snprintf(text, size, "%s r%d, #%d", op->mnemonic, rt, imm);
+            break;
+        case MACHINE_FORMAT_CODE:
+            known = rs == 0 && rt == 0 && rd == 0;
+            snprintf(text, size, shamt ? "%s %d" : "%s", op->mnemonic, shamt);
+            break;
         }
-        // daddu
-        else if(sscanf(line, "daddu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
-            int rd = RegisterNumber(regA);
-            int rs = RegisterNumber(regB);
-            int rt = RegisterNumber(regC);
-            if(rd >= 0 && rs >= 0 && rt >= 0) { 
-                code = Encode_R_Type(rs, rt, rd, 0, FUNCT_DADDU); 
-                matched = 1; 
+    }
+    if(!known && size > 0)
+        text[0] = '\0';
+    return known;
+}
+
+static void AddSymbol(MachineImage *image, const char *name, int in_data, uint64_t value, uint64_t size);
+
+static int FindSymbol(const MachineImage *image, const char *name) {
+    if(image->bucket_count == 0)
+        return -1;
+    size_t mask = image->bucket_count - 1;
+    size_t i = hash64(name, strlen(name), 0) & mask;
+    while(image->symbol_buckets[i] >= 0) {
+        if(strcmp(image->symbols[image->symbol_buckets[i]].name, name) == 0)
+            return image->symbol_buckets[i];
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+int MachineFindSymbol(const MachineImage *image, const char *name) {
+    return FindSymbol(image, name);
+}
+
+static void IndexSymbol(MachineImage *image, int symbol) {
+    size_t mask = image->bucket_count - 1;
+    size_t i = hash64(image->symbols[symbol].name, strlen(image->symbols[symbol].name), 0) & mask;
+    while(image->symbol_buckets[i] >= 0)
+        i = (i + 1) & mask;
+    image->symbol_buckets[i] = symbol;
+}
+
+static void AddSymbol(MachineImage *image, const char *name, int in_data, uint64_t value, uint64_t size) {
+    if(FindSymbol(image, name) >= 0) {
+        fprintf(get_diagnostics_stream(), "Warning: label %s defined twice\n", name);
+        return;
+    }
+    if(image->symbol_count == image->symbol_capacity) {
+        image->symbol_capacity = image->symbol_capacity ? image->symbol_capacity * 2 : 16;
+        image->symbols = realloc(image->symbols, sizeof(MachineSymbol) * image->symbol_capacity);
+    }
+    MachineSymbol *symbol = &image->symbols[image->symbol_count++];
+    symbol->name = strdup(name);
+    symbol->in_data = in_data;
+    symbol->value = value;
+    symbol->size = size;
+
+    // keep the table at most half full
+    if((size_t)image->symbol_count * 2 > image->bucket_count) {
+        free(image->symbol_buckets);
+        image->bucket_count = image->bucket_count ? image->bucket_count * 2 : INITIAL_BUCKETS;
+        image->symbol_buckets = malloc(sizeof(int) * image->bucket_count);
+        memset(image->symbol_buckets, 0xff, sizeof(int) * image->bucket_count);
+        for(int i = 0; i < image->symbol_count; i++)
+            IndexSymbol(image, i);
+    } else {
+        IndexSymbol(image, image->symbol_count - 1);
+    }
+}
+
+static void AddDataBytes(MachineImage *image, const void *bytes, size_t length) {
+    if(image->data_size + length > image->data_capacity) {
+        while(image->data_size + length > image->data_capacity)
+            image->data_capacity = image->data_capacity ? image->data_capacity * 2 : 256;
+        image->data = realloc(image->data, image->data_capacity);
+    }
+    if(bytes)
+        memcpy(image->data + image->data_size, bytes, length);
+    else
+        memset(image->data + image->data_size, 0, length);
+    image->data_size += length;
+}
+
+static void AddDataWord(MachineImage *image, uint64_t value) {
+    unsigned char bytes[8];
+    for(int i = 0; i < 8; i++)
+        bytes[i] = (unsigned char)(value >> (image->big_endian ? (7 - i) * 8 : i * 8));
+    AddDataBytes(image, bytes, 8);
+}
+
+// a directive in .data: .space N, .asciiz "text" (with the escapes
+// AssemblyWriteData writes), .ascii "text" (the same without the '\0') or
+// .word64 a, b, ...; returns 0 if it's none
+static int AddData(MachineImage *image, SourceLine *source, const char *line) {
+    const char *m = source->mnemonic;
+    char *p = source->operands;
+    if(strcmp(m, ".space") == 0) {
+        char *end;
+        long long size = strtoll(p, &end, 0);
+        if(*p == '\0' || *Trim(end) != '\0' || size < 0)
+            return 0;
+        AddDataBytes(image, NULL, size);
+    } else if(strcmp(m, ".asciiz") == 0 || strcmp(m, ".ascii") == 0) {
+        if(*p != '"')
+            return 0;
+        for(p++; *p && *p != '"'; p++) {
+            char c = *p;
+            if(c == '\\' && p[1]) {
+                p++;
+                c = *p == 'n' ? '\n' : *p == 't' ? '\t' : *p == '0' ? '\0' : *p;
             }
+            AddDataBytes(image, &c, 1);
         }
-        // dsubu
-        else if(sscanf(line, "dsubu %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
-            int rd = RegisterNumber(regA);
-            int rs = RegisterNumber(regB);
-            int rt = RegisterNumber(regC);
-            if(rd >= 0 && rs >= 0 && rt >= 0) { 
-                code = Encode_R_Type(rs, rt, rd, 0, FUNCT_DSUBU);
-                matched = 1;
+        if(strcmp(m, ".asciiz") == 0)
+            AddDataBytes(image, "", 1);
+    } else if(strcmp(m, ".word64") == 0) {
+        char *value = p;
+        while(*value) {
+            char *comma = strchr(value, ',');
+            if(comma)
+                *comma = '\0';
+            char label[MAX_LABEL_LEN];
+            long long number;
+            if(!ParseImmediate(Trim(value), &number, label))
+                return 0;
+            if(label[0]) {
+                int symbol = FindSymbol(image, label);
+                if(symbol < 0) {
+                    fprintf(get_diagnostics_stream(), "Warning: undefined label %s: %s\n", label, line);
+                    number = 0;
+                } else {
+                    number = image->symbols[symbol].value;
+                }
             }
+            AddDataWord(image, number);
+            if(!comma)
+                break;
+            value = comma + 1;
         }
-        // dmult
-        else if(sscanf(line, "dmult %7[^,], %7s", regA, regB) == 2) {
-            int rs = RegisterNumber(regA);
-            int rt = RegisterNumber(regB);
-            if(rs >= 0 && rt >= 0) {
-                code = Encode_R_Type(rs, rt, 0, 0, FUNCT_DMULT + 4); // + 4 bc 0x1C - 0x18 = 0x04 (this outputs ...18 while in the simlator it is ...1C); same for ddiv
-                matched = 1; 
-            }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+void MachineImageInit(MachineImage *image, int big_endian) {
+    memset(image, 0, sizeof(*image));
+    image->big_endian = big_endian;
+}
+
+void FreeMachineImage(MachineImage *image) {
+    for(int i = 0; i < image->symbol_count; i++)
+        free(image->symbols[i].name);
+    for(int i = 0; i < image->fixup_count; i++) {
+        free(image->fixups[i].label);
+        free(image->fixups[i].line);
+    }
+    free(image->symbols);
+    free(image->symbol_buckets);
+    free(image->references);
+    free(image->fixups);
+    free(image->code);
+    free(image->data);
+    free(image->source_lines);
+    memset(image, 0, sizeof(*image));
+}
+
+// ".data" / ".code" (or ".text"): 1/0, -1 for anything else
+static int SectionDirective(const SourceLine *source) {
+    if(strcmp(source->mnemonic, ".data") == 0)
+        return 1;
+    if(strcmp(source->mnemonic, ".code") == 0 || strcmp(source->mnemonic, ".text") == 0)
+        return 0;
+    return -1;
+}
+
+void MachineDefineLabels(MachineImage *image, FILE *in) {
+    int in_data = 0;
+    size_t instruction = image->instruction_count;
+    char *line = NULL, *copy = NULL;
+    size_t size = 0, copy_size = 0;
+    while(ReadLine(in, &line, &size, &copy, &copy_size) > 0) {
+        SourceLine source;
+        if(!SplitLine(line, &source))
+            continue;
+        int section = SectionDirective(&source);
+        if(section >= 0) {
+            in_data = section;
+            continue;
         }
-        // ddiv
-        else if(sscanf(line, "ddiv %7[^,], %7s", regA, regB) == 2) {
-            int rs = RegisterNumber(regA);
-            int rt = RegisterNumber(regB);
-            if(rs >= 0 && rt >= 0) { 
-                code = Encode_R_Type(rs, rt, 0, 0, FUNCT_DDIV + 4);  
-                matched = 1; 
-            }
+
+        if(!in_data) {
+            if(source.label[0])
+                AddSymbol(image, source.label, 0, instruction * 4, 0);
+            uint32_t code;
+            char label[MAX_LABEL_LEN];
+            int relocation;
+            if(source.mnemonic[0] && EncodeInstruction(&source, &code, label, &relocation) != 0)
+                instruction++;
+            continue;
         }
-        // mflo
-        else if(sscanf(line, "mflo %7s", regA) == 1) {
-            int rd = RegisterNumber(regA);
-            if(rd >= 0) {
-                code = Encode_R_Type(0, 0, rd, 0, FUNCT_MFLO);
-                matched = 1;
-            }
+
+        // a .word64 is 8 byte aligned, label and all
+        if(strcmp(source.mnemonic, ".word64") == 0 && image->data_size % 8)
+            AddDataBytes(image, NULL, 8 - image->data_size % 8);
+        uint64_t start = image->data_size;
+        if(source.mnemonic[0] && !AddData(image, &source, copy)) {
+            fprintf(get_diagnostics_stream(), "Warning: could not parse line: %s\n", copy);
+            continue;
         }
-        // mfhi
-        else if(sscanf(line, "mfhi %7s", regA) == 1) {
-            int rd = RegisterNumber(regA);
-            if(rd >= 0 ){ 
-                code = Encode_R_Type(0, 0, rd, 0, FUNCT_MFHI); 
-                matched = 1; 
+        if(source.label[0])
+            AddSymbol(image, source.label, 1, start, image->data_size - start);
+    }
+    free(line);
+    free(copy);
+}
+
+static void AddReference(MachineImage *image, size_t instruction, int symbol, int relocation) {
+    if(image->reference_count == image->reference_capacity) {
+        image->reference_capacity = image->reference_capacity ? image->reference_capacity * 2 : 64;
+        image->references = realloc(image->references, sizeof(MachineReference) * image->reference_capacity);
+    }
+    image->references[image->reference_count++] = (MachineReference){ instruction, symbol, relocation };
+}
+
+// fill in the label's address (or its half), if it has one yet
+static int ResolveLabel(MachineImage *image, uint32_t *code, const char *label, int relocation,
+                        size_t instruction, const char *line) {
+    int symbol = FindSymbol(image, label);
+    if(symbol < 0)
+        return 0;
+    uint64_t address = image->symbols[symbol].value;
+    if(relocation == MACHINE_RELOCATION_HI16)
+        address = (address + 0x8000) >> 16;
+    else if(relocation == MACHINE_RELOCATION_16 && !FitsImmediate((long long)address))
+        fprintf(get_diagnostics_stream(), "Warning: address of %s out of 16-bit range: %s\n", label, line);
+    *code |= (uint32_t)(address & 0xFFFF);
+    // the relocations are the ELF object's, made from the collected code;
+    // a listing is written as it goes and keeps nothing per instruction
+    if(image->collect_code)
+        AddReference(image, instruction, symbol, relocation);
+    return 1;
+}
+
+// the text of a line of the source, for the annotated listing
+static const char *SourceText(MachineImage *image, int line, size_t *length) {
+    if(!image->source || line < 1)
+        return NULL;
+    if(!image->source_lines) {
+        // where every line starts
+        int capacity = 64;
+        image->source_lines = malloc(sizeof(size_t) * capacity);
+        image->source_lines[image->source_line_count++] = 0;
+        for(size_t i = 0; i < image->source_length; i++) {
+            if(image->source[i] != '\n')
+                continue;
+            if(image->source_line_count == capacity) {
+                capacity *= 2;
+                image->source_lines = realloc(image->source_lines, sizeof(size_t) * capacity);
             }
+            image->source_lines[image->source_line_count++] = i + 1;
         }
-        // ld (load doubleword)
-        else if(sscanf(line, "ld %7[^,], %7[^)]", regA, regB) == 2) {
-            int rt = RegisterNumber(regA);
-            int rs = 0;
-            int16_t imm = 0;
-            char var_name[MAX_NAME_LEN] = {0};
-            sscanf(regB, "%63[^ (]", var_name);
-            imm = (int16_t)GetOffsetOfTheSymbol(var_name);
-            if(rt >= 0) {
-                code = Encode_I_Type(OP_LD, rs, rt, imm);
-                matched = 1;
-            }
+    }
+    if(line > image->source_line_count)
+        return NULL;
+    size_t start = image->source_lines[line - 1];
+    size_t end = line < image->source_line_count ? image->source_lines[line] - 1 : image->source_length;
+    while(end > start && (image->source[end - 1] == '\r' || image->source[end - 1] == '\n'))
+        end--;
+    *length = end - start;
+    return image->source + start;
+}
+
+// "; line N: <source>" above the code of a source line
+static void ListSourceLine(MachineImage *image, ListingWriter *w, int line) {
+    char *p = ListingReserve(w);
+    p += sprintf(p, "; line %d", line);
+    w->used = p - w->buffer;
+    size_t length;
+    const char *text = SourceText(image, line, &length);
+    if(text) {
+        ListingWrite(w, ": ", 2);
+        ListingWrite(w, text, length);
+    }
+    ListingWrite(w, "\n", 1);
+}
+
+// address, hex, fields and the assembly it came from
+static void ListAnnotated(ListingWriter *w, size_t instruction, uint32_t code, const char *assembly) {
+    char *p = ListingReserve(w);
+    p = RenderHex(p, instruction * 4, 8);
+    memcpy(p, "  ", 2);
+    p = RenderHex(p + 2, code, 8);
+    memcpy(p, "  ", 2);
+    p = RenderFields(p + 2, code);
+    *p++ = ' ';
+    w->used = p - w->buffer;
+    while(*assembly && isspace((unsigned char)*assembly))
+        assembly++;
+    ListingWrite(w, assembly, strlen(assembly));
+    ListingWrite(w, "\n", 1);
+}
+
+void MachineEncode(MachineImage *image, FILE *in, FILE *listing) {
+    ListingWriter writer = { listing, listing ? malloc(LISTING_BUFFER) : NULL, 0 };
+    int in_data = 0;
+    int source_line = 0, listed_line = 0;
+    char *line = NULL, *copy = NULL;
+    size_t size = 0, copy_size = 0;
+    while(ReadLine(in, &line, &size, &copy, &copy_size) > 0) {
+        int marker;
+        if(image->annotated && sscanf(line, " ; line %d", &marker) == 1) {
+            source_line = marker;
+            continue;
         }
-        // sd (store doubleword)
-        else if(sscanf(line, "sd %7[^,], %7[^)]", regA, regB) == 2) {
-            int rt = RegisterNumber(regA);
-            int rs = 0;
-            int16_t imm = 0;
-            char var_name[MAX_NAME_LEN] = {0};
-            sscanf(regB, "%63[^ (]", var_name);
-            imm = (int16_t)GetOffsetOfTheSymbol(var_name);
-            if(rt >= 0) {
-                code = Encode_I_Type(OP_SD, rs, rt, imm);
-                matched = 1;
-            }
-        } 
-
-        //////////////
-        // daddi with # (immediate) - like daddi r1, r0, #32
-        if(sscanf(line, "daddi %7[^,], %7[^,], #%i", regA, regB, &imm) == 3) {
-            int rt = RegisterNumber(regA);
-            int rs = RegisterNumber(regB);
-            if(rt >= 0 && rs >= 0) { 
-                code = Encode_I_Type(OP_DADDI, rs, rt, imm); 
-                matched = 1; 
-            }
+        SourceLine source;
+        if(!SplitLine(line, &source))
+            continue;
+        int section = SectionDirective(&source);
+        if(section >= 0) {
+            in_data = section;
+            continue;
         }
-        // daddi without # (for labels) - like daddi r1, r0, str0  
-        else if(sscanf(line, "daddi %7[^,], %7[^,], %s", regA, regB, regC) == 3) {
-            int rt = RegisterNumber(regA);
-            int rs = RegisterNumber(regB);
-            // For labels, use 0 as immediate placeholder
-            if(rt >= 0 && rs >= 0) { 
-                code = Encode_I_Type(OP_DADDI, rs, rt, 0); 
-                matched = 1; 
-            }
+        // the directives and labels were pass 1's
+        if(in_data || source.mnemonic[0] == '\0')
+            continue;
+
+        uint32_t code;
+        char label[MAX_LABEL_LEN];
+        int relocation;
+        int encoded = EncodeInstruction(&source, &code, label, &relocation);
+        if(encoded == 0) {
+            fprintf(get_diagnostics_stream(), "Warning: could not parse line: %s\n", copy);
+            continue;
         }
+        if(encoded < 0)
+            fprintf(get_diagnostics_stream(), "Warning: immediate out of 16-bit range: %s\n", copy);
 
-        // dadd (like dadd r1, r2, r0)
-        else if(sscanf(line, "dadd %7[^,], %7[^,], %7s", regA, regB, regC) == 3) {
-            int rd = RegisterNumber(regA);
-            int rs = RegisterNumber(regB);
-            int rt = RegisterNumber(regC);
-            if(rd >= 0 && rs >= 0 && rt >= 0) { 
-                code = Encode_R_Type(rs, rt, rd, 0, FUNCT_DADD); 
-                matched = 1; 
+        size_t instruction = image->instruction_count++;
+        if(label[0] && !ResolveLabel(image, &code, label, relocation, instruction, copy)) {
+            if(image->fixup_count == image->fixup_capacity) {
+                image->fixup_capacity = image->fixup_capacity ? image->fixup_capacity * 2 : 64;
+                image->fixups = realloc(image->fixups, sizeof(MachineFixup) * image->fixup_capacity);
             }
+            image->fixups[image->fixup_count++] = (MachineFixup){ instruction, code, strdup(label), relocation, strdup(copy) };
         }
 
-        // syscall with number - like syscall 4
-        else if(sscanf(line, "syscall %d", &imm) == 1) {
-            code = Encode_R_Type(0, 0, 0, imm, FUNCT_SYSCALL);
-            matched = 1;
+        if(image->collect_code) {
+            if(image->code_count == image->code_capacity) {
+                image->code_capacity = image->code_capacity ? image->code_capacity * 2 : 256;
+                image->code = realloc(image->code, sizeof(uint32_t) * image->code_capacity);
+            }
+            image->code[image->code_count++] = code;
         }
-
-        // syscall without number - like syscall
-        else if(strncmp(p, "syscall", 7) == 0) {
-            code = Encode_R_Type(0, 0, 0, 0, FUNCT_SYSCALL);
-            matched = 1;
+        if(!listing)
+            continue;
+        if(!image->annotated) {
+            writer.used = RenderInstruction(ListingReserve(&writer), code) - writer.buffer;
+            continue;
+        }
+        if(source_line != listed_line) {
+            ListSourceLine(image, &writer, source_line);
+            listed_line = source_line;
         }
-        //////////////
+        ListAnnotated(&writer, instruction, code, copy);
+    }
+    if(listing) {
+        ListingFlush(&writer);
+        free(writer.buffer);
+    }
+    free(line);
+    free(copy);
+}
 
-        if(matched) {
-            PrintBinary(code, out);
-            fprintf(out," : %08X\n", code); // hex representation
+void MachineResolveFixups(MachineImage *image, FILE *listing, long listing_start) {
+    int patched = 0;
+    for(int i = 0; i < image->fixup_count; i++) {
+        MachineFixup *fixup = &image->fixups[i];
+        uint32_t code = fixup->code;
+        if(!ResolveLabel(image, &code, fixup->label, fixup->relocation, fixup->instruction, fixup->line)) {
+            fprintf(get_diagnostics_stream(), "Warning: undefined label %s: %s\n", fixup->label, fixup->line);
         } else {
-            fprintf(stderr,"Warning: could not parse line: %s\n", line);
+            if(image->collect_code)
+                image->code[fixup->instruction] = code;
+            if(listing) {
+                char text[MACHINE_LISTING_LINE];
+                RenderInstruction(text, code);
+                fseek(listing, listing_start + (long)(fixup->instruction * MACHINE_LISTING_LINE), SEEK_SET);
+                fwrite(text, 1, MACHINE_LISTING_LINE, listing);
+                patched = 1;
+            }
         }
+        free(fixup->label);
+        free(fixup->line);
+    }
+    image->fixup_count = 0;
+    if(patched)
+        fseek(listing, 0, SEEK_END);
+}
+
+// both passes over one seekable stream
+static void Assemble(MachineImage *image, FILE *in, FILE *listing) {
+    long start = ftell(in);
+    if(start >= 0) {
+        MachineDefineLabels(image, in);
+        fseek(in, start, SEEK_SET);
+    }
+    MachineEncode(image, in, listing);
+    MachineResolveFixups(image, NULL, 0);
+    stats_count(STATS_INSTRUCTIONS, image->instruction_count);
+}
+
+// MAIN TRANSLATION SECTION
+// convert assembly to machine code, one line per assembly
+// each instrcution line is converted into a bits of integer code
+// and teh resulting binary and hex are written to out_file
+int MachineFromAssembly(const char *asm_file, const char *out_file) {
+    FILE *in = fopen(asm_file, "r");
+    if(!in)
+        return 0;
+    FILE *out = fopen(out_file, "w");
+    if(!out) { 
+        fclose(in); 
+        return 0; 
     }
 
+    int ok = MachineFromAssemblyStream(in, out);
+
     fclose(in);
     fclose(out);
+    return ok;
+}
+
+// same as above but on already open streams (e.g. a tmpfile when
+// the assembly itself was not requested); streams are left open
+int MachineFromAssemblyStream(FILE *in, FILE *out) {
+    MachineImage image;
+    MachineImageInit(&image, 1);
+    Assemble(&image, in, out);
+    FreeMachineImage(&image);
+    return 1;
+}
+
+int MachineAnnotatedListing(FILE *in, FILE *out, const char *source, size_t source_length) {
+    MachineImage image;
+    MachineImageInit(&image, 1);
+    image.annotated = 1;
+    image.source = source;
+    image.source_length = source_length;
+    Assemble(&image, in, out);
+    FreeMachineImage(&image);
+    return 1;
+}
+
+int MachineImageFromAssemblyStream(FILE *in, MachineImage *image, int big_endian) {
+    MachineImageInit(image, big_endian);
+    image->collect_code = 1;
+    Assemble(image, in, NULL);
     return 1;
 }
+
+// BINARY OUTPUTS
+
+// the code words in the image's byte order
+static unsigned char *CodeBytes(const MachineImage *image) {
+    unsigned char *bytes = malloc(image->code_count * 4 + 1);
+    for(size_t i = 0; i < image->code_count; i++) {
+        uint32_t code = image->code[i];
+        for(int b = 0; b < 4; b++)
+            bytes[i * 4 + b] = (unsigned char)(code >> (image->big_endian ? (3 - b) * 8 : b * 8));
+    }
+    return bytes;
+}
+
+char *MachineRawImage(const MachineImage *image, size_t *length) {
+    size_t data_offset = MACHINE_DATA_OFFSET(image->code_count);
+    *length = data_offset + image->data_size;
+    char *file = calloc(1, *length + 1);
+    unsigned char *code = CodeBytes(image);
+    memcpy(file, code, image->code_count * 4);
+    if(image->data_size > 0)
+        memcpy(file + data_offset, image->data, image->data_size);
+    free(code);
+    return file;
+}
+
+char *MachineElfObject(const MachineImage *image, size_t *length) {
+    unsigned char *code = CodeBytes(image);
+    ElfSection sections[2] = {
+        { ".text", ELF_SECTION_PROGBITS, ELF_SECTION_ALLOC | ELF_SECTION_EXEC, code, image->code_count * 4, 4 },
+        { ".data", ELF_SECTION_PROGBITS, ELF_SECTION_ALLOC | ELF_SECTION_WRITE, image->data, image->data_size, 8 }
+    };
+
+    // the labels are local, the program's entry is global
+    ElfSymbol *symbols = malloc(sizeof(ElfSymbol) * (image->symbol_count + 1));
+    for(int i = 0; i < image->symbol_count; i++) {
+        const MachineSymbol *s = &image->symbols[i];
+        symbols[i] = (ElfSymbol){ s->name, s->in_data ? 2 : 1, s->value, s->size,
+                                  s->in_data ? ELF_SYMBOL_OBJECT : ELF_SYMBOL_NOTYPE, 0 };
+    }
+    symbols[image->symbol_count] = (ElfSymbol){ "_start", 1, 0, image->code_count * 4, ELF_SYMBOL_FUNC, 1 };
+
+    // every label use is a 16 bit absolute address or one half of one
+    static const uint32_t relocation_types[] = {
+        ELF_RELOCATION_MIPS_16, ELF_RELOCATION_MIPS_HI16, ELF_RELOCATION_MIPS_LO16
+    };
+    ElfRelocation *relocations = malloc(sizeof(ElfRelocation) * (image->reference_count + 1));
+    for(int i = 0; i < image->reference_count; i++)
+        relocations[i] = (ElfRelocation){ 1, image->references[i].instruction * 4, image->references[i].symbol,
+                                          relocation_types[image->references[i].relocation], 0 };
+
+    ElfHeader header = { ELF_MACHINE_MIPS, ELF_FLAGS_MIPS64, image->big_endian, 0 };
+    char *file = elf_object(&header, sections, 2, symbols, image->symbol_count + 1,
+                            relocations, image->reference_count, length);
+    free(relocations);
+    free(symbols);
+    free(code);
+    return file;
+}
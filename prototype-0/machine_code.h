@@ -2,7 +2,160 @@
 #define MACHINE_CODE_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 
+// assemble a whole .s file/stream into the machine code listing
+// (two passes: the labels first, so the input has to be seekable)
 int MachineFromAssembly(const char *asm_file, const char *out_file);
+int MachineFromAssemblyStream(FILE *in, FILE *out);
 
-#endif
\ No newline at end of file
+// every listing line is "<32 bits in groups of 4>  : <hex>\n"
+#define MACHINE_LISTING_LINE 52
+
+// the listing with each instruction's address, hex, fields in binary
+// (opcode rs rt rd shamt funct, or opcode rs rt immediate) and assembly,
+// under the line of source it came from: the "; line N" markers of
+// AssemblyLineMarkers, with the text from source if it's not NULL
+int MachineAnnotatedListing(FILE *in, FILE *out, const char *source, size_t source_length);
+
+// I-type opcodes
+#define OP_DADDIU 0x19 // daddiu rt, rs, immediate
+#define OP_LD 0x37 // 64-bit load doubleword
+#define OP_SD 0x3F // 64-bit store doubleword
+#define OP_DADDI 0x18  
+#define OP_LUI 0x0F // lui rt, immediate: the immediate << 16, sign extended
+
+// R-type function codes (funct field)
+#define FUNCT_DADDU 0x2D
+#define FUNCT_DSUBU 0x2F
+#define FUNCT_DMULT 0x1C
+#define FUNCT_DDIV 0x1E
+#define FUNCT_MFHI 0x10
+#define FUNCT_MFLO 0x12
+#define FUNCT_SYSCALL 0x0C
+#define FUNCT_DADD 0x2C
+
+// how an instruction's operands are written (and where they go)
+#define MACHINE_FORMAT_RT_RS_IMM 0 // daddiu rt, rs, #imm       (I-type)
+#define MACHINE_FORMAT_RD_RS_RT  1 // daddu rd, rs, rt          (R-type)
+#define MACHINE_FORMAT_RS_RT     2 // dmult rs, rt              (R-type)
+#define MACHINE_FORMAT_RD        3 // mflo rd                   (R-type)
+#define MACHINE_FORMAT_RT_MEMORY 4 // ld rt, offset(base)       (I-type, base in rs)
+#define MACHINE_FORMAT_CODE      5 // syscall [n]               (R-type, n in shamt)
+#define MACHINE_FORMAT_RT_IMM    6 // lui rt, #imm              (I-type, rs 0)
+
+// what a label operand puts in the immediate: its address (which has to fit
+// in 16 bits) or, as %hi(label) and %lo(label), the halves of an address
+// anywhere in the first 2 GB: lui rt, %hi(label) then %lo(label)(rt) or
+// daddiu rt, rt, %lo(label). %hi is rounded up when %lo is negative
+#define MACHINE_RELOCATION_16   0
+#define MACHINE_RELOCATION_HI16 1
+#define MACHINE_RELOCATION_LO16 2
+
+// the opcode table of the assembler and the disassembler
+typedef struct {
+    const char *mnemonic;
+    uint8_t opcode;     // 0 for the R-type ones, told apart by funct
+    uint8_t funct;
+    int format;         // MACHINE_FORMAT_*
+} MachineOpcode;
+
+extern const MachineOpcode machine_opcodes[];
+extern const int machine_opcode_count;
+
+// one instruction's assembly (no labels) to its word: 1, 0 if it isn't an
+// instruction, -1 if the immediate doesn't fit in 16 bits
+int MachineAssembleLine(const char *text, uint32_t *code);
+// and back, as the canonical "daddiu r1, r0, #5" / "ld r1, 16(r0)"; returns
+// 0 (and "") for a word the assembler would never produce
+int MachineDisassemble(uint32_t code, char *text, size_t size);
+
+// a label: a .data variable/string/word, or a place in the code
+typedef struct {
+    char *name;
+    int in_data;        // else .code
+    uint64_t value;     // its address (data and code both start at 0)
+    uint64_t size;
+} MachineSymbol;
+
+// an instruction that uses a label (a relocation in the ELF object)
+typedef struct {
+    size_t instruction;
+    int symbol;         // index into symbols
+    int relocation;     // MACHINE_RELOCATION_*
+} MachineReference;
+
+// a label used before anything defined it
+typedef struct {
+    size_t instruction;
+    uint32_t code;      // with 0 where the address goes
+    char *label;
+    int relocation;     // MACHINE_RELOCATION_*
+    char *line;         // for the warning if it never gets defined
+} MachineFixup;
+
+// the assembler's state: its symbol table built from the directives, the
+// data image and (if collected) the code
+typedef struct {
+    int big_endian;             // of the .word64s in the data
+
+    uint32_t *code;             // only with collect_code
+    size_t code_count;
+    size_t code_capacity;
+    int collect_code;
+    size_t instruction_count;   // instructions encoded so far
+
+    unsigned char *data;        // .space is zero filled, .asciiz with its '\0'
+    size_t data_size;
+    size_t data_capacity;
+
+    MachineSymbol *symbols;
+    int symbol_count;
+    int symbol_capacity;
+    int *symbol_buckets;        // open addressing by name, -1 = free
+    size_t bucket_count;
+
+    MachineReference *references;   // only with collect_code
+    int reference_count;
+    int reference_capacity;
+
+    MachineFixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+
+    // annotated listing (MachineAnnotatedListing)
+    int annotated;
+    const char *source;
+    size_t source_length;
+    size_t *source_lines;       // where each line starts, made on first use
+    int source_line_count;
+} MachineImage;
+
+// the raw image is the code, then the data from the next 8 byte boundary
+#define MACHINE_DATA_OFFSET(code_count) (((code_count) * 4 + 7) & ~(size_t)7)
+
+void MachineImageInit(MachineImage *image, int big_endian);
+void FreeMachineImage(MachineImage *image);
+
+// pass 1: the labels and the data of the directives (.space, .ascii(z), .word64)
+void MachineDefineLabels(MachineImage *image, FILE *in);
+// pass 2: encode the instructions, listed to listing if not NULL. a label
+// that isn't defined yet becomes a fixup (its instruction listed with 0)
+void MachineEncode(MachineImage *image, FILE *in, FILE *listing);
+// fill in the fixups whose labels are defined now, in the code and in the
+// listing (which started at listing_start), and warn about the rest
+void MachineResolveFixups(MachineImage *image, FILE *listing, long listing_start);
+
+// both passes over a whole program, collecting the code
+int MachineImageFromAssemblyStream(FILE *in, MachineImage *image, int big_endian);
+// the index of a label in image->symbols, -1 if there is none
+int MachineFindSymbol(const MachineImage *image, const char *name);
+
+// the whole file in memory (malloc'd), in the image's byte order
+char *MachineRawImage(const MachineImage *image, size_t *length);
+// an ELF64 relocatable object: .text, .data, a symbol table and the
+// relocations of the label uses
+char *MachineElfObject(const MachineImage *image, size_t *length);
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "options.h"
+#include "driver.h"
+#include "cache.h"
+#include "daemon.h"
+#include "stream.h"
+#include "batch.h"
+#include "stats.h"
+#include "trace.h"
+
+// write the trace (if there is one) and let go of the options
+static int Finish(CompilerOptions *opts, int status) {
+    if(opts->trace_file && !trace_write()) {
+        fprintf(stderr, "Error: Cannot write trace %s\n", opts->trace_file);
+        status = 1;
+    }
+    free_options(opts);
+    return status;
+}
+
+int main(int argc, char **argv) {
+    CompilerOptions opts;
+    if(!parse_options(argc, argv, &opts)) {
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+    if(opts.trace_file && !trace_start(opts.trace_file)) {
+        fprintf(stderr, "Error: Cannot write trace %s\n", opts.trace_file);
+        free_options(&opts);
+        return 1;
+    }
+
+    if(opts.daemon)
+        return Finish(&opts, run_daemon(&opts));
+
+    if(opts.batch)
+        return Finish(&opts, run_batch(&opts));
+
+    // never holds the whole program, so there is nothing to cache either
+    if(opts.stream || opts.pipeline)
+        return Finish(&opts, opts.pipeline ? compile_pipeline(&opts) : compile_stream(&opts));
+
+    if(opts.time_passes || opts.stats)
+        stats_enable();
+
+    size_t length;
+    stats_begin(STATS_READ);
+    trace_begin("read");
+    char *source = read_source_file(opts.input_filename, &length);
+    trace_end("read");
+    stats_end(STATS_READ);
+    if(!source) {
+        fprintf(stderr, "Error: Cannot open file %s\n", opts.input_filename);
+        return Finish(&opts, 1);
+    }
+
+    // a one-shot compiler only has the on-disk cache tier
+    Cache *cache = opts.cache_dir ? cache_create(opts.cache_dir, 0) : NULL;
+    CacheKey key;
+    CompileResult result;
+    int cached = 0;
+
+    if(cache) {
+        key = cache_key(source, length, &opts);
+        cached = cache_lookup(cache, &key, &result);
+    }
+    if(!cached) {
+        compile_source(source, length, &opts, &result);
+        if(cache)
+            cache_store(cache, &key, &result);
+    }
+
+    int status = result.status;
+    stats_begin(STATS_EMIT);
+    trace_begin("emit");
+    if(!emit_result(&result, &opts))
+        status = 1;
+    trace_end("emit");
+    stats_end(STATS_EMIT);
+
+    if(cache) {
+        if(opts.cache_stats)
+            cache_print_stats(cache, stderr);
+        cache_destroy(cache);
+    }
+    if(opts.time_passes || opts.stats)
+        stats_report(stderr, opts.time_passes, opts.stats, opts.stats_json);
+    free_result(&result);
+    free(source);
+    return Finish(&opts, status);
+}
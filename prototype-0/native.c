@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "native.h"
+#include "x86_64.h"
+#include "elf.h"
+#include "driver.h"
+
+// where the program goes: the code right behind the ELF headers
+#define BASE_ADDRESS 0x400000
+#define CODE_ADDRESS (BASE_ADDRESS + ELF_HEADERS_SIZE(2))
+
+#define ALIGN(n, a) (((n) + (a) - 1) & ~(uint64_t)((a) - 1))
+
+// write(1, rsi, rdx) until it's all out (or fails)
+static const unsigned char write_all_routine[] = {
+    0x48, 0x85, 0xd2,                   // next: test rdx, rdx
+    0x74, 0x19,                         // jz done
+    0xb8, 0x01, 0x00, 0x00, 0x00,       // mov eax, 1 (write)
+    0xbf, 0x01, 0x00, 0x00, 0x00,       // mov edi, 1 (stdout)
+    0x0f, 0x05,                         // syscall
+    0x48, 0x85, 0xc0,                   // test rax, rax
+    0x7e, 0x08,                         // jle done
+    0x48, 0x01, 0xc6,                   // add rsi, rax
+    0x48, 0x29, 0xc2,                   // sub rdx, rax
+    0xeb, 0xe2,                         // jmp next
+    0xc3                                // done: ret
+};
+
+// call write_all_routine, whose rel32 is patched in at the end
+static void EmitWriteAll(X86Code *x, size_t *calls, int *call_count) {
+    x86_emit(x, "\xe8", 1);
+    calls[(*call_count)++] = x->size;
+    x86_emit32(x, 0);
+}
+
+// what run_program prints for the error at this exit
+static char *ExitMessage(const X86Exit *exit, size_t *length) {
+    ErrorState errors;
+    error_state_init(&errors);
+    if(exit->uninitialized)
+        report_uninitialized_variable(&errors, exit->line, 0, exit->name);
+    else
+        report_division_by_zero(&errors, exit->line, 0);
+
+    char *message = NULL;
+    FILE *out = open_memstream(&message, length);
+    print_run_result(out, &errors, "");
+    fclose(out);
+    error_state_free(&errors);
+    return message;
+}
+
+char *native_executable(Node *program, size_t *length) {
+    X86Code x;
+    x86_init(&x);
+
+    // mov rbx, frame; mov r12, output (both in .bss, filled in below)
+    x86_emit(&x, "\x48\xbb", 2);
+    size_t frame_address = x.size;
+    x86_emit64(&x, 0);
+    x86_emit(&x, "\x49\xbc", 2);
+    size_t output_address[2];
+    output_address[0] = x.size;
+    x86_emit64(&x, 0);
+
+    x86_program(&x, program);
+
+    // every exit and the end of the program write something
+    size_t *calls = malloc(sizeof(size_t) * (x.exit_count + 1));
+    int call_count = 0;
+
+    // mov rsi, output; mov rdx, r12; sub rdx, rsi; call write_all; xor edi, edi
+    x86_emit(&x, "\x48\xbe", 2);
+    output_address[1] = x.size;
+    x86_emit64(&x, 0);
+    x86_emit(&x, "\x4c\x89\xe2\x48\x29\xf2", 6);
+    EmitWriteAll(&x, calls, &call_count);
+    x86_emit(&x, "\x31\xff", 2);
+    // exit: mov eax, 60 (exit); syscall
+    size_t exit_call = x.size;
+    x86_emit(&x, "\xb8\x3c\x00\x00\x00\x0f\x05", 7);
+
+    // one stub per exit: mov rsi, message; mov edx, length; call write_all;
+    // mov edi, 1; jmp exit
+    for(int i = 0; i < x.exit_count; i++) {
+        size_t message_length;
+        char *message = ExitMessage(&x.exits[i], &message_length);
+        size_t offset = x86_add_data(&x, message, message_length);
+        free(message);
+
+        x86_jump_here(&x, x.exits[i].position);
+        x86_emit(&x, "\x48\xbe", 2);
+        x86_emit_data_address(&x, offset);
+        x86_emit(&x, "\xba", 1);
+        x86_emit32(&x, (int32_t)message_length);
+        EmitWriteAll(&x, calls, &call_count);
+        x86_emit(&x, "\xbf\x01\x00\x00\x00\xe9", 6);
+        x86_emit32(&x, (int32_t)(exit_call - (x.size + 4)));
+    }
+
+    size_t routine = x.size;
+    x86_emit(&x, write_all_routine, sizeof(write_all_routine));
+    for(int i = 0; i < call_count; i++)
+        x86_patch32(&x, calls[i], (int32_t)(routine - (calls[i] + 4)));
+    free(calls);
+    x86_finish(&x);
+
+    // code, then the text it prints (one read+exec segment), then .bss
+    uint64_t data_address = CODE_ADDRESS + ALIGN(x.size, 16);
+    x86_relocate(&x, data_address);
+    uint64_t bss_address = ALIGN(data_address + x.data_size, ELF_PAGE_SIZE);
+    uint64_t frame_size = ALIGN(((uint64_t)x.variable_count + 1) * 4, 16);
+    x86_patch64(&x, frame_address, bss_address);
+    x86_patch64(&x, output_address[0], bss_address + frame_size);
+    x86_patch64(&x, output_address[1], bss_address + frame_size);
+
+    size_t text_size = data_address - CODE_ADDRESS + x.data_size;
+    char *text = calloc(1, text_size);
+    memcpy(text, x.code, x.size);
+    memcpy(text + (data_address - CODE_ADDRESS), x.data, x.data_size);
+
+    ElfSegment segments[2] = {
+        { text, text_size, text_size, CODE_ADDRESS, ELF_R | ELF_X },
+        { NULL, 0, frame_size + x.output_bound, bss_address, ELF_R | ELF_W },
+    };
+    ElfHeader header = { ELF_MACHINE_X86_64, 0, 0, CODE_ADDRESS };
+    char *file = elf_executable(&header, segments, 2, length);
+
+    free(text);
+    x86_free(&x);
+    return file;
+}
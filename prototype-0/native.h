@@ -0,0 +1,19 @@
+#ifndef NATIVE_H
+#define NATIVE_H
+
+#include <stddef.h>
+#include "ast.h"
+
+// compile a checked program into a standalone x86-64 Linux executable
+//
+// the same code as the JIT (x86_64.h) behind a _start that needs no libc:
+// the frame and the output buffer are in .bss, and at the end the output
+// goes out with write(2) and the program exits with exit(2). a runtime
+// error writes exactly what run_program would have printed instead and
+// exits with status 1. the program itself can't crash it: the division
+// is x86_64.c's, which doesn't idiv by -1, so the executable prints what
+// --run prints where the CPU would have raised SIGFPE.
+// returns the ELF file (malloc'd)
+char *native_executable(Node *program, size_t *length);
+
+#endif
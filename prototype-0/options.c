@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "passes.h"
+
+// default size of the daemon's in-memory cache tier
+#define DEFAULT_CACHE_MEMORY (64u << 20)
+
+static const char *mc_extensions[] = { ".mc", ".bin", ".o", ".lst" };
+
+// build the machine code filename from the assembly filename
+// "out.s" -> "out.mc", anything else gets ".mc" appended
+// (.bin/.o for the binary formats)
+static char *MachineFilenameFor(const char *asm_filename, const char *extension) {
+    size_t len = strlen(asm_filename);
+    char *name = malloc(len + strlen(extension) + 1);
+    strcpy(name, asm_filename);
+
+    char *dot = strrchr(name, '.');
+    if(dot && strcmp(dot, ".s") == 0)
+        strcpy(dot, extension);
+    else
+        strcat(name, extension);
+    return name;
+}
+
+void print_usage(FILE *out, const char *prog) {
+    fprintf(out, "Usage: %s [options] <input_file> [output_file]\n", prog);
+    fprintf(out, "       %s --daemon [cache options]\n", prog);
+    fprintf(out, "       %s --batch [options] <input_file|'glob'|@list_file>...\n", prog);
+    fprintf(out, "Stages (default: all of them):\n");
+    fprintf(out, "  --run         interpret the program and print its output\n");
+    fprintf(out, "  -S            write MIPS64 assembly\n");
+    fprintf(out, "  --mc          write machine code\n");
+    fprintf(out, "  --check-only  only parse and check the program\n");
+    fprintf(out, "  --stream      compile statement by statement in constant memory (no cache)\n");
+    fprintf(out, "  --pipeline    like --stream, with each compiler stage on its own thread\n");
+    fprintf(out, "  --jit         run the program as native x86-64 code instead of interpreting it\n");
+    fprintf(out, "Optimization (not with --stream/--pipeline/--incremental):\n");
+    fprintf(out, "  -O0                no passes (default)\n");
+    fprintf(out, "  -O1                simplify,dead-stores: expressions simplified, and no stores or\n");
+    fprintf(out, "                     variables that nothing reads in the MIPS64 code\n");
+    fprintf(out, "  -O2, -O            the same, and values computed again reused, there and by --run\n");
+    fprintf(out, "  --passes=A,B,...   run these passes in this order instead of a level's:\n");
+    print_passes(out, "                       ");
+    fprintf(out, "  --print-after=PASS|all  the program as p0 source after the pass (stderr)\n");
+    fprintf(out, "  --ir               generate the MIPS64 code through the SSA IR, values kept in\n");
+    fprintf(out, "                     registers from one statement to the next\n");
+    fprintf(out, "  --print-ir         --ir, and write the IR out (stderr)\n");
+    fprintf(out, "Target:\n");
+    fprintf(out, "  --target=mips64    MIPS64 assembly and machine code (default)\n");
+    fprintf(out, "  --target=x86_64    a standalone x86-64 Linux executable instead (-S/--mc)\n");
+    fprintf(out, "  -o FILE            output file, same as output_file (x86_64 default: a.out)\n");
+    fprintf(out, "  --mc-format=listing|raw|elf|annotated\n");
+    fprintf(out, "                     machine code as text (default), as a raw code+data image\n");
+    fprintf(out, "                     (data from the next 8 byte boundary), as an ELF64 object or as\n");
+    fprintf(out, "                     a listing with addresses, fields, assembly and source lines (.lst)\n");
+    fprintf(out, "  --endian=big|little  byte order of the raw and ELF outputs (default big)\n");
+    fprintf(out, "Statistics (stderr, one-shot compiles only):\n");
+    fprintf(out, "  --time-passes      time, allocations and bytes allocated of every phase and pass\n");
+    fprintf(out, "  --stats            tokens, AST nodes, symbols, instructions, strings, what -O\n");
+    fprintf(out, "                     left out, reused and simplified (by rule), and memory\n");
+    fprintf(out, "  --stats-format=text|json  tables (default) or one JSON object\n");
+    fprintf(out, "  --trace=FILE       write a Chrome/Perfetto trace of the phases and statements\n");
+    fprintf(out, "                     (every mode; daemon and batch compiles get a track each)\n");
+    fprintf(out, "Compile cache:\n");
+    fprintf(out, "  --cache-dir=DIR    keep compiled results under DIR\n");
+    fprintf(out, "  --cache-size=MB    in-memory cache size for --daemon (default 64)\n");
+    fprintf(out, "  --cache-stats      print cache hit/miss counters to stderr\n");
+    fprintf(out, "  --daemon           serve compile requests on stdin/stdout\n");
+    fprintf(out, "  --incremental      with --daemon, only recompile the lines that changed\n");
+    fprintf(out, "Batch:\n");
+    fprintf(out, "  --batch            compile every input, one JSON line per input on stdout\n");
+    fprintf(out, "  --jobs=N           worker threads (default: one per CPU)\n");
+    fprintf(out, "  --out-dir=DIR      write DIR/<name>.out/.err/.s/.mc instead of JSON fields\n");
+    fprintf(out, "                     (.bin/.o/.lst by --mc-format, none for an x86_64 executable)\n");
+}
+
+int apply_stage_option(CompilerOptions *opts, const char *arg) {
+    if(strcmp(arg, "--run") == 0)
+        opts->stages |= STAGE_RUN;
+    else if(strcmp(arg, "-S") == 0)
+        opts->stages |= STAGE_ASM;
+    else if(strcmp(arg, "--mc") == 0)
+        opts->stages |= STAGE_MC;
+    else if(strcmp(arg, "--check-only") == 0)
+        opts->check_only = 1;
+    else
+        return 0;
+    return 1;
+}
+
+void finish_stage_options(CompilerOptions *opts) {
+    // no stage flags -> old behaviour, run everything
+    if(opts->check_only)
+        opts->stages = 0;
+    else if(opts->stages == 0)
+        opts->stages = STAGE_ALL;
+}
+
+int apply_optimization_option(CompilerOptions *opts, const char *arg) {
+    if(strcmp(arg, "-O") == 0 || strcmp(arg, "-O2") == 0) {
+        opts->opt_level = 2;
+    } else if(strcmp(arg, "-O1") == 0) {
+        opts->opt_level = 1;
+    } else if(strcmp(arg, "-O0") == 0) {
+        opts->opt_level = 0;
+    } else if(strncmp(arg, "--passes=", 9) == 0) {
+        Pipeline pipeline;
+        if(!pipeline_parse(arg + 9, &pipeline)) {
+            fprintf(stderr, "Error: --passes= takes pass names separated by commas, not %s\n", arg + 9);
+            return -1;
+        }
+        opts->passes = arg + 9;
+    } else if(strncmp(arg, "--print-after=", 14) == 0) {
+        if(!pass_exists(arg + 14, 1)) {
+            fprintf(stderr, "Error: no pass is called %s\n", arg + 14);
+            return -1;
+        }
+        opts->print_after = arg + 14;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+int optimizing(const CompilerOptions *opts) {
+    return opts->passes ? opts->passes[0] != '\0' : opts->opt_level > 0;
+}
+
+const char *machine_extension(const CompilerOptions *opts) {
+    return opts->target == TARGET_X86_64 ? "" : mc_extensions[opts->mc_format];
+}
+
+int machine_is_binary(const CompilerOptions *opts) {
+    return opts->target == TARGET_X86_64 || opts->mc_format == MC_FORMAT_RAW || opts->mc_format == MC_FORMAT_ELF;
+}
+
+int parse_options(int argc, char **argv, CompilerOptions *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->asm_filename = "MIPS64.s";
+    opts->cache_memory_limit = DEFAULT_CACHE_MEMORY;
+
+    // --batch can come after the inputs, so they're collected either way
+    opts->inputs = malloc(sizeof(char*) * argc);
+    const char *output = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+
+        int optimization = apply_optimization_option(opts, arg);
+        if(optimization < 0)
+            return 0;
+        if(optimization > 0 || apply_stage_option(opts, arg)) {
+            continue;
+        } else if(strcmp(arg, "--stream") == 0) {
+            opts->stream = 1;
+        } else if(strcmp(arg, "--pipeline") == 0) {
+            opts->pipeline = 1;
+        } else if(strcmp(arg, "--ir") == 0) {
+            opts->ir = 1;
+        } else if(strcmp(arg, "--print-ir") == 0) {
+            opts->ir = 1;
+            opts->print_ir = 1;
+        } else if(strcmp(arg, "--jit") == 0) {
+            opts->jit = 1;
+        } else if(strcmp(arg, "--target=mips64") == 0) {
+            opts->target = TARGET_MIPS64;
+        } else if(strcmp(arg, "--target=x86_64") == 0) {
+            opts->target = TARGET_X86_64;
+        } else if(strcmp(arg, "--mc-format=listing") == 0) {
+            opts->mc_format = MC_FORMAT_LISTING;
+        } else if(strcmp(arg, "--mc-format=raw") == 0) {
+            opts->mc_format = MC_FORMAT_RAW;
+        } else if(strcmp(arg, "--mc-format=elf") == 0) {
+            opts->mc_format = MC_FORMAT_ELF;
+        } else if(strcmp(arg, "--mc-format=annotated") == 0) {
+            opts->mc_format = MC_FORMAT_ANNOTATED;
+        } else if(strcmp(arg, "--endian=big") == 0) {
+            opts->little_endian = 0;
+        } else if(strcmp(arg, "--endian=little") == 0) {
+            opts->little_endian = 1;
+        } else if(strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if(strcmp(arg, "--time-passes") == 0) {
+            opts->time_passes = 1;
+        } else if(strcmp(arg, "--stats") == 0) {
+            opts->stats = 1;
+        } else if(strcmp(arg, "--stats-format=text") == 0) {
+            opts->stats_json = 0;
+        } else if(strcmp(arg, "--stats-format=json") == 0) {
+            opts->stats_json = 1;
+        } else if(strncmp(arg, "--trace=", 8) == 0 && arg[8] != '\0') {
+            opts->trace_file = arg + 8;
+        } else if(strncmp(arg, "--cache-dir=", 12) == 0) {
+            opts->cache_dir = arg + 12;
+        } else if(strncmp(arg, "--cache-size=", 13) == 0) {
+            opts->cache_memory_limit = (size_t)strtoul(arg + 13, NULL, 10) << 20;
+        } else if(strcmp(arg, "--cache-stats") == 0) {
+            opts->cache_stats = 1;
+        } else if(strcmp(arg, "--daemon") == 0) {
+            opts->daemon = 1;
+        } else if(strcmp(arg, "--incremental") == 0) {
+            opts->incremental = 1;
+        } else if(strcmp(arg, "--batch") == 0) {
+            opts->batch = 1;
+        } else if(strncmp(arg, "--jobs=", 7) == 0) {
+            opts->jobs = atoi(arg + 7);
+        } else if(strncmp(arg, "--out-dir=", 10) == 0) {
+            opts->out_dir = arg + 10;
+        } else if(arg[0] == '-' && arg[1] != '\0') {
+            fprintf(stderr, "Error: Unknown option %s\n", arg);
+            return 0;
+        } else {
+            opts->inputs[opts->input_count++] = arg;
+        }
+    }
+
+    // a single compile takes an input and an optional output name
+    int positional = opts->input_count;
+    if(opts->batch) {
+        if(positional == 0)
+            return 0;
+    } else if(positional > 2) {
+        fprintf(stderr, "Error: Unexpected argument %s\n", opts->inputs[2]);
+        return 0;
+    } else {
+        if(positional > 0)
+            opts->input_filename = opts->inputs[0];
+        if(positional > 1)
+            output = opts->inputs[1];
+        if(!opts->input_filename && !opts->daemon)
+            return 0;
+    }
+    if(opts->target == TARGET_X86_64 && (opts->stream || opts->pipeline)) {
+        fprintf(stderr, "Error: --target=x86_64 needs the whole program, not --stream/--pipeline\n");
+        return 0;
+    }
+    if(opts->mc_format != MC_FORMAT_LISTING && (opts->stream || opts->pipeline)) {
+        fprintf(stderr, "Error: --mc-format=raw/elf/annotated needs the whole program, not --stream/--pipeline\n");
+        return 0;
+    }
+
+    if(opts->ir && (opts->target == TARGET_X86_64 || opts->stream || opts->pipeline || opts->incremental)) {
+        fprintf(stderr, "Error: --ir is for the whole program's MIPS64 code, not --target=x86_64/--stream/--pipeline/--incremental\n");
+        return 0;
+    }
+
+    if(optimizing(opts) && (opts->stream || opts->pipeline || opts->incremental)) {
+        fprintf(stderr, "Error: -O1/-O2/--passes= need the whole program, not --stream/--pipeline/--incremental\n");
+        return 0;
+    }
+
+    if((opts->time_passes || opts->stats) && (opts->daemon || opts->batch || opts->stream || opts->pipeline)) {
+        fprintf(stderr, "Error: --time-passes/--stats are for one-shot compiles, not --daemon/--batch/--stream/--pipeline\n");
+        return 0;
+    }
+
+    finish_stage_options(opts);
+
+    // the default names are fixed, a given output name is followed by the .mc
+    if(output)
+        opts->asm_filename = output;
+    if(opts->target == TARGET_X86_64)
+        opts->machine_filename = strdup(output ? output : "a.out");
+    else if(!output)
+        opts->machine_filename = MachineFilenameFor("MACHINE_CODE", machine_extension(opts));
+    else
+        opts->machine_filename = MachineFilenameFor(opts->asm_filename, machine_extension(opts));
+    return 1;
+}
+
+void free_options(CompilerOptions *opts) {
+    free(opts->machine_filename);
+    opts->machine_filename = NULL;
+    free(opts->inputs);
+    opts->inputs = NULL;
+}
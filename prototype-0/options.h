@@ -0,0 +1,90 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// compiler stages that run after parsing + semantics
+// (with no stage flags at all every stage runs, like before)
+#define STAGE_RUN 0x1 // interpret the program and print its output
+#define STAGE_ASM 0x2 // write MIPS64 assembly to the .s file
+#define STAGE_MC  0x4 // write machine code to the .mc file
+#define STAGE_ALL (STAGE_RUN | STAGE_ASM | STAGE_MC)
+
+// what the code generation stages produce
+#define TARGET_MIPS64 0 // MIPS64 assembly (.s) and machine code (.mc)
+#define TARGET_X86_64 1 // a standalone x86-64 Linux executable (see native.h)
+
+// how the machine code is written (MIPS64)
+#define MC_FORMAT_LISTING 0 // a text line per instruction, binary and hex (.mc)
+#define MC_FORMAT_RAW     1 // the code, then the data, as bytes (.bin)
+#define MC_FORMAT_ELF     2 // an ELF64 MIPS object with .text, .data and symbols (.o)
+#define MC_FORMAT_ANNOTATED 3 // the listing with addresses, fields, assembly and source (.lst)
+
+// command line options for one compiler invocation
+typedef struct {
+    const char *input_filename;
+    const char *asm_filename;
+    char *machine_filename;   // derived from asm_filename (the executable for x86_64)
+    int target;               // TARGET_*
+    int mc_format;            // MC_FORMAT_*
+    int little_endian;        // byte order of the raw and ELF outputs (default big)
+    int stages;               // STAGE_* bits, 0 = check only
+    int check_only;
+    int opt_level;            // -O0 (default), -O1, -O2 (and -O): passes.h
+    const char *passes;       // --passes=a,b,c instead of the level's, NULL = the level's
+    const char *print_after;  // --print-after=PASS|all, NULL = no dumps
+    int ir;                   // --ir: the MIPS64 code through the SSA IR (ir.h)
+    int print_ir;             // --print-ir: and the IR on stderr
+
+    // compile cache (see cache.h)
+    const char *cache_dir;    // on-disk tier, NULL = off
+    size_t cache_memory_limit; // in-memory tier size in bytes (daemon only)
+    int cache_stats;          // print hit/miss counters to stderr
+
+    int daemon;               // serve compile requests on stdin/stdout
+    int stream;               // compile statement by statement in constant memory (see stream.h)
+    int pipeline;             // the same with every stage on its own thread
+    int jit;                  // run the program as native code (see jit.h)
+    int incremental;          // daemon: recompile only the changed lines (see incremental.h)
+
+    // compile many inputs on a thread pool (see batch.h)
+    int batch;
+    int jobs;                 // worker threads, 0 = one per CPU
+    const char *out_dir;      // per-input output files, NULL = JSON lines on stdout
+    const char **inputs;      // every positional argument in batch mode
+    int input_count;
+
+    // one-shot compile statistics on stderr (see stats.h)
+    int time_passes;          // time and allocations of each phase
+    int stats;                // counts, allocations and peak memory
+    int stats_json;           // as a JSON object instead of tables
+
+    const char *trace_file;   // Chrome trace-event timeline, NULL = off (see trace.h)
+} CompilerOptions;
+
+// parse argv into opts; returns 0 on bad usage
+int parse_options(int argc, char **argv, CompilerOptions *opts);
+void free_options(CompilerOptions *opts);
+void print_usage(FILE *out, const char *prog);
+
+// apply one stage flag (--run, -S, --mc, --check-only); returns 0 if arg is not one.
+// used for argv and for the per-request flags of the daemon
+int apply_stage_option(CompilerOptions *opts, const char *arg);
+// turn the collected stage flags into the final opts->stages
+void finish_stage_options(CompilerOptions *opts);
+
+// apply one optimisation flag (-O, -O0, -O1, -O2, --passes=, --print-after=);
+// returns 0 if arg is not one, -1 (with the error on stderr) if it names a
+// pass there isn't. like apply_stage_option, also the daemon's
+int apply_optimization_option(CompilerOptions *opts, const char *arg);
+// 1 if any pass runs
+int optimizing(const CompilerOptions *opts);
+
+// the extension of the machine code file: ".mc", ".bin", ".o" or ".lst"
+// by --mc-format, "" for an x86_64 executable
+const char *machine_extension(const CompilerOptions *opts);
+// 1 if the machine code is bytes rather than text (raw, ELF, executable)
+int machine_is_binary(const CompilerOptions *opts);
+
+#endif
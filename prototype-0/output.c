@@ -9,15 +9,21 @@ void capture_init(OutputCapture *cap) {
     cap->size = 0;
     cap->buffer = malloc(cap->capacity);
     cap->buffer[0] = '\0';
+    cap->sink = NULL;
 }
 
 void capture_write(OutputCapture *cap, const char *str) {
     size_t len = strlen(str);
+    if(cap->sink) {
+        fwrite(str, 1, len, cap->sink);
+        return;
+    }
     if(cap->size + len + 1 >= cap->capacity) {
         cap->capacity = (cap->size + len + 1) * 2;
         cap->buffer = realloc(cap->buffer, cap->capacity);
     }
-    strcat(cap->buffer, str);
+    // append at the end we know instead of strcat walking the whole buffer
+    memcpy(cap->buffer + cap->size, str, len + 1);
     cap->size += len;
 }
 
@@ -7,6 +7,7 @@ typedef struct {
     char *buffer;
     size_t size;
     size_t capacity;
+    FILE *sink;     // if set, writes go straight to this file instead
 } OutputCapture;
 
 void capture_init(OutputCapture *cap);
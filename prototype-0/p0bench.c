@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "driver.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "assembly.h"
+#include "machine_code.h"
+
+void free_node(Node *node);
+
+// p0bench: how long each phase of the compiler takes on generated programs
+//
+//   p0bench [--lines=N,N,...] [--repeat=N] [--warmup=N] [--variables=N]
+//           [--depth=N] [--strings=N] [--print-percent=N] [--seed=S]
+//           [--output=FILE]
+//   p0bench --stream-memory [--lines=N,N,...] [--compiler=PATH] [...]
+//
+// every size in --lines gets one program from the generator (generator.h),
+// which then goes through every phase --repeat times after --warmup runs
+// that aren't counted. the phases are timed apart:
+//
+//   lex        scanning the whole text into tokens (scan_text)
+//   parse      the parser over those tokens, building the AST
+//   semantics  the symbol checks. the grammar actions make them while
+//              parsing, so here they are made again over the finished AST
+//              against a fresh analyzer, and "parse" includes them too
+//   interpret  running the program to its output
+//   codegen    the MIPS64 assembly for it
+//   encode     assembling that into the machine code listing
+//
+// the results (median, p95, min and max per phase, in milliseconds) are
+// written as JSON, to stdout unless --output says otherwise
+//
+// --stream-memory measures the peak resident set of "compiler --stream -S
+// --mc" (stream.h) on every size instead, which is to stay flat: it fails
+// when the largest program's is more than half as much again as the
+// smallest's
+
+#define MAX_SIZES 16
+
+// how much more the peak of --stream-memory may be on the largest program
+#define STREAM_GROWTH_PERCENT 50
+
+enum { PHASE_LEX, PHASE_PARSE, PHASE_SEMANTICS, PHASE_INTERPRET, PHASE_CODEGEN, PHASE_ENCODE, PHASE_COUNT };
+
+static const char *phase_names[PHASE_COUNT] = {
+    "lex", "parse", "semantics", "interpret", "codegen", "encode"
+};
+
+typedef struct {
+    GeneratorOptions generator;
+    long sizes[MAX_SIZES];
+    int size_count;
+    int repeat;
+    int warmup;
+    const char *output;
+    int stream_memory;
+    const char *compiler;   // what --stream-memory runs
+} Bench;
+
+typedef struct {
+    long lines;
+    size_t bytes;
+    size_t tokens;
+    size_t assembly_bytes;
+    size_t listing_bytes;
+    double *times[PHASE_COUNT];     // ms, one per repeat
+} Result;
+
+static double Now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static Node *NextItem(Node *item) {
+    while(item->node_type == 3)
+        item = item->binop.right;
+    return item->list.next;
+}
+
+// what the grammar actions ask of the analyzer, over a parsed program
+static void CheckSymbols(Node *program) {
+    Semantics sem;
+    sem_init(&sem);
+    for(Node *statement = program; statement; statement = statement->list.next) {
+        sem_set_line(&sem, statement->line_number);
+        if(statement->node_type != 4 && statement->node_type != 5)
+            continue;
+        sem_set_decl_line(&sem, statement->node_type == 4);
+        for(Node *item = statement->list.items; item; item = NextItem(item)) {
+            Node *id = item->node_type == 3 ? item->binop.left : item;
+            if(statement->node_type == 4)
+                sem_add_symbol(&sem, id->str_val);
+            else
+                sem_check_declared(&sem, id->str_val);
+        }
+    }
+    sem_cleanup(&sem);
+}
+
+// every phase once; times[] gets the milliseconds of each
+static void RunOnce(const char *source, size_t length, Result *result, double *times) {
+    double start = Now();
+    sem_init(&sem_analyzer);
+    sem_set_line(&sem_analyzer, 1);
+    ast_root = NULL;
+    result->tokens = scan_text(source, length, 1);
+    double lexed = Now();
+    parse_scanned();
+    double parsed = Now();
+    CheckSymbols(ast_root);
+    double checked = Now();
+
+    ErrorState errors;
+    error_state_init(&errors);
+    free(interpret_program(ast_root, &errors));
+    error_state_free(&errors);
+    double interpreted = Now();
+
+    char *assembly = NULL;
+    size_t assembly_length = 0;
+    FILE *out = open_memstream(&assembly, &assembly_length);
+    GenerateAssemblyProgram(ast_root, out);
+    fclose(out);
+    double generated = Now();
+
+    char *listing = NULL;
+    size_t listing_length = 0;
+    FILE *in = fmemopen(assembly, assembly_length, "r");
+    out = open_memstream(&listing, &listing_length);
+    MachineFromAssemblyStream(in, out);
+    fclose(in);
+    fclose(out);
+    double encoded = Now();
+
+    times[PHASE_LEX] = lexed - start;
+    times[PHASE_PARSE] = parsed - lexed;
+    times[PHASE_SEMANTICS] = checked - parsed;
+    times[PHASE_INTERPRET] = interpreted - checked;
+    times[PHASE_CODEGEN] = generated - interpreted;
+    times[PHASE_ENCODE] = encoded - generated;
+    result->assembly_bytes = assembly_length;
+    result->listing_bytes = listing_length;
+
+    free(listing);
+    free(assembly);
+    sem_cleanup(&sem_analyzer);
+    free_node(ast_root);
+    ast_root = NULL;
+}
+
+static int CompareTimes(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// nearest rank, on sorted times
+static double Percentile(const double *sorted, int count, int percent) {
+    int rank = (count * percent + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void WriteStats(FILE *out, double *times, int count) {
+    qsort(times, count, sizeof(double), CompareTimes);
+    fprintf(out, "{\"median_ms\": %.3f, \"p95_ms\": %.3f, \"min_ms\": %.3f, \"max_ms\": %.3f}",
+            Percentile(times, count, 50), Percentile(times, count, 95), times[0], times[count - 1]);
+}
+
+static void WriteJson(FILE *out, const Bench *b, Result *results) {
+    const GeneratorOptions *g = &b->generator;
+    fprintf(out, "{\n  \"generator\": {\"variables\": %d, \"depth\": %d, \"strings\": %d, "
+            "\"print_percent\": %d, \"seed\": %llu},\n",
+            g->variables, g->depth, g->strings, g->print_percent, (unsigned long long)g->seed);
+    fprintf(out, "  \"repeat\": %d,\n  \"warmup\": %d,\n  \"runs\": [\n", b->repeat, b->warmup);
+    for(int s = 0; s < b->size_count; s++) {
+        Result *r = &results[s];
+        fprintf(out, "    {\n      \"lines\": %ld, \"bytes\": %zu, \"tokens\": %zu, "
+                "\"assembly_bytes\": %zu, \"listing_bytes\": %zu,\n      \"phases\": {\n",
+                r->lines, r->bytes, r->tokens, r->assembly_bytes, r->listing_bytes);
+        for(int p = 0; p < PHASE_COUNT; p++) {
+            fprintf(out, "        \"%s\": ", phase_names[p]);
+            WriteStats(out, r->times[p], b->repeat);
+            fprintf(out, ",\n");
+        }
+        // the total of each run, so its spread isn't the sum of the phases'
+        double *totals = calloc(b->repeat, sizeof(double));
+        for(int i = 0; i < b->repeat; i++)
+            for(int p = 0; p < PHASE_COUNT; p++)
+                totals[i] += r->times[p][i];
+        fprintf(out, "        \"total\": ");
+        WriteStats(out, totals, b->repeat);
+        free(totals);
+        fprintf(out, "\n      }\n    }%s\n", s + 1 < b->size_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// the peak resident set (kB) of the compiler compiling a program of the
+// given size with --stream, in a directory of its own; -1 if it failed.
+// the program goes straight to the file, so what the child had from this
+// process before its exec (which counts too) is small
+static long StreamPeak(const Bench *b, long lines) {
+    char directory[] = "/tmp/p0bench-XXXXXX";
+    if(!mkdtemp(directory))
+        return -1;
+    char input[64], assembly[64], machine[64];
+    snprintf(input, sizeof(input), "%s/p.p0", directory);
+    snprintf(assembly, sizeof(assembly), "%s/MIPS64.s", directory);
+    snprintf(machine, sizeof(machine), "%s/MACHINE_CODE.mc", directory);
+    GeneratorOptions options = b->generator;
+    options.lines = lines;
+    FILE *f = fopen(input, "w");
+    if(!f) {
+        rmdir(directory);
+        return -1;
+    }
+    generate_program(&options, f);
+    fclose(f);
+
+    long peak = -1;
+    fflush(NULL);   // or the child writes what's buffered here again
+    pid_t pid = fork();
+    if(pid == 0) {
+        if(chdir(directory) != 0 || !freopen("/dev/null", "w", stdout))
+            _exit(127);
+        execl(b->compiler, b->compiler, "--stream", "-S", "--mc", "p.p0", (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if(pid > 0 && wait4(pid, &status, 0, &usage) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        peak = usage.ru_maxrss;
+    unlink(input);
+    unlink(assembly);
+    unlink(machine);
+    rmdir(directory);
+    return peak;
+}
+
+static int RunStreamMemory(Bench *b, FILE *out) {
+    // the child runs in another directory
+    char *compiler = realpath(b->compiler, NULL);
+    if(!compiler) {
+        perror(b->compiler);
+        return 1;
+    }
+    b->compiler = compiler;
+    long peaks[MAX_SIZES];
+    int smallest = 0, largest = 0;
+    fprintf(out, "{\n  \"stream_memory\": [\n");
+    for(int s = 0; s < b->size_count; s++) {
+        peaks[s] = StreamPeak(b, b->sizes[s]);
+        fprintf(out, "    {\"lines\": %ld, \"peak_rss_kb\": %ld}%s\n", b->sizes[s], peaks[s],
+                s + 1 < b->size_count ? "," : "");
+        if(b->sizes[s] < b->sizes[smallest])
+            smallest = s;
+        if(b->sizes[s] > b->sizes[largest])
+            largest = s;
+    }
+    fprintf(out, "  ]\n}\n");
+    free(compiler);
+
+    for(int s = 0; s < b->size_count; s++) {
+        if(peaks[s] < 0) {
+            fprintf(stderr, "stream memory: the compiler failed on %ld lines\n", b->sizes[s]);
+            return 1;
+        }
+    }
+    if(peaks[largest] * 100 > peaks[smallest] * (100 + STREAM_GROWTH_PERCENT)) {
+        fprintf(stderr, "stream memory: %ld kB on %ld lines, %ld kB on %ld, it grows with the program\n",
+                peaks[largest], b->sizes[largest], peaks[smallest], b->sizes[smallest]);
+        return 1;
+    }
+    return 0;
+}
+
+static int ParseNumber(const char *arg, const char *name, long *value) {
+    size_t n = strlen(name);
+    if(strncmp(arg, name, n) != 0 || arg[n] != '=')
+        return 0;
+    *value = atol(arg + n + 1);
+    return 1;
+}
+
+// "100,1e4,1000000"
+static int ParseSizes(const char *list, Bench *b) {
+    b->size_count = 0;
+    while(*list) {
+        char *end;
+        double size = strtod(list, &end);
+        if(end == list || size < 1 || b->size_count == MAX_SIZES)
+            return 0;
+        b->sizes[b->size_count++] = (long)size;
+        list = *end == ',' ? end + 1 : end;
+        if(*end && *end != ',')
+            return 0;
+    }
+    return b->size_count > 0;
+}
+
+int main(int argc, char **argv) {
+    Bench b;
+    memset(&b, 0, sizeof(b));
+    generator_defaults(&b.generator);
+    b.sizes[0] = 100;
+    b.sizes[1] = 1000;
+    b.sizes[2] = 10000;
+    b.sizes[3] = 100000;
+    b.size_count = 4;
+    b.repeat = 5;
+    b.warmup = 1;
+    b.compiler = "./compiler";
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        long value;
+        int ok = 1;
+        if(strncmp(arg, "--lines=", 8) == 0)
+            ok = ParseSizes(arg + 8, &b);
+        else if(ParseNumber(arg, "--repeat", &value))
+            ok = (b.repeat = value) > 0;
+        else if(ParseNumber(arg, "--warmup", &value))
+            ok = (b.warmup = value) >= 0;
+        else if(strncmp(arg, "--seed=", 7) == 0)
+            b.generator.seed = strtoull(arg + 7, NULL, 10);
+        else if(ParseNumber(arg, "--variables", &value))
+            b.generator.variables = value;
+        else if(ParseNumber(arg, "--depth", &value))
+            b.generator.depth = value;
+        else if(ParseNumber(arg, "--strings", &value))
+            b.generator.strings = value;
+        else if(ParseNumber(arg, "--print-percent", &value))
+            b.generator.print_percent = value;
+        else if(strncmp(arg, "--output=", 9) == 0)
+            b.output = arg + 9;
+        else if(strcmp(arg, "--stream-memory") == 0)
+            b.stream_memory = 1;
+        else if(strncmp(arg, "--compiler=", 11) == 0)
+            b.compiler = arg + 11;
+        else
+            ok = 0;
+        if(!ok) {
+            fprintf(stderr, "Usage: %s [--lines=N,N,...] [--repeat=N] [--warmup=N] [--variables=N]\n", argv[0]);
+            fprintf(stderr, "       [--depth=N] [--strings=N] [--print-percent=N] [--seed=S] [--output=FILE]\n");
+            fprintf(stderr, "       [--stream-memory [--compiler=PATH]]\n");
+            return 1;
+        }
+    }
+
+    if(b.stream_memory) {
+        FILE *out = b.output ? fopen(b.output, "w") : stdout;
+        if(!out) {
+            perror(b.output);
+            return 1;
+        }
+        int status = RunStreamMemory(&b, out);
+        if(out != stdout)
+            fclose(out);
+        return status;
+    }
+
+    // the compiler's diagnostics aren't what's measured
+    FILE *diag = fopen("/dev/null", "w");
+    set_diagnostics_stream(diag);
+
+    Result *results = calloc(b.size_count, sizeof(Result));
+    double times[PHASE_COUNT];
+    for(int s = 0; s < b.size_count; s++) {
+        Result *r = &results[s];
+        GeneratorOptions options = b.generator;
+        options.lines = r->lines = b.sizes[s];
+        char *source = NULL;
+        FILE *f = open_memstream(&source, &r->bytes);
+        generate_program(&options, f);
+        fclose(f);
+
+        for(int p = 0; p < PHASE_COUNT; p++)
+            r->times[p] = calloc(b.repeat, sizeof(double));
+        for(int i = 0; i < b.warmup; i++)
+            RunOnce(source, r->bytes, r, times);
+        for(int i = 0; i < b.repeat; i++) {
+            RunOnce(source, r->bytes, r, times);
+            for(int p = 0; p < PHASE_COUNT; p++)
+                r->times[p][i] = times[p];
+        }
+        fprintf(stderr, "%ld lines: done\n", r->lines);
+        free(source);
+    }
+
+    set_diagnostics_stream(NULL);
+    fclose(diag);
+
+    FILE *out = b.output ? fopen(b.output, "w") : stdout;
+    if(!out) {
+        perror(b.output);
+        return 1;
+    }
+    WriteJson(out, &b, results);
+    if(out != stdout)
+        fclose(out);
+
+    for(int s = 0; s < b.size_count; s++)
+        for(int p = 0; p < PHASE_COUNT; p++)
+            free(results[s].times[p]);
+    free(results);
+    return 0;
+}
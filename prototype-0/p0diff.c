@@ -0,0 +1,555 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "driver.h"
+#include "incremental.h"
+#include "generator.h"
+#include "interpreter.h"
+#include "passes.h"
+#include "assembly.h"
+#include "machine_code.h"
+#include "emulator.h"
+#include "jit.h"
+#include "native.h"
+
+void free_node(Node *node);
+extern char **environ;
+
+// p0diff: differential testing of the MIPS64 back end against the interpreter
+//
+// every program comes from the generator (generator.h), so it is well
+// defined. it runs once through the interpreter and once as generated code:
+// codegen, the assembler and the emulator (emulator.h). the two have to
+// print the same thing and leave every variable with the same value, and
+// the back end must not warn about anything on the way. with --optimize
+// both are -O's, the interpreter reusing values and the code leaving out
+// the stores nothing reads: then only the output has to be the same. the
+// code is of the program after -O2's passes (passes.h), or the ones of
+// --passes=, run after the interpreter ran it as it was written, which
+// checks the rules of simplify.h too. with --ir the code is the lowering
+// of the SSA IR (ir.h) instead
+//
+// with --incremental it's the daemon's incremental compiles (incremental.h)
+// that are checked instead: the program, then the program with the first
+// letter of every string in the other case, go through one state, and the
+// second result has to be the same as a full compile's of the edit. the
+// lines that aren't prints keep their code, but .data moves under it
+//
+// with --x86 it's the x86-64 back ends: what --run prints for the program
+// has to be what the JIT's run (jit.h) prints, and what the executable
+// (native.h) writes, which must exit 1 exactly when that's a runtime
+// error. their arithmetic is 32 bits like the interpreter's, so --overflow
+// can let the values wrap there, which the MIPS64 code doesn't
+//
+//   p0diff [--programs=N] [--seed=S] [--jobs=N] [--lines=N] [--variables=N]
+//          [--depth=N] [--strings=N] [--print-percent=N] [--show=N]
+//          [--optimize | --passes=A,B,...] [--ir] [--incremental]
+//          [--x86 [--overflow]]
+//
+// program i is generated with seed S + i, so "--seed=S+i --programs=1"
+// brings a failure back (and --print writes the program out)
+
+// no generated program gets anywhere near this
+#define STEP_LIMIT 100000000L
+
+typedef struct {
+    GeneratorOptions generator;
+    long programs;
+    int jobs;
+    int show;           // programs whose failure is shown in full
+    int print;          // print the first program instead of running it
+    int optimize;       // -O's interpreter and code
+    Pipeline pipeline;  // the code's passes then
+    int ir;             // the code through the SSA IR
+    int incremental;    // an incremental compile of an edit against a full one
+    int x86;            // --run against the JIT and the native executable
+
+    atomic_long next;
+    atomic_long failed;
+    atomic_int shown;
+    pthread_mutex_t report_lock;
+} Harness;
+
+typedef struct {
+    char *output;
+    size_t output_length;
+    int values[64];
+    int has_value[64];
+} Run;
+
+// where the runs first differ, NULL if they don't
+static const char *Compare(const Harness *h, const Run *a, const Run *b, char *detail, size_t size) {
+    if(a->output_length != b->output_length || memcmp(a->output, b->output, a->output_length) != 0) {
+        size_t i = 0;
+        while(i < a->output_length && i < b->output_length && a->output[i] == b->output[i])
+            i++;
+        snprintf(detail, size, "at byte %zu", i);
+        return "output";
+    }
+    for(int v = 0; v < h->generator.variables && v < 64 && !h->optimize; v++) {
+        if(a->has_value[v] && a->values[v] != b->values[v]) {
+            snprintf(detail, size, "v%d is %d, not %d", v, b->values[v], a->values[v]);
+            return "variable";
+        }
+    }
+    return NULL;
+}
+
+static void Report(Harness *h, uint64_t seed, const char *kind, const char *detail,
+                   const char *source, const Run *interpreted, const Run *emulated, const char *diagnostics) {
+    pthread_mutex_lock(&h->report_lock);
+    fprintf(stderr, "seed %llu: %s differs (%s)\n", (unsigned long long)seed, kind, detail);
+    if(atomic_fetch_add(&h->shown, 1) < h->show) {
+        fprintf(stderr, "--- program\n%s", source);
+        if(interpreted)
+            fprintf(stderr, "--- interpreter\n%.*s\n", (int)interpreted->output_length, interpreted->output);
+        if(emulated)
+            fprintf(stderr, "--- %s\n%.*s\n", h->x86 ? "x86-64" : "emulator",
+                    (int)emulated->output_length, emulated->output);
+        if(diagnostics && *diagnostics)
+            fprintf(stderr, "--- diagnostics\n%s", diagnostics);
+        fprintf(stderr, "---\n");
+    }
+    pthread_mutex_unlock(&h->report_lock);
+}
+
+// 1 if the program behaves the same both ways
+static int CheckProgram(Harness *h, uint64_t seed) {
+    GeneratorOptions options = h->generator;
+    options.seed = seed;
+    char *source = NULL;
+    size_t length = 0;
+    FILE *f = open_memstream(&source, &length);
+    generate_program(&options, f);
+    fclose(f);
+
+    char *diagnostics = NULL;
+    size_t diagnostics_length = 0;
+    FILE *diag = open_memstream(&diagnostics, &diagnostics_length);
+    set_diagnostics_stream(diag);
+
+    sem_init(&sem_analyzer);
+    sem_set_line(&sem_analyzer, 1);
+    ast_root = NULL;
+    int ok = 1;
+    Run interpreted, emulated;
+    memset(&interpreted, 0, sizeof(interpreted));
+    memset(&emulated, 0, sizeof(emulated));
+    const char *kind = NULL;
+    char detail[128] = "";
+
+    if(parse_text(source, length, 1) != 0 || sem_get_error_count(&sem_analyzer) > 0) {
+        kind = "compilation";
+        snprintf(detail, sizeof(detail), "the program doesn't compile");
+    } else {
+        // the interpreter, keeping its variables
+        ErrorState errors;
+        error_state_init(&errors);
+        FILE *out = open_memstream(&interpreted.output, &interpreted.output_length);
+        InterpreterState *state = interpreter_begin(&errors, out);
+        if(h->optimize)
+            interpreter_reuse_values(state);
+        for(Node *statement = ast_root; statement && !interpreter_stopped(state); statement = statement->list.next)
+            interpreter_execute(state, statement);
+        fclose(out);
+        if(interpreter_stopped(state)) {
+            kind = "interpreter";
+            snprintf(detail, sizeof(detail), "runtime error in a generated program");
+        }
+        for(int v = 0; v < options.variables && v < 64; v++) {
+            char name[16];
+            snprintf(name, sizeof(name), "v%d", v);
+            interpreted.has_value[v] = interpreter_variable(state, name, &interpreted.values[v]);
+        }
+        interpreter_end(state);
+        error_state_free(&errors);
+
+        // the generated code on the emulator
+        char *assembly = NULL;
+        size_t assembly_length = 0;
+        out = open_memstream(&assembly, &assembly_length);
+        Optimization optimization = { NULL, NULL };
+        if(h->optimize && !run_pipeline(&h->pipeline, ast_root, NULL, &optimization) && !kind) {
+            kind = "verifier";
+            snprintf(detail, sizeof(detail), "the passes left an AST the back end can't take");
+        }
+        if(h->ir) {
+            IrProgram *ir = ir_build(ast_root, optimization.dead, h->optimize);
+            if(!ir_verify(ir) && !kind) {
+                kind = "verifier";
+                snprintf(detail, sizeof(detail), "the IR isn't well formed");
+            }
+            GenerateAssemblyIR(ir, out);
+            ir_free(ir);
+        } else {
+            AssemblyDeadStores(optimization.dead);
+            AssemblyValueNumbers(optimization.numbering);
+            GenerateAssemblyProgram(ast_root, out);
+            AssemblyValueNumbers(NULL);
+            AssemblyDeadStores(NULL);
+        }
+        free_optimization(&optimization);
+        fclose(out);
+        MachineImage image;
+        FILE *in = fmemopen(assembly, assembly_length, "r");
+        MachineImageFromAssemblyStream(in, &image, 1);
+        fclose(in);
+
+        Emulator emu;
+        out = open_memstream(&emulated.output, &emulated.output_length);
+        int status = emulator_run(&emu, &image, out, STEP_LIMIT);
+        fclose(out);
+        for(int v = 0; v < options.variables && v < 64; v++) {
+            char name[16];
+            snprintf(name, sizeof(name), "v%d", v);
+            int symbol = MachineFindSymbol(&image, name);
+            emulated.has_value[v] = symbol >= 0;
+            if(symbol >= 0)
+                emulated.values[v] = (int)emulator_load(&emu, image.symbols[symbol].value);
+        }
+
+        fflush(diag);
+        if(!kind && status != EMULATOR_OK) {
+            kind = "emulator";
+            snprintf(detail, sizeof(detail), "%s at instruction %zu", emulator_status_name(status), emu.pc);
+        } else if(!kind && diagnostics_length > 0) {
+            kind = "back end";
+            snprintf(detail, sizeof(detail), "warnings");
+        } else if(!kind) {
+            kind = Compare(h, &interpreted, &emulated, detail, sizeof(detail));
+        }
+        emulator_free(&emu);
+        FreeMachineImage(&image);
+        free(assembly);
+    }
+
+    sem_cleanup(&sem_analyzer);
+    free_node(ast_root);
+    ast_root = NULL;
+    set_diagnostics_stream(NULL);
+    fclose(diag);
+
+    if(kind) {
+        Report(h, seed, kind, detail, source, &interpreted, &emulated, diagnostics);
+        ok = 0;
+    }
+    free(interpreted.output);
+    free(emulated.output);
+    free(diagnostics);
+    free(source);
+    return ok;
+}
+
+// the source with the first letter of every string in the other case
+// (the generator's strings have no quotes in them)
+static char *EditStrings(const char *source, size_t length) {
+    char *edited = malloc(length + 1);
+    memcpy(edited, source, length + 1);
+    int in_string = 0;
+    for(size_t i = 0; i < length; i++) {
+        if(edited[i] != '"')
+            continue;
+        in_string = !in_string;
+        if(in_string && isalpha((unsigned char)edited[i + 1]))
+            edited[i + 1] ^= 0x20;
+    }
+    return edited;
+}
+
+// 1 if the incremental compile of the edited program is the full one's
+static int CheckEdit(Harness *h, uint64_t seed) {
+    GeneratorOptions options = h->generator;
+    options.seed = seed;
+    char *source = NULL;
+    size_t length = 0;
+    FILE *f = open_memstream(&source, &length);
+    generate_program(&options, f);
+    fclose(f);
+    char *edited = EditStrings(source, length);
+
+    // every stage, as a daemon COMPILE with no flags
+    CompilerOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.asm_filename = "MIPS64.s";
+    finish_stage_options(&opts);
+
+    IncrementalState *state = incremental_create();
+    CompileResult first, incremental, full;
+    incremental_compile(state, source, length, &opts, &first);
+    incremental_compile(state, edited, length, &opts, &incremental);
+    compile_source(edited, length, &opts, &full);
+
+    static const char *section_names[RESULT_SECTION_COUNT] = { "output", "diagnostics", "assembly", "machine code" };
+    const char *kind = NULL;
+    char detail[128] = "";
+    if(incremental.status != full.status) {
+        kind = "status";
+        snprintf(detail, sizeof(detail), "%d, not %d", incremental.status, full.status);
+    }
+    for(int s = 0; s < RESULT_SECTION_COUNT && !kind; s++) {
+        size_t a = incremental.lengths[s], b = full.lengths[s];
+        if(a == b && (a == 0 || memcmp(incremental.sections[s], full.sections[s], a) == 0))
+            continue;
+        size_t i = 0;
+        while(i < a && i < b && incremental.sections[s][i] == full.sections[s][i])
+            i++;
+        kind = section_names[s];
+        snprintf(detail, sizeof(detail), "incremental at byte %zu", i);
+    }
+    if(kind)
+        Report(h, seed, kind, detail, edited, NULL, NULL, NULL);
+
+    free_result(&first);
+    free_result(&incremental);
+    free_result(&full);
+    incremental_destroy(state);
+    free(edited);
+    free(source);
+    return kind == NULL;
+}
+
+// runs the executable, with what it writes in run; its exit status, -1 if
+// it couldn't be run or didn't exit
+static int RunExecutable(const char *elf, size_t length, Run *run) {
+    char path[] = "/tmp/p0diff-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+        return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int written = write(fd, elf, length) == (ssize_t)length && fchmod(fd, 0700) == 0;
+    close(fd);
+    int pipes[2];
+    if(!written || pipe(pipes) != 0) {
+        unlink(path);
+        return -1;
+    }
+    fcntl(pipes[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipes[1], F_SETFD, FD_CLOEXEC);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipes[1], STDOUT_FILENO);
+    char *argv[] = { path, NULL };
+    pid_t pid;
+    int error;
+    // another worker's child can hold the file open for writing until it
+    // execs, which the exec here fails on
+    while((error = posix_spawn(&pid, path, &actions, NULL, argv, environ)) == ETXTBSY)
+        usleep(1000);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipes[1]);
+
+    int status = -1;
+    if(error == 0) {
+        FILE *out = open_memstream(&run->output, &run->output_length);
+        char buffer[4096];
+        ssize_t n;
+        while((n = read(pipes[0], buffer, sizeof(buffer))) > 0)
+            fwrite(buffer, 1, n, out);
+        fclose(out);
+        int wait_status;
+        if(waitpid(pid, &wait_status, 0) == pid && WIFEXITED(wait_status))
+            status = WEXITSTATUS(wait_status);
+    }
+    close(pipes[0]);
+    unlink(path);
+    return status;
+}
+
+// what the program prints the way --run prints it: the output, or the
+// runtime error
+static void RunResult(ErrorState *errors, char *output, Run *run) {
+    FILE *out = open_memstream(&run->output, &run->output_length);
+    print_run_result(out, errors, output);
+    fclose(out);
+    free(output);
+}
+
+// 1 if the interpreter, the JIT and the executable print the same
+static int CheckX86(Harness *h, uint64_t seed) {
+    GeneratorOptions options = h->generator;
+    options.seed = seed;
+    char *source = NULL;
+    size_t length = 0;
+    FILE *f = open_memstream(&source, &length);
+    generate_program(&options, f);
+    fclose(f);
+
+    char *diagnostics = NULL;
+    size_t diagnostics_length = 0;
+    FILE *diag = open_memstream(&diagnostics, &diagnostics_length);
+    set_diagnostics_stream(diag);
+
+    sem_init(&sem_analyzer);
+    sem_set_line(&sem_analyzer, 1);
+    ast_root = NULL;
+    Run interpreted, jitted, native;
+    memset(&interpreted, 0, sizeof(interpreted));
+    memset(&jitted, 0, sizeof(jitted));
+    memset(&native, 0, sizeof(native));
+    const Run *other = NULL;
+    const char *kind = NULL;
+    char detail[128] = "";
+
+    if(parse_text(source, length, 1) != 0 || sem_get_error_count(&sem_analyzer) > 0) {
+        kind = "compilation";
+        snprintf(detail, sizeof(detail), "the program doesn't compile");
+    } else {
+        ErrorState errors;
+        error_state_init(&errors);
+        RunResult(&errors, interpret_program(ast_root, &errors), &interpreted);
+        int runtime_error = get_error_count(&errors) > 0;
+        error_state_free(&errors);
+
+        error_state_init(&errors);
+        char *output = jit_program(ast_root, &errors);
+        if(output)
+            RunResult(&errors, output, &jitted);
+        error_state_free(&errors);
+
+        size_t elf_length;
+        char *elf = native_executable(ast_root, &elf_length);
+        int status = RunExecutable(elf, elf_length, &native);
+        free(elf);
+
+        if(!output) {
+            kind = "jit";
+            snprintf(detail, sizeof(detail), "it can't run here");
+        } else if((kind = Compare(h, &interpreted, &jitted, detail, sizeof(detail)))) {
+            kind = "jit output";
+            other = &jitted;
+        } else if(status != runtime_error) {
+            kind = "native";
+            snprintf(detail, sizeof(detail), "exit status %d, not %d", status, runtime_error);
+            other = &native;
+        } else if((kind = Compare(h, &interpreted, &native, detail, sizeof(detail)))) {
+            kind = "native output";
+            other = &native;
+        }
+    }
+
+    sem_cleanup(&sem_analyzer);
+    free_node(ast_root);
+    ast_root = NULL;
+    set_diagnostics_stream(NULL);
+    fclose(diag);
+
+    if(kind)
+        Report(h, seed, kind, detail, source, &interpreted, other, diagnostics);
+    free(interpreted.output);
+    free(jitted.output);
+    free(native.output);
+    free(diagnostics);
+    free(source);
+    return kind == NULL;
+}
+
+static void *Worker(void *arg) {
+    Harness *h = arg;
+    int (*check)(Harness*, uint64_t) = h->incremental ? CheckEdit : h->x86 ? CheckX86 : CheckProgram;
+    long i;
+    while((i = atomic_fetch_add(&h->next, 1)) < h->programs)
+        if(!check(h, h->generator.seed + i))
+            atomic_fetch_add(&h->failed, 1);
+    return NULL;
+}
+
+static int ParseNumber(const char *arg, const char *name, long *value) {
+    size_t n = strlen(name);
+    if(strncmp(arg, name, n) != 0 || arg[n] != '=')
+        return 0;
+    *value = atol(arg + n + 1);
+    return 1;
+}
+
+static int Usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--programs=N] [--seed=S] [--jobs=N] [--lines=N] [--variables=N]\n", program);
+    fprintf(stderr, "       [--depth=N] [--strings=N] [--print-percent=N] [--show=N] [--print]\n");
+    fprintf(stderr, "       [--optimize | --passes=A,B,...] [--ir] [--incremental] [--x86 [--overflow]]\n");
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    Harness h;
+    memset(&h, 0, sizeof(h));
+    generator_defaults(&h.generator);
+    h.programs = 10000;
+    h.show = 1;
+    pthread_mutex_init(&h.report_lock, NULL);
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        long value;
+        if(ParseNumber(arg, "--programs", &value))
+            h.programs = value;
+        else if(ParseNumber(arg, "--jobs", &value))
+            h.jobs = value;
+        else if(ParseNumber(arg, "--show", &value))
+            h.show = value;
+        else if(strncmp(arg, "--seed=", 7) == 0)
+            h.generator.seed = strtoull(arg + 7, NULL, 10);
+        else if(ParseNumber(arg, "--lines", &value))
+            h.generator.lines = value;
+        else if(ParseNumber(arg, "--variables", &value))
+            h.generator.variables = value;
+        else if(ParseNumber(arg, "--depth", &value))
+            h.generator.depth = value;
+        else if(ParseNumber(arg, "--strings", &value))
+            h.generator.strings = value;
+        else if(ParseNumber(arg, "--print-percent", &value))
+            h.generator.print_percent = value;
+        else if(strcmp(arg, "--print") == 0)
+            h.print = 1;
+        else if(strcmp(arg, "--optimize") == 0)
+            h.optimize = pipeline_for_level(2, &h.pipeline);
+        else if(strncmp(arg, "--passes=", 9) == 0 && pipeline_parse(arg + 9, &h.pipeline))
+            h.optimize = 1;
+        else if(strcmp(arg, "--ir") == 0)
+            h.ir = 1;
+        else if(strcmp(arg, "--incremental") == 0)
+            h.incremental = 1;
+        else if(strcmp(arg, "--x86") == 0)
+            h.x86 = 1;
+        else if(strcmp(arg, "--overflow") == 0)
+            h.generator.overflow = 1;
+        else
+            return Usage(argv[0]);
+    }
+    // the values wrap where the MIPS64 code's don't
+    if(h.generator.overflow && !h.x86 && !h.print)
+        return Usage(argv[0]);
+
+    if(h.print) {
+        generate_program(&h.generator, stdout);
+        return 0;
+    }
+
+    if(h.jobs <= 0)
+        h.jobs = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t *threads = malloc(sizeof(pthread_t) * h.jobs);
+    for(int i = 0; i < h.jobs; i++)
+        pthread_create(&threads[i], NULL, Worker, &h);
+    for(int i = 0; i < h.jobs; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    long failed = atomic_load(&h.failed);
+    printf("%ld programs, %ld differ, %d jobs, %.0f programs/min\n",
+           h.programs, failed, h.jobs, seconds > 0 ? h.programs * 60 / seconds : 0.0);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "machine_code.h"
+
+// p0dis: the MIPS64 disassembler, from the assembler's own opcode table
+//
+//   p0dis [listing]                 disassemble a .mc or annotated .lst listing (stdin by default)
+//   p0dis --round-trip FILE.s       assemble FILE.s, then disassemble and reassemble every instruction
+//   p0dis --round-trip --random=N   the same for N random instructions (and N random words)
+//
+// a round trip fails when the reassembled word isn't the one we started with,
+// or the disassembly isn't the text the random instruction was made from
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [listing.mc]\n", prog);
+    fprintf(stderr, "       %s --round-trip FILE.s\n", prog);
+    fprintf(stderr, "       %s --round-trip --random=N [--seed=S]\n", prog);
+}
+
+// the word of a listing line: "<binary> : HEX" or "ADDRESS  HEX  ..." (annotated)
+static int listing_word(const char *line, uint32_t *code) {
+    const char *colon = strstr(line, " : ");
+    char *end;
+    if(colon) {
+        *code = (uint32_t)strtoul(colon + 3, &end, 16);
+        return end > colon + 3;
+    }
+    if(line[0] == ';' || strlen(line) < 18 || line[8] != ' ' || line[9] != ' ')
+        return 0;
+    *code = (uint32_t)strtoul(line + 10, &end, 16);
+    return end == line + 18;
+}
+
+static int disassemble_listing(FILE *in) {
+    char *line = NULL;
+    size_t size = 0;
+    size_t address = 0;
+    int unknown = 0;
+    while(getline(&line, &size, in) > 0) {
+        uint32_t code;
+        if(!listing_word(line, &code))
+            continue;
+        char text[64];
+        if(MachineDisassemble(code, text, sizeof(text))) {
+            printf("%08zX  %08X  %s\n", address, code, text);
+        } else {
+            printf("%08zX  %08X  .word 0x%08X    ; unknown\n", address, code, code);
+            unknown++;
+        }
+        address += 4;
+    }
+    free(line);
+    return unknown == 0 ? 0 : 1;
+}
+
+// assemble, disassemble, reassemble: 1 if code comes back
+static int round_trip_word(uint32_t code, char *text, size_t size) {
+    uint32_t again;
+    return MachineDisassemble(code, text, size) && MachineAssembleLine(text, &again) == 1 && again == code;
+}
+
+static int round_trip_file(const char *filename) {
+    FILE *in = fopen(filename, "r");
+    if(!in) {
+        fprintf(stderr, "Error: Cannot open file %s\n", filename);
+        return 1;
+    }
+    MachineImage image;
+    MachineImageFromAssemblyStream(in, &image, 1);
+    fclose(in);
+
+    int failed = 0;
+    for(size_t i = 0; i < image.code_count; i++) {
+        char text[64];
+        if(!round_trip_word(image.code[i], text, sizeof(text))) {
+            fprintf(stderr, "%08zX  %08X  does not round-trip: \"%s\"\n", i * 4, image.code[i], text);
+            failed++;
+        }
+    }
+    printf("%zu instructions, %d failed\n", image.code_count, failed);
+    FreeMachineImage(&image);
+    return failed == 0 ? 0 : 1;
+}
+
+static uint64_t random_state;
+
+static uint64_t next_random() {
+    // xorshift64*
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+// a random instruction's canonical text, written out independently of the
+// disassembler, and the same instruction written loosely (spacing, '#', comments)
+static void random_instruction(char *canonical, char *loose, size_t size) {
+    const MachineOpcode *op = &machine_opcodes[next_random() % machine_opcode_count];
+    uint64_t r = next_random();
+    int a = r & 31, b = (r >> 5) & 31, c = (r >> 10) & 31;
+    int imm = (int16_t)(r >> 16);
+    switch(op->format) {
+    case MACHINE_FORMAT_RT_RS_IMM:
+        snprintf(canonical, size, "%s r%d, r%d, #%d", op->mnemonic, a, b, imm);
+        snprintf(loose, size, "  %s\tr%d ,r%d,%d ; comment", op->mnemonic, a, b, imm);
+        break;
+    case MACHINE_FORMAT_RD_RS_RT:
+        snprintf(canonical, size, "%s r%d, r%d, r%d", op->mnemonic, a, b, c);
+        snprintf(loose, size, "%s r%d,r%d,  r%d", op->mnemonic, a, b, c);
+        break;
+    case MACHINE_FORMAT_RS_RT:
+        snprintf(canonical, size, "%s r%d, r%d", op->mnemonic, a, b);
+        snprintf(loose, size, "\t%s r%d,r%d", op->mnemonic, a, b);
+        break;
+    case MACHINE_FORMAT_RD:
+        snprintf(canonical, size, "%s r%d", op->mnemonic, a);
+        snprintf(loose, size, "%s   r%d  ", op->mnemonic, a);
+        break;
+    case MACHINE_FORMAT_RT_MEMORY:
+        snprintf(canonical, size, "%s r%d, %d(r%d)", op->mnemonic, a, imm, b);
+        snprintf(loose, size, "%s r%d, %d( r%d )", op->mnemonic, a, imm, b);
+        break;
+    case MACHINE_FORMAT_RT_IMM:
+        snprintf(canonical, size, "%s r%d, #%d", op->mnemonic, a, imm);
+        snprintf(loose, size, "%s r%d,%d", op->mnemonic, a, imm & 0xFFFF);
+        break;
+    case MACHINE_FORMAT_CODE:
+        if(a)
+            snprintf(canonical, size, "%s %d", op->mnemonic, a);
+        else
+            snprintf(canonical, size, "%s", op->mnemonic);
+        snprintf(loose, size, "%s #%d", op->mnemonic, a);
+        break;
+    }
+}
+
+static int round_trip_random(long count, uint64_t seed) {
+    random_state = seed ? seed : 1;
+    long failed = 0, known_words = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(long i = 0; i < count; i++) {
+        // text -> word -> text -> word
+        char canonical[64], loose[64], text[64];
+        uint32_t code, again;
+        random_instruction(canonical, loose, sizeof(canonical));
+        if(MachineAssembleLine(loose, &code) != 1 || MachineAssembleLine(canonical, &again) != 1 || again != code ||
+           !round_trip_word(code, text, sizeof(text)) || strcmp(text, canonical) != 0) {
+            if(failed++ < 10)
+                fprintf(stderr, "\"%s\" does not round-trip: %08X \"%s\"\n", canonical, code, text);
+        }
+
+        // any word the disassembler takes has to assemble back to itself
+        uint32_t word = (uint32_t)next_random();
+        if(MachineDisassemble(word, text, sizeof(text))) {
+            known_words++;
+            if(MachineAssembleLine(text, &again) != 1 || again != word) {
+                if(failed++ < 10)
+                    fprintf(stderr, "%08X disassembles to \"%s\", which assembles to %08X\n", word, text, again);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%ld instructions, %ld random words (%ld known), %ld failed, %.0f round trips/s\n",
+           count, count, known_words, failed, seconds > 0 ? 2 * count / seconds : 0.0);
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    int round_trip = 0;
+    long random_count = -1;
+    uint64_t seed = 1;
+    const char *file = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--round-trip") == 0)
+            round_trip = 1;
+        else if(strncmp(argv[i], "--random=", 9) == 0)
+            random_count = atol(argv[i] + 9);
+        else if(strncmp(argv[i], "--seed=", 7) == 0)
+            seed = strtoull(argv[i] + 7, NULL, 10);
+        else if(argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage(argv[0]);
+            return 1;
+        } else if(!file)
+            file = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if(round_trip) {
+        if(random_count >= 0)
+            return round_trip_random(random_count, seed);
+        if(!file) {
+            usage(argv[0]);
+            return 1;
+        }
+        return round_trip_file(file);
+    }
+
+    if(!file || strcmp(file, "-") == 0)
+        return disassemble_listing(stdin);
+    FILE *in = fopen(file, "r");
+    if(!in) {
+        fprintf(stderr, "Error: Cannot open file %s\n", file);
+        return 1;
+    }
+    int status = disassemble_listing(in);
+    fclose(in);
+    return status;
+}
@@ -55,7 +55,7 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
 #define YYPUSH 0
@@ -74,22 +74,25 @@
 #include <string.h>
 #include "semantics.h"
 #include "ast.h"
-#include "assembly.h"
-#include "machine_code.h"
-#include "interpreter.h"
+#include "error.h"
 
 #define NODE_PRINT_PART 7 // FIX ATTEMPT
 
-// recent: global variable to handle errors and lin enumbers
-ErrorState error_state;
-
 // AST root
-Node *ast_root = NULL;
+// (this and the rest of the compiler's state is per thread: the batch
+// driver runs a whole compilation on each of its workers)
+_Thread_local Node *ast_root = NULL;
 
 // global semantic analyzer
-Semantics sem_analyzer;
+_Thread_local Semantics sem_analyzer;
+
+// when set, every statement is handed over here as soon as its line is
+// parsed (and not kept in ast_root) - see stream.h
+_Thread_local void (*statement_handler)(Node *statement) = NULL;
+
+// last statement of ast_root, so appending a line doesn't walk the list
+static _Thread_local Node *lines_tail = NULL;
 
-extern int yylex();
 extern int yyparse();
 extern FILE *yyin;
 void yyerror(const char *s);
@@ -111,7 +114,7 @@ void free_node(Node *node);
 void print_ast(Node *node, int depth); 
 
 
-#line 115 "parser.tab.c"
+#line 118 "parser.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -184,6 +187,21 @@ typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 
+/* Unqualified %code blocks.  */
+#line 57 "parser.y"
+
+int yylex(YYSTYPE *lval);
+
+// where the parser takes its tokens from: the flex scanner, unless a
+// pipeline thread (stream.h) or tokens scanned up front (parse_text) feed it
+_Thread_local int (*token_source)(YYSTYPE *lval) = NULL;
+
+static int NextToken(YYSTYPE *lval) {
+    return token_source ? token_source(lval) : yylex(lval);
+}
+#define yylex NextToken
+
+#line 205 "parser.tab.c"
 
 #ifdef short
 # undef short
@@ -504,9 +522,9 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  13
+#define YYFINAL  4
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   52
+#define YYLAST   49
 
 /* YYNTOKENS -- Number of terminals.  */
 #define YYNTOKENS  22
@@ -515,7 +533,7 @@ union yyalloc
 /* YYNRULES -- Number of rules.  */
 #define YYNRULES  34
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  60
+#define YYNSTATES  59
 
 /* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   267
@@ -565,10 +583,10 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_int16 yyrline[] =
 {
-       0,    73,    73,    80,    85,    90,    95,   102,   107,   111,
-     117,   124,   130,   135,   140,   146,   155,   175,   193,   198,
-     224,   232,   238,   245,   250,   258,   263,   268,   274,   278,
-     282,   288,   292,   300,   304
+       0,    96,    96,   105,   120,   126,   131,   138,   143,   147,
+     153,   160,   166,   171,   176,   183,   193,   216,   237,   242,
+     268,   276,   282,   289,   295,   303,   308,   313,   319,   323,
+     327,   333,   337,   346,   350
 };
 #endif
 
@@ -600,7 +618,7 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#define YYPACT_NINF (-28)
+#define YYPACT_NINF (-27)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
@@ -614,12 +632,12 @@ yysymbol_name (yysymbol_kind_t yysymbol)
    STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
-       7,    19,    12,     4,     1,   -28,    13,    24,    19,    25,
-     -28,   -28,   -28,   -28,    21,   -28,    23,    -4,     6,   -28,
-     -28,   -28,     6,     4,   -28,   -28,   -28,   -28,     6,     6,
-     -28,    26,    18,    20,   -28,     8,    18,    23,   -28,   -10,
-      -4,   -28,     6,     6,     6,     6,    28,   -28,   -28,   -28,
-      26,    20,    20,   -28,   -28,    27,   -28,     6,     8,   -28
+       5,   -27,     6,    18,   -27,   -27,     0,    -2,   -27,    11,
+     -27,    28,   -27,   -27,   -27,    16,   -27,    21,    -6,     3,
+     -27,     3,     0,   -27,   -27,   -27,   -27,     3,     3,   -27,
+      22,    17,    19,   -27,     2,    17,    21,   -27,    14,    -6,
+     -27,     3,     3,     3,     3,    32,   -27,   -27,   -27,    22,
+      19,    19,   -27,   -27,    23,   -27,     3,     2,   -27
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -627,26 +645,26 @@ static const yytype_int8 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       0,     4,     0,     0,     0,     6,     0,     0,     4,     0,
-       7,     9,     8,     1,    14,    10,    13,     0,     0,     2,
-       3,     5,     0,     0,    11,    31,    32,    23,     0,     0,
-      19,    22,    24,    27,    30,    18,    15,    13,    34,     0,
-       0,    20,     0,     0,     0,     0,     0,    16,    12,    33,
-      22,    25,    26,    28,    29,     0,    21,     0,    18,    17
+       0,     4,     0,     0,     1,     2,     0,     0,     6,     0,
+       3,     0,     7,     9,     8,    14,    10,    13,     0,     0,
+       5,     0,     0,    11,    31,    32,    23,     0,     0,    19,
+      22,    24,    27,    30,    18,    15,    13,    34,     0,     0,
+      20,     0,     0,     0,     0,     0,    16,    12,    33,    22,
+      25,    26,    28,    29,     0,    21,     0,    18,    17
 };
 
 /* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
-     -28,   -28,    32,   -28,   -28,   -28,   -28,     9,    29,   -28,
-     -15,   -28,   -28,    -2,    10,   -18,    -6,   -27
+     -27,   -27,   -27,   -27,   -27,   -27,   -27,     8,    24,   -27,
+     -12,   -27,   -27,    -1,    10,   -19,    -3,   -26
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-       0,     2,     7,     8,     9,    10,    15,    24,    16,    11,
-      47,    12,    30,    41,    31,    32,    33,    34
+       0,     2,     3,    10,    11,    12,    16,    23,    17,    13,
+      46,    14,    29,    40,    30,    31,    32,    33
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
@@ -654,34 +672,32 @@ static const yytype_int8 yydefgoto[] =
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int8 yytable[] =
 {
-      35,    38,    42,    43,    36,    25,    26,    27,    49,    28,
-       1,    39,    13,    29,    14,    25,    26,    53,    54,    28,
-      42,    43,    17,    29,     3,     4,     5,    46,    19,     6,
-      42,    43,    21,    18,    44,    45,    51,    52,    55,    58,
-      20,    22,    23,    59,     0,    40,    48,    57,    56,     0,
-      50,     0,    37
+      34,    37,    35,    24,    25,    26,     4,    27,     1,    38,
+      15,    28,    24,    25,    41,    42,    27,    52,    53,    18,
+      28,    45,     5,     6,     7,     8,    41,    42,     9,    41,
+      42,    19,    48,    43,    44,    20,    21,    57,    50,    51,
+      22,    39,    54,    56,    47,    58,    36,     0,    55,    49
 };
 
 static const yytype_int8 yycheck[] =
 {
-      18,    28,    12,    13,    22,     9,    10,    11,    18,    13,
-       3,    29,     0,    17,    10,     9,    10,    44,    45,    13,
-      12,    13,    21,    17,     5,     6,     7,    19,     4,    10,
-      12,    13,     7,    20,    14,    15,    42,    43,    10,    57,
-       8,    20,    19,    58,    -1,    19,    37,    20,    50,    -1,
-      40,    -1,    23
+      19,    27,    21,     9,    10,    11,     0,    13,     3,    28,
+      10,    17,     9,    10,    12,    13,    13,    43,    44,    21,
+      17,    19,     4,     5,     6,     7,    12,    13,    10,    12,
+      13,    20,    18,    14,    15,     7,    20,    56,    41,    42,
+      19,    19,    10,    20,    36,    57,    22,    -1,    49,    39
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
    state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
-       0,     3,    23,     5,     6,     7,    10,    24,    25,    26,
-      27,    31,    33,     0,    10,    28,    30,    21,    20,     4,
-      24,     7,    20,    19,    29,     9,    10,    11,    13,    17,
-      34,    36,    37,    38,    39,    37,    37,    30,    39,    37,
-      19,    35,    12,    13,    14,    15,    19,    32,    29,    18,
-      36,    38,    38,    39,    39,    10,    35,    20,    37,    32
+       0,     3,    23,    24,     0,     4,     5,     6,     7,    10,
+      25,    26,    27,    31,    33,    10,    28,    30,    21,    20,
+       7,    20,    19,    29,     9,    10,    11,    13,    17,    34,
+      36,    37,    38,    39,    37,    37,    30,    39,    37,    19,
+      35,    12,    13,    14,    15,    19,    32,    29,    18,    36,
+      38,    38,    39,    39,    10,    35,    20,    37,    32
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
@@ -900,18 +916,129 @@ yydestruct (const char *yymsg,
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
 
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
-  YY_USE (yykind);
+  switch (yykind)
+    {
+    case YYSYMBOL_ID: /* ID  */
+#line 84 "parser.y"
+            { free(((*yyvaluep).str_val)); }
+#line 925 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_STR: /* STR  */
+#line 84 "parser.y"
+            { free(((*yyvaluep).str_val)); }
+#line 931 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_program: /* program  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 937 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_lines: /* lines  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 943 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_line: /* line  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 949 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_full_line: /* full_line  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 955 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_decl: /* decl  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 961 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_decl_items: /* decl_items  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 967 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_more_decl_items: /* more_decl_items  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 973 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_decl_item: /* decl_item  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 979 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_assign: /* assign  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 985 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_more_assign: /* more_assign  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 991 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_print_stmt: /* print_stmt  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 997 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_print_parts: /* print_parts  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 1003 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_more_print_parts: /* more_print_parts  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 1009 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_print_part: /* print_part  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 1015 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_expr: /* expr  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 1021 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_term: /* term  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 1027 "parser.tab.c"
+        break;
+
+    case YYSYMBOL_factor: /* factor  */
+#line 85 "parser.y"
+            { free_node((Node*)((*yyvaluep).node_ptr)); }
+#line 1033 "parser.tab.c"
+        break;
+
+      default:
+        break;
+    }
   YY_IGNORE_MAYBE_UNINITIALIZED_END
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
-
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
 
@@ -923,6 +1050,19 @@ int yynerrs;
 int
 yyparse (void)
 {
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
+
+    /* Number of syntax errors so far.  */
+    int yynerrs = 0;
+
     yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
     int yyerrstatus = 0;
@@ -1075,7 +1215,7 @@ yybackup:
   if (yychar == YYEMPTY)
     {
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yylex (&yylval);
     }
 
   if (yychar <= YYEOF)
@@ -1163,129 +1303,143 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* program: PROG_START lines PROG_END  */
-#line 74 "parser.y"
+#line 97 "parser.y"
     {
         ast_root = (yyvsp[-1].node_ptr);
+        (yyval.node_ptr) = NULL;  // owned by ast_root now
         //printf("Parsed program successfully\n");
     }
-#line 1172 "parser.tab.c"
+#line 1313 "parser.tab.c"
     break;
 
-  case 3: /* lines: line lines  */
-#line 81 "parser.y"
+  case 3: /* lines: lines line  */
+#line 106 "parser.y"
     {
-        (yyval.node_ptr) = append_to_list((Node*)(yyvsp[-1].node_ptr), (Node*)(yyvsp[0].node_ptr));
+        (yyval.node_ptr) = (yyvsp[-1].node_ptr);
+        Node *statement = (Node*)(yyvsp[0].node_ptr);
+        if(statement && statement_handler) {
+            statement_handler(statement);
+        } else if(statement) {
+            if(!(yyval.node_ptr))
+                (yyval.node_ptr) = statement;
+            else
+                lines_tail->list.next = statement;
+            lines_tail = statement;
+        }
     }
-#line 1180 "parser.tab.c"
+#line 1331 "parser.tab.c"
     break;
 
   case 4: /* lines: %empty  */
-#line 85 "parser.y"
+#line 120 "parser.y"
     {
         (yyval.node_ptr) = NULL;
+        lines_tail = NULL;
     }
-#line 1188 "parser.tab.c"
+#line 1340 "parser.tab.c"
     break;
 
   case 5: /* line: full_line NEWLINE_TOKEN  */
-#line 91 "parser.y"
+#line 127 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[-1].node_ptr);
         sem_set_line(&sem_analyzer, sem_analyzer.current_line + 1);
     }
-#line 1197 "parser.tab.c"
+#line 1349 "parser.tab.c"
     break;
 
   case 6: /* line: NEWLINE_TOKEN  */
-#line 96 "parser.y"
+#line 132 "parser.y"
     {
         (yyval.node_ptr) = NULL;
         sem_set_line(&sem_analyzer, sem_analyzer.current_line + 1);
     }
-#line 1206 "parser.tab.c"
+#line 1358 "parser.tab.c"
     break;
 
   case 7: /* full_line: decl  */
-#line 103 "parser.y"
+#line 139 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[0].node_ptr);
         sem_set_decl_line(&sem_analyzer, false);  // reset after declaration line
     }
-#line 1215 "parser.tab.c"
+#line 1367 "parser.tab.c"
     break;
 
   case 8: /* full_line: print_stmt  */
-#line 108 "parser.y"
+#line 144 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[0].node_ptr);
     }
-#line 1223 "parser.tab.c"
+#line 1375 "parser.tab.c"
     break;
 
   case 9: /* full_line: assign  */
-#line 112 "parser.y"
+#line 148 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[0].node_ptr);
     }
-#line 1231 "parser.tab.c"
+#line 1383 "parser.tab.c"
     break;
 
   case 10: /* decl: KW_INT decl_items  */
-#line 118 "parser.y"
+#line 154 "parser.y"
     {
         sem_set_decl_line(&sem_analyzer, true);  // we r currently in a declaration line
         (yyval.node_ptr) = create_decl_node((Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1240 "parser.tab.c"
+#line 1392 "parser.tab.c"
     break;
 
   case 11: /* decl_items: decl_item more_decl_items  */
-#line 125 "parser.y"
+#line 161 "parser.y"
     {
         (yyval.node_ptr) = append_to_list((Node*)(yyvsp[-1].node_ptr), (Node*)(yyvsp[0].node_ptr));
     }
-#line 1248 "parser.tab.c"
+#line 1400 "parser.tab.c"
     break;
 
   case 12: /* more_decl_items: ',' decl_item more_decl_items  */
-#line 131 "parser.y"
+#line 167 "parser.y"
     {
         (yyval.node_ptr) = append_to_list((Node*)(yyvsp[-1].node_ptr), (Node*)(yyvsp[0].node_ptr));
     }
-#line 1256 "parser.tab.c"
+#line 1408 "parser.tab.c"
     break;
 
   case 13: /* more_decl_items: %empty  */
-#line 135 "parser.y"
+#line 171 "parser.y"
     {
         (yyval.node_ptr) = NULL;
     }
-#line 1264 "parser.tab.c"
+#line 1416 "parser.tab.c"
     break;
 
   case 14: /* decl_item: ID  */
-#line 141 "parser.y"
+#line 177 "parser.y"
     {
         // in declaration line: just add symbol
         sem_add_symbol(&sem_analyzer, (yyvsp[0].str_val));
         (yyval.node_ptr) = create_id_node((yyvsp[0].str_val), sem_analyzer.current_line);  // division by 0 fix & add line number
+        free((yyvsp[0].str_val));
     }
-#line 1274 "parser.tab.c"
+#line 1427 "parser.tab.c"
     break;
 
   case 15: /* decl_item: ID '=' expr  */
-#line 147 "parser.y"
+#line 184 "parser.y"
     {
         // in declaration line: add symbol and create initialization
         sem_add_symbol(&sem_analyzer, (yyvsp[-2].str_val));
         Node *id_node = create_id_node((yyvsp[-2].str_val), sem_analyzer.current_line);
         (yyval.node_ptr) = create_binop_node('=', id_node, (Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
+        free((yyvsp[-2].str_val));
     }
-#line 1285 "parser.tab.c"
+#line 1439 "parser.tab.c"
     break;
 
   case 16: /* assign: ID '=' expr more_assign  */
-#line 156 "parser.y"
+#line 194 "parser.y"
     {
         // in assignment: check variable exists
         if(sem_check_declared(&sem_analyzer, (yyvsp[-3].str_val))) {
@@ -1301,13 +1455,16 @@ yyreduce:
             (yyval.node_ptr) = create_assign_node(assign_list, sem_analyzer.current_line);
         } else {
             (yyval.node_ptr) = NULL;
+            free_node((Node*)(yyvsp[-1].node_ptr));
+            free_node((Node*)(yyvsp[0].node_ptr));
         }
+        free((yyvsp[-3].str_val));
     }
-#line 1307 "parser.tab.c"
+#line 1464 "parser.tab.c"
     break;
 
   case 17: /* more_assign: ',' ID '=' expr more_assign  */
-#line 176 "parser.y"
+#line 217 "parser.y"
     {
         // parse another assignment in the chain
         if(sem_check_declared(&sem_analyzer, (yyvsp[-3].str_val))) {
@@ -1322,160 +1479,165 @@ yyreduce:
             (yyval.node_ptr) = list;
         } else {
             (yyval.node_ptr) = NULL;
+            free_node((Node*)(yyvsp[-1].node_ptr));
+            free_node((Node*)(yyvsp[0].node_ptr));
         }
+        free((yyvsp[-3].str_val));
     }
-#line 1328 "parser.tab.c"
+#line 1488 "parser.tab.c"
     break;
 
   case 18: /* more_assign: %empty  */
-#line 193 "parser.y"
+#line 237 "parser.y"
     {
         (yyval.node_ptr) = NULL;
     }
-#line 1336 "parser.tab.c"
+#line 1496 "parser.tab.c"
     break;
 
   case 19: /* print_stmt: KW_PRINT ':' print_parts  */
-#line 199 "parser.y"
+#line 243 "parser.y"
     {
         (yyval.node_ptr) = create_print_node((Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1344 "parser.tab.c"
+#line 1504 "parser.tab.c"
     break;
 
   case 20: /* print_parts: print_part more_print_parts  */
-#line 225 "parser.y"
+#line 269 "parser.y"
     {
     	//printf("DEBUG: Append print part, node type: %d\n", ((Node*)$1)->node_type);
         (yyval.node_ptr) = append_to_list((Node*)(yyvsp[-1].node_ptr), (Node*)(yyvsp[0].node_ptr));
     }
-#line 1353 "parser.tab.c"
+#line 1513 "parser.tab.c"
     break;
 
   case 21: /* more_print_parts: ',' print_part more_print_parts  */
-#line 233 "parser.y"
+#line 277 "parser.y"
     {
         //printf("DEBUG more_print_parts: matched with comma\n");
         (yyval.node_ptr) = append_to_list((Node*)(yyvsp[-1].node_ptr), (Node*)(yyvsp[0].node_ptr));
     }
-#line 1362 "parser.tab.c"
+#line 1522 "parser.tab.c"
     break;
 
   case 22: /* more_print_parts: %empty  */
-#line 238 "parser.y"
+#line 282 "parser.y"
     {
         //printf("DEBUG more_print_parts: matched epsilon (empty)\n");
         (yyval.node_ptr) = NULL;
     }
-#line 1371 "parser.tab.c"
+#line 1531 "parser.tab.c"
     break;
 
   case 23: /* print_part: STR  */
-#line 246 "parser.y"
+#line 290 "parser.y"
     {
         (yyval.node_ptr) = create_print_part_node(create_str_node((yyvsp[0].str_val), sem_analyzer.current_line),
                                     sem_analyzer.current_line); 
+        free((yyvsp[0].str_val));
     }
-#line 1380 "parser.tab.c"
+#line 1541 "parser.tab.c"
     break;
 
   case 24: /* print_part: expr  */
-#line 251 "parser.y"
+#line 296 "parser.y"
     {
         (yyval.node_ptr) = create_print_part_node((yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1388 "parser.tab.c"
+#line 1549 "parser.tab.c"
     break;
 
   case 25: /* expr: expr '+' term  */
-#line 259 "parser.y"
+#line 304 "parser.y"
     {
     	//printf("DEBUG: Creating addition expr\n"); // DEBUG
          (yyval.node_ptr) = create_binop_node('+', (Node*)(yyvsp[-2].node_ptr), (Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1397 "parser.tab.c"
+#line 1558 "parser.tab.c"
     break;
 
   case 26: /* expr: expr '-' term  */
-#line 264 "parser.y"
+#line 309 "parser.y"
     {
     	//printf("DEBUG: Creating subtraction expr\n"); // DEBUG
         (yyval.node_ptr) = create_binop_node('-', (Node*)(yyvsp[-2].node_ptr), (Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1406 "parser.tab.c"
+#line 1567 "parser.tab.c"
     break;
 
   case 27: /* expr: term  */
-#line 269 "parser.y"
+#line 314 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[0].node_ptr);
     }
-#line 1414 "parser.tab.c"
+#line 1575 "parser.tab.c"
     break;
 
   case 28: /* term: term '*' factor  */
-#line 275 "parser.y"
+#line 320 "parser.y"
     {
         (yyval.node_ptr) = create_binop_node('*', (Node*)(yyvsp[-2].node_ptr), (Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1422 "parser.tab.c"
+#line 1583 "parser.tab.c"
     break;
 
   case 29: /* term: term '/' factor  */
-#line 279 "parser.y"
+#line 324 "parser.y"
     {
         (yyval.node_ptr) = create_binop_node('/', (Node*)(yyvsp[-2].node_ptr), (Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1430 "parser.tab.c"
+#line 1591 "parser.tab.c"
     break;
 
   case 30: /* term: factor  */
-#line 283 "parser.y"
+#line 328 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[0].node_ptr);
     }
-#line 1438 "parser.tab.c"
+#line 1599 "parser.tab.c"
     break;
 
   case 31: /* factor: NUM  */
-#line 289 "parser.y"
+#line 334 "parser.y"
     {
         (yyval.node_ptr) = create_num_node((yyvsp[0].int_val), sem_analyzer.current_line);
     }
-#line 1446 "parser.tab.c"
+#line 1607 "parser.tab.c"
     break;
 
   case 32: /* factor: ID  */
-#line 293 "parser.y"
+#line 338 "parser.y"
     {
         if(sem_check_declared(&sem_analyzer, (yyvsp[0].str_val))) {
             (yyval.node_ptr) = create_id_node((yyvsp[0].str_val), sem_analyzer.current_line);
         } else {
             (yyval.node_ptr) = NULL;  // Error occurred
         }
+        free((yyvsp[0].str_val));
     }
-#line 1458 "parser.tab.c"
+#line 1620 "parser.tab.c"
     break;
 
   case 33: /* factor: '(' expr ')'  */
-#line 301 "parser.y"
+#line 347 "parser.y"
     {
         (yyval.node_ptr) = (yyvsp[-1].node_ptr);
     }
-#line 1466 "parser.tab.c"
+#line 1628 "parser.tab.c"
     break;
 
   case 34: /* factor: '-' factor  */
-#line 305 "parser.y"
+#line 351 "parser.y"
     {
         Node *neg_one = create_num_node(-1, sem_analyzer.current_line);
         (yyval.node_ptr) = create_binop_node('*', neg_one, (Node*)(yyvsp[0].node_ptr), sem_analyzer.current_line);
     }
-#line 1475 "parser.tab.c"
+#line 1637 "parser.tab.c"
     break;
 
 
-#line 1479 "parser.tab.c"
+#line 1641 "parser.tab.c"
 
       default: break;
     }
@@ -1668,7 +1830,7 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 311 "parser.y"
+#line 357 "parser.y"
 
 
 void print_ast(Node *node, int depth) {
@@ -1712,117 +1874,8 @@ void print_ast(Node *node, int depth) {
     }
 }
 
-int main(int argc, char **argv) {
-    if(argc < 2) {
-        fprintf(stderr, "Usage: %s <input_file> [output_file]\n", argv[0]);
-        return 1;
-    }
-
-    // handle errors & line numbers
-    // initialize error state
-    error_state_init(&error_state);  // ADD THIS
-    
-    char *asm_filename = "MIPS64.s";
-    char *machine_filename = "MACHINE_CODE.mc";
-    
-    if(argc >= 3) {
-        asm_filename = argv[2];
-        // create machine code filename from assembly filename
-        char *dot = strrchr(asm_filename, '.');
-        if(dot && strcmp(dot, ".s") == 0) {
-            // replace .s with .mc
-            strcpy(dot, ".mc");
-            machine_filename = asm_filename;
-            strcpy(dot, ".s"); // Restore .s
-        } else {
-            // append .mc
-            machine_filename = malloc(strlen(asm_filename) + 4);
-            sprintf(machine_filename, "%s.mc", asm_filename);
-        }
-    }
-    
-    // initialize semantic analyzer
-    sem_init(&sem_analyzer);
-    sem_set_line(&sem_analyzer, 1);
-    
-    yyin = fopen(argv[1], "r");
-    if(!yyin) {
-        fprintf(stderr, "Error: Cannot open file %s\n", argv[1]);
-        sem_cleanup(&sem_analyzer);
-        return 1;
-    }
-    
-    int parse_result = yyparse();
-    int error_count = sem_get_error_count(&sem_analyzer);
-    
-    if(parse_result == 0 && error_count == 0) {
-        //printf("Compilation successful!\n");
-        
-        // debug: print AST structure
-        //printf("\n=== AST Structure ===\n");
-        //print_ast(ast_root, 0);
-        //printf("====================\n\n");
-        
-        // open output file for assembly
-        FILE *asm_file = fopen(asm_filename, "w");
-        if(!asm_file) {
-            fprintf(stderr, "Error: Cannot open assembly file %s\n", asm_filename);
-            fclose(yyin);
-            sem_cleanup(&sem_analyzer);
-            free_node(ast_root);
-            return 1;
-        }
-        
-        // generate MIPS64 assembly
-        GenerateAssemblyProgram(ast_root, asm_file);
-        fclose(asm_file);
-        
-        //printf("MIPS64 assembly written to %s\n", asm_filename);
-        
-        // now convert assembly to machine code
-        //printf("\n=== Converting assembly to machine code ===\n");
-        if(MachineFromAssembly(asm_filename, machine_filename)) {
-            //printf("Machine code written to %s\n", machine_filename);
-        }
-        
-        // now interpret the program and display output
-        //printf("\n=== Program Output ===\n");
-        // interpret with error state
-        char *output = interpret_program(ast_root, &error_state);
-        
-        // print runtime errors if any
-        if(get_error_count(&error_state) > 0) {
-            printf("\n=== Runtime Error ===\n");
-            print_messages(&error_state);
-            printf("====================\n");
-            free(output);
-        } else {
-            // onnly print output if NO runtime errors
-            if(output && strlen(output) > 0) {
-                printf("%s", output);
-            }
-            free(output);
-        }
-        
-    } else {
-        // semantic/parsing error - don't execute at all
-        //printf("Compilation failed with %d error(s)\n", error_count);
-        // NVM the count; we should stop at the first error
-        printf("Compilation failed\n");
-     
-    }
-    
-    fclose(yyin);
-    yylex_destroy();
-    sem_cleanup(&sem_analyzer);
-    free_node(ast_root);
-    error_state_free(&error_state);  // cleanup error state
-    
-    return (parse_result != 0 || error_count > 0) ? 1 : 0;
-}
-
 void yyerror(const char *s) {
-    fprintf(stderr, "Syntax error at line %d: %s\n", sem_analyzer.current_line, s);
+    fprintf(get_diagnostics_stream(), "Syntax error at line %d: %s\n", sem_analyzer.current_line, s);
 }
 
 /* AST creation functions */
@@ -1923,24 +1976,36 @@ Node *append_to_list(Node *first, Node *rest) {
 ////
 
 void free_node(Node *node) {
-    if(!node)
-        return;
-    
-    switch(node->node_type) {
-        case 1: // STR
-        case 2: // ID
-            free(node->str_val);
-            break;
-        case 3: // BINOP
-            free_node(node->binop.left);
-            free_node(node->binop.right);
-            break;
-        case 4: // DECL
-        case 5: // ASSIGN
-        case 6: // PRINT
-            free_node(node->list.items);
-            free_node(node->list.next);
-            break;
+    // statements (and print parts) are a list, walk it instead of recursing
+    while(node) {
+        Node *next = NULL;
+
+        switch(node->node_type) {
+            case 0: // NUM
+                // the rightmost leaf of a decl/assign item carries the next
+                // item (append_to_list goes through binop.right)
+                next = node->list.next;
+                break;
+            case 1: // STR
+                free(node->str_val);
+                break;
+            case 2: // ID
+                free(node->str_val);
+                next = node->list.next;
+                break;
+            case 3: // BINOP
+                free_node(node->binop.left);
+                free_node(node->binop.right);
+                break;
+            case 4: // DECL
+            case 5: // ASSIGN
+            case 6: // PRINT
+            case NODE_PRINT_PART:
+                free_node(node->list.items);
+                next = node->list.next;
+                break;
+        }
+        free(node);
+        node = next;
     }
-    free(node);
 }
@@ -4,22 +4,25 @@
 #include <string.h>
 #include "semantics.h"
 #include "ast.h"
-#include "assembly.h"
-#include "machine_code.h"
-#include "interpreter.h"
+#include "error.h"
 
 #define NODE_PRINT_PART 7 // FIX ATTEMPT
 
-// recent: global variable to handle errors and lin enumbers
-ErrorState error_state;
-
 // AST root
-Node *ast_root = NULL;
+// (this and the rest of the compiler's state is per thread: the batch
+// driver runs a whole compilation on each of its workers)
+_Thread_local Node *ast_root = NULL;
 
 // global semantic analyzer
-Semantics sem_analyzer;
+_Thread_local Semantics sem_analyzer;
+
+// when set, every statement is handed over here as soon as its line is
+// parsed (and not kept in ast_root) - see stream.h
+_Thread_local void (*statement_handler)(Node *statement) = NULL;
+
+// last statement of ast_root, so appending a line doesn't walk the list
+static _Thread_local Node *lines_tail = NULL;
 
-extern int yylex();
 extern int yyparse();
 extern FILE *yyin;
 void yyerror(const char *s);
@@ -42,12 +45,28 @@ void print_ast(Node *node, int depth);
 
 %}
 
+// pure: yylval isn't a global shared between the scanner and the parser
+%define api.pure full
+
 %union {
     int int_val;
     char *str_val;
     void *node_ptr;
 }
 
+%code {
+int yylex(YYSTYPE *lval);
+
+// where the parser takes its tokens from: the flex scanner, unless a
+// pipeline thread (stream.h) or tokens scanned up front (parse_text) feed it
+_Thread_local int (*token_source)(YYSTYPE *lval) = NULL;
+
+static int NextToken(YYSTYPE *lval) {
+    return token_source ? token_source(lval) : yylex(lval);
+}
+#define yylex NextToken
+}
+
 %token PROG_START PROG_END
 %token KW_INT KW_PRINT
 %token NEWLINE_TOKEN ILLEGAL
@@ -61,6 +80,10 @@ void print_ast(Node *node, int depth);
 %type <node_ptr> print_parts more_print_parts print_part
 %type <node_ptr> expr term factor
 
+// whatever is still on the stack when a syntax error aborts the parse
+%destructor { free($$); } <str_val>
+%destructor { free_node((Node*)$$); } <node_ptr>
+
 //%left '+' '-'
 //%left '*' '/'
 %right '+' '-'
@@ -73,17 +96,30 @@ void print_ast(Node *node, int depth);
 program: PROG_START lines PROG_END
     {
         ast_root = $2;
+        $$ = NULL;  // owned by ast_root now
         //printf("Parsed program successfully\n");
     }
     ;
 
-lines: line lines
+// left recursive so the value stack doesn't grow with the program
+lines: lines line
     {
-        $$ = append_to_list((Node*)$1, (Node*)$2);
+        $$ = $1;
+        Node *statement = (Node*)$2;
+        if(statement && statement_handler) {
+            statement_handler(statement);
+        } else if(statement) {
+            if(!$$)
+                $$ = statement;
+            else
+                lines_tail->list.next = statement;
+            lines_tail = statement;
+        }
     }
     | /* epsilon */
     {
         $$ = NULL;
+        lines_tail = NULL;
     }
     ;
 
@@ -142,6 +178,7 @@ decl_item: ID
         // in declaration line: just add symbol
         sem_add_symbol(&sem_analyzer, $1);
         $$ = create_id_node($1, sem_analyzer.current_line);  // division by 0 fix & add line number
+        free($1);
     }
     | ID '=' expr
     {
@@ -149,6 +186,7 @@ decl_item: ID
         sem_add_symbol(&sem_analyzer, $1);
         Node *id_node = create_id_node($1, sem_analyzer.current_line);
         $$ = create_binop_node('=', id_node, (Node*)$3, sem_analyzer.current_line);
+        free($1);
     }
     ;
 
@@ -168,7 +206,10 @@ assign: ID '=' expr more_assign
             $$ = create_assign_node(assign_list, sem_analyzer.current_line);
         } else {
             $$ = NULL;
+            free_node((Node*)$3);
+            free_node((Node*)$4);
         }
+        free($1);
     }
     ;
 
@@ -187,7 +228,10 @@ more_assign: ',' ID '=' expr more_assign
             $$ = list;
         } else {
             $$ = NULL;
+            free_node((Node*)$4);
+            free_node((Node*)$5);
         }
+        free($2);
     }
     | /* epsilon */
     {
@@ -246,6 +290,7 @@ print_part: STR
     {
         $$ = create_print_part_node(create_str_node($1, sem_analyzer.current_line),
                                     sem_analyzer.current_line); 
+        free($1);
     }
     | expr %prec PRINT_EXPR
     {
@@ -296,6 +341,7 @@ factor: NUM
         } else {
             $$ = NULL;  // Error occurred
         }
+        free($1);
     }
     | '(' expr ')'
     {
@@ -351,117 +397,8 @@ void print_ast(Node *node, int depth) {
     }
 }
 
-int main(int argc, char **argv) {
-    if(argc < 2) {
-        fprintf(stderr, "Usage: %s <input_file> [output_file]\n", argv[0]);
-        return 1;
-    }
-
-    // handle errors & line numbers
-    // initialize error state
-    error_state_init(&error_state);  // ADD THIS
-    
-    char *asm_filename = "MIPS64.s";
-    char *machine_filename = "MACHINE_CODE.mc";
-    
-    if(argc >= 3) {
-        asm_filename = argv[2];
-        // create machine code filename from assembly filename
-        char *dot = strrchr(asm_filename, '.');
-        if(dot && strcmp(dot, ".s") == 0) {
-            // replace .s with .mc
-            strcpy(dot, ".mc");
-            machine_filename = asm_filename;
-            strcpy(dot, ".s"); // Restore .s
-        } else {
-            // append .mc
-            machine_filename = malloc(strlen(asm_filename) + 4);
-            sprintf(machine_filename, "%s.mc", asm_filename);
-        }
-    }
-    
-    // initialize semantic analyzer
-    sem_init(&sem_analyzer);
-    sem_set_line(&sem_analyzer, 1);
-    
-    yyin = fopen(argv[1], "r");
-    if(!yyin) {
-        fprintf(stderr, "Error: Cannot open file %s\n", argv[1]);
-        sem_cleanup(&sem_analyzer);
-        return 1;
-    }
-    
-    int parse_result = yyparse();
-    int error_count = sem_get_error_count(&sem_analyzer);
-    
-    if(parse_result == 0 && error_count == 0) {
-        //printf("Compilation successful!\n");
-        
-        // debug: print AST structure
-        //printf("\n=== AST Structure ===\n");
-        //print_ast(ast_root, 0);
-        //printf("====================\n\n");
-        
-        // open output file for assembly
-        FILE *asm_file = fopen(asm_filename, "w");
-        if(!asm_file) {
-            fprintf(stderr, "Error: Cannot open assembly file %s\n", asm_filename);
-            fclose(yyin);
-            sem_cleanup(&sem_analyzer);
-            free_node(ast_root);
-            return 1;
-        }
-        
-        // generate MIPS64 assembly
-        GenerateAssemblyProgram(ast_root, asm_file);
-        fclose(asm_file);
-        
-        //printf("MIPS64 assembly written to %s\n", asm_filename);
-        
-        // now convert assembly to machine code
-        //printf("\n=== Converting assembly to machine code ===\n");
-        if(MachineFromAssembly(asm_filename, machine_filename)) {
-            //printf("Machine code written to %s\n", machine_filename);
-        }
-        
-        // now interpret the program and display output
-        //printf("\n=== Program Output ===\n");
-        // interpret with error state
-        char *output = interpret_program(ast_root, &error_state);
-        
-        // print runtime errors if any
-        if(get_error_count(&error_state) > 0) {
-            printf("\n=== Runtime Error ===\n");
-            print_messages(&error_state);
-            printf("====================\n");
-            free(output);
-        } else {
-            // onnly print output if NO runtime errors
-            if(output && strlen(output) > 0) {
-                printf("%s", output);
-            }
-            free(output);
-        }
-        
-    } else {
-        // semantic/parsing error - don't execute at all
-        //printf("Compilation failed with %d error(s)\n", error_count);
-        // NVM the count; we should stop at the first error
-        printf("Compilation failed\n");
-     
-    }
-    
-    fclose(yyin);
-    yylex_destroy();
-    sem_cleanup(&sem_analyzer);
-    free_node(ast_root);
-    error_state_free(&error_state);  // cleanup error state
-    
-    return (parse_result != 0 || error_count > 0) ? 1 : 0;
-}
-
 void yyerror(const char *s) {
-    fprintf(stderr, "Syntax error at line %d: %s\n", sem_analyzer.current_line, s);
+    fprintf(get_diagnostics_stream(), "Syntax error at line %d: %s\n", sem_analyzer.current_line, s);
 }
 
 /* AST creation functions */
@@ -562,24 +499,36 @@ Node *append_to_list(Node *first, Node *rest) {
 ////
 
 void free_node(Node *node) {
-    if(!node)
-        return;
-    
-    switch(node->node_type) {
-        case 1: // STR
-        case 2: // ID
-            free(node->str_val);
-            break;
-        case 3: // BINOP
-            free_node(node->binop.left);
-            free_node(node->binop.right);
-            break;
-        case 4: // DECL
-        case 5: // ASSIGN
-        case 6: // PRINT
-            free_node(node->list.items);
-            free_node(node->list.next);
-            break;
-    }
-    free(node);
+    // statements (and print parts) are a list, walk it instead of recursing
+    while(node) {
+        Node *next = NULL;
+
+        switch(node->node_type) {
+            case 0: // NUM
+                // the rightmost leaf of a decl/assign item carries the next
+                // item (append_to_list goes through binop.right)
+                next = node->list.next;
+                break;
+            case 1: // STR
+                free(node->str_val);
+                break;
+            case 2: // ID
+                free(node->str_val);
+                next = node->list.next;
+                break;
+            case 3: // BINOP
+                free_node(node->binop.left);
+                free_node(node->binop.right);
+                break;
+            case 4: // DECL
+            case 5: // ASSIGN
+            case 6: // PRINT
+            case NODE_PRINT_PART:
+                free_node(node->list.items);
+                next = node->list.next;
+                break;
+        }
+        free(node);
+        node = next;
+    }
 }
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "passes.h"
+#include "simplify.h"
+#include "error.h"
+#include "hash.h"
+#include "stats.h"
+#include "trace.h"
+
+#define INITIAL_BUCKETS 64
+
+typedef struct {
+    const char *name;
+    const char *description;
+    int transform;      // rewrites the AST
+    void (*run)(Node *program, Optimization *optimization);
+} Pass;
+
+static void Simplify(Node *program, Optimization *optimization) {
+    long hits[SIMPLIFY_RULE_COUNT] = { 0 };
+    simplify_program(program, hits);
+    for(int rule = 0; rule < SIMPLIFY_RULE_COUNT; rule++)
+        stats_count(STATS_FOLDED_CONSTANTS + rule, hits[rule]);
+}
+
+static void FindDeadStores(Node *program, Optimization *optimization) {
+    dead_stores_free(optimization->dead);
+    optimization->dead = dead_stores_find(program);
+    stats_count(STATS_DEAD_STORES, dead_stores_store_count(optimization->dead));
+    stats_count(STATS_DEAD_VARIABLES, dead_stores_variable_count(optimization->dead));
+}
+
+// after dead-stores, the expressions it leaves out aren't numbered
+static void NumberValues(Node *program, Optimization *optimization) {
+    value_numbering_free(optimization->numbering);
+    optimization->numbering = value_numbering_create();
+    value_numbering_program(optimization->numbering, program, optimization->dead);
+    stats_count(STATS_REUSED_VALUES, value_numbering_reuse_count(optimization->numbering));
+}
+
+static const Pass passes[] = {
+    { "simplify", "fold constants, drop identities, lean chains left (simplify.h)", 1, Simplify },
+    { "dead-stores", "the stores and variables nothing reads (dead_store.h)", 0, FindDeadStores },
+    { "value-numbering", "the values computed before, to reuse (value_number.h)", 0, NumberValues },
+};
+
+#define PASS_COUNT (int)(sizeof(passes) / sizeof(passes[0]))
+
+static const char *levels[] = {
+    "",
+    "simplify,dead-stores",
+    "simplify,dead-stores,value-numbering",
+};
+
+static int FindPass(const char *name, size_t length) {
+    for(int i = 0; i < PASS_COUNT; i++)
+        if(strlen(passes[i].name) == length && strncmp(passes[i].name, name, length) == 0)
+            return i;
+    return -1;
+}
+
+int pass_exists(const char *name, int all) {
+    return FindPass(name, strlen(name)) >= 0 || (all && strcmp(name, "all") == 0);
+}
+
+void print_passes(FILE *out, const char *indent) {
+    for(int i = 0; i < PASS_COUNT; i++)
+        fprintf(out, "%s%-16s %s\n", indent, passes[i].name, passes[i].description);
+}
+
+int pipeline_parse(const char *names, Pipeline *pipeline) {
+    pipeline->count = 0;
+    const char *name = names;
+    while(*name) {
+        size_t length = strcspn(name, ",");
+        int pass = FindPass(name, length);
+        if(pass < 0 || pipeline->count == MAX_PIPELINE_PASSES)
+            return 0;
+        pipeline->passes[pipeline->count++] = pass;
+        name += length;
+        if(*name == ',' && *++name == '\0')
+            return 0;   // "a,"
+    }
+    return 1;
+}
+
+int pipeline_for_level(int level, Pipeline *pipeline) {
+    if(level < 0 || level >= (int)(sizeof(levels) / sizeof(levels[0])))
+        return 0;
+    return pipeline_parse(levels[level], pipeline);
+}
+
+int pipeline_from_options(const CompilerOptions *opts, Pipeline *pipeline) {
+    if(opts->passes)
+        return pipeline_parse(opts->passes, pipeline);
+    return pipeline_for_level(opts->opt_level, pipeline);
+}
+
+void free_optimization(Optimization *optimization) {
+    dead_stores_free(optimization->dead);
+    value_numbering_free(optimization->numbering);
+    optimization->dead = NULL;
+    optimization->numbering = NULL;
+}
+
+// the verifier: what the code generator, the interpreter and free_node take
+// for granted about the AST. every node is reached once (a node in two
+// places would be freed twice), so the nodes seen go in a set
+typedef struct {
+    const Node **seen;      // open addressing, at most half full
+    size_t buckets;
+    size_t count;
+    const char *problem;    // the first one found
+    int line;
+} Verifier;
+
+static size_t NodeBucket(const Node *node, size_t mask) {
+    return hash64(&node, sizeof(node), 0) & mask;
+}
+
+static void InsertNode(const Node **table, size_t bucket_count, const Node *node) {
+    size_t mask = bucket_count - 1;
+    size_t i = NodeBucket(node, mask);
+    while(table[i])
+        i = (i + 1) & mask;
+    table[i] = node;
+}
+
+static int Fail(Verifier *v, const char *problem, const Node *node) {
+    if(!v->problem) {
+        v->problem = problem;
+        v->line = node ? node->line_number : 0;
+    }
+    return 0;
+}
+
+// 0 if the node was seen before
+static int Visit(Verifier *v, const Node *node) {
+    if(v->buckets > 0) {
+        size_t mask = v->buckets - 1;
+        for(size_t i = NodeBucket(node, mask); v->seen[i]; i = (i + 1) & mask)
+            if(v->seen[i] == node)
+                return Fail(v, "a node is in the program twice", node);
+    }
+    if((v->count + 1) * 2 > v->buckets) {
+        size_t count = v->buckets ? v->buckets * 2 : INITIAL_BUCKETS;
+        const Node **table = calloc(count, sizeof(Node*));
+        for(size_t i = 0; i < v->buckets; i++)
+            if(v->seen[i])
+                InsertNode(table, count, v->seen[i]);
+        free(v->seen);
+        v->seen = table;
+        v->buckets = count;
+    }
+    InsertNode(v->seen, v->buckets, node);
+    v->count++;
+    return 1;
+}
+
+// numbers, variables and the four operations. the leaves have a next only
+// at the end of an item (carry = this is the item's rightmost leaf)
+static int VerifyExpression(Verifier *v, const Node *node, int carry) {
+    if(!node)
+        return Fail(v, "an operand is missing", NULL);
+    if(!Visit(v, node))
+        return 0;
+    switch(node->node_type) {
+        case 0: // NUM
+        case 2: // ID
+            if(node->node_type == 2 && !node->str_val)
+                return Fail(v, "a variable without a name", node);
+            if(!carry && node->list.next)
+                return Fail(v, "a leaf inside an expression has a next item", node);
+            return 1;
+        case 3: // BINOP
+            if(node->binop.op != '+' && node->binop.op != '-' && node->binop.op != '*' && node->binop.op != '/')
+                return Fail(v, "an operation that isn't + - * or /", node);
+            return VerifyExpression(v, node->binop.left, 0) && VerifyExpression(v, node->binop.right, carry);
+    }
+    return Fail(v, "an expression with a node that isn't one", node);
+}
+
+static const Node *RightmostLeaf(const Node *node) {
+    while(node->node_type == 3)
+        node = node->binop.right;
+    return node;
+}
+
+static int VerifyStatement(Verifier *v, const Node *statement) {
+    if(!Visit(v, statement))
+        return 0;
+    switch(statement->node_type) {
+        case 4: // DECL
+        case 5: // ASSIGN
+            if(!statement->list.items)
+                return Fail(v, "a declaration or assignment without items", statement);
+            for(const Node *item = statement->list.items; item; item = RightmostLeaf(item)->list.next) {
+                if(!Visit(v, item))
+                    return 0;
+                if(item->node_type == 2 && statement->node_type == 4 && item->str_val)
+                    continue;
+                if(item->node_type != 3 || item->binop.op != '=' || !item->binop.left ||
+                   item->binop.left->node_type != 2 || !item->binop.left->str_val)
+                    return Fail(v, "an item that isn't \"x\" or \"x = expression\"", item);
+                if(!Visit(v, item->binop.left))
+                    return 0;
+                if(item->binop.left->list.next)
+                    return Fail(v, "a stored variable has a next item", item);
+                if(!VerifyExpression(v, item->binop.right, 1))
+                    return 0;
+            }
+            return 1;
+        case 6: // PRINT
+            for(const Node *part = statement->print_stmt.parts; part; part = part->list.next) {
+                if(!Visit(v, part))
+                    return 0;
+                if(part->node_type != NODE_PRINT_PART || !part->list.items)
+                    return Fail(v, "a print with a part that isn't one", statement);
+                const Node *content = part->list.items;
+                if(content->node_type == 1) {   // STR
+                    if(!Visit(v, content))
+                        return 0;
+                    if(!content->str_val)
+                        return Fail(v, "a string without text", content);
+                } else if(!VerifyExpression(v, content, 0)) {
+                    return 0;
+                }
+            }
+            return 1;
+    }
+    return Fail(v, "a statement that isn't a declaration, an assignment or a print", statement);
+}
+
+static int Verify(Node *program, const char *pass) {
+    Verifier v = { NULL, 0, 0, NULL, 0 };
+    for(const Node *statement = program; statement && VerifyStatement(&v, statement); statement = statement->list.next)
+        ;
+    free(v.seen);
+    if(!v.problem)
+        return 1;
+    fprintf(get_diagnostics_stream(), "Internal error: after pass %s, %s (line %d)\n", pass, v.problem, v.line);
+    return 0;
+}
+
+// --print-after: the program as p0 source. the grammar's operators are
+// left-associative, so a right operand of the same precedence is the one
+// that needs parentheses
+static int Precedence(const Node *node) {
+    if(node->node_type != 3)
+        return 3;
+    return node->binop.op == '+' || node->binop.op == '-' ? 1 : 2;
+}
+
+static void PrintExpression(FILE *out, const Node *node);
+
+static void PrintOperand(FILE *out, const Node *node, int parenthesise) {
+    if(parenthesise)
+        fputc('(', out);
+    PrintExpression(out, node);
+    if(parenthesise)
+        fputc(')', out);
+}
+
+static void PrintExpression(FILE *out, const Node *node) {
+    if(node->node_type == 0) {
+        fprintf(out, "%d", node->int_val);
+    } else if(node->node_type == 2) {
+        fputs(node->str_val, out);
+    } else {
+        int precedence = Precedence(node);
+        PrintOperand(out, node->binop.left, Precedence(node->binop.left) < precedence);
+        fprintf(out, " %c ", node->binop.op);
+        PrintOperand(out, node->binop.right, Precedence(node->binop.right) <= precedence);
+    }
+}
+
+static void PrintString(FILE *out, const char *text) {
+    fputc('"', out);
+    for(const char *c = text; *c; c++) {
+        switch(*c) {
+            case '\n': fputs("\\n", out); break;
+            case '\t': fputs("\\t", out); break;
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            default: fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// what the analyses found about a statement, as " // dead: x; reused: a + b"
+typedef struct {
+    const char *heading;    // of the list, until its first entry
+    int lists;              // started so far
+} Note;
+
+static void NoteEntry(Note *note, FILE *out) {
+    if(note->heading) {
+        fprintf(out, "%s%s: ", note->lists++ ? "; " : " // ", note->heading);
+        note->heading = NULL;
+    } else {
+        fputs(", ", out);
+    }
+}
+
+static void NoteReuses(Note *note, FILE *out, const ValueNumbering *numbering, const Node *node) {
+    if(node->node_type != 3)
+        return;
+    if(value_number_reused(numbering, node)) {
+        NoteEntry(note, out);
+        PrintExpression(out, node);
+        return;
+    }
+    NoteReuses(note, out, numbering, node->binop.left);
+    NoteReuses(note, out, numbering, node->binop.right);
+}
+
+static void PrintStatement(FILE *out, const Node *statement, const Optimization *optimization) {
+    Note note = { NULL, 0 };
+    if(statement->node_type == 6) {
+        fputs("p: ", out);
+        for(const Node *part = statement->print_stmt.parts; part; part = part->list.next) {
+            if(part->list.items->node_type == 1)
+                PrintString(out, part->list.items->str_val);
+            else
+                PrintExpression(out, part->list.items);
+            if(part->list.next)
+                fputs(", ", out);
+        }
+        if(optimization->numbering) {
+            note.heading = "reused";
+            for(const Node *part = statement->print_stmt.parts; part; part = part->list.next)
+                NoteReuses(&note, out, optimization->numbering, part->list.items);
+        }
+        fputc('\n', out);
+        return;
+    }
+
+    fputs(statement->node_type == 4 ? "int " : "", out);
+    for(const Node *item = statement->list.items; item; item = RightmostLeaf(item)->list.next) {
+        if(item->node_type == 2) {
+            fputs(item->str_val, out);
+        } else {
+            fprintf(out, "%s = ", item->binop.left->str_val);
+            PrintExpression(out, item->binop.right);
+        }
+        if(RightmostLeaf(item)->list.next)
+            fputs(", ", out);
+    }
+    if(optimization->dead) {
+        static const char *headings[] = { NULL, "dead", "evaluated only" };
+        for(int status = STORE_DEAD; status <= STORE_EVALUATE; status++) {
+            note.heading = headings[status];
+            for(const Node *item = statement->list.items; item; item = RightmostLeaf(item)->list.next)
+                if(item->node_type == 3 && dead_stores_store(optimization->dead, item) == status) {
+                    NoteEntry(&note, out);
+                    fputs(item->binop.left->str_val, out);
+                }
+        }
+    }
+    if(optimization->numbering) {
+        note.heading = "reused";
+        for(const Node *item = statement->list.items; item; item = RightmostLeaf(item)->list.next)
+            if(item->node_type == 3)
+                NoteReuses(&note, out, optimization->numbering, item->binop.right);
+    }
+    fputc('\n', out);
+}
+
+static void PrintProgram(FILE *out, const Node *program, const char *pass, const Optimization *optimization) {
+    fprintf(out, "=== after %s ===\n>>>\n", pass);
+    for(const Node *statement = program; statement; statement = statement->list.next)
+        PrintStatement(out, statement, optimization);
+    fprintf(out, "<<<\n");
+}
+
+int run_pipeline(const Pipeline *pipeline, Node *program, const char *print_after, Optimization *optimization) {
+    for(int i = 0; i < pipeline->count; i++) {
+        const Pass *pass = &passes[pipeline->passes[i]];
+        if(pass->transform)
+            free_optimization(optimization);
+
+        stats_pass_begin(pass->name);
+        trace_begin(pass->name);
+        pass->run(program, optimization);
+        trace_end(pass->name);
+        stats_pass_end(pass->name);
+
+        trace_begin("verify");
+        int verified = Verify(program, pass->name);
+        trace_end("verify");
+        if(!verified)
+            return 0;
+        if(print_after && (strcmp(print_after, "all") == 0 || strcmp(print_after, pass->name) == 0))
+            PrintProgram(get_diagnostics_stream(), program, pass->name, optimization);
+    }
+    return 1;
+}
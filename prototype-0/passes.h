@@ -0,0 +1,55 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "ast.h"
+#include "options.h"
+#include "dead_store.h"
+#include "value_number.h"
+
+// the pass manager: the optimisation passes that run on a checked program
+// between the checks and codegen, by -O level or by name (--passes=).
+//
+//   -O0  none (the default)
+//   -O1  simplify,dead-stores
+//   -O2  simplify,dead-stores,value-numbering (-O is -O2)
+//
+// a pass is a transform, which rewrites the AST, or an analysis, which
+// leaves what it found for codegen and the interpreter. the analyses point
+// into the AST, so a transform drops the ones before it: only what ran
+// after the last transform reaches the back ends. after every pass the
+// verifier checks the AST is still one they take, and --print-after=PASS
+// writes the program out as p0 source, what the analyses found as
+// comments. each pass is timed on its own (stats_pass_begin, the trace)
+
+#define MAX_PIPELINE_PASSES 32
+
+typedef struct {
+    int passes[MAX_PIPELINE_PASSES];
+    int count;
+} Pipeline;
+
+// what the passes left for the back ends, NULL = not run
+typedef struct {
+    DeadStores *dead;           // dead-stores
+    ValueNumbering *numbering;  // value-numbering
+} Optimization;
+
+// 1 if name is a pass's, or "all" when all is set (--print-after=all)
+int pass_exists(const char *name, int all);
+// the names of the passes, each with what it does, one per line
+void print_passes(FILE *out, const char *indent);
+
+// the passes of an -O level (0-2), or of a comma-separated list of names;
+// 0 if there's a name that isn't a pass's, or too many of them
+int pipeline_for_level(int level, Pipeline *pipeline);
+int pipeline_parse(const char *names, Pipeline *pipeline);
+// opts' pipeline: --passes= if it was given, -O's level if not
+int pipeline_from_options(const CompilerOptions *opts, Pipeline *pipeline);
+
+// run the pipeline on program. the dumps of print_after (a pass, "all", or
+// NULL = none) and what the verifier finds go to the diagnostics stream;
+// 0 if it found anything, and then the program is no good to the back ends
+int run_pipeline(const Pipeline *pipeline, Node *program, const char *print_after, Optimization *optimization);
+void free_optimization(Optimization *optimization);
+
+#endif
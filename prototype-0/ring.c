@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+#include "ring.h"
+
+#define SPIN_LIMIT 256
+#define YIELD_LIMIT 16
+#define SLEEP_NS 20000
+
+void ring_init(Ring *ring, size_t capacity) {
+    size_t size = 1;
+    while(size < capacity)
+        size <<= 1;
+    ring->slots = malloc(sizeof(void*) * size);
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+void ring_free(Ring *ring) {
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+// the other side is usually only a moment away; if not, get out of its way
+// (a stage can wait a long time on a slower one, or share its CPU with it)
+static void Backoff(int *spins) {
+    int n = ++*spins;
+    if(n <= SPIN_LIMIT)
+        return;
+    if(n <= SPIN_LIMIT + YIELD_LIMIT) {
+        sched_yield();
+    } else {
+        struct timespec pause = { 0, SLEEP_NS };
+        nanosleep(&pause, NULL);
+    }
+}
+
+void ring_push(Ring *ring, void *item) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    int spins = 0;
+    // full while the consumer is a whole ring behind
+    while(tail - atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask)
+        Backoff(&spins);
+
+    ring->slots[tail & ring->mask] = item;
+    // release: the item (and everything it points to) is visible before the new tail
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void *ring_pop(Ring *ring) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    int spins = 0;
+    while(atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+        Backoff(&spins);
+
+    void *item = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return item;
+}
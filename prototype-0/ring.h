@@ -0,0 +1,22 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// lock-free single-producer/single-consumer queue of pointers, connecting
+// two pipeline threads. push waits while it's full, pop while it's empty
+// (spinning, then yielding, then sleeping)
+typedef struct {
+    void **slots;
+    size_t mask;                           // capacity - 1, capacity is a power of two
+    _Alignas(64) atomic_size_t head;       // next slot to pop, only the consumer writes it
+    _Alignas(64) atomic_size_t tail;       // next slot to push, only the producer writes it
+} Ring;
+
+void ring_init(Ring *ring, size_t capacity);
+void ring_free(Ring *ring);
+void ring_push(Ring *ring, void *item);
+void *ring_pop(Ring *ring);
+
+#endif
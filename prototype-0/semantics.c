@@ -1,13 +1,37 @@
 #include "semantics.h"
+#include "error.h"
+#include "stats.h"
+#include "hash.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define INITIAL_BUCKETS 64
+
 void sem_init(Semantics *sem) {
     sem->symbol_table = NULL;
+    sem->buckets = NULL;
+    sem->bucket_count = 0;
+    sem->symbol_count = 0;
     sem->current_line = 0;
     sem->error_count = 0;
     sem->in_decl_line = false;
+    sem->record_facts = false;
+    sem->facts = NULL;
+    sem->fact_count = 0;
+    sem->fact_capacity = 0;
+}
+
+static void AddFact(Semantics *sem, SemFactKind kind, const char *name) {
+    if(!sem->record_facts)
+        return;
+    if(sem->fact_count >= sem->fact_capacity) {
+        sem->fact_capacity = sem->fact_capacity ? sem->fact_capacity * 2 : 8;
+        sem->facts = realloc(sem->facts, sizeof(SemFact) * sem->fact_capacity);
+    }
+    sem->facts[sem->fact_count].kind = kind;
+    sem->facts[sem->fact_count].name = strdup(name);
+    sem->fact_count++;
 }
 
 void sem_set_line(Semantics *sem, int line) {
@@ -18,19 +42,36 @@ void sem_set_decl_line(Semantics *sem, bool is_decl_line) {
     sem->in_decl_line = is_decl_line;
 }
 
+static Symbol *FindSymbol(Semantics *sem, const char *name) {
+    if(sem->bucket_count == 0)
+        return NULL;
+    size_t mask = sem->bucket_count - 1;
+    size_t i = hash64(name, strlen(name), 0) & mask;
+    while(sem->buckets[i]) {
+        if(strcmp(sem->buckets[i]->name, name) == 0)
+            return sem->buckets[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+static void IndexSymbol(Semantics *sem, Symbol *symbol) {
+    size_t mask = sem->bucket_count - 1;
+    size_t i = hash64(symbol->name, strlen(symbol->name), 0) & mask;
+    while(sem->buckets[i])
+        i = (i + 1) & mask;
+    sem->buckets[i] = symbol;
+}
+
 // in sem_check_declared and sem_add_symbol functions
-bool sem_check_declared(Semantics *sem, const char *name) {
+static bool CheckDeclared(Semantics *sem, const char *name) {
     if (sem->error_count > 0) return false; // alr has error, stop checking
+    AddFact(sem, FACT_USE, name);
     
-    Symbol *s = sem->symbol_table;
-    while(s) {
-        if(strcmp(s->name, name) == 0) {
-            return true;
-        }
-        s = s->next;
-    }
+    if(FindSymbol(sem, name))
+        return true;
     
-    fprintf(stderr, "Semantic error at line %d: Variable '%s' used before declaration\n", 
+    fprintf(get_diagnostics_stream(), "Semantic error at line %d: Variable '%s' used before declaration\n", 
             sem->current_line, name);
     sem->error_count = 1; // set to 1 intead of incrementing
     return false;
@@ -38,33 +79,31 @@ bool sem_check_declared(Semantics *sem, const char *name) {
 
 // updated to stop counting all undeclared variable errors
 // & stop at the first encounetr of such erorr
-bool sem_add_symbol(Semantics *sem, const char *name) {
+static bool AddSymbol(Semantics *sem, const char *name) {
+    AddFact(sem, FACT_DECLARE, name);
     // check for duplicate declaration
-    Symbol *s = sem->symbol_table;
-    while(s) {
-        if(strcmp(s->name, name) == 0) {
-            if(s->is_error) {
-                s->is_error = false;
-                s->declared_line = sem->current_line;
-                return true;
-            }
-            if(sem->in_decl_line) {
-                // in declaration line - this is an error ( bc we can't redeclare)
-                fprintf(stderr, "Semantic error at line %d: Variable '%s' already declared\n", 
-                        sem->current_line, name);
-                sem->error_count++;
-                return false;
-            }
-            // not in declaration line - this might be assignment to existing var
+    Symbol *s = FindSymbol(sem, name);
+    if(s) {
+        if(s->is_error) {
+            s->is_error = false;
+            s->declared_line = sem->current_line;
             return true;
         }
-        s = s->next;
+        if(sem->in_decl_line) {
+            // in declaration line - this is an error ( bc we can't redeclare)
+            fprintf(get_diagnostics_stream(), "Semantic error at line %d: Variable '%s' already declared\n", 
+                    sem->current_line, name);
+            sem->error_count++;
+            return false;
+        }
+        // not in declaration line - this might be assignment to existing var
+        return true;
     }
     
     // add new symbol
     Symbol *new_sym = malloc(sizeof(Symbol));
     if(!new_sym) {
-        fprintf(stderr, "Memory allocation error\n");
+        fprintf(get_diagnostics_stream(), "Memory allocation error\n");
         return false;
     }
     
@@ -75,17 +114,35 @@ bool sem_add_symbol(Semantics *sem, const char *name) {
     new_sym->next = sem->symbol_table;
     sem->symbol_table = new_sym;
     
+    if((size_t)++sem->symbol_count * 2 > sem->bucket_count) {
+        free(sem->buckets);
+        sem->bucket_count = sem->bucket_count ? sem->bucket_count * 2 : INITIAL_BUCKETS;
+        sem->buckets = calloc(sem->bucket_count, sizeof(Symbol*));
+        for(Symbol *symbol = sem->symbol_table; symbol; symbol = symbol->next)
+            IndexSymbol(sem, symbol);
+    } else {
+        IndexSymbol(sem, new_sym);
+    }
     return true;
 }
 
+// the checks the grammar actions make, timed as the semantics phase (stats.h)
+bool sem_check_declared(Semantics *sem, const char *name) {
+    stats_begin(STATS_SEMANTICS);
+    bool declared = CheckDeclared(sem, name);
+    stats_end(STATS_SEMANTICS);
+    return declared;
+}
+
+bool sem_add_symbol(Semantics *sem, const char *name) {
+    stats_begin(STATS_SEMANTICS);
+    bool added = AddSymbol(sem, name);
+    stats_end(STATS_SEMANTICS);
+    return added;
+}
+
 bool sem_is_duplicate(Semantics *sem, const char *name) {
-    Symbol *s = sem->symbol_table;
-    while(s) {
-        if(strcmp(s->name, name) == 0)
-            return true;
-        s = s->next;
-    }
-    return false;
+    return FindSymbol(sem, name) != NULL;
 }
 
 int sem_get_error_count(Semantics *sem) {
@@ -115,13 +172,38 @@ void sem_cleanup(Semantics *sem) {
         current = next;
     }
     sem->symbol_table = NULL;
+    free(sem->buckets);
+    sem->buckets = NULL;
+    sem->bucket_count = 0;
+    sem->symbol_count = 0;
+    sem_free_facts(sem->facts, sem->fact_count);
+    sem->facts = NULL;
+    sem->fact_count = sem->fact_capacity = 0;
+}
+
+void sem_record_facts(Semantics *sem, bool record) {
+    sem->record_facts = record;
+}
+
+SemFact* sem_take_facts(Semantics *sem, int *count) {
+    SemFact *facts = sem->facts;
+    *count = sem->fact_count;
+    sem->facts = NULL;
+    sem->fact_count = sem->fact_capacity = 0;
+    return facts;
+}
+
+void sem_free_facts(SemFact *facts, int count) {
+    for(int i = 0; i < count; i++)
+        free(facts[i].name);
+    free(facts);
 }
 
 
 // ADDED TO ONLY ACCEPT "int" & reflect changes in parser.y
 bool sem_check_type(Semantics *sem, const char *type_name) {
     if(strcmp(type_name, "int") != 0) {
-        fprintf(stderr, "Semantic error at line %d: Type '%s' is not supported. Only 'int' is allowed.\n", 
+        fprintf(get_diagnostics_stream(), "Semantic error at line %d: Type '%s' is not supported. Only 'int' is allowed.\n", 
                 sem->current_line, type_name);
         sem->error_count++;
         return false;
@@ -2,6 +2,7 @@
 #define SEMANTICS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 // symbol table entry
 typedef struct Symbol {
@@ -13,12 +14,34 @@ typedef struct Symbol {
     struct Symbol *next;
 } Symbol;
 
+// one declare/use check, recorded in parse order when record_facts is set
+// (the incremental compiler keeps these per line to re-check a line
+// against a new symbol state without parsing it again)
+typedef enum {
+    FACT_DECLARE,
+    FACT_USE
+} SemFactKind;
+
+typedef struct {
+    SemFactKind kind;
+    char *name;
+} SemFact;
+
 // semantic analyzer state
 typedef struct Semantics {
     Symbol *symbol_table;
+    // the same symbols hashed by name (open addressing, at most half full)
+    Symbol **buckets;
+    size_t bucket_count;
+    int symbol_count;
     int current_line;
     int error_count;
     bool in_decl_line;  // r we parsing a declaration line?
+
+    bool record_facts;
+    SemFact *facts;
+    int fact_count;
+    int fact_capacity;
 } Semantics;
 
 // initialize semantic analyzer
@@ -48,6 +71,11 @@ void sem_print_symbols(Semantics *sem);
 // clean up
 void sem_cleanup(Semantics *sem);
 
+// recorded facts; take_facts hands them over to the caller (free with sem_free_facts)
+void sem_record_facts(Semantics *sem, bool record);
+SemFact* sem_take_facts(Semantics *sem, int *count);
+void sem_free_facts(SemFact *facts, int count);
+
 bool sem_check_type(Semantics *sem, const char *type_name);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "simplify.h"
+#include "hash.h"
+
+#define INITIAL_BUCKETS 64
+
+// parser.y
+Node *create_num_node(int val, int line);
+Node *create_binop_node(int op, Node *left, Node *right, int line);
+void free_node(Node *node);
+
+// whether a variable has a value at the statement being simplified; the
+// names are the AST's, of the declarations and stores (which stay)
+typedef struct {
+    const char *name;   // NULL = empty
+    int initialized;
+} Variable;
+
+// a term of a sum or a factor of a product
+typedef struct {
+    Node *node;
+    int negative;       // a term that's subtracted
+} Operand;
+
+// a chain taken apart, its operands in the order they're evaluated
+typedef struct {
+    Operand *operands;
+    int count;
+    int capacity;
+    int depth;          // right operands within right operands, as it was
+} Chain;
+
+typedef struct {
+    // open addressing, at most half full
+    Variable *variables;
+    size_t variable_buckets;
+    size_t variable_count;
+
+    long *hits;
+} Simplifier;
+
+static Variable *FindVariable(const Simplifier *s, const char *name) {
+    if(s->variable_buckets == 0)
+        return NULL;
+    size_t mask = s->variable_buckets - 1;
+    for(size_t i = hash64(name, strlen(name), 0) & mask; s->variables[i].name; i = (i + 1) & mask)
+        if(strcmp(s->variables[i].name, name) == 0)
+            return &s->variables[i];
+    return NULL;
+}
+
+static void InsertVariable(Variable *table, size_t bucket_count, Variable variable) {
+    size_t mask = bucket_count - 1;
+    size_t i = hash64(variable.name, strlen(variable.name), 0) & mask;
+    while(table[i].name)
+        i = (i + 1) & mask;
+    table[i] = variable;
+}
+
+static void SetInitialized(Simplifier *s, const char *name, int initialized) {
+    Variable *variable = FindVariable(s, name);
+    if(variable) {
+        variable->initialized = initialized;
+        return;
+    }
+    if((s->variable_count + 1) * 2 > s->variable_buckets) {
+        size_t count = s->variable_buckets ? s->variable_buckets * 2 : INITIAL_BUCKETS;
+        Variable *table = calloc(count, sizeof(Variable));
+        for(size_t i = 0; i < s->variable_buckets; i++)
+            if(s->variables[i].name)
+                InsertVariable(table, count, s->variables[i]);
+        free(s->variables);
+        s->variables = table;
+        s->variable_buckets = count;
+    }
+    InsertVariable(s->variables, s->variable_buckets, (Variable){ name, initialized });
+    s->variable_count++;
+}
+
+// 1 if evaluating node can fail at run time: a division by anything but a
+// number other than 0 (as dead_store.c has it), or a variable without a value
+static int CanFail(const Simplifier *s, const Node *node) {
+    if(node->node_type == 2) {
+        const Variable *variable = FindVariable(s, node->str_val);
+        return !variable || !variable->initialized;
+    }
+    if(node->node_type != 3)
+        return 0;
+    if(node->binop.op == '/' && (node->binop.right->node_type != 0 || node->binop.right->int_val == 0))
+        return 1;
+    return CanFail(s, node->binop.left) || CanFail(s, node->binop.right);
+}
+
+static int IsSum(const Node *node) {
+    return node->node_type == 3 && (node->binop.op == '+' || node->binop.op == '-');
+}
+
+static int IsProduct(const Node *node) {
+    return node->node_type == 3 && node->binop.op == '*';
+}
+
+static int Fits(int64_t value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static void AddOperand(Chain *chain, Node *node, int negative) {
+    if(chain->count == chain->capacity) {
+        chain->capacity = chain->capacity ? chain->capacity * 2 : 16;
+        chain->operands = realloc(chain->operands, sizeof(Operand) * chain->capacity);
+    }
+    chain->operands[chain->count++] = (Operand){ node, negative };
+}
+
+// a number as the first operand
+static void PrependOperand(Chain *chain, Node *node, int negative) {
+    AddOperand(chain, node, negative);
+    memmove(chain->operands + 1, chain->operands, sizeof(Operand) * (chain->count - 1));
+    chain->operands[0] = (Operand){ node, negative };
+}
+
+// a product negated through its first factor, if that's a negative number
+// (SimplifyProduct puts the number first): -1 goes, any other is made positive
+static int Negate(Node **product) {
+    Node *node = *product;
+    if(IsProduct(node->binop.left))
+        return Negate(&node->binop.left);
+    Node *factor = node->binop.left;
+    if(factor->node_type != 0 || factor->int_val >= 0 || factor->int_val == INT32_MIN)
+        return 0;
+    if(factor->int_val == -1) {
+        *product = node->binop.right;
+        free(factor);
+        free(node);
+    } else {
+        factor->int_val = -factor->int_val;
+    }
+    return 1;
+}
+
+// the numbers go from the chain: their node freed, *constants of them
+static void TakeConstants(Chain *chain) {
+    int kept = 0;
+    for(int i = 0; i < chain->count; i++) {
+        if(chain->operands[i].node->node_type == 0)
+            free(chain->operands[i].node);
+        else
+            chain->operands[kept++] = chain->operands[i];
+    }
+    chain->count = kept;
+}
+
+static Node *Simplify(Simplifier *s, Node *node);
+
+// the terms of a sum, each one simplified unless it already is; the chain's
+// own nodes are freed, it's built again
+static void GatherTerms(Simplifier *s, Chain *chain, Node *node, int negative, int depth, int simplified) {
+    if(IsSum(node)) {
+        int op = node->binop.op;
+        Node *left = node->binop.left, *right = node->binop.right;
+        free(node);
+        GatherTerms(s, chain, left, negative, depth, simplified);
+        GatherTerms(s, chain, right, op == '-' ? !negative : negative, depth + 1, simplified);
+        return;
+    }
+    if(depth > chain->depth)
+        chain->depth = depth;
+    if(!simplified) {
+        node = Simplify(s, node);
+        if(IsSum(node)) {
+            GatherTerms(s, chain, node, negative, depth, 1);
+            return;
+        }
+    }
+    // a negation, or a product by a negative number, is subtracted
+    if(IsProduct(node) && Negate(&node)) {
+        negative = !negative;
+        s->hits[SIMPLIFY_NEGATIONS]++;
+    }
+    AddOperand(chain, node, negative);
+}
+
+// the terms again, leaning left: evaluated in their order, and in two
+// temporaries however many there are. its value is the sum's, or the sum's
+// negated if *negative
+static Node *BuildSum(const Chain *chain, int *negative, int line) {
+    Node *sum = chain->operands[0].node;
+    *negative = chain->operands[0].negative;
+    for(int i = 1; i < chain->count; i++) {
+        // -l + r is -(l - r), and -l - r is -(l + r)
+        int op = *negative == chain->operands[i].negative ? '+' : '-';
+        sum = create_binop_node(op, sum, chain->operands[i].node, line);
+    }
+    return sum;
+}
+
+static Node *SimplifySum(Simplifier *s, Node *node) {
+    Chain chain = { NULL, 0, 0, 0 };
+    int line = node->line_number;
+    GatherTerms(s, &chain, node, 0, 0, 0);
+
+    // the constants as one number, if it fits one (wrapping, which modulo
+    // 2^32 and 2^64 is the sum)
+    uint64_t sum = 0;
+    int constants = 0, zeros = 0;
+    for(int i = 0; i < chain.count; i++) {
+        const Operand *term = &chain.operands[i];
+        if(term->node->node_type != 0)
+            continue;
+        uint64_t value = (uint64_t)(int64_t)term->node->int_val;
+        sum = term->negative ? sum - value : sum + value;
+        constants++;
+        zeros += term->node->int_val == 0;
+    }
+    int64_t constant = 0;
+    if(constants > 0 && Fits((int64_t)sum)) {
+        constant = (int64_t)sum;
+        TakeConstants(&chain);
+        if(chain.count == 0) {
+            s->hits[SIMPLIFY_FOLDED] += constants - 1;
+        } else {
+            if(constants - zeros >= 2)
+                s->hits[SIMPLIFY_FOLDED] += constants - zeros - 1;
+            s->hits[SIMPLIFY_IDENTITIES] += zeros;
+        }
+    }
+
+    Node *result;
+    if(chain.count == 0) {
+        result = create_num_node((int)constant, line);
+    } else {
+        if(chain.count >= 3 && chain.depth > 1)
+            s->hits[SIMPLIFY_REASSOCIATED]++;
+        // the constant last, or first when the first term is subtracted
+        // (it can't fail, so it can go anywhere)
+        if(constant != 0) {
+            int negative = constant < 0 && constant != INT32_MIN;
+            Node *number = create_num_node(negative ? (int)-constant : (int)constant, line);
+            if(chain.operands[0].negative)
+                PrependOperand(&chain, number, negative);
+            else
+                AddOperand(&chain, number, negative);
+        }
+        int negative;
+        result = BuildSum(&chain, &negative, line);
+        if(negative)
+            result = create_binop_node('*', create_num_node(-1, line), result, line);
+    }
+    free(chain.operands);
+    return result;
+}
+
+// the factors of a product, like GatherTerms
+static void GatherFactors(Simplifier *s, Chain *chain, Node *node, int depth, int simplified) {
+    if(IsProduct(node)) {
+        Node *left = node->binop.left, *right = node->binop.right;
+        free(node);
+        GatherFactors(s, chain, left, depth, simplified);
+        GatherFactors(s, chain, right, depth + 1, simplified);
+        return;
+    }
+    if(depth > chain->depth)
+        chain->depth = depth;
+    if(!simplified) {
+        node = Simplify(s, node);
+        if(IsProduct(node)) {
+            GatherFactors(s, chain, node, depth, 1);
+            return;
+        }
+    }
+    AddOperand(chain, node, 0);
+}
+
+// the factors again, leaning left like BuildSum's terms
+static Node *BuildProduct(const Chain *chain, int line) {
+    Node *product = chain->operands[0].node;
+    for(int i = 1; i < chain->count; i++)
+        product = create_binop_node('*', product, chain->operands[i].node, line);
+    return product;
+}
+
+static Node *SimplifyProduct(Simplifier *s, Node *node) {
+    Chain chain = { NULL, 0, 0, 0 };
+    int line = node->line_number;
+    GatherFactors(s, &chain, node, 0, 0);
+
+    uint64_t product = 1;
+    int constants = 0, negations = 0;
+    for(int i = 0; i < chain.count; i++) {
+        const Node *factor = chain.operands[i].node;
+        if(factor->node_type != 0)
+            continue;
+        product *= (uint64_t)(int64_t)factor->int_val;
+        constants++;
+        negations += factor->int_val == -1;
+    }
+    int64_t constant = 1;
+    if(constants > 0 && Fits((int64_t)product)) {
+        constant = (int64_t)product;
+        TakeConstants(&chain);
+        if(constants >= 2 && negations == constants)
+            s->hits[SIMPLIFY_NEGATIONS] += constants / 2;
+        else if(constants >= 2)
+            s->hits[SIMPLIFY_FOLDED] += constants - 1;
+        if(constant == 1 && chain.count > 0 && negations < constants)
+            s->hits[SIMPLIFY_IDENTITIES]++;
+
+        // times 0 the others go, but not the ones that can fail
+        if(constant == 0 && chain.count > 0) {
+            int kept = 0;
+            for(int i = 0; i < chain.count; i++) {
+                if(CanFail(s, chain.operands[i].node))
+                    chain.operands[kept++] = chain.operands[i];
+                else
+                    free_node(chain.operands[i].node);
+            }
+            chain.count = kept;
+            s->hits[SIMPLIFY_ZEROS]++;
+        }
+    }
+
+    Node *result;
+    if(chain.count == 0) {
+        result = create_num_node((int)constant, line);
+    } else {
+        if(chain.count >= 3 && chain.depth > 1)
+            s->hits[SIMPLIFY_REASSOCIATED]++;
+        // the constant first, the way a negation is (-1 * x)
+        if(constant != 1)
+            PrependOperand(&chain, create_num_node((int)constant, line), 0);
+        result = BuildProduct(&chain, line);
+    }
+    free(chain.operands);
+    return result;
+}
+
+static Node *SimplifyQuotient(Simplifier *s, Node *node) {
+    Node *left = node->binop.left = Simplify(s, node->binop.left);
+    Node *right = node->binop.right = Simplify(s, node->binop.right);
+    if(right->node_type == 0 && right->int_val == 1) {
+        free(right);
+        free(node);
+        s->hits[SIMPLIFY_IDENTITIES]++;
+        return left;
+    }
+    // a division that can't fail (or overflow) done now
+    if(left->node_type == 0 && right->node_type == 0 && right->int_val != 0 &&
+       !(left->int_val == INT32_MIN && right->int_val == -1)) {
+        Node *quotient = create_num_node(left->int_val / right->int_val, node->line_number);
+        free_node(node);
+        s->hits[SIMPLIFY_FOLDED]++;
+        return quotient;
+    }
+    return node;
+}
+
+// the expression node simplified, which may be a node of its own
+static Node *Simplify(Simplifier *s, Node *node) {
+    if(node->node_type != 3)
+        return node;
+    switch(node->binop.op) {
+        case '+':
+        case '-':
+            return SimplifySum(s, node);
+        case '*':
+            return SimplifyProduct(s, node);
+        case '/':
+            return SimplifyQuotient(s, node);
+    }
+    return node;
+}
+
+// the items of a declaration/assignment are chained through the rightmost
+// leaf of each one (see the interpreter's next_item)
+static Node *RightmostLeaf(Node *node) {
+    while(node->node_type == 3)
+        node = node->binop.right;
+    return node;
+}
+
+// "x = expr": the expression is simplified without the next item on its
+// rightmost leaf, and the leaf that's rightmost after carries it
+static void SimplifyStore(Simplifier *s, Node *item) {
+    Node *last = RightmostLeaf(item->binop.right);
+    Node *next = last->list.next;
+    last->list.next = NULL;
+    item->binop.right = Simplify(s, item->binop.right);
+    RightmostLeaf(item->binop.right)->list.next = next;
+    SetInitialized(s, item->binop.left->str_val, 1);
+}
+
+void simplify_program(Node *program, long hits[SIMPLIFY_RULE_COUNT]) {
+    Simplifier s;
+    memset(&s, 0, sizeof(s));
+    s.hits = hits;
+    for(Node *statement = program; statement; statement = statement->list.next) {
+        if(statement->node_type == 4 || statement->node_type == 5) {  // NODE_DECL, NODE_ASSIGN
+            for(Node *item = statement->list.items; item; item = RightmostLeaf(item)->list.next) {
+                if(item->node_type == 2)
+                    SetInitialized(&s, item->str_val, 0);
+                else if(item->node_type == 3 && item->binop.op == '=' && item->binop.left->node_type == 2)
+                    SimplifyStore(&s, item);
+            }
+        } else if(statement->node_type == 6) {  // NODE_PRINT
+            for(Node *part = statement->print_stmt.parts; part; part = part->list.next)
+                if(part->node_type == NODE_PRINT_PART)
+                    part->list.items = Simplify(&s, part->list.items);
+        }
+    }
+    free(s.variables);
+}
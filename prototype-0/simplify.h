@@ -0,0 +1,36 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "ast.h"
+
+// algebraic simplification (-O): a checked program's expressions rewritten
+// in place, before anything else looks at them.
+//
+// a chain of '+' and '-' is taken apart into its terms, and a chain of '*'
+// into its factors. the constants among them become one (at the end of a
+// sum, at the start of a product), the ones that change nothing go (x + 0,
+// x * 1, x / 1), a negation (-1 * x) in a sum is a subtraction and two of
+// them in a product cancel. what's left is built again leaning left, the
+// way the grammar builds "a + b + c": the code generator evaluates that in
+// two temporaries, and "a + (b + (c + d))" in one more for every term.
+//
+// the terms keep their order, so they're evaluated in the order they were
+// and the first one that fails at run time (a division by zero, or a
+// variable without a value) is still the first. x * 0 is 0 only for the
+// factors that can't fail. wrapping arithmetic is a ring, so the values
+// are the same modulo 2^32 and 2^64: the interpreter's and the code's
+
+// what the rules did, in stats.h's order from STATS_FOLDED_CONSTANTS
+enum {
+    SIMPLIFY_FOLDED,        // constants merged into one
+    SIMPLIFY_IDENTITIES,    // x + 0, x * 1 and x / 1 made x
+    SIMPLIFY_ZEROS,         // x * 0 made 0
+    SIMPLIFY_NEGATIONS,     // negations cancelled or made subtractions
+    SIMPLIFY_REASSOCIATED,  // chains that leaned right made to lean left
+    SIMPLIFY_RULE_COUNT
+};
+
+// hits[rule] goes up by how often each rule applied
+void simplify_program(Node *program, long hits[SIMPLIFY_RULE_COUNT]);
+
+#endif
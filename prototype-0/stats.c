@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "stats.h"
+
+int stats_enabled = 0;
+
+static const char *phase_names[STATS_PHASE_COUNT] = {
+    "read", "lex", "parse", "semantics", "optimize", "codegen", "encode", "run", "emit"
+};
+
+static const char *count_names[STATS_COUNT_COUNT] = {
+    "tokens", "nodes", "symbols", "instructions", "strings", "dead_stores", "dead_variables", "reused_values",
+    "folded_constants", "identities", "zero_products", "negations", "reassociated_chains",
+    "ir_instructions", "spilled_values"
+};
+
+static const char *count_labels[STATS_COUNT_COUNT] = {
+    "tokens", "AST nodes", "symbols", "instructions", "strings", "dead stores", "dead variables", "reused values",
+    "folded constants", "identities", "zero products", "negations", "reassociated chains",
+    "IR instructions", "spilled values"
+};
+
+typedef struct {
+    long long nanoseconds;
+    long allocs;
+    long bytes;
+    // where the phase was entered
+    long long start;
+    long start_allocs;
+    long start_bytes;
+} Phase;
+
+static Phase phases[STATS_PHASE_COUNT];
+
+// the passes inside STATS_OPTIMIZE, in the order they first ran
+#define MAX_PASSES 32
+
+static struct {
+    const char *name;
+    Phase phase;
+} passes[MAX_PASSES];
+static int pass_count;
+static long counts[STATS_COUNT_COUNT];
+
+// every allocation once stats are on (any thread can allocate), as the
+// allocator wrappers report them
+static long alloc_calls;
+static long alloc_bytes;       // asked for
+static long heap_live;         // usable size of what's allocated and not freed
+static long heap_peak;
+
+static long long Now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void stats_enable(void) {
+    stats_enabled = 1;
+}
+
+static void Begin(Phase *p) {
+    p->start_allocs = __atomic_load_n(&alloc_calls, __ATOMIC_RELAXED);
+    p->start_bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+    p->start = Now();
+}
+
+static void End(Phase *p) {
+    p->nanoseconds += Now() - p->start;
+    p->allocs += __atomic_load_n(&alloc_calls, __ATOMIC_RELAXED) - p->start_allocs;
+    p->bytes += __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - p->start_bytes;
+}
+
+void stats_phase_begin(int phase) {
+    Begin(&phases[phase]);
+}
+
+void stats_phase_end(int phase) {
+    End(&phases[phase]);
+}
+
+static Phase *PassPhase(const char *pass) {
+    for(int i = 0; i < pass_count; i++)
+        if(strcmp(passes[i].name, pass) == 0)
+            return &passes[i].phase;
+    if(pass_count == MAX_PASSES)
+        return NULL;
+    passes[pass_count].name = pass;
+    return &passes[pass_count++].phase;
+}
+
+// past MAX_PASSES of them a pass isn't timed (it's still in optimize)
+void stats_pass_phase_begin(const char *pass) {
+    Phase *p = PassPhase(pass);
+    if(p)
+        Begin(p);
+}
+
+void stats_pass_phase_end(const char *pass) {
+    Phase *p = PassPhase(pass);
+    if(p)
+        End(p);
+}
+
+void stats_add(int count, long value) {
+    counts[count] += value;
+}
+
+void stats_allocated(long size, long usable) {
+    __atomic_fetch_add(&alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    long live = __atomic_add_fetch(&heap_live, usable, __ATOMIC_RELAXED);
+    // a racing thread can only make the peak a little low
+    if(live > __atomic_load_n(&heap_peak, __ATOMIC_RELAXED))
+        __atomic_store_n(&heap_peak, live, __ATOMIC_RELAXED);
+}
+
+void stats_freed(long usable) {
+    __atomic_fetch_sub(&heap_live, usable, __ATOMIC_RELAXED);
+}
+
+static long PeakRssKb(void) {
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+// the phases that don't run inside another one
+static long long TotalNanoseconds(void) {
+    long long total = 0;
+    for(int i = 0; i < STATS_PHASE_COUNT; i++)
+        if(i != STATS_SEMANTICS)
+            total += phases[i].nanoseconds;
+    return total;
+}
+
+static void ReportPhase(FILE *out, const char *name, const Phase *p, long long total) {
+    fprintf(out, "%-22s %12.3f %6.1f%% %10ld %14ld\n", name, p->nanoseconds / 1e6,
+            total > 0 ? 100.0 * p->nanoseconds / total : 0.0, p->allocs, p->bytes);
+}
+
+static void ReportText(FILE *out, int time_passes, int show_counts) {
+    if(time_passes) {
+        long long total = TotalNanoseconds();
+        fprintf(out, "=== Time passes ===\n");
+        fprintf(out, "%-22s %12s %7s %10s %14s\n", "phase", "time (ms)", "%", "allocs", "bytes");
+        for(int i = 0; i < STATS_PHASE_COUNT; i++) {
+            const Phase *p = &phases[i];
+            char name[32];
+            snprintf(name, sizeof(name), i == STATS_SEMANTICS ? "  %s (in parse)" : "%s", phase_names[i]);
+            ReportPhase(out, name, p, total);
+            for(int j = 0; i == STATS_OPTIMIZE && j < pass_count; j++) {
+                snprintf(name, sizeof(name), "  %s", passes[j].name);
+                ReportPhase(out, name, &passes[j].phase, total);
+            }
+        }
+        fprintf(out, "%-22s %12.3f\n", "total", total / 1e6);
+    }
+    if(show_counts) {
+        fprintf(out, "=== Statistics ===\n");
+        for(int i = 0; i < STATS_COUNT_COUNT; i++)
+            fprintf(out, "%-22s %12ld\n", count_labels[i], counts[i]);
+        fprintf(out, "%-22s %12ld\n", "allocations", alloc_calls);
+        fprintf(out, "%-22s %12ld\n", "allocated bytes", alloc_bytes);
+        fprintf(out, "%-22s %12ld\n", "peak heap bytes", heap_peak);
+        fprintf(out, "%-22s %12ld\n", "peak RSS (KB)", PeakRssKb());
+    }
+}
+
+static void ReportJson(FILE *out, int time_passes, int show_counts) {
+    const char *separator = "";
+    fprintf(out, "{");
+    if(time_passes) {
+        fprintf(out, "\"phases\": {");
+        for(int i = 0; i < STATS_PHASE_COUNT; i++) {
+            const Phase *p = &phases[i];
+            fprintf(out, "%s\"%s\": {\"ms\": %.3f, \"allocs\": %ld, \"bytes\": %ld}",
+                    i > 0 ? ", " : "", phase_names[i], p->nanoseconds / 1e6, p->allocs, p->bytes);
+        }
+        fprintf(out, "}, \"passes\": {");
+        for(int i = 0; i < pass_count; i++) {
+            const Phase *p = &passes[i].phase;
+            fprintf(out, "%s\"%s\": {\"ms\": %.3f, \"allocs\": %ld, \"bytes\": %ld}",
+                    i > 0 ? ", " : "", passes[i].name, p->nanoseconds / 1e6, p->allocs, p->bytes);
+        }
+        fprintf(out, "}, \"total_ms\": %.3f", TotalNanoseconds() / 1e6);
+        separator = ", ";
+    }
+    if(show_counts) {
+        fprintf(out, "%s\"counts\": {", separator);
+        for(int i = 0; i < STATS_COUNT_COUNT; i++)
+            fprintf(out, "%s\"%s\": %ld", i > 0 ? ", " : "", count_names[i], counts[i]);
+        fprintf(out, "}, \"memory\": {\"allocs\": %ld, \"bytes\": %ld, \"peak_heap_bytes\": %ld, \"peak_rss_kb\": %ld}",
+                alloc_calls, alloc_bytes, heap_peak, PeakRssKb());
+    }
+    fprintf(out, "}\n");
+}
+
+void stats_report(FILE *out, int time_passes, int show_counts, int json) {
+    if(json)
+        ReportJson(out, time_passes, show_counts);
+    else
+        ReportText(out, time_passes, show_counts);
+}
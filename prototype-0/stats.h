@@ -0,0 +1,96 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+// --time-passes and --stats: how long each phase of a compile took, what it
+// allocated, and how big the program turned out to be.
+//
+// everything is off until stats_enable(). until then a phase boundary or a
+// count is one test of stats_enabled, and malloc/free (which the compiler
+// wraps, see allocator.c) forward straight to the C library's. the other
+// programs link this without the wrappers and count no allocations
+//
+// the phases of one compile, in the order they run. semantics runs inside
+// parse (the grammar actions do the checks), so its time is part of parse's,
+// and the passes of -O (passes.h) are timed each on their own in optimize
+enum {
+    STATS_READ,         // reading the input file
+    STATS_LEX,
+    STATS_PARSE,
+    STATS_SEMANTICS,
+    STATS_OPTIMIZE,
+    STATS_CODEGEN,
+    STATS_ENCODE,
+    STATS_RUN,          // interpreting (or the JIT)
+    STATS_EMIT,         // writing the output files
+    STATS_PHASE_COUNT
+};
+
+// what the program is made of
+enum {
+    STATS_TOKENS,
+    STATS_NODES,        // of the AST
+    STATS_SYMBOLS,      // variables the checks declared
+    STATS_INSTRUCTIONS, // MIPS64 instructions encoded
+    STATS_STRINGS,      // string literals in the data section
+    STATS_DEAD_STORES,  // stores -O left out (dead_store.h)
+    STATS_DEAD_VARIABLES, // variables -O left out of .data
+    STATS_REUSED_VALUES,  // operations -O found computed before (value_number.h)
+    STATS_FOLDED_CONSTANTS, // what -O's simplification rules did (simplify.h)
+    STATS_IDENTITIES,
+    STATS_ZERO_PRODUCTS,
+    STATS_NEGATIONS,
+    STATS_REASSOCIATED_CHAINS,
+    STATS_IR_INSTRUCTIONS,  // of the SSA IR (--ir, ir.h)
+    STATS_SPILLED_VALUES,   // IR values the temps had no room for
+    STATS_COUNT_COUNT
+};
+
+extern int stats_enabled;
+
+void stats_enable(void);
+
+// a phase can be entered any number of times, its times add up. one thread
+// at a time: the phase boundaries are the one-shot compiler's
+void stats_phase_begin(int phase);
+void stats_phase_end(int phase);
+void stats_add(int count, long value);
+// the same for a pass, by its name (which has to outlive the report)
+void stats_pass_phase_begin(const char *pass);
+void stats_pass_phase_end(const char *pass);
+// from the allocator wrappers: a block of size bytes asked for that holds
+// usable bytes of the heap, and one freed again
+void stats_allocated(long size, long usable);
+void stats_freed(long usable);
+
+static inline void stats_begin(int phase) {
+    if(stats_enabled)
+        stats_phase_begin(phase);
+}
+
+static inline void stats_end(int phase) {
+    if(stats_enabled)
+        stats_phase_end(phase);
+}
+
+static inline void stats_pass_begin(const char *pass) {
+    if(stats_enabled)
+        stats_pass_phase_begin(pass);
+}
+
+static inline void stats_pass_end(const char *pass) {
+    if(stats_enabled)
+        stats_pass_phase_end(pass);
+}
+
+static inline void stats_count(int count, long value) {
+    if(stats_enabled)
+        stats_add(count, value);
+}
+
+// the phase table (time_passes) and/or the counts and memory (show_counts),
+// as text or as one JSON object
+void stats_report(FILE *out, int time_passes, int show_counts, int json);
+
+#endif
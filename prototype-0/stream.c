@@ -0,0 +1,463 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "stream.h"
+#include "driver.h"
+#include "assembly.h"
+#include "machine_code.h"
+#include "symbol_table.h"
+#include "interpreter.h"
+#include "error.h"
+#include "ring.h"
+#include "parser.tab.h"
+
+void free_node(Node *node);
+extern _Thread_local int (*token_source)(YYSTYPE *lval);
+
+// lexer state (lexer.l)
+extern int yylex(YYSTYPE *lval);
+extern void yyrestart(FILE *input_file);
+extern int yylex_destroy(void);
+extern int line_num;
+extern int column_num;
+
+// the compilation in progress, for the parser's statement_handler
+static struct {
+    FILE *code;                      // .code section so far (ASM/MC)
+    FILE *output;                    // program output so far (RUN)
+    InterpreterState *interpreter;
+    ErrorState runtime_errors;
+    unsigned long statements;
+} stream;
+
+// codegen + interpretation of one checked statement, which is freed afterwards
+static void EmitStatement(Node *statement, FILE *code) {
+    if(code) {
+        AssemblyCollectStatement(statement);
+        GenerateAssemblyNode(statement, code);
+    }
+    if(stream.interpreter && !interpreter_stopped(stream.interpreter))
+        interpreter_execute(stream.interpreter, statement);
+    stream.statements++;
+    free_node(statement);
+}
+
+static void StreamStatement(Node *statement) {
+    // after an error nothing gets emitted, the rest is only parsed and checked
+    if(sem_get_error_count(&sem_analyzer) == 0)
+        EmitStatement(statement, stream.code);
+    else
+        free_node(statement);
+}
+
+static void CopyFile(FILE *from, FILE *to) {
+    char buffer[8192];
+    size_t n;
+    rewind(from);
+    while((n = fread(buffer, 1, sizeof(buffer), from)) > 0)
+        fwrite(buffer, 1, n, to);
+}
+
+// the .data section is complete now: write it, then the code behind it.
+// machine_code is the already encoded .code section and data the .data
+// section written by another thread, if there are
+static int WriteCode(const CompilerOptions *opts, FILE *machine_code, FILE *data) {
+    int ok = 1;
+    FILE *assembly = NULL;
+    if(opts->stages & STAGE_ASM) {
+        assembly = fopen(opts->asm_filename, "w+");
+        if(!assembly) {
+            fprintf(stderr, "Error: Cannot open assembly file %s\n", opts->asm_filename);
+            ok = 0;
+        }
+    }
+    if(!assembly)
+        assembly = tmpfile();
+
+    // an empty program has no sections at all
+    if(stream.statements > 0) {
+        if(data)
+            CopyFile(data, assembly);
+        else
+            AssemblyWriteData(assembly);
+        CopyFile(stream.code, assembly);
+    }
+
+    if(opts->stages & STAGE_MC) {
+        FILE *machine = fopen(opts->machine_filename, "w");
+        if(!machine) {
+            fprintf(stderr, "Error: Cannot open machine code file %s\n", opts->machine_filename);
+            ok = 0;
+        } else if(machine_code) {
+            // .data lines don't encode to anything
+            CopyFile(machine_code, machine);
+            fclose(machine);
+        } else {
+            rewind(assembly);
+            MachineFromAssemblyStream(assembly, machine);
+            fclose(machine);
+        }
+    }
+    fclose(assembly);
+    return ok;
+}
+
+// same as run_program: the output only if the whole program ran
+static void WriteOutput() {
+    if(get_error_count(&stream.runtime_errors) > 0) {
+        printf("\n=== Runtime Error ===\n");
+        fprint_messages(stdout, &stream.runtime_errors);
+        printf("====================\n");
+    } else if(!interpreter_stopped(stream.interpreter)) {
+        CopyFile(stream.output, stdout);
+    }
+}
+
+int compile_stream(const CompilerOptions *opts) {
+    FILE *in = fopen(opts->input_filename, "rb");
+    if(!in) {
+        fprintf(stderr, "Error: Cannot open file %s\n", opts->input_filename);
+        return 1;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    if(opts->stages & (STAGE_ASM | STAGE_MC)) {
+        stream.code = tmpfile();
+        AssemblyBegin();
+    }
+    if(opts->stages & STAGE_RUN) {
+        stream.output = tmpfile();
+        error_state_init(&stream.runtime_errors);
+        stream.interpreter = interpreter_begin(&stream.runtime_errors, stream.output);
+    }
+
+    sem_init(&sem_analyzer);
+    sem_set_line(&sem_analyzer, 1);
+    ast_root = NULL;
+
+    statement_handler = StreamStatement;
+    int parse_result = parse_file(in, 1);
+    statement_handler = NULL;
+    fclose(in);
+
+    int status = 0;
+    if(parse_result == 0 && sem_get_error_count(&sem_analyzer) == 0) {
+        if(stream.code && !WriteCode(opts, NULL, NULL))
+            status = 1;
+        if(stream.interpreter)
+            WriteOutput();
+    } else {
+        // semantic/parsing error - nothing of what was emitted is kept
+        printf("Compilation failed\n");
+        status = 1;
+    }
+    fflush(stdout);
+
+    if(stream.code) {
+        AssemblyEnd();
+        fclose(stream.code);
+    }
+    if(stream.interpreter) {
+        interpreter_end(stream.interpreter);
+        error_state_free(&stream.runtime_errors);
+        fclose(stream.output);
+    }
+    sem_cleanup(&sem_analyzer);
+    free_node(ast_root);
+    ast_root = NULL;
+    return status;
+}
+
+///// pipelined: scanner -> parser -> codegen -> encoder, one thread each
+
+#define TOKEN_BATCH 512
+#define STATEMENT_BATCH 64
+#define RING_SIZE 64
+
+typedef struct {
+    int type;
+    YYSTYPE value;
+    char *diagnostic;   // lexical error, printed when the parser gets to it
+} Token;
+
+typedef struct {
+    int count;
+    Token tokens[TOKEN_BATCH];
+} TokenBatch;
+
+typedef struct {
+    int count;
+    Node *statements[STATEMENT_BATCH];
+} StatementBatch;
+
+typedef struct {
+    char *text;
+    size_t length;
+} CodeBatch;
+
+static struct {
+    Ring tokens;                // scanner -> parser
+    Ring statements;            // parser -> codegen, NULL at the end
+    Ring code;                  // codegen -> encoder, NULL at the end
+    FILE *input;
+    int encode;                 // ASM or MC: codegen + encoder threads
+    FILE *machine;              // encoded .code section (MC)
+    MachineImage assembler;     // its labels come with the data, at the end
+    FILE *warnings;             // encoder diagnostics, only shown if the program compiles
+    FILE *data;                 // .data section, written by codegen once it's done
+
+    // parser thread
+    TokenBatch *batch;
+    int next_token;
+    int end_of_input;
+    StatementBatch *pending;
+    int parse_result;
+    int semantic_errors;
+} pipeline;
+
+static void *ScanThread(void *arg) {
+    // lexical errors travel with their token so they come out in parse order
+    char message[256];
+    FILE *diag = fmemopen(message, sizeof(message), "w");
+    set_diagnostics_stream(diag);
+
+    yyrestart(pipeline.input);
+    int type;
+    do {
+        TokenBatch *batch = malloc(sizeof(TokenBatch));
+        batch->count = 0;
+        do {
+            Token *token = &batch->tokens[batch->count++];
+            token->type = type = yylex(&token->value);
+            token->diagnostic = NULL;
+            if(type == ILLEGAL) {
+                fflush(diag);
+                token->diagnostic = strndup(message, ftell(diag));
+                rewind(diag);
+            }
+        } while(type != 0 && batch->count < TOKEN_BATCH);
+        ring_push(&pipeline.tokens, batch);
+    } while(type != 0);
+
+    yylex_destroy();
+    set_diagnostics_stream(NULL);
+    fclose(diag);
+    return NULL;
+}
+
+static Token *NextToken() {
+    if(!pipeline.batch || pipeline.next_token == pipeline.batch->count) {
+        free(pipeline.batch);
+        pipeline.batch = ring_pop(&pipeline.tokens);
+        pipeline.next_token = 0;
+    }
+    Token *token = &pipeline.batch->tokens[pipeline.next_token++];
+    if(token->type == 0)
+        pipeline.end_of_input = 1;
+    return token;
+}
+
+// token_source for the parser
+static int PipelineToken(YYSTYPE *lval) {
+    Token *token = NextToken();
+    if(token->diagnostic) {
+        fputs(token->diagnostic, get_diagnostics_stream());
+        free(token->diagnostic);
+    }
+    *lval = token->value;
+    return token->type;
+}
+
+// the parser stopped early (syntax error): throw away the rest of the input
+static void DrainTokens() {
+    while(!pipeline.end_of_input) {
+        Token *token = NextToken();
+        free(token->diagnostic);
+        if(token->type == ID || token->type == STR)
+            free(token->value.str_val);
+    }
+    free(pipeline.batch);
+    pipeline.batch = NULL;
+}
+
+// statement_handler for the parser
+static void PipelineStatement(Node *statement) {
+    if(sem_get_error_count(&sem_analyzer) > 0) {
+        free_node(statement);
+        return;
+    }
+    StatementBatch *batch = pipeline.pending;
+    batch->statements[batch->count++] = statement;
+    if(batch->count == STATEMENT_BATCH) {
+        ring_push(&pipeline.statements, batch);
+        pipeline.pending = calloc(1, sizeof(StatementBatch));
+    }
+}
+
+static void *ParseThread(void *arg) {
+    // the parser and checker state is per thread (driver.h)
+    sem_init(&sem_analyzer);
+    sem_set_line(&sem_analyzer, 1);
+    ast_root = NULL;
+
+    pipeline.pending = calloc(1, sizeof(StatementBatch));
+    token_source = PipelineToken;
+    statement_handler = PipelineStatement;
+    pipeline.parse_result = yyparse();
+    statement_handler = NULL;
+    token_source = NULL;
+    pipeline.semantic_errors = sem_get_error_count(&sem_analyzer);
+    sem_cleanup(&sem_analyzer);
+    free_node(ast_root);
+    ast_root = NULL;
+
+    DrainTokens();
+    ring_push(&pipeline.statements, pipeline.pending);
+    ring_push(&pipeline.statements, NULL);
+    return NULL;
+}
+
+static void *EncodeThread(void *arg);
+
+static void *CodegenThread(void *arg) {
+    // the assembly and symbol table state is per thread too, so the encoder
+    // is started from here: it looks offsets up in this thread's table,
+    // which has to outlive it
+    pthread_t encoder;
+    if(pipeline.encode) {
+        AssemblyBegin();
+        pthread_create(&encoder, NULL, EncodeThread, NULL);
+    }
+
+    StatementBatch *batch;
+    while((batch = ring_pop(&pipeline.statements)) != NULL) {
+        CodeBatch *code = NULL;
+        FILE *out = NULL;
+        if(pipeline.encode) {
+            code = malloc(sizeof(CodeBatch));
+            out = open_memstream(&code->text, &code->length);
+        }
+        for(int i = 0; i < batch->count; i++)
+            EmitStatement(batch->statements[i], out);
+        if(out) {
+            fclose(out);
+            ring_push(&pipeline.code, code);
+        }
+        free(batch);
+    }
+    if(pipeline.encode) {
+        // the encoder resolves the labels with the data once the code is done
+        AssemblyWriteData(pipeline.data);
+        ring_push(&pipeline.code, NULL);
+        pthread_join(encoder, NULL);
+        AssemblyEnd();
+    }
+    return NULL;
+}
+
+// writes the .code section as it comes and encodes it
+static void *EncodeThread(void *arg) {
+    set_diagnostics_stream(pipeline.warnings);
+    CodeBatch *code;
+    while((code = ring_pop(&pipeline.code)) != NULL) {
+        fwrite(code->text, 1, code->length, stream.code);
+        if(pipeline.machine && code->length > 0) {
+            FILE *in = fmemopen(code->text, code->length, "r");
+            MachineEncode(&pipeline.assembler, in, pipeline.machine);
+            fclose(in);
+        }
+        free(code->text);
+        free(code);
+    }
+    if(pipeline.machine) {
+        // pass 1 over the data, then the addresses go into the listing
+        rewind(pipeline.data);
+        MachineDefineLabels(&pipeline.assembler, pipeline.data);
+        MachineResolveFixups(&pipeline.assembler, pipeline.machine, 0);
+    }
+    set_diagnostics_stream(NULL);
+    return NULL;
+}
+
+int compile_pipeline(const CompilerOptions *opts) {
+    // with one CPU there is nothing to overlap, the threads would only take turns
+    if(sysconf(_SC_NPROCESSORS_ONLN) < 2)
+        return compile_stream(opts);
+
+    FILE *in = fopen(opts->input_filename, "rb");
+    if(!in) {
+        fprintf(stderr, "Error: Cannot open file %s\n", opts->input_filename);
+        return 1;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.input = in;
+    pipeline.encode = (opts->stages & (STAGE_ASM | STAGE_MC)) != 0;
+    if(pipeline.encode) {
+        stream.code = tmpfile();
+        pipeline.data = tmpfile();
+    }
+    if(opts->stages & STAGE_MC) {
+        pipeline.machine = tmpfile();
+        pipeline.warnings = tmpfile();
+        MachineImageInit(&pipeline.assembler, 1);
+    }
+    if(opts->stages & STAGE_RUN) {
+        stream.output = tmpfile();
+        error_state_init(&stream.runtime_errors);
+        stream.interpreter = interpreter_begin(&stream.runtime_errors, stream.output);
+    }
+
+    line_num = 1;
+    column_num = 1;
+
+    ring_init(&pipeline.tokens, RING_SIZE);
+    ring_init(&pipeline.statements, RING_SIZE);
+    ring_init(&pipeline.code, RING_SIZE);
+
+    pthread_t scanner, parser, codegen;
+    pthread_create(&scanner, NULL, ScanThread, NULL);
+    pthread_create(&parser, NULL, ParseThread, NULL);
+    pthread_create(&codegen, NULL, CodegenThread, NULL);
+
+    pthread_join(scanner, NULL);
+    pthread_join(parser, NULL);
+    pthread_join(codegen, NULL);
+    fclose(in);
+
+    int status = 0;
+    if(pipeline.parse_result == 0 && pipeline.semantic_errors == 0) {
+        if(pipeline.warnings)
+            CopyFile(pipeline.warnings, stderr);
+        if(stream.code && !WriteCode(opts, pipeline.machine, pipeline.data))
+            status = 1;
+        if(stream.interpreter)
+            WriteOutput();
+    } else {
+        printf("Compilation failed\n");
+        status = 1;
+    }
+    fflush(stdout);
+
+    ring_free(&pipeline.tokens);
+    ring_free(&pipeline.statements);
+    ring_free(&pipeline.code);
+    if(pipeline.machine) {
+        fclose(pipeline.machine);
+        fclose(pipeline.warnings);
+        FreeMachineImage(&pipeline.assembler);
+    }
+    if(stream.code) {
+        fclose(stream.code);
+        fclose(pipeline.data);
+    }
+    if(stream.interpreter) {
+        interpreter_end(stream.interpreter);
+        error_state_free(&stream.runtime_errors);
+        fclose(stream.output);
+    }
+    return status;
+}
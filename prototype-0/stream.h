@@ -0,0 +1,25 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "options.h"
+
+// compile a program of any size in constant memory
+//
+// every statement is checked, interpreted and code generated as soon as its
+// line is parsed, then freed. nothing is kept per statement: the .code
+// section and the program output go to temp files and only the .data
+// section (one entry per variable/string, not per line) is built up in
+// memory, to be written in front of the code at the end. a program that
+// turns out to have an error still prints just "Compilation failed".
+// writes the same files/output as a normal compile; returns the exit status
+int compile_stream(const CompilerOptions *opts);
+
+// the same, pipelined: the scanner, the parser (+ checks), codegen (+ the
+// interpreter) and the machine code encoder each run on their own thread,
+// handing batches of tokens, statements and assembly text down through
+// single-producer/single-consumer rings (ring.h). on a big program it takes
+// about as long as the slowest of them instead of all of them together.
+// on a single CPU this is just compile_stream
+int compile_pipeline(const CompilerOptions *opts);
+
+#endif
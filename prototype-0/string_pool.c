@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "string_pool.h"
+#include "symbol_table.h"
+
+#define INITIAL_TAILS 256
+
+// the index holds every string, but the other tails only up to this many:
+// it's 48 bytes a byte of .data, so it can't grow with the program (see
+// string_pool.h)
+#define MAX_SHARED_TAILS 16384
+
+typedef struct {
+    char *label;
+    char *value;
+    size_t length;
+    uint64_t offset;        // in .data
+    int block;              // the string whose bytes these are (itself if its own)
+    int next_in_block;      // the next string sharing block's bytes, -1 at the end
+} PooledString;
+
+// every string and the tails of the first blocks, hashed by their
+// contents: a new literal is looked up as a tail, which finds a whole
+// string the same way
+typedef struct {
+    uint64_t hash;
+    uint32_t length;
+    uint32_t position;      // where the tail starts in the block
+    int block;              // -1 = empty slot
+    int string;             // the string that is exactly this tail, -1 if none yet
+} Tail;
+
+// the text and the labels of the strings, copied into chunks that are only
+// freed with the pool: a malloc of their own would leave them scattered
+// over the heap between what every statement allocates and frees, and
+// with --stream that heap then can't be used for much else
+#define CHUNK_SIZE 65536
+
+typedef struct Chunk {
+    struct Chunk *next;
+    size_t used;
+    size_t size;
+    char bytes[];
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;          // the one being filled first
+    PooledString *strings;
+    int string_count;
+    int string_capacity;
+
+    int *blocks;            // indices into strings, in offset order
+    int block_count;
+    int block_capacity;
+
+    Tail *tails;            // open addressing, at most half full
+    size_t tail_count;
+    size_t tail_capacity;
+    size_t shared_tails;    // the ones that aren't a whole block
+} StringPool;
+
+static _Thread_local StringPool pool;
+
+void StringPoolInit() {
+    StringPoolFree();
+}
+
+void StringPoolFree() {
+    while(pool.chunks) {
+        Chunk *next = pool.chunks->next;
+        free(pool.chunks);
+        pool.chunks = next;
+    }
+    free(pool.strings);
+    free(pool.blocks);
+    free(pool.tails);
+    memset(&pool, 0, sizeof(pool));
+}
+
+// hash of s[0..length) built from its end, so the hashes of all of the
+// tails of a string come out of one pass over it (TailHashes)
+#define TAIL_PRIME 0x100000001b3ULL
+
+static uint64_t Mix(uint64_t h, size_t length) {
+    h ^= length;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t TailHash(const char *s, size_t length) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(size_t i = length; i > 0; i--)
+        h = (h ^ (unsigned char)s[i - 1]) * TAIL_PRIME;
+    return Mix(h, length);
+}
+
+static Tail *FindTail(const char *s, size_t length, uint64_t hash) {
+    if(pool.tail_capacity == 0)
+        return NULL;
+    size_t mask = pool.tail_capacity - 1;
+    for(size_t i = hash & mask; pool.tails[i].block >= 0; i = (i + 1) & mask) {
+        Tail *tail = &pool.tails[i];
+        if(tail->hash == hash && tail->length == length &&
+           memcmp(pool.strings[tail->block].value + tail->position, s, length) == 0)
+            return tail;
+    }
+    return NULL;
+}
+
+static Tail *InsertTail(const Tail *tail) {
+    size_t mask = pool.tail_capacity - 1;
+    size_t i = tail->hash & mask;
+    while(pool.tails[i].block >= 0)
+        i = (i + 1) & mask;
+    pool.tails[i] = *tail;
+    return &pool.tails[i];
+}
+
+static void GrowTails(size_t needed) {
+    if(needed * 2 <= pool.tail_capacity)
+        return;
+    Tail *old = pool.tails;
+    size_t old_capacity = pool.tail_capacity;
+    pool.tail_capacity = pool.tail_capacity ? pool.tail_capacity : INITIAL_TAILS;
+    while(needed * 2 > pool.tail_capacity)
+        pool.tail_capacity *= 2;
+    pool.tails = malloc(sizeof(Tail) * pool.tail_capacity);
+    for(size_t i = 0; i < pool.tail_capacity; i++)
+        pool.tails[i].block = -1;
+    for(size_t i = 0; i < old_capacity; i++)
+        if(old[i].block >= 0)
+            InsertTail(&old[i]);
+    free(old);
+}
+
+// index a new block and those of its tails that aren't in the pool
+// already, the empty one (its '\0') included, while MAX_SHARED_TAILS allows
+static void AddTails(int block) {
+    const PooledString *s = &pool.strings[block];
+    size_t room = pool.shared_tails < MAX_SHARED_TAILS ? MAX_SHARED_TAILS - pool.shared_tails : 0;
+    size_t tails = s->length < room ? s->length : room;
+    GrowTails(pool.tail_count + tails + 1);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for(size_t position = s->length + 1; position-- > 0; ) {
+        if(position < s->length)
+            h = (h ^ (unsigned char)s->value[position]) * TAIL_PRIME;
+        if(position > 0 && pool.shared_tails >= MAX_SHARED_TAILS)
+            continue;   // the hash of the whole block still needs every byte
+        size_t length = s->length - position;
+        uint64_t hash = Mix(h, length);
+        if(FindTail(s->value + position, length, hash))
+            continue;
+        if(position > 0)
+            pool.shared_tails++;
+        Tail tail = { hash, length, position, block, position == 0 ? block : -1 };
+        InsertTail(&tail);
+        pool.tail_count++;
+    }
+}
+
+// a copy of text[0..length) and a '\0' in a chunk
+static char *CopyText(const char *text, size_t length) {
+    Chunk *chunk = pool.chunks;
+    if(!chunk || chunk->size - chunk->used < length + 1) {
+        size_t size = length + 1 > CHUNK_SIZE ? length + 1 : CHUNK_SIZE;
+        chunk = malloc(sizeof(Chunk) + size);
+        chunk->used = 0;
+        chunk->size = size;
+        // a string too long for a chunk of its own goes behind the one
+        // being filled, which keeps its room
+        if(pool.chunks && size > CHUNK_SIZE) {
+            chunk->next = pool.chunks->next;
+            pool.chunks->next = chunk;
+        } else {
+            chunk->next = pool.chunks;
+            pool.chunks = chunk;
+        }
+    }
+    char *copy = chunk->bytes + chunk->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    chunk->used += length + 1;
+    return copy;
+}
+
+static int NewString(const char *value, size_t length) {
+    if(pool.string_count == pool.string_capacity) {
+        pool.string_capacity = pool.string_capacity ? pool.string_capacity * 2 : 64;
+        pool.strings = realloc(pool.strings, sizeof(PooledString) * pool.string_capacity);
+    }
+    int index = pool.string_count++;
+    PooledString *s = &pool.strings[index];
+    s->value = CopyText(value, length);
+    s->length = length;
+    char label[24];
+    snprintf(label, sizeof(label), "str%d", index);
+    s->label = CopyText(label, strlen(label));
+    s->next_in_block = -1;
+    return index;
+}
+
+int StringPoolAdd(const char *value) {
+    size_t length = strlen(value);
+    Tail *tail = FindTail(value, length, TailHash(value, length));
+    if(tail && tail->string >= 0)
+        return tail->string;
+
+    int index = NewString(value, length);
+    PooledString *s = &pool.strings[index];
+    if(tail) {
+        // in the middle of a block
+        PooledString *block = &pool.strings[tail->block];
+        s->block = tail->block;
+        s->offset = block->offset + tail->position;
+        s->next_in_block = block->next_in_block;
+        block->next_in_block = index;
+        tail->string = index;
+        return index;
+    }
+
+    s->block = index;
+    s->offset = ReserveDataBytes(length + 1);
+    if(pool.block_count == pool.block_capacity) {
+        pool.block_capacity = pool.block_capacity ? pool.block_capacity * 2 : 64;
+        pool.blocks = realloc(pool.blocks, sizeof(int) * pool.block_capacity);
+    }
+    pool.blocks[pool.block_count++] = index;
+    AddTails(index);
+    return index;
+}
+
+const char *StringPoolLabel(int string) {
+    return pool.strings[string].label;
+}
+
+uint64_t StringPoolOffset(int string) {
+    return pool.strings[string].offset;
+}
+
+int StringPoolCount() {
+    return pool.string_count;
+}
+
+int StringPoolBlockCount() {
+    return pool.block_count;
+}
+
+uint64_t StringPoolBlockOffset(int block) {
+    return pool.strings[pool.blocks[block]].offset;
+}
+
+// the same escapes the assembler reads back
+static void WriteEscaped(FILE *out, const char *text, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+        char c = text[i];
+        if(c == '\n') {
+            fprintf(out, "\\n");
+        } else if(c == '"') {
+            fprintf(out, "\\\"");
+        } else if(c == '\\') {
+            fprintf(out, "\\\\");
+        } else {
+            fputc(c, out);
+        }
+    }
+}
+
+static int CompareOffsets(const void *a, const void *b) {
+    uint64_t x = pool.strings[*(const int*)a].offset, y = pool.strings[*(const int*)b].offset;
+    return x < y ? -1 : x > y;
+}
+
+uint64_t StringPoolWriteBlock(FILE *out, int block) {
+    const PooledString *s = &pool.strings[pool.blocks[block]];
+    int count = 0;
+    for(int i = pool.blocks[block]; i >= 0; i = pool.strings[i].next_in_block)
+        count++;
+    int *labels = malloc(sizeof(int) * count);
+    count = 0;
+    for(int i = pool.blocks[block]; i >= 0; i = pool.strings[i].next_in_block)
+        labels[count++] = i;
+    qsort(labels, count, sizeof(int), CompareOffsets);
+
+    for(int i = 0; i < count; i++) {
+        const PooledString *piece = &pool.strings[labels[i]];
+        size_t start = piece->offset - s->offset;
+        size_t end = i + 1 < count ? pool.strings[labels[i + 1]].offset - s->offset : s->length;
+        fprintf(out, "%s: %s \"", piece->label, i + 1 < count ? ".ascii" : ".asciiz");
+        WriteEscaped(out, s->value + start, end - start);
+        fprintf(out, "\"\n");
+    }
+    free(labels);
+    return s->offset + s->length + 1;
+}
@@ -0,0 +1,39 @@
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// the string literals of the program being compiled, as the lexer decoded
+// them, each with its label and its place in .data (the bytes are reserved
+// through the symbol table, in the order the strings are first used).
+//
+// a literal that is the tail of one already in the pool takes no bytes of
+// its own: its label points into the other one, so after "\nWhatever...\n"
+// the literal "...\n" costs nothing. only an earlier string can be shared
+// that way, its address may already be in code that's been generated.
+// there's no limit on the number of strings, but only the first 16K tails
+// are looked up: every byte of .data would cost 48 bytes of index if they
+// all were, and the index has to stay small when the pool grows with the
+// program (--stream). a later literal that's the tail of a later string
+// has bytes of its own; the same literal twice is one string all the same
+
+// each thread has its own pool
+void StringPoolInit();
+void StringPoolFree();
+
+// the string's index in the pool, added the first time
+int StringPoolAdd(const char *value);
+const char *StringPoolLabel(int string);
+uint64_t StringPoolOffset(int string);
+int StringPoolCount();
+
+// the strings with bytes of their own ("blocks"), in the order of their
+// offsets; a block is written as one .asciiz, cut into .ascii pieces where
+// the labels of the strings sharing it go
+int StringPoolBlockCount();
+uint64_t StringPoolBlockOffset(int block);
+// returns the offset just past the block
+uint64_t StringPoolWriteBlock(FILE *out, int block);
+
+#endif
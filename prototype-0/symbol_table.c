@@ -1,99 +1,169 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include "symbol_table.h"
+#include "hash.h"
 
-// symbol table entry: name -> allocated register
-static struct {
-    char name[MAX_NAME_LEN];
-    int reg;
+#define INITIAL_BUCKETS 64
+
+// symbol table entry: name -> place in .data
+typedef struct {
+    char *name;
     uint64_t offset;
-} table[MAX_SYMBOLS];
+    int has_initial;
+    int64_t initial;
+} SymbolEntry;
 
-// current number of symbols in the table
-static int symbol_count = 0;
+struct SymbolTable {
+    SymbolEntry *table;
+    int symbol_count;
+    int symbol_capacity;
 
-// next available register to allocate
-static int next_reg = REG_MIN;
+    // open addressing over table, -1 = empty; at most half full
+    int *buckets;
+    size_t bucket_count;
 
-// next memory offset for .data variables
-static uint64_t next_offset = 0x0;
+    // next free byte of .data
+    uint64_t next_offset;
+};
 
-// print .data section with .space directives for all variables
-void PrintDataSection(FILE *out) {
-    for(int i = 0; i < symbol_count; i++) {
-        fprintf(out, "%s: .space 8\n", table[i].name);
-    }
+// every thread compiles with its own table
+static _Thread_local SymbolTable own_symbols;
+static _Thread_local SymbolTable *symbols = NULL;
+
+SymbolTable *GetSymbolTable() {
+    if(!symbols)
+        symbols = &own_symbols;
+    return symbols;
 }
 
 // initialize/reset the symbol table
 void SymbolInit() {
-    symbol_count = 0;
-    next_reg = REG_MIN;
-    next_offset = 0x0;
-    // clear all var names by marking them as empty strings...
-    for(int i = 0; i < MAX_SYMBOLS; i++)
-        table[i].name[0] = '\0';
-}
-
-// get the register number associated with a symbol
-// returns -1 if symbol not found
-int GetRegisterOfTheSymbol(const char *name) {
-    for(int i = 0; i < symbol_count; i++) {
-        if(strcmp(table[i].name, name) == 0) 
-            return table[i].reg;
+    SymbolTable *t = GetSymbolTable();
+    for(int i = 0; i < t->symbol_count; i++)
+        free(t->table[i].name);
+    t->symbol_count = 0;
+    t->next_offset = 0x0;
+    if(t->buckets)
+        memset(t->buckets, 0xff, sizeof(int) * t->bucket_count);
+}
+
+void SymbolFree() {
+    SymbolTable *t = GetSymbolTable();
+    SymbolInit();
+    free(t->table);
+    free(t->buckets);
+    memset(t, 0, sizeof(*t));
+}
+
+static int FindSymbol(SymbolTable *t, const char *name) {
+    if(t->bucket_count == 0)
+        return -1;
+    size_t mask = t->bucket_count - 1;
+    size_t i = hash64(name, strlen(name), 0) & mask;
+    while(t->buckets[i] >= 0) {
+        if(strcmp(t->table[t->buckets[i]].name, name) == 0)
+            return t->buckets[i];
+        i = (i + 1) & mask;
     }
     return -1;
 }
 
+static void IndexSymbol(SymbolTable *t, int symbol) {
+    size_t mask = t->bucket_count - 1;
+    size_t i = hash64(t->table[symbol].name, strlen(t->table[symbol].name), 0) & mask;
+    while(t->buckets[i] >= 0)
+        i = (i + 1) & mask;
+    t->buckets[i] = symbol;
+}
+
 // check if symbol exists
 int SymbolExists(const char *name) {
-    return GetRegisterOfTheSymbol(name) != -1;
-}
-
-// allocate a register for a new symbol
-// returns the register number, or existing reg if already allocated
-// returns -1 if out of table space or registers
-int AllocateRegisterForTheSymbol(const char *name) {
-    int r = GetRegisterOfTheSymbol(name);
-    if(r != -1)
-        return r; // already allocated
-    
-    if(symbol_count >= MAX_SYMBOLS)
-        return -1; // table is full
-    if(next_reg > REG_MAX)
-        return -1; // out of registers
-    
-    // store symbol name and assigned register
-    strncpy(table[symbol_count].name, name, MAX_NAME_LEN-1);
-    table[symbol_count].name[MAX_NAME_LEN-1] = '\0';
-    table[symbol_count].reg = next_reg;
-    // assign memory offset and increment for next variable
-    table[symbol_count].offset = next_offset;
-    next_offset += 0x8;  // increments by 8 bytes (like eduMIPS64)
-    symbol_count++;
-    return next_reg++;
-}
-
-// get the memory offset associated with a symbol
-// returns 0 if symbol not found
-uint64_t GetOffsetOfTheSymbol(const char *name) {
-    for(int i = 0; i < symbol_count; i++) {
-        if (strcmp(table[i].name, name) == 0) 
-            return table[i].offset;
+    return FindSymbol(GetSymbolTable(), name) >= 0;
+}
+
+uint64_t DeclareSymbol(const char *name) {
+    SymbolTable *t = GetSymbolTable();
+    int symbol = FindSymbol(t, name);
+    if(symbol >= 0)
+        return t->table[symbol].offset; // already declared
+
+    if(t->symbol_count == t->symbol_capacity) {
+        t->symbol_capacity = t->symbol_capacity ? t->symbol_capacity * 2 : 64;
+        t->table = realloc(t->table, sizeof(SymbolEntry) * t->symbol_capacity);
     }
-    return 0;
+    SymbolEntry *entry = &t->table[t->symbol_count++];
+    entry->name = strdup(name);
+    entry->has_initial = 0;
+    // 8 bytes, 8 byte aligned (like eduMIPS64)
+    t->next_offset = (t->next_offset + 7) & ~(uint64_t)7;
+    entry->offset = t->next_offset;
+    t->next_offset += 0x8;
+
+    if((size_t)t->symbol_count * 2 > t->bucket_count) {
+        free(t->buckets);
+        t->bucket_count = t->bucket_count ? t->bucket_count * 2 : INITIAL_BUCKETS;
+        t->buckets = malloc(sizeof(int) * t->bucket_count);
+        memset(t->buckets, 0xff, sizeof(int) * t->bucket_count);
+        for(int i = 0; i < t->symbol_count; i++)
+            IndexSymbol(t, i);
+    } else {
+        IndexSymbol(t, t->symbol_count - 1);
+    }
+    return entry->offset;
+}
+
+uint64_t GetOffsetOfTheSymbol(const char *name) {
+    SymbolTable *t = GetSymbolTable();
+    int symbol = FindSymbol(t, name);
+    return symbol >= 0 ? t->table[symbol].offset : 0;
+}
+
+void SetSymbolInitialValue(const char *name, int64_t value) {
+    SymbolTable *t = GetSymbolTable();
+    DeclareSymbol(name);
+    SymbolEntry *entry = &t->table[FindSymbol(t, name)];
+    entry->has_initial = 1;
+    entry->initial = value;
+}
+
+uint64_t ReserveDataBytes(uint64_t size) {
+    SymbolTable *t = GetSymbolTable();
+    uint64_t offset = t->next_offset;
+    t->next_offset += size;
+    return offset;
+}
+
+uint64_t DataSize() {
+    return GetSymbolTable()->next_offset;
+}
+
+int SymbolCount() {
+    return GetSymbolTable()->symbol_count;
 }
 
-// print all symbols with registers and offsets (for debugging)
+const char *SymbolName(int index) {
+    return GetSymbolTable()->table[index].name;
+}
+
+uint64_t SymbolOffset(int index) {
+    return GetSymbolTable()->table[index].offset;
+}
+
+int SymbolInitialValue(int index, int64_t *value) {
+    const SymbolEntry *entry = &GetSymbolTable()->table[index];
+    if(entry->has_initial)
+        *value = entry->initial;
+    return entry->has_initial;
+}
+
+// print all symbols with their offsets (for debugging)
 void PrintAllSymbols(FILE *out) {
+    SymbolTable *t = GetSymbolTable();
     fprintf(out, "# Symbol Table\n");
-    fprintf(out, "# Name\tReg\tOffset\n");
-    for(int i = 0; i < symbol_count; i++) {
-        fprintf(out, "# %s\tr%d\t0x%lX\n",
-                table[i].name,
-                table[i].reg,
-                table[i].offset);
-    }
+    fprintf(out, "# Name\tOffset\n");
+    for(int i = 0; i < t->symbol_count; i++)
+        fprintf(out, "# %s\t0x%lX\n", t->table[i].name, t->table[i].offset);
     fprintf(out, "\n");
-}
\ No newline at end of file
+}
@@ -4,17 +4,44 @@
 #include <stdio.h>
 #include <stdint.h>
 
-#define MAX_SYMBOLS 100
-#define MAX_NAME_LEN 32
-#define REG_MIN 1
-#define REG_MAX 31
+// the variables of the program being compiled and the .data section they
+// live in. every variable is 8 bytes of memory (it has no register of its
+// own: the code loads it when it's used and stores it when it's set), and
+// the strings reserve their bytes here too, so .data is laid out in the
+// order things are first used and every address is known as soon as it's
+// collected. there's no limit on the number of variables
 
+// the table used by the calling thread (each thread has its own)
+typedef struct SymbolTable SymbolTable;
+SymbolTable *GetSymbolTable();
+
+// empty the table (and .data) for a new program
 void SymbolInit();
-int GetRegisterOfTheSymbol(const char *name);
+// give back its memory, once the program is done
+void SymbolFree();
+
 int SymbolExists(const char *name);
-int AllocateRegisterForTheSymbol(const char *name);
+// the variable's offset in .data, which it gets the first time
+uint64_t DeclareSymbol(const char *name);
+// returns 0 if symbol not found
 uint64_t GetOffsetOfTheSymbol(const char *name);
+// a variable whose declaration sets it to a constant starts out with that
+// value in .data, rather than being stored by code
+void SetSymbolInitialValue(const char *name, int64_t value);
+
+// size bytes of .data for something that isn't a variable (a string);
+// returns their offset
+uint64_t ReserveDataBytes(uint64_t size);
+uint64_t DataSize();
+
+// the variables in the order they were declared, which is also the order
+// of their offsets
+int SymbolCount();
+const char *SymbolName(int index);
+uint64_t SymbolOffset(int index);
+// 0 if the variable has no initial value
+int SymbolInitialValue(int index, int64_t *value);
+
 void PrintAllSymbols(FILE *out);
-void PrintDataSection(FILE *out);
 
-#endif
\ No newline at end of file
+#endif
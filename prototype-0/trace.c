@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "trace.h"
+
+// events in a thread's buffer, which is written to the file when it's full
+#define TRACE_BUFFER 4096
+
+// the tracks: one process for the threads, one for the requests
+#define PID_THREADS 1
+#define PID_REQUESTS 2
+
+typedef struct {
+    const char *name;
+    int64_t time;       // ns since trace_start
+    int64_t request;
+    int line;
+    char phase;         // 'B', 'E', or 'M' when a request first shows up
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    int thread;                 // 1, 2, ... in the order threads first record
+    TraceEvent events[TRACE_BUFFER];
+    int count;
+    int64_t request;
+    struct TraceBuffer *next;   // every thread's buffer
+} TraceBuffer;
+
+int trace_enabled = 0;
+
+static int64_t trace_origin;
+static _Atomic(TraceBuffer*) buffers;
+static atomic_int thread_count;
+static _Thread_local TraceBuffer *buffer;
+
+// the file, written by one thread at a time
+static FILE *trace_file;
+static pthread_mutex_t file_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int64_t Now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void WriteEvent(FILE *out, const TraceBuffer *b, const TraceEvent *event) {
+    int pid = event->request ? PID_REQUESTS : PID_THREADS;
+    long long tid = event->request ? (long long)event->request : b->thread;
+    if(event->phase == 'M') {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lld,"
+                "\"args\":{\"name\":\"request %lld\"}}", pid, tid, tid);
+        return;
+    }
+    fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%lld",
+            event->name, event->phase, event->time / 1000.0, pid, tid);
+    if(event->request || event->line > 0) {
+        fprintf(out, ",\"args\":{");
+        if(event->request)
+            fprintf(out, "\"thread\":%d", b->thread);
+        if(event->line > 0)
+            fprintf(out, "%s\"line\":%d", event->request ? "," : "", event->line);
+        fprintf(out, "}");
+    }
+    fprintf(out, "}");
+}
+
+// the events in b go to the file, and b is empty again
+static void WriteBuffer(TraceBuffer *b) {
+    pthread_mutex_lock(&file_lock);
+    for(int i = 0; i < b->count; i++)
+        WriteEvent(trace_file, b, &b->events[i]);
+    pthread_mutex_unlock(&file_lock);
+    b->count = 0;
+}
+
+int trace_start(const char *filename) {
+    trace_file = fopen(filename, "w");
+    if(!trace_file)
+        return 0;
+    fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    fprintf(trace_file, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"threads\"}},", PID_THREADS);
+    fprintf(trace_file, "\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"requests\"}}", PID_REQUESTS);
+    trace_origin = Now();
+    trace_enabled = 1;
+    return 1;
+}
+
+// this thread's buffer, pushed on the list (and its track named) the first time
+static TraceBuffer *Buffer(void) {
+    if(buffer)
+        return buffer;
+    buffer = calloc(1, sizeof(TraceBuffer));
+    buffer->thread = atomic_fetch_add(&thread_count, 1) + 1;
+    TraceBuffer *head = atomic_load(&buffers);
+    do {
+        buffer->next = head;
+    } while(!atomic_compare_exchange_weak(&buffers, &head, buffer));
+    pthread_mutex_lock(&file_lock);
+    fprintf(trace_file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"thread %d\"}}", PID_THREADS, buffer->thread, buffer->thread);
+    pthread_mutex_unlock(&file_lock);
+    return buffer;
+}
+
+static void Record(TraceBuffer *b, const char *name, char phase, int line) {
+    if(b->count == TRACE_BUFFER)
+        WriteBuffer(b);
+    TraceEvent *event = &b->events[b->count++];
+    event->name = name;
+    event->time = Now() - trace_origin;
+    event->request = b->request;
+    event->line = line;
+    event->phase = phase;
+}
+
+void trace_event(const char *name, char phase, int line) {
+    Record(Buffer(), name, phase, line);
+}
+
+void trace_set_request(int64_t request) {
+    TraceBuffer *b = Buffer();
+    b->request = request;
+    // names the request's track
+    if(request != 0)
+        Record(b, "request", 'M', 0);
+}
+
+void trace_write_thread(void) {
+    if(buffer && buffer->count > 0)
+        WriteBuffer(buffer);
+}
+
+int trace_write(void) {
+    trace_enabled = 0;
+    TraceBuffer *b = atomic_exchange(&buffers, NULL);
+    while(b) {
+        TraceBuffer *next = b->next;
+        WriteBuffer(b);
+        free(b);
+        b = next;
+    }
+    buffer = NULL;
+    fprintf(trace_file, "\n]}\n");
+    int ok = !ferror(trace_file);
+    ok = fclose(trace_file) == 0 && ok;
+    trace_file = NULL;
+    return ok;
+}
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// --trace=FILE: a timeline of the compile in the Chrome trace-event format
+// (chrome://tracing, ui.perfetto.dev).
+//
+// every thread records into a buffer of its own, with no locks and no
+// atomics past its first event. a full buffer is written to the file
+// (under the file's one lock) and taken from the start again, and so is
+// a daemon request's when it's done (trace_flush), so a trace that's on
+// for as long as a daemon runs costs a buffer a thread, not an event a
+// phase. until trace_start() a begin or end is one test of trace_enabled.
+//
+// a thread's events go on its own track, unless it's working on a request
+// (trace_set_request, the daemon's and the batch's compiles): then they go
+// on that request's track, so compiles running side by side stay apart
+extern int trace_enabled;
+
+// 0 if FILE can't be opened
+int trace_start(const char *filename);
+// the rest of the events, and the end of the file. all of the threads that
+// recorded must be done. 0 if the file couldn't be written
+int trace_write(void);
+// this thread's events so far go to the file
+void trace_write_thread(void);
+
+// name has to outlive the trace (a string literal). line > 0 is recorded
+// as the event's source line
+void trace_event(const char *name, char phase, int line);
+// what this thread's events belong to from now on, 0 = no request
+void trace_set_request(int64_t request);
+
+static inline void trace_begin(const char *name) {
+    if(trace_enabled)
+        trace_event(name, 'B', 0);
+}
+
+static inline void trace_end(const char *name) {
+    if(trace_enabled)
+        trace_event(name, 'E', 0);
+}
+
+// the same for one statement
+static inline void trace_begin_line(const char *name, int line) {
+    if(trace_enabled)
+        trace_event(name, 'B', line);
+}
+
+static inline void trace_end_line(const char *name, int line) {
+    if(trace_enabled)
+        trace_event(name, 'E', line);
+}
+
+static inline void trace_request(int64_t request) {
+    if(trace_enabled)
+        trace_set_request(request);
+}
+
+static inline void trace_flush(void) {
+    if(trace_enabled)
+        trace_write_thread();
+}
+
+#endif
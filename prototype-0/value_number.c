@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "value_number.h"
+#include "hash.h"
+
+#define INITIAL_BUCKETS 64
+
+// an operation on two numbers, or a constant (op '#', left = its value)
+typedef struct {
+    int op;
+    int left;
+    int right;
+    int number;     // -1 = empty
+} Operation;
+
+typedef struct {
+    char *name;     // NULL = empty
+    int number;
+} VariableValue;
+
+typedef struct {
+    const Node *node;   // NULL = empty
+    int number;         // -1 for the operands of a reuse
+    int reuse;          // an earlier operation has the number
+} NodeValue;
+
+struct ValueNumbering {
+    // every table is open addressing, at most half full
+    Operation *operations;
+    size_t operation_buckets;
+    size_t operation_count;
+
+    VariableValue *variables;
+    size_t variable_buckets;
+    size_t variable_count;
+
+    NodeValue *nodes;
+    size_t node_buckets;
+    size_t node_count;
+
+    int number_count;
+    int *reuses;        // by number
+    int reuse_capacity;
+    long reuse_count;
+};
+
+static size_t OperationBucket(int op, int left, int right, size_t mask) {
+    int key[3] = { op, left, right };
+    return hash64(key, sizeof(key), 0) & mask;
+}
+
+static size_t NodeBucket(const Node *node, size_t mask) {
+    return hash64(&node, sizeof(node), 0) & mask;
+}
+
+static int NewNumber(ValueNumbering *v) {
+    if(v->number_count == v->reuse_capacity) {
+        v->reuse_capacity = v->reuse_capacity ? v->reuse_capacity * 2 : 256;
+        v->reuses = realloc(v->reuses, sizeof(int) * v->reuse_capacity);
+    }
+    v->reuses[v->number_count] = 0;
+    return v->number_count++;
+}
+
+static void InsertOperation(Operation *table, size_t bucket_count, Operation operation) {
+    size_t mask = bucket_count - 1;
+    size_t i = OperationBucket(operation.op, operation.left, operation.right, mask);
+    while(table[i].number >= 0)
+        i = (i + 1) & mask;
+    table[i] = operation;
+}
+
+// the number of an operation, a new one the first time (*found = 0)
+static int OperationNumber(ValueNumbering *v, int op, int left, int right, int *found) {
+    if(v->operation_buckets > 0) {
+        size_t mask = v->operation_buckets - 1;
+        for(size_t i = OperationBucket(op, left, right, mask); v->operations[i].number >= 0; i = (i + 1) & mask) {
+            Operation *o = &v->operations[i];
+            if(o->op == op && o->left == left && o->right == right) {
+                *found = 1;
+                return o->number;
+            }
+        }
+    }
+    *found = 0;
+    if((v->operation_count + 1) * 2 > v->operation_buckets) {
+        size_t count = v->operation_buckets ? v->operation_buckets * 2 : INITIAL_BUCKETS;
+        Operation *table = malloc(sizeof(Operation) * count);
+        for(size_t i = 0; i < count; i++)
+            table[i].number = -1;
+        for(size_t i = 0; i < v->operation_buckets; i++)
+            if(v->operations[i].number >= 0)
+                InsertOperation(table, count, v->operations[i]);
+        free(v->operations);
+        v->operations = table;
+        v->operation_buckets = count;
+    }
+    int number = NewNumber(v);
+    InsertOperation(v->operations, v->operation_buckets, (Operation){ op, left, right, number });
+    v->operation_count++;
+    return number;
+}
+
+static VariableValue *FindVariable(const ValueNumbering *v, const char *name) {
+    if(v->variable_buckets == 0)
+        return NULL;
+    size_t mask = v->variable_buckets - 1;
+    for(size_t i = hash64(name, strlen(name), 0) & mask; v->variables[i].name; i = (i + 1) & mask)
+        if(strcmp(v->variables[i].name, name) == 0)
+            return &v->variables[i];
+    return NULL;
+}
+
+static void InsertVariable(VariableValue *table, size_t bucket_count, VariableValue variable) {
+    size_t mask = bucket_count - 1;
+    size_t i = hash64(variable.name, strlen(variable.name), 0) & mask;
+    while(table[i].name)
+        i = (i + 1) & mask;
+    table[i] = variable;
+}
+
+// what's stored in a variable from now on
+static void SetVariable(ValueNumbering *v, const char *name, int number) {
+    VariableValue *variable = FindVariable(v, name);
+    if(variable) {
+        variable->number = number;
+        return;
+    }
+    if((v->variable_count + 1) * 2 > v->variable_buckets) {
+        size_t count = v->variable_buckets ? v->variable_buckets * 2 : INITIAL_BUCKETS;
+        VariableValue *table = calloc(count, sizeof(VariableValue));
+        for(size_t i = 0; i < v->variable_buckets; i++)
+            if(v->variables[i].name)
+                InsertVariable(table, count, v->variables[i]);
+        free(v->variables);
+        v->variables = table;
+        v->variable_buckets = count;
+    }
+    InsertVariable(v->variables, v->variable_buckets, (VariableValue){ strdup(name), number });
+    v->variable_count++;
+}
+
+// the value of a variable, a number of its own if nothing was stored in it
+static int VariableNumber(ValueNumbering *v, const char *name) {
+    VariableValue *variable = FindVariable(v, name);
+    if(variable)
+        return variable->number;
+    int number = NewNumber(v);
+    SetVariable(v, name, number);
+    return number;
+}
+
+static NodeValue *FindNode(const ValueNumbering *v, const Node *node) {
+    if(v->node_buckets == 0)
+        return NULL;
+    size_t mask = v->node_buckets - 1;
+    for(size_t i = NodeBucket(node, mask); v->nodes[i].node; i = (i + 1) & mask)
+        if(v->nodes[i].node == node)
+            return &v->nodes[i];
+    return NULL;
+}
+
+static void InsertNode(NodeValue *table, size_t bucket_count, NodeValue value) {
+    size_t mask = bucket_count - 1;
+    size_t i = NodeBucket(value.node, mask);
+    while(table[i].node)
+        i = (i + 1) & mask;
+    table[i] = value;
+}
+
+static void SetNode(ValueNumbering *v, const Node *node, int number, int reuse) {
+    NodeValue *value = FindNode(v, node);
+    if(value) {
+        // a statement numbered again (the interpreter runs each one once,
+        // but a node can't end up with two numbers either way)
+        value->number = number;
+        value->reuse = reuse;
+        return;
+    }
+    if((v->node_count + 1) * 2 > v->node_buckets) {
+        size_t count = v->node_buckets ? v->node_buckets * 2 : INITIAL_BUCKETS;
+        NodeValue *table = calloc(count, sizeof(NodeValue));
+        for(size_t i = 0; i < v->node_buckets; i++)
+            if(v->nodes[i].node)
+                InsertNode(table, count, v->nodes[i]);
+        free(v->nodes);
+        v->nodes = table;
+        v->node_buckets = count;
+    }
+    InsertNode(v->nodes, v->node_buckets, (NodeValue){ node, number, reuse });
+    v->node_count++;
+}
+
+// the number of an expression, operands first (the order they're
+// evaluated in); every operation is noted with whether it's a reuse
+static int Number(ValueNumbering *v, const Node *node) {
+    int found;
+    switch(node->node_type) {
+        case 0: // NODE_NUM
+            return OperationNumber(v, '#', node->int_val, 0, &found);
+        case 2: // NODE_ID
+            return VariableNumber(v, node->str_val);
+        case 3: { // NODE_BINOP
+            int left = Number(v, node->binop.left);
+            int right = Number(v, node->binop.right);
+            int op = node->binop.op;
+            if((op == '+' || op == '*') && left > right) {
+                int swap = left;
+                left = right;
+                right = swap;
+            }
+            int number = OperationNumber(v, op, left, right, &found);
+            SetNode(v, node, number, found);
+            return number;
+        }
+        case NODE_PRINT_PART:
+            return Number(v, node->list.items);
+    }
+    return NewNumber(v);
+}
+
+// count the reuses of an expression Number went over, and take the numbers
+// of the operations under them away: nothing computes those
+static void Hide(ValueNumbering *v, const Node *node) {
+    if(node->node_type != 3)
+        return;
+    NodeValue *value = FindNode(v, node);
+    value->number = -1;
+    Hide(v, node->binop.left);
+    Hide(v, node->binop.right);
+}
+
+static void CountReuses(ValueNumbering *v, const Node *node) {
+    if(node->node_type == NODE_PRINT_PART) {
+        CountReuses(v, node->list.items);
+        return;
+    }
+    if(node->node_type != 3)
+        return;
+    NodeValue *value = FindNode(v, node);
+    if(value->reuse) {
+        v->reuses[value->number]++;
+        v->reuse_count++;
+        Hide(v, node->binop.left);
+        Hide(v, node->binop.right);
+        return;
+    }
+    CountReuses(v, node->binop.left);
+    CountReuses(v, node->binop.right);
+}
+
+static int Evaluate(ValueNumbering *v, const Node *expression) {
+    int number = Number(v, expression);
+    CountReuses(v, expression);
+    return number;
+}
+
+// the items of a declaration/assignment are chained through the rightmost
+// leaf of each one (see the interpreter's next_item)
+static Node *NextItem(Node *item) {
+    while(item->node_type == 3)
+        item = item->binop.right;
+    return item->list.next;
+}
+
+ValueNumbering *value_numbering_create(void) {
+    return calloc(1, sizeof(ValueNumbering));
+}
+
+void value_numbering_free(ValueNumbering *v) {
+    if(!v)
+        return;
+    for(size_t i = 0; i < v->variable_buckets; i++)
+        free(v->variables[i].name);
+    free(v->variables);
+    free(v->operations);
+    free(v->nodes);
+    free(v->reuses);
+    free(v);
+}
+
+void value_numbering_statement(ValueNumbering *v, Node *statement, const DeadStores *dead) {
+    if(statement->node_type == 4 || statement->node_type == 5) {  // NODE_DECL, NODE_ASSIGN
+        for(Node *item = statement->list.items; item; item = NextItem(item)) {
+            if(item->node_type == 2) {
+                // declared without a value: one nothing else has
+                SetVariable(v, item->str_val, NewNumber(v));
+            } else if(item->node_type == 3 && item->binop.op == '=' && item->binop.left->node_type == 2) {
+                int status = dead ? dead_stores_store(dead, item) : STORE_LIVE;
+                if(status == STORE_DEAD)
+                    continue;
+                int number = Evaluate(v, item->binop.right);
+                if(status == STORE_LIVE)
+                    SetVariable(v, item->binop.left->str_val, number);
+            }
+        }
+    } else if(statement->node_type == 6) {  // NODE_PRINT
+        for(Node *part = statement->print_stmt.parts; part; part = part->list.next) {
+            Node *content = part->node_type == NODE_PRINT_PART ? part->list.items : part;
+            if(content->node_type != 1)  // NODE_STR
+                Evaluate(v, content);
+        }
+    }
+}
+
+void value_numbering_program(ValueNumbering *v, Node *program, const DeadStores *dead) {
+    for(Node *statement = program; statement; statement = statement->list.next)
+        value_numbering_statement(v, statement, dead);
+}
+
+int value_number(const ValueNumbering *v, const Node *expression) {
+    if(expression->node_type != 3)
+        return -1;
+    const NodeValue *value = FindNode(v, expression);
+    return value ? value->number : -1;
+}
+
+int value_number_reused(const ValueNumbering *v, const Node *expression) {
+    if(expression->node_type != 3)
+        return 0;
+    const NodeValue *value = FindNode(v, expression);
+    return value && value->reuse && value->number >= 0;
+}
+
+int value_number_count(const ValueNumbering *v) {
+    return v->number_count;
+}
+
+int value_number_reuses(const ValueNumbering *v, int number) {
+    return number >= 0 && number < v->number_count ? v->reuses[number] : 0;
+}
+
+long value_numbering_reuse_count(const ValueNumbering *v) {
+    return v->reuse_count;
+}
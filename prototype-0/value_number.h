@@ -0,0 +1,48 @@
+#ifndef VALUE_NUMBER_H
+#define VALUE_NUMBER_H
+
+#include "ast.h"
+#include "dead_store.h"
+
+// value numbering (-O): which expressions of a checked program compute a
+// value an earlier one already did.
+//
+// the statements are numbered in the order they run. a number is a
+// constant, a variable's value, or an operation on two numbers ('+' and
+// '*' either way round). a variable takes the number of what's stored in
+// it, so after "x = a + b" both "x * 2" and "(a + b) * 2" are one value,
+// and storing to a variable again gives the expressions that read it new
+// numbers: a value is never out of date, only the expressions that had it
+// can't get it any more.
+//
+// an operation whose number an earlier one has is a reuse, and its
+// operands aren't numbered (nothing has to compute them). the interpreter
+// keeps the value of every number it computed (interpreter_reuse_values);
+// the code generator keeps the ones with reuses ahead in registers
+// (AssemblyValueNumbers)
+
+typedef struct ValueNumbering ValueNumbering;
+
+ValueNumbering *value_numbering_create(void);
+void value_numbering_free(ValueNumbering *numbering);
+
+// number a statement's expressions, after the statements before it. the
+// expressions of the stores dead leaves out (NULL = none) aren't evaluated,
+// so they aren't numbered
+void value_numbering_statement(ValueNumbering *numbering, Node *statement, const DeadStores *dead);
+// all of a program's statements
+void value_numbering_program(ValueNumbering *numbering, Node *program, const DeadStores *dead);
+
+// the number of an operation (a binop other than '='); -1 for anything
+// else, and for the operands of a reuse
+int value_number(const ValueNumbering *numbering, const Node *expression);
+// 1 if an earlier operation computed the expression's number
+int value_number_reused(const ValueNumbering *numbering, const Node *expression);
+// how many numbers there are so far; they go from 0 up
+int value_number_count(const ValueNumbering *numbering);
+// how many reuses of a number there are in what was numbered
+int value_number_reuses(const ValueNumbering *numbering, int number);
+// all of them together
+long value_numbering_reuse_count(const ValueNumbering *numbering);
+
+#endif
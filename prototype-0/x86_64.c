@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "x86_64.h"
+#include "hash.h"
+
+struct X86Variable {
+    const char *name;   // NULL = free entry
+    int slot;           // index in the frame array
+    int initialized;    // known while compiling: a program has no branches
+};
+
+// capture_printf formats into a 1024 byte buffer
+#define PRINT_LIMIT 1023
+// "-2147483648"
+#define INT_DIGITS 11
+
+#define EAX 0
+#define ECX 1
+
+// print eax at r12 in decimal and advance r12. digits are built in the red
+// zone below rsp, then copied over with rep movsb
+static const unsigned char print_int_routine[] = {
+    0x85, 0xc0,                         // test eax, eax
+    0x79, 0x0a,                         // jns digits
+    0x41, 0xc6, 0x04, 0x24, 0x2d,       // mov byte [r12], '-'
+    0x49, 0xff, 0xc4,                   // inc r12
+    0xf7, 0xd8,                         // neg eax (INT_MIN stays, read as unsigned)
+                                        // digits:
+    0x48, 0x8d, 0x7c, 0x24, 0xf0,       // lea rdi, [rsp-16]
+    0x48, 0x89, 0xfe,                   // mov rsi, rdi (end)
+    0x41, 0xb8, 0x0a, 0x00, 0x00, 0x00, // mov r8d, 10
+                                        // next:
+    0x31, 0xd2,                         // xor edx, edx
+    0x41, 0xf7, 0xf0,                   // div r8d
+    0x80, 0xc2, 0x30,                   // add dl, '0'
+    0x48, 0xff, 0xcf,                   // dec rdi
+    0x88, 0x17,                         // mov [rdi], dl
+    0x85, 0xc0,                         // test eax, eax
+    0x75, 0xef,                         // jnz next
+    0x48, 0x89, 0xf1,                   // mov rcx, rsi
+    0x48, 0x29, 0xf9,                   // sub rcx, rdi
+    0x48, 0x89, 0xfe,                   // mov rsi, rdi
+    0x4c, 0x89, 0xe7,                   // mov rdi, r12
+    0xf3, 0xa4,                         // rep movsb
+    0x49, 0x89, 0xfc,                   // mov r12, rdi
+    0xc3                                // ret
+};
+
+void x86_init(X86Code *x) {
+    memset(x, 0, sizeof(*x));
+}
+
+void x86_free(X86Code *x) {
+    free(x->code);
+    free(x->data);
+    free(x->data_references);
+    free(x->exits);
+    free(x->calls);
+    free(x->variables);
+    free(x->pending);
+    memset(x, 0, sizeof(*x));
+}
+
+///// code buffer
+
+void x86_emit(X86Code *x, const void *bytes, size_t length) {
+    if(x->size + length > x->capacity) {
+        x->capacity = (x->size + length) * 2;
+        x->code = realloc(x->code, x->capacity);
+    }
+    memcpy(x->code + x->size, bytes, length);
+    x->size += length;
+}
+
+void x86_emit32(X86Code *x, int32_t value) {
+    x86_emit(x, &value, 4);
+}
+
+void x86_emit64(X86Code *x, uint64_t value) {
+    x86_emit(x, &value, 8);
+}
+
+void x86_patch32(X86Code *x, size_t position, int32_t value) {
+    memcpy(x->code + position, &value, 4);
+}
+
+void x86_patch64(X86Code *x, size_t position, uint64_t value) {
+    memcpy(x->code + position, &value, 8);
+}
+
+void x86_jump_here(X86Code *x, size_t position) {
+    x86_patch32(x, position, (int32_t)(x->size - (position + 4)));
+}
+
+size_t x86_add_data(X86Code *x, const void *bytes, size_t length) {
+    if(x->data_size + length > x->data_capacity) {
+        x->data_capacity = (x->data_size + length) * 2;
+        x->data = realloc(x->data, x->data_capacity);
+    }
+    size_t offset = x->data_size;
+    memcpy(x->data + offset, bytes, length);
+    x->data_size += length;
+    return offset;
+}
+
+void x86_emit_data_address(X86Code *x, size_t offset) {
+    if(x->reference_count == x->reference_capacity) {
+        x->reference_capacity = x->reference_capacity ? x->reference_capacity * 2 : 64;
+        x->data_references = realloc(x->data_references, sizeof(size_t) * x->reference_capacity);
+    }
+    x->data_references[x->reference_count++] = x->size;
+    x86_emit64(x, offset);
+}
+
+void x86_finish(X86Code *x) {
+    size_t routine = x->size;
+    x86_emit(x, print_int_routine, sizeof(print_int_routine));
+    for(int i = 0; i < x->call_count; i++)
+        x86_patch32(x, x->calls[i], (int32_t)(routine - (x->calls[i] + 4)));
+}
+
+void x86_relocate(X86Code *x, uint64_t data_address) {
+    for(int i = 0; i < x->reference_count; i++) {
+        uint64_t offset;
+        memcpy(&offset, x->code + x->data_references[i], 8);
+        x86_patch64(x, x->data_references[i], data_address + offset);
+    }
+}
+
+///// variables
+
+static void GrowVariables(X86Code *x) {
+    struct X86Variable *old = x->variables;
+    size_t old_capacity = x->variable_capacity;
+    x->variable_capacity = old_capacity ? old_capacity * 2 : 64;
+    x->variables = calloc(x->variable_capacity, sizeof(struct X86Variable));
+
+    size_t mask = x->variable_capacity - 1;
+    for(size_t i = 0; i < old_capacity; i++) {
+        if(!old[i].name)
+            continue;
+        size_t j = hash64(old[i].name, strlen(old[i].name), 0) & mask;
+        while(x->variables[j].name)
+            j = (j + 1) & mask;
+        x->variables[j] = old[i];
+    }
+    free(old);
+}
+
+// a name seen for the first time gets a slot, not initialized (add_variable)
+static struct X86Variable *FindVariable(X86Code *x, const char *name) {
+    if((size_t)(x->variable_count + 1) * 2 > x->variable_capacity)
+        GrowVariables(x);
+
+    size_t mask = x->variable_capacity - 1;
+    size_t i = hash64(name, strlen(name), 0) & mask;
+    while(x->variables[i].name) {
+        if(strcmp(x->variables[i].name, name) == 0)
+            return &x->variables[i];
+        i = (i + 1) & mask;
+    }
+    struct X86Variable *var = &x->variables[i];
+    var->name = name;
+    var->slot = x->variable_count++;
+    var->initialized = 0;
+    return var;
+}
+
+///// error exits
+
+// jump (opcode + rel32) to the exit for a runtime error at node
+static void EmitExitJump(X86Code *x, const char *opcode, size_t length, int uninitialized, Node *node) {
+    if(x->exit_count == x->exit_capacity) {
+        x->exit_capacity = x->exit_capacity ? x->exit_capacity * 2 : 16;
+        x->exits = realloc(x->exits, sizeof(X86Exit) * x->exit_capacity);
+    }
+    x86_emit(x, opcode, length);
+    X86Exit *exit = &x->exits[x->exit_count++];
+    exit->uninitialized = uninitialized;
+    exit->line = node->line_number;
+    exit->name = uninitialized ? node->str_val : NULL;
+    exit->position = x->size;
+    x86_emit32(x, 0);
+}
+
+// the error happens for sure: the rest of the program is never reached
+static void EmitError(X86Code *x, int uninitialized, Node *node) {
+    EmitExitJump(x, "\xe9", 1, uninitialized, node);    // jmp
+    x->dead = 1;
+}
+
+///// print
+
+static void AddText(X86Code *x, const char *text) {
+    size_t length = strlen(text);
+    if(length > PRINT_LIMIT)
+        length = PRINT_LIMIT;
+    if(x->pending_length + length > x->pending_capacity) {
+        x->pending_capacity = (x->pending_length + length) * 2;
+        x->pending = realloc(x->pending, x->pending_capacity);
+    }
+    memcpy(x->pending + x->pending_length, text, length);
+    x->pending_length += length;
+    x->output_bound += length;
+}
+
+static void FlushText(X86Code *x) {
+    if(x->pending_length == 0)
+        return;
+    size_t offset = x86_add_data(x, x->pending, x->pending_length);
+    x86_emit(x, "\x48\xbe", 2);                 // mov rsi, text
+    x86_emit_data_address(x, offset);
+    x86_emit(x, "\x4c\x89\xe7\xb9", 4);         // mov rdi, r12; mov ecx, length
+    x86_emit32(x, (int32_t)x->pending_length);
+    x86_emit(x, "\xf3\xa4\x49\x89\xfc", 5);     // rep movsb; mov r12, rdi
+    x->pending_length = 0;
+}
+
+static void EmitPrintInt(X86Code *x) {
+    if(x->call_count == x->call_capacity) {
+        x->call_capacity = x->call_capacity ? x->call_capacity * 2 : 64;
+        x->calls = realloc(x->calls, sizeof(size_t) * x->call_capacity);
+    }
+    x86_emit(x, "\xe8", 1);                     // call print_int_routine
+    x->calls[x->call_count++] = x->size;
+    x86_emit32(x, 0);
+    x->output_bound += INT_DIGITS;
+}
+
+///// expressions, value in eax
+
+// NUM or ID straight into eax or ecx
+static void EmitLoad(X86Code *x, Node *node, int reg) {
+    if(node->node_type == 0) {
+        unsigned char mov = 0xb8 + reg;         // mov reg, imm32
+        x86_emit(x, &mov, 1);
+        x86_emit32(x, node->int_val);
+        return;
+    }
+    struct X86Variable *var = FindVariable(x, node->str_val);
+    if(!var->initialized) {
+        EmitError(x, 1, node);
+        return;
+    }
+    unsigned char mov[2] = { 0x8b, 0x83 | (reg << 3) };   // mov reg, [rbx + slot]
+    x86_emit(x, mov, 2);
+    x86_emit32(x, var->slot * 4);
+}
+
+static void EmitExpression(X86Code *x, Node *node);
+
+// left then right, like evaluate_expression, stopping at the first error
+static void EmitBinop(X86Code *x, Node *node) {
+    Node *right = node->binop.right;
+    EmitExpression(x, node->binop.left);
+    if(x->dead)
+        return;
+
+    if(right && (right->node_type == 0 || right->node_type == 2)) {
+        EmitLoad(x, right, ECX);
+    } else {
+        x86_emit(x, "\x50", 1);                 // push rax
+        EmitExpression(x, right);
+        x86_emit(x, "\x89\xc1\x58", 3);         // mov ecx, eax; pop rax
+    }
+    if(x->dead)
+        return;
+
+    switch(node->binop.op) {
+        case '+': x86_emit(x, "\x01\xc8", 2); break;       // add eax, ecx
+        case '-': x86_emit(x, "\x29\xc8", 2); break;       // sub eax, ecx
+        case '*': x86_emit(x, "\x0f\xaf\xc1", 3); break;   // imul eax, ecx
+        case '/':
+            if(right && right->node_type == 0 && right->int_val == 0) {
+                EmitError(x, 0, node);
+                return;
+            }
+            // idiv traps on INT_MIN / -1, where the interpreter wraps:
+            // a quotient by -1 is the negation
+            if(right && right->node_type == 0) {
+                if(right->int_val == -1)
+                    x86_emit(x, "\xf7\xd8", 2);            // neg eax
+                else
+                    x86_emit(x, "\x99\xf7\xf9", 3);        // cdq; idiv ecx
+                break;
+            }
+            x86_emit(x, "\x83\xf9\xff\x75\x04", 5);        // cmp ecx, -1; jne +4
+            x86_emit(x, "\xf7\xd8\xeb\x0b", 4);            // neg eax; jmp +11 (past the idiv)
+            x86_emit(x, "\x85\xc9", 2);                    // test ecx, ecx
+            EmitExitJump(x, "\x0f\x84", 2, 0, node);       // jz exit
+            x86_emit(x, "\x99\xf7\xf9", 3);                // cdq; idiv ecx
+            break;
+        case '=':   // the left value
+            break;
+        default:
+            x86_emit(x, "\x31\xc0", 2);                    // xor eax, eax
+    }
+}
+
+static void EmitExpression(X86Code *x, Node *node) {
+    if(x->dead)
+        return;
+    if(!node) {
+        x86_emit(x, "\x31\xc0", 2);
+        return;
+    }
+    switch(node->node_type) {
+        case 0: // NODE_NUM
+        case 2: // NODE_ID
+            EmitLoad(x, node, EAX);
+            break;
+        case 3: // NODE_BINOP
+            EmitBinop(x, node);
+            break;
+        default:
+            x86_emit(x, "\x31\xc0", 2);
+    }
+}
+
+///// statements, walked the way execute_statement walks them
+
+// the next declaration/assignment item, past the expression of this one
+// (they're chained through the rightmost leaf, see append_to_list)
+static Node *NextItem(Node *item) {
+    while(item->node_type == 3)
+        item = item->binop.right;
+    return item->list.next;
+}
+
+static void EmitAssignments(X86Code *x, Node *items, int declaration) {
+    for(Node *current = items; current && !x->dead; current = NextItem(current)) {
+        if(current->node_type == 3 && current->binop.op == '=') {
+            EmitExpression(x, current->binop.right);
+            if(x->dead)
+                return;
+            struct X86Variable *var = FindVariable(x, current->binop.left->str_val);
+            x86_emit(x, "\x89\x83", 2);         // mov [rbx + slot], eax
+            x86_emit32(x, var->slot * 4);
+            var->initialized = 1;
+        } else if(declaration && current->node_type == 2) {
+            FindVariable(x, current->str_val)->initialized = 0;
+        }
+    }
+}
+
+// any error drops the whole output, so there's no need to check every part
+// before printing the first one like the interpreter does
+static void EmitPrint(X86Code *x, Node *node) {
+    Node *last = NULL;
+    for(Node *part = node->print_stmt.parts; part; part = part->list.next) {
+        Node *content = part->node_type == NODE_PRINT_PART ? part->list.items : part;
+        last = content;
+        if(content->node_type == 1) {
+            AddText(x, content->str_val);
+            continue;
+        }
+        FlushText(x);
+        EmitExpression(x, content);
+        if(x->dead)
+            return;
+        EmitPrintInt(x);
+    }
+
+    int length = last && last->node_type == 1 ? strlen(last->str_val) : 0;
+    if(!(length > 0 && last->str_val[length-1] == '\n'))
+        AddText(x, "\n");
+}
+
+void x86_program(X86Code *x, Node *program) {
+    for(Node *current = program; current && !x->dead; current = current->list.next) {
+        switch(current->node_type) {
+            case 4: // NODE_DECL
+                EmitAssignments(x, current->list.items, 1);
+                break;
+            case 5: // NODE_ASSIGN
+                EmitAssignments(x, current->list.items, 0);
+                break;
+            case 6: // NODE_PRINT
+                EmitPrint(x, current);
+                break;
+        }
+    }
+    if(!x->dead)
+        FlushText(x);
+}
@@ -0,0 +1,90 @@
+#ifndef X86_64_H
+#define X86_64_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// x86-64 code generation shared by the JIT (jit.h) and the native
+// executables (native.h)
+//
+// x86_program() compiles the statements of a checked program, walking them
+// exactly like the interpreter does, into straight-line code that:
+//   - keeps every variable in a frame array at rbx (4 bytes per slot)
+//   - appends what it prints at r12, which it advances. the output is at
+//     most output_bound bytes, so the caller can size the buffer up front
+//   - jumps to one of exits[] on a runtime error (rel32 at exits[].position,
+//     for the caller to point at its error handling)
+//   - falls through at the end when the whole program ran
+//   - never traps: arithmetic wraps at 32 bits like the interpreter's, a
+//     quotient by -1 included (INT_MIN / -1 is INT_MIN, not an idiv)
+// it clobbers rax, rcx, rdx, rsi, rdi and r8, and uses the stack below rsp.
+// the caller wraps it in a prologue/epilogue, then x86_finish() appends the
+// runtime the code calls and x86_relocate() says where the data ends up
+
+// where a runtime error leaves the generated code
+typedef struct {
+    int uninitialized;  // else division by zero
+    int line;
+    const char *name;   // the variable (points into the AST)
+    size_t position;    // of the rel32 to patch
+} X86Exit;
+
+typedef struct {
+    unsigned char *code;
+    size_t size;
+    size_t capacity;
+
+    // read-only data the code refers to: the printed text, plus anything
+    // the caller adds with x86_add_data
+    char *data;
+    size_t data_size;
+    size_t data_capacity;
+    size_t *data_references;    // imm64s holding an offset into data
+    int reference_count;
+    int reference_capacity;
+
+    X86Exit *exits;
+    int exit_count;
+    int exit_capacity;
+
+    size_t *calls;              // rel32s of the calls to the print routine
+    int call_count;
+    int call_capacity;
+
+    struct X86Variable *variables;
+    size_t variable_capacity;
+    int variable_count;         // slots in the frame
+
+    char *pending;              // text not printed yet (one copy per run of strings)
+    size_t pending_length;
+    size_t pending_capacity;
+
+    size_t output_bound;        // most bytes the program can print
+    int dead;                   // an error exit is taken for sure, nothing after it runs
+} X86Code;
+
+void x86_init(X86Code *x);
+void x86_free(X86Code *x);
+
+void x86_emit(X86Code *x, const void *bytes, size_t length);
+void x86_emit32(X86Code *x, int32_t value);
+void x86_emit64(X86Code *x, uint64_t value);
+void x86_patch32(X86Code *x, size_t position, int32_t value);
+void x86_patch64(X86Code *x, size_t position, uint64_t value);
+// point the rel32 at position to the current end of the code
+void x86_jump_here(X86Code *x, size_t position);
+
+// copy bytes into the data, returns their offset
+size_t x86_add_data(X86Code *x, const void *bytes, size_t length);
+// imm64 = address of data + offset (after x86_relocate)
+void x86_emit_data_address(X86Code *x, size_t offset);
+
+void x86_program(X86Code *x, Node *program);
+
+// append the runtime the code calls; the code is complete after this
+void x86_finish(X86Code *x);
+// the data will be at data_address: fill in the addresses that refer to it
+void x86_relocate(X86Code *x, uint64_t data_address);
+
+#endif
@@ -10,16 +10,27 @@ app.use(cors());
 app.use(express.json());
 
 const COMPILER_DIR = path.join(__dirname, "prototype-0");
-const linuxCompiler = path.join(COMPILER_DIR, "compiler");
-const windowsCompiler = path.join(COMPILER_DIR, "compiler.exe");
 
-// prefer linux binary if exists
-const COMPILER = fs.existsSync(linuxCompiler) ? linuxCompiler : windowsCompiler;
+// the compiler built from this tree: the checked-in compiler.exe is older
+// than the stage flags used below, so it's never run in its place
+const COMPILER = path.join(COMPILER_DIR, "compiler");
+const NOT_BUILT = `Error: compiler not built (run make in ${COMPILER_DIR})`;
 
 const INPUT = path.join(COMPILER_DIR, "input.p0");
 const ASM_FILE = path.join(COMPILER_DIR, "MIPS64.s");
 const BIN_FILE = path.join(COMPILER_DIR, "MACHINE_CODE.mc");
 
+// compiled results are cached on disk by source hash + stage flags,
+// so recompiling the same program skips the compiler's front end
+const CACHE_DIR = path.join(COMPILER_DIR, ".p0cache");
+const CACHE_FLAG = `--cache-dir="${CACHE_DIR}"`;
+
+// the compiler only writes the stages it's asked for, so MIPS64.s and
+// MACHINE_CODE.mc can be left over from an older program: these say which
+// of them the last /compile wrote, and the /generated routes serve nothing else
+let assemblyFresh = false;
+let binaryFresh = false;
+
 // -------------------------------------------
 // SAFE /compile — DOES NOT OUTPUT ASM/HEX ON ERROR
 // -------------------------------------------
@@ -27,8 +38,16 @@ app.post("/compile", (req, res) => {
   const code = req.body.code;
   const tab = req.body.tab || "Output";
 
+  if (!fs.existsSync(COMPILER)) {
+    assemblyFresh = false;
+    binaryFresh = false;
+    return res.status(503).json({ result: NOT_BUILT });
+  }
+
   try {
     fs.writeFileSync(INPUT, code);
+    assemblyFresh = false;
+    binaryFresh = false;
 
     let result = "";
 
@@ -66,12 +85,15 @@ app.post("/compile", (req, res) => {
     const writeErrorFiles = (errorText) => {
       fs.writeFileSync(ASM_FILE, errorText);
       fs.writeFileSync(BIN_FILE, errorText);
+      assemblyFresh = true;
+      binaryFresh = true;
     };
 
     // ------------------- OUTPUT mode -------------------
+    // --run: interpret only, no codegen/encoding and no .s/.mc files
     if (tab === "Output") {
       try {
-        result = execSync(`cd "${COMPILER_DIR}" && .\\compiler.exe "${INPUT}"`, {
+        result = execSync(`"${COMPILER}" --run ${CACHE_FLAG} "${INPUT}"`, {
           encoding: "utf8",
           cwd: COMPILER_DIR
         }).trim();
@@ -85,7 +107,7 @@ app.post("/compile", (req, res) => {
     // ------------------- ASSEMBLY mode -------------------
     else if (tab === "Assembly") {
       try {
-        execSync(`cd "${COMPILER_DIR}" && .\\compiler.exe -S "${INPUT}"`, {
+        execSync(`"${COMPILER}" -S ${CACHE_FLAG} "${INPUT}"`, {
           stdio: "ignore",
           cwd: COMPILER_DIR
         });
@@ -94,6 +116,7 @@ app.post("/compile", (req, res) => {
         writeErrorFiles(realError);
         return res.json({ result: realError });
       }
+      assemblyFresh = true;
 
       result = fs.existsSync(ASM_FILE)
         ? fs.readFileSync(ASM_FILE, "utf8").trim()
@@ -101,9 +124,10 @@ app.post("/compile", (req, res) => {
     }
 
     // ------------------- BINARY mode -------------------
+    // -S too, so /generated has the assembly that goes with the listing
     else if (tab === "Binary/Hex") {
       try {
-        execSync(`cd "${COMPILER_DIR}" && .\\compiler.exe -S "${INPUT}"`, {
+        execSync(`"${COMPILER}" -S --mc ${CACHE_FLAG} "${INPUT}"`, {
           stdio: "ignore",
           cwd: COMPILER_DIR
         });
@@ -112,6 +136,8 @@ app.post("/compile", (req, res) => {
         writeErrorFiles(realError);
         return res.json({ result: realError });
       }
+      assemblyFresh = true;
+      binaryFresh = true;
 
       result = fs.existsSync(BIN_FILE)
         ? fs.readFileSync(BIN_FILE, "utf8").trim()
@@ -126,11 +152,13 @@ app.post("/compile", (req, res) => {
 });
 
 // -------------------------------------------
-// Additional routes (unchanged)
+// Additional routes: 404 unless the last /compile wrote the file
 // -------------------------------------------
 app.get("/generated/assembly", (req, res) => {
   try {
-    if (fs.existsSync(ASM_FILE)) {
+    if (!assemblyFresh) {
+      res.status(404).json({ assembly: null, message: "Assembly not generated for the current source" });
+    } else if (fs.existsSync(ASM_FILE)) {
       const asm = fs.readFileSync(ASM_FILE, "utf8");
       res.json({ assembly: asm });
     } else {
@@ -143,7 +171,9 @@ app.get("/generated/assembly", (req, res) => {
 
 app.get("/generated/hex", (req, res) => {
   try {
-    if (fs.existsSync(BIN_FILE)) {
+    if (!binaryFresh) {
+      res.status(404).json({ hex: null, message: "Binary not generated for the current source" });
+    } else if (fs.existsSync(BIN_FILE)) {
       const hexText = fs.readFileSync(BIN_FILE, "utf8").trim();
       res.json({ hex: hexText });
     } else {
@@ -156,8 +186,11 @@ app.get("/generated/hex", (req, res) => {
 
 app.get("/generated", (req, res) => {
   try {
-    const assembly = fs.existsSync(ASM_FILE) ? fs.readFileSync(ASM_FILE, "utf8") : null;
-    const hex = fs.existsSync(BIN_FILE) ? fs.readFileSync(BIN_FILE, "utf8").trim() : null;
+    if (!assemblyFresh && !binaryFresh) {
+      return res.status(404).json({ assembly: null, hex: null, message: "Nothing generated for the current source" });
+    }
+    const assembly = assemblyFresh && fs.existsSync(ASM_FILE) ? fs.readFileSync(ASM_FILE, "utf8") : null;
+    const hex = binaryFresh && fs.existsSync(BIN_FILE) ? fs.readFileSync(BIN_FILE, "utf8").trim() : null;
     res.json({ assembly, hex });
   } catch (e) {
     res.status(500).json({ assembly: null, hex: null, error: e.message });
@@ -179,4 +212,5 @@ app.get("/load-source", (req, res) => {
 
 app.listen(3001, () => {
   console.log("CSC112 COMPILER BACKEND — ERROR SAFE MODE ENABLED");
+  if (!fs.existsSync(COMPILER)) console.warn(NOT_BUILT);
 });